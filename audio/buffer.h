@@ -20,6 +20,7 @@
 
 #include <string>
 #include <memory>
+#include <atomic>
 #include <vector>
 #include <cstring>
 
@@ -111,6 +112,15 @@ namespace audio
           : mCapacity(capacity)
           , mData(data)
         {}
+        // Reset the view to a new data buffer for reuse.
+        void Reset(void* data, size_t capacity)
+        {
+            mCapacity = capacity;
+            mData     = data;
+            mSize     = 0;
+            mFormat   = Format();
+            mInfos.clear();
+        }
         virtual void SetFormat(const Format& format) override
         { mFormat = format; }
         virtual Format GetFormat() const override
@@ -135,7 +145,7 @@ namespace audio
         virtual const InfoTag& GetInfoTag(size_t index) const override
         { return base::SafeIndex(mInfos, index); }
     private:
-        const std::size_t mCapacity = 0;
+        std::size_t mCapacity = 0;
         void* mData = nullptr;
         std::size_t mSize = 0;
         std::vector<InfoTag> mInfos;
@@ -166,7 +176,7 @@ namespace audio
         virtual size_t GetByteSize() const override
         { return mSize; }
         virtual size_t GetCapacity() const override
-        { return mSize - sizeof(canary); }
+        { return mBuffer.size() - sizeof(canary); }
         virtual void SetByteSize(size_t bytes) override
         {
             const auto limit = mBuffer.size() - sizeof(canary);
@@ -174,11 +184,29 @@ namespace audio
             mSize = bytes;
         }
         virtual size_t GetNumInfoTags() const override
-        { return mInfos.size(); }
+        { return mNumInfos; }
         virtual void AddInfoTag(const InfoTag& tag) override
-        { mInfos.push_back(tag); }
+        {
+            // reuse the previous info tag objects (and their string
+            // storage) when the buffer is recycled.
+            if (mNumInfos < mInfos.size())
+                mInfos[mNumInfos] = tag;
+            else mInfos.push_back(tag);
+            ++mNumInfos;
+        }
         virtual const InfoTag& GetInfoTag(size_t index) const override
-        { return base::SafeIndex(mInfos, index); }
+        {
+            ASSERT(index < mNumInfos);
+            return base::SafeIndex(mInfos, index);
+        }
+        // Reset the buffer for reuse. Clears the format, content size and
+        // info tags but retains the allocated storage.
+        void Reset()
+        {
+            mFormat   = Format();
+            mSize     = 0;
+            mNumInfos = 0;
+        }
     private:
         void Resize(size_t bytes)
         {
@@ -196,6 +224,8 @@ namespace audio
         // The collection of info tags accumulated as the buffer
         // has passed over a number of audio elements.
         std::vector<InfoTag> mInfos;
+        // The number of info tags currently in use in mInfos.
+        std::size_t mNumInfos = 0;
         // Size of PCM data content in bytes. can be less than
         // the buffer's actual capacity.
         std::size_t mSize = 0;
@@ -204,9 +234,110 @@ namespace audio
     class BufferAllocator
     {
     public:
+        virtual ~BufferAllocator() = default;
         virtual BufferHandle Allocate(size_t bytes)
         { return std::make_shared<VectorBuffer>(bytes); }
     private:
     };
 
+    // Buffer allocator that recycles buffers instead of allocating a new
+    // buffer on every allocation request. The buffers are kept in buckets
+    // by their (power of two) capacity and a buffer becomes available for
+    // reuse once every handle to it other than the pool's own has been
+    // released. Once the pool has warmed up a graph that keeps producing
+    // buffers of the same sizes doesn't need any more heap allocations.
+    // The pool is not thread safe and is meant to be used on the audio
+    // thread by a single audio graph.
+    class BufferPool : public BufferAllocator
+    {
+    public:
+        struct Stats {
+            // The number of allocation requests.
+            std::size_t requests = 0;
+            // The number of buffers that were allocated from the heap.
+            std::size_t allocations = 0;
+            // The number of buffers currently owned by the pool.
+            std::size_t buffers = 0;
+            // The total capacity of the buffers owned by the pool in bytes.
+            std::size_t bytes = 0;
+        };
+        virtual BufferHandle Allocate(size_t bytes) override
+        {
+            ++mStats.requests;
+
+            const auto bucket_index = GetBucketIndex(bytes);
+            if (bucket_index == NumBuckets)
+            {
+                // too big for pooling, just allocate a one off buffer.
+                ++mStats.allocations;
+                return std::make_shared<VectorBuffer>(bytes);
+            }
+            auto& bucket = mBuckets[bucket_index];
+            for (auto& buffer : bucket)
+            {
+                if (!IsFree(buffer))
+                    continue;
+                buffer->Reset();
+                return buffer;
+            }
+            const auto capacity = GetBucketCapacity(bucket_index);
+            auto buffer = std::make_shared<VectorBuffer>(capacity);
+            bucket.push_back(buffer);
+            ++mStats.allocations;
+            ++mStats.buffers;
+            mStats.bytes += capacity;
+            return buffer;
+        }
+        // Get the current pool statistics.
+        const Stats& GetStats() const
+        { return mStats; }
+        // Release the buffers that aren't currently used.
+        void Purge()
+        {
+            for (size_t i=0; i<NumBuckets; ++i)
+            {
+                auto& bucket = mBuckets[i];
+                for (size_t j=0; j<bucket.size();)
+                {
+                    if (!IsFree(bucket[j])) {
+                        ++j;
+                        continue;
+                    }
+                    std::swap(bucket[j], bucket.back());
+                    bucket.pop_back();
+                    mStats.buffers--;
+                    mStats.bytes -= GetBucketCapacity(i);
+                }
+            }
+        }
+    private:
+        static constexpr size_t MinBufferSize = 256;
+        static constexpr size_t NumBuckets = 16;
+        static size_t GetBucketCapacity(size_t index)
+        { return MinBufferSize << index; }
+        static size_t GetBucketIndex(size_t bytes)
+        {
+            size_t index = 0;
+            while (index < NumBuckets && GetBucketCapacity(index) < bytes)
+                ++index;
+            return index;
+        }
+        // If the pool has the only reference to the buffer then nobody
+        // is using it anymore. The last handle can be released on another
+        // thread (for example the buffer was queued to the main thread)
+        // and use_count is only a relaxed load. The acquire fence pairs
+        // with the release of that reference so that the other thread's
+        // accesses to the buffer happen before the pool reuses it.
+        static bool IsFree(const std::shared_ptr<VectorBuffer>& buffer)
+        {
+            if (buffer.use_count() > 1)
+                return false;
+            std::atomic_thread_fence(std::memory_order_acquire);
+            return true;
+        }
+    private:
+        std::vector<std::shared_ptr<VectorBuffer>> mBuckets[NumBuckets];
+        Stats mStats;
+    };
+
 } // namespace
@@ -0,0 +1,301 @@
+// Copyright (C) 2020-2021 Sami Väisänen
+// Copyright (C) 2020-2021 Ensisoft http://www.ensisoft.com
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+#include "config.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+
+#include "base/assert.h"
+#include "base/logging.h"
+#include "audio/decoder.h"
+
+namespace {
+std::atomic<std::size_t> read_ahead_decoders = {0};
+std::atomic<std::size_t> read_ahead_underruns = {0};
+std::atomic<std::size_t> read_ahead_depth_ms = {0};
+} // namespace
+
+namespace audio
+{
+
+ReadAheadDecoder::ReadAheadDecoder(std::unique_ptr<Decoder> decoder, SampleType type)
+  : ReadAheadDecoder(std::move(decoder), type, Params())
+{}
+
+ReadAheadDecoder::ReadAheadDecoder(std::unique_ptr<Decoder> decoder, SampleType type, const Params& params)
+  : mSampleRate(decoder->GetSampleRate())
+  , mChannels(decoder->GetNumChannels())
+  , mFrames(decoder->GetNumFrames())
+  , mSampleType(type)
+  , mParams(params)
+  , mFrameSize([&]() {
+        Format format;
+        format.sample_type   = type;
+        format.channel_count = decoder->GetNumChannels();
+        return std::size_t(GetFrameSizeInBytes(format));
+    }())
+{
+    ASSERT(mParams.block_frames && mParams.num_blocks);
+    mState = std::make_shared<State>();
+    mState->decoder = std::move(decoder);
+    mState->blocks.resize(mParams.num_blocks);
+    for (auto& block : mState->blocks)
+        block.pcm.resize(mParams.block_frames * mFrameSize);
+
+    ++read_ahead_decoders;
+    std::thread thread(&ReadAheadDecoder::ThreadLoop, mState, mSampleType,
+                       std::size_t(mParams.block_frames), std::size_t(mFrames));
+    thread.detach();
+}
+
+ReadAheadDecoder::~ReadAheadDecoder()
+{
+    // don't join the decoder thread since this is likely running on the
+    // audio thread. the decoder thread owns a reference to the shared
+    // state and cleans up once it notices the shutdown.
+    {
+        std::lock_guard<decltype(mState->mutex)> lock(mState->mutex);
+        mState->shutdown = true;
+    }
+    mState->condition.notify_one();
+
+    read_ahead_depth_ms -= mDepthMs;
+    --read_ahead_decoders;
+    if (mUnderruns)
+        WARN("Audio read ahead decoder had underruns. [underruns=%1, frames=%2]", mUnderruns, mUnderrunFrames);
+}
+
+size_t ReadAheadDecoder::ReadFrames(float* ptr, size_t frames)
+{
+    ASSERT(mSampleType == SampleType::Float32);
+    return ReadFrames<float>(ptr, frames);
+}
+size_t ReadAheadDecoder::ReadFrames(short* ptr, size_t frames)
+{
+    ASSERT(mSampleType == SampleType::Int16);
+    return ReadFrames<short>(ptr, frames);
+}
+size_t ReadAheadDecoder::ReadFrames(int* ptr, size_t frames)
+{
+    ASSERT(mSampleType == SampleType::Int32);
+    return ReadFrames<int>(ptr, frames);
+}
+
+void ReadAheadDecoder::Reset()
+{
+    Seek(0);
+}
+
+bool ReadAheadDecoder::Seek(unsigned frame)
+{
+    // hand the rewind over to the decoder thread. the blocks already
+    // in the ring are released right away so that the decoder thread
+    // has room to decode. a block that the decoder thread is possibly
+    // still decoding belongs to the previous epoch and is discarded by
+    // the reader when it comes across it.
+    mReadOffset = 0;
+    mDropFrames = 0;
+    mState->seek_frame.store(std::min(frame, mFrames), std::memory_order_relaxed);
+    mState->epoch.fetch_add(1, std::memory_order_release);
+    mState->tail.store(mState->head.load(std::memory_order_acquire), std::memory_order_release);
+    mState->condition.notify_one();
+    return true;
+}
+
+std::size_t ReadAheadDecoder::GetNumBufferedFrames() const
+{
+    const auto& blocks = mState->blocks;
+    const auto epoch = mState->epoch.load(std::memory_order_relaxed);
+    const auto tail  = mState->tail.load(std::memory_order_relaxed);
+    const auto head  = mState->head.load(std::memory_order_acquire);
+    std::size_t ret = 0;
+    for (auto i=tail; i<head; ++i)
+    {
+        const auto& block = blocks[i % blocks.size()];
+        if (block.epoch == epoch)
+            ret += block.frames;
+    }
+    return ret - std::min(ret, mReadOffset + mDropFrames);
+}
+
+// static
+ReadAheadDecoder::Stats ReadAheadDecoder::GetStats()
+{
+    Stats stats;
+    stats.decoders  = read_ahead_decoders;
+    stats.underruns = read_ahead_underruns;
+    stats.depth_ms  = read_ahead_depth_ms;
+    return stats;
+}
+
+template<typename T>
+size_t ReadAheadDecoder::ReadFrames(T* ptr, size_t frames)
+{
+    auto* out = reinterpret_cast<char*>(ptr);
+    auto& state = *mState;
+    auto& blocks = state.blocks;
+    const auto epoch = state.epoch.load(std::memory_order_relaxed);
+
+    size_t frames_read = 0;
+    while (frames_read < frames)
+    {
+        const auto tail = state.tail.load(std::memory_order_relaxed);
+        const auto head = state.head.load(std::memory_order_acquire);
+        if (head == tail)
+        {
+            if (state.error.load(std::memory_order_acquire))
+                std::rethrow_exception(state.exception);
+            // the done epoch is stored after the last block has been
+            // published so if it's current then the head is final.
+            if (state.done_epoch.load(std::memory_order_acquire) == epoch &&
+                head == state.head.load(std::memory_order_acquire))
+                break;
+            // the decoder thread is behind. waiting here would stall the
+            // audio thread so fill the rest with silence and drop the same
+            // amount of frames later when the decoder has caught up.
+            const auto missing = frames - frames_read;
+            std::memset(out + frames_read * mFrameSize, 0, missing * mFrameSize);
+            frames_read += missing;
+            mDropFrames += missing;
+            mUnderrunFrames += missing;
+            ++mUnderruns;
+            ++read_ahead_underruns;
+            break;
+        }
+        auto& block = blocks[tail % blocks.size()];
+        if (block.epoch == epoch)
+        {
+            const auto frames_to_drop = std::min(block.frames - mReadOffset, mDropFrames);
+            mReadOffset += frames_to_drop;
+            mDropFrames -= frames_to_drop;
+
+            const auto frames_in_block = block.frames - mReadOffset;
+            const auto frames_to_copy  = std::min(frames_in_block, frames - frames_read);
+            std::memcpy(out + frames_read * mFrameSize, &block.pcm[mReadOffset * mFrameSize],
+                        frames_to_copy * mFrameSize);
+            frames_read += frames_to_copy;
+            mReadOffset += frames_to_copy;
+            if (mReadOffset < block.frames)
+                continue;
+        }
+        mReadOffset = 0;
+        state.tail.store(tail + 1, std::memory_order_release);
+        state.condition.notify_one();
+    }
+    UpdateDepth();
+    return frames_read;
+}
+
+// static
+void ReadAheadDecoder::ThreadLoop(std::shared_ptr<State> state, SampleType type,
+                                  std::size_t block_frames, std::size_t frame_count)
+{
+    auto& blocks = state->blocks;
+    auto& decoder = state->decoder;
+    std::size_t frames_decoded = 0;
+    std::size_t decoder_epoch  = 1;
+    try
+    {
+        for (;;)
+        {
+            if (state->shutdown)
+                return;
+
+            const auto epoch = state->epoch.load(std::memory_order_acquire);
+            if (epoch != decoder_epoch)
+            {
+                const auto frame = state->seek_frame.load(std::memory_order_relaxed);
+                if (frame == 0)
+                    decoder->Reset();
+                else if (!decoder->Seek(frame))
+                {
+                    // read and discard up to the seek position. this is
+                    // slow but happens on the decoder thread.
+                    std::vector<char> scratch(blocks[0].pcm.size());
+                    decoder->Reset();
+                    std::size_t skipped = 0;
+                    while (skipped < frame)
+                    {
+                        const auto ret = ReadFrames(*decoder, scratch.data(), type,
+                                                    std::min(block_frames, frame - skipped));
+                        if (ret == 0)
+                            break;
+                        skipped += ret;
+                    }
+                }
+                frames_decoded = frame;
+                decoder_epoch = epoch;
+            }
+
+            const auto head = state->head.load(std::memory_order_relaxed);
+            const auto tail = state->tail.load(std::memory_order_acquire);
+            const auto done = state->done_epoch.load(std::memory_order_relaxed) == decoder_epoch;
+            if (done || head - tail == blocks.size())
+            {
+                // nothing to do until the reader has consumed a block or
+                // asks for a rewind. the reader doesn't take the lock when
+                // notifying so wait with a timeout in order not to miss
+                // the notification.
+                std::unique_lock<decltype(state->mutex)> lock(state->mutex);
+                if (!state->shutdown)
+                    state->condition.wait_for(lock, std::chrono::milliseconds(5));
+                continue;
+            }
+
+            auto& block = blocks[head % blocks.size()];
+            const auto frames = std::min(block_frames, frame_count - frames_decoded);
+            const auto ret = frames ? ReadFrames(*decoder, block.pcm.data(), type, frames) : 0;
+            block.frames = ret;
+            block.epoch  = decoder_epoch;
+            frames_decoded += ret;
+            if (ret)
+                state->head.store(head + 1, std::memory_order_release);
+            if (ret == 0 || frames_decoded >= frame_count)
+                state->done_epoch.store(decoder_epoch, std::memory_order_release);
+        }
+    }
+    catch (const std::exception& e)
+    {
+        ERROR("Exception in audio read ahead decoder thread. [what='%1']", e.what());
+        state->exception = std::current_exception();
+        state->error.store(true, std::memory_order_release);
+    }
+}
+
+// static
+std::size_t ReadAheadDecoder::ReadFrames(Decoder& decoder, void* pcm, SampleType type, std::size_t frames)
+{
+    if (type == SampleType::Float32)
+        return decoder.ReadFrames((float*)pcm, frames);
+    else if (type == SampleType::Int16)
+        return decoder.ReadFrames((short*)pcm, frames);
+    else if (type == SampleType::Int32)
+        return decoder.ReadFrames((int*)pcm, frames);
+    else BUG("Unhandled sample type.");
+    return 0;
+}
+
+void ReadAheadDecoder::UpdateDepth()
+{
+    const auto depth_ms = GetNumBufferedFrames() * 1000 / mSampleRate;
+    read_ahead_depth_ms += depth_ms;
+    read_ahead_depth_ms -= mDepthMs;
+    mDepthMs = depth_ms;
+}
+
+} // namespace
@@ -19,6 +19,15 @@
 #include "config.h"
 
 #include <cstddef>
+#include <memory>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <atomic>
+#include <condition_variable>
+#include <exception>
+
+#include "audio/format.h"
 
 namespace audio
 {
@@ -53,8 +62,131 @@ namespace audio
         virtual size_t ReadFrames(int* ptr, size_t frames) = 0;
         // Reset decoder state for looped playback.
         virtual void Reset() = 0;
+        // Seek to the given frame so that the next read starts at that
+        // frame. Returns false if the decoder can't seek in which case
+        // the caller needs to read and discard the frames instead.
+        virtual bool Seek(unsigned frame)
+        { return false; }
     protected:
     private:
     };
 
+    // Decoder wrapper that decodes the audio ahead of playback on a
+    // separate decoder thread. The decoded PCM data is stored in a ring
+    // of fixed size PCM blocks (single producer, single consumer) and
+    // the read functions only copy the data out of the ring. This way the
+    // cost of decoding and the latency of the file IO are kept away from
+    // the audio thread. If the decoder thread falls behind (the ring is
+    // empty when data is needed) the missing frames are filled with
+    // silence and counted as underrun frames. The same number of frames
+    // is then dropped once the decoder thread has caught up so that the
+    // stream stays in sync with the playback time.
+    // Reset (rewind) is handed over to the decoder thread and the reader
+    // never waits on (or starts/joins) the decoder thread.
+    class ReadAheadDecoder : public Decoder
+    {
+    public:
+        struct Params {
+            // The number of frames in each PCM block.
+            unsigned block_frames = 4096;
+            // The number of PCM blocks in the ring, i.e. how far
+            // ahead the decoder thread is allowed to decode.
+            unsigned num_blocks = 8;
+        };
+        // Global read ahead statistics over all read ahead decoders.
+        struct Stats {
+            // The current number of read ahead decoders.
+            std::size_t decoders = 0;
+            // The total number of times when a read found the ring
+            // empty and had to fill frames with silence.
+            std::size_t underruns = 0;
+            // The total amount of audio in milliseconds decoded ahead
+            // of playback in all current read ahead decoders.
+            std::size_t depth_ms = 0;
+        };
+        // Wrap the given decoder. The sample type is the type that is
+        // used to read the PCM frames out of the decoder. The decoder
+        // thread starts decoding immediately.
+        ReadAheadDecoder(std::unique_ptr<Decoder> decoder, SampleType type);
+        ReadAheadDecoder(std::unique_ptr<Decoder> decoder, SampleType type, const Params& params);
+       ~ReadAheadDecoder();
+        virtual unsigned GetSampleRate() const override
+        { return mSampleRate; }
+        virtual unsigned GetNumChannels() const override
+        { return mChannels; }
+        virtual unsigned GetNumFrames() const override
+        { return mFrames; }
+        virtual size_t ReadFrames(float* ptr, size_t frames) override;
+        virtual size_t ReadFrames(short* ptr, size_t frames) override;
+        virtual size_t ReadFrames(int* ptr, size_t frames) override;
+        virtual void Reset() override;
+        // Seeking is handed over to the decoder thread the same way
+        // as a reset and always succeeds.
+        virtual bool Seek(unsigned frame) override;
+
+        // Get the number of frames currently decoded ahead of playback.
+        std::size_t GetNumBufferedFrames() const;
+        // Get the number of underruns in this decoder.
+        std::size_t GetNumUnderruns() const
+        { return mUnderruns; }
+        // Get the number of frames that were filled with silence
+        // because of underruns in this decoder.
+        std::size_t GetNumUnderrunFrames() const
+        { return mUnderrunFrames; }
+
+        static Stats GetStats();
+    private:
+        struct Block {
+            std::vector<char> pcm;
+            std::size_t frames = 0;
+            // the rewind epoch the block was decoded in.
+            std::size_t epoch  = 0;
+        };
+        // The state shared between the reader and the decoder thread.
+        // The decoder thread is detached and keeps the state alive
+        // until it has exited so that the reader never has to join it.
+        struct State {
+            std::unique_ptr<Decoder> decoder;
+            std::vector<Block> blocks;
+            // the number of blocks produced by the decoder thread.
+            std::atomic<std::size_t> head = {0};
+            // the number of blocks consumed by the reader.
+            std::atomic<std::size_t> tail = {0};
+            // the current rewind epoch, incremented by the reader on
+            // reset or seek. Blocks decoded in an older epoch are discarded.
+            std::atomic<std::size_t> epoch = {1};
+            // the frame to seek to when the epoch changes.
+            std::atomic<unsigned> seek_frame = {0};
+            // the epoch in which the decoder has decoded all the frames.
+            std::atomic<std::size_t> done_epoch = {0};
+            std::atomic<bool> shutdown = {false};
+            std::mutex mutex;
+            std::condition_variable condition;
+            std::exception_ptr exception;
+            std::atomic<bool> error = {false};
+        };
+        template<typename T>
+        size_t ReadFrames(T* ptr, size_t frames);
+        void UpdateDepth();
+        static void ThreadLoop(std::shared_ptr<State> state, SampleType type,
+                               std::size_t block_frames, std::size_t frame_count);
+        static std::size_t ReadFrames(Decoder& decoder, void* pcm, SampleType type, std::size_t frames);
+    private:
+        const unsigned mSampleRate = 0;
+        const unsigned mChannels = 0;
+        const unsigned mFrames = 0;
+        const SampleType mSampleType;
+        const Params mParams;
+        const std::size_t mFrameSize = 0;
+        std::shared_ptr<State> mState;
+        // the read offset in frames in the current tail block.
+        std::size_t mReadOffset = 0;
+        // the number of decoded frames still to be dropped in order
+        // to make up for the silence filled in on underrun.
+        std::size_t mDropFrames = 0;
+        std::size_t mUnderruns = 0;
+        std::size_t mUnderrunFrames = 0;
+        std::size_t mDepthMs = 0;
+    };
+
 } // namespace
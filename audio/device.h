@@ -19,6 +19,10 @@
 #include "config.h"
 
 #include <memory>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <chrono>
 
 namespace audio
 {
@@ -47,9 +51,34 @@ namespace audio
         virtual std::shared_ptr<Stream> Prepare(std::unique_ptr<Source> sample) = 0;
 
         // Poll and dispatch pending audio device events.
-        // Todo: this needs a proper waiting/signaling mechanism.
         virtual void Poll() = 0;
 
+        // Block the calling (audio) thread until the device has pending
+        // events to dispatch with Poll (such as a stream needing more
+        // audio data), Wakeup is called or the maximum wait time has
+        // elapsed, whichever comes first. If Wakeup was called since the
+        // previous wait returns immediately.
+        // The default implementation only waits for Wakeup or the timeout.
+        virtual void WaitEvents(unsigned max_milliseconds)
+        {
+            std::unique_lock<std::mutex> lock(mWaitMutex);
+            mWaitCondition.wait_for(lock, std::chrono::milliseconds(max_milliseconds), [this]() {
+                return mWakeup.load(std::memory_order_acquire);
+            });
+            mWakeup.store(false, std::memory_order_release);
+        }
+        // Wake up the thread blocked in WaitEvents. Unlike the other
+        // device functions this can be called from any thread.
+        virtual void Wakeup()
+        {
+            // if the flag is already set the waiting thread has
+            // already been (or is about to be) woken up.
+            if (mWakeup.exchange(true, std::memory_order_acq_rel))
+                return;
+            std::lock_guard<std::mutex> lock(mWaitMutex);
+            mWaitCondition.notify_one();
+        }
+
         // Initialize the audio device.
         // this should be called *once* after the device is created.
         virtual void Init() = 0;
@@ -72,6 +101,9 @@ namespace audio
 
     protected:
     private:
+        std::mutex mWaitMutex;
+        std::condition_variable mWaitCondition;
+        std::atomic<bool> mWakeup = {false};
     };
 
 } // namespace
@@ -16,10 +16,35 @@
 
 #include "config.h"
 
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#  include <emmintrin.h>
+#  define AUDIO_SIMD_SSE2
+// AVX2 kernels are compiled separately for the AVX2 target and
+// selected at runtime when the CPU supports AVX2.
+#  if defined(_MSC_VER) && !defined(__clang__)
+#    include <immintrin.h>
+#    include <intrin.h>
+#    define AUDIO_SIMD_AVX2
+#    define AUDIO_TARGET_AVX2
+#  elif (defined(__GNUC__) || defined(__clang__)) && !defined(__EMSCRIPTEN__)
+#    include <immintrin.h>
+#    define AUDIO_SIMD_AVX2
+#    define AUDIO_TARGET_AVX2 __attribute__((target("avx2")))
+#  endif
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+#  include <arm_neon.h>
+#  define AUDIO_SIMD_NEON
+#endif
+
 #include <sndfile.h>
 #include <fstream>
 #include <type_traits>
+#include <atomic>
+#include <mutex>
+#include <list>
+#include <algorithm>
 #include <cmath> // for pow
+#include <limits>
 
 #include <samplerate.h>
 
@@ -28,88 +53,500 @@
 #include "base/math.h"
 #include "base/logging.h"
 #include "audio/element.h"
+#include "audio/graph.h"
+#include "audio/decoder.h"
 #include "audio/sndfile.h"
 #include "audio/mpg123.h"
+#include "audio/wav.h"
 #include "audio/loader.h"
+#include "audio/worker.h"
 
 namespace {
 using namespace audio;
-template<unsigned ChannelCount>
-void AdjustFrameGain(Frame<float, ChannelCount>* frame, float gain)
+
+// The SIMD kernels operate on interleaved samples and return the number
+// of samples processed. The rest of the samples are processed by the scalar
+// code. All kernels produce the same results as the scalar code.
+using MixFloatFunc  = unsigned (*)(const float* const* srcs, unsigned src_count, float src_gain, float* out, unsigned count);
+using MixInt16Func  = unsigned (*)(const short* const* srcs, unsigned src_count, float src_gain, short* out, unsigned count);
+using GainFloatFunc = unsigned (*)(float* samples, float gain, unsigned count);
+using GainInt16Func = unsigned (*)(short* samples, float gain, unsigned count);
+// The ramp kernels apply a per frame gain value to the samples of each frame.
+// Returns the number of frames processed.
+using RampFloatFunc = unsigned (*)(float* samples, const float* gains, unsigned channels, unsigned frames);
+using RampInt16Func = unsigned (*)(short* samples, const float* gains, unsigned channels, unsigned frames);
+
+#if defined(AUDIO_SIMD_SSE2)
+unsigned MixFloat_SSE2(const float* const* srcs, unsigned src_count, float src_gain, float* out, unsigned count)
+{
+    const auto gain = _mm_set1_ps(src_gain);
+    const auto end  = count & ~3u;
+    for (unsigned i=0; i<end; i+=4)
+    {
+        auto sum = _mm_setzero_ps();
+        for (unsigned j=0; j<src_count; ++j)
+            sum = _mm_add_ps(sum, _mm_mul_ps(gain, _mm_loadu_ps(srcs[j] + i)));
+        _mm_storeu_ps(out + i, sum);
+    }
+    return end;
+}
+// Convert 8 int16 samples into 2x4 float values.
+inline void LoadInt16_SSE2(const short* ptr, __m128* lo, __m128* hi)
 {
-    // float's can exceed the -1.0f - 1.0f range.
-    for (unsigned i=0; i<ChannelCount; ++i)
+    const auto s = _mm_loadu_si128(reinterpret_cast<const __m128i*>(ptr));
+    *lo = _mm_cvtepi32_ps(_mm_srai_epi32(_mm_unpacklo_epi16(s, s), 16));
+    *hi = _mm_cvtepi32_ps(_mm_srai_epi32(_mm_unpackhi_epi16(s, s), 16));
+}
+// Convert (truncate) 2x4 float values into 8 int16 samples
+// clamped to the [-0x7fff, 0x7fff] range.
+inline void StoreInt16_SSE2(short* ptr, __m128 lo, __m128 hi)
+{
+    const auto min = _mm_set1_ps(-32767.0f);
+    const auto max = _mm_set1_ps( 32767.0f);
+    lo = _mm_min_ps(_mm_max_ps(lo, min), max);
+    hi = _mm_min_ps(_mm_max_ps(hi, min), max);
+    const auto s = _mm_packs_epi32(_mm_cvttps_epi32(lo), _mm_cvttps_epi32(hi));
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(ptr), s);
+}
+unsigned MixInt16_SSE2(const short* const* srcs, unsigned src_count, float src_gain, short* out, unsigned count)
+{
+    const auto gain = _mm_set1_ps(src_gain);
+    const auto end  = count & ~7u;
+    for (unsigned i=0; i<end; i+=8)
     {
-        frame->channels[i] *= gain;
+        // the scalar code accumulates into an integer, i.e. the
+        // sum is truncated after every source.
+        auto sum_lo = _mm_setzero_ps();
+        auto sum_hi = _mm_setzero_ps();
+        for (unsigned j=0; j<src_count; ++j)
+        {
+            __m128 lo, hi;
+            LoadInt16_SSE2(srcs[j] + i, &lo, &hi);
+            sum_lo = _mm_cvtepi32_ps(_mm_cvttps_epi32(_mm_add_ps(sum_lo, _mm_mul_ps(gain, lo))));
+            sum_hi = _mm_cvtepi32_ps(_mm_cvttps_epi32(_mm_add_ps(sum_hi, _mm_mul_ps(gain, hi))));
+        }
+        StoreInt16_SSE2(out + i, sum_lo, sum_hi);
     }
+    return end;
 }
-template<typename Type, unsigned ChannelCount>
-void AdjustFrameGain(Frame<Type, ChannelCount>* frame, float gain)
+unsigned GainFloat_SSE2(float* samples, float gain, unsigned count)
 {
-    static_assert(std::is_integral<Type>::value);
-    // for integer formats clamp the values in order to avoid
-    // undefined overflow / wrapping over.
-    for (unsigned i=0; i<ChannelCount; ++i)
+    const auto g   = _mm_set1_ps(gain);
+    const auto end = count & ~3u;
+    for (unsigned i=0; i<end; i+=4)
+        _mm_storeu_ps(samples + i, _mm_mul_ps(_mm_loadu_ps(samples + i), g));
+    return end;
+}
+unsigned GainInt16_SSE2(short* samples, float gain, unsigned count)
+{
+    const auto g   = _mm_set1_ps(gain);
+    const auto end = count & ~7u;
+    for (unsigned i=0; i<end; i+=8)
     {
-        const std::int64_t sample = frame->channels[i] * gain;
-        const std::int64_t min = SampleBits<Type>::Bits * -1;
-        const std::int64_t max = SampleBits<Type>::Bits;
-        frame->channels[i] = math::clamp(min, max, sample);
+        __m128 lo, hi;
+        LoadInt16_SSE2(samples + i, &lo, &hi);
+        StoreInt16_SSE2(samples + i, _mm_mul_ps(lo, g), _mm_mul_ps(hi, g));
     }
+    return end;
 }
-
-template<unsigned ChannelCount>
-void MixFrames(Frame<float, ChannelCount>** srcs, unsigned src_count, float src_gain,
-               Frame<float, ChannelCount>* out)
+unsigned RampFloat_SSE2(float* samples, const float* gains, unsigned channels, unsigned frames)
 {
-    float channel_values[ChannelCount] = {};
-
-    // profiling with valgrind+callgrind shows that the
-    // loops perform better when performed over all srcs
-    // frames and then over the channels of each frame
-    // as opposed to over channel followed by over srcs.
-    for (unsigned j=0; j<src_count; ++j)
+    const auto end = frames & ~3u;
+    if (channels == 1)
+    {
+        for (unsigned i=0; i<end; i+=4)
+            _mm_storeu_ps(samples + i, _mm_mul_ps(_mm_loadu_ps(samples + i), _mm_loadu_ps(gains + i)));
+        return end;
+    }
+    else if (channels == 2)
     {
-        for (unsigned i=0; i<ChannelCount; ++i)
+        for (unsigned i=0; i<end; i+=4)
         {
-            channel_values[i] += (src_gain * srcs[j]->channels[i]);
+            const auto g  = _mm_loadu_ps(gains + i);
+            const auto g0 = _mm_unpacklo_ps(g, g);
+            const auto g1 = _mm_unpackhi_ps(g, g);
+            auto* ptr = samples + i*2;
+            _mm_storeu_ps(ptr + 0, _mm_mul_ps(_mm_loadu_ps(ptr + 0), g0));
+            _mm_storeu_ps(ptr + 4, _mm_mul_ps(_mm_loadu_ps(ptr + 4), g1));
         }
+        return end;
     }
-    for (unsigned i=0; i<ChannelCount; ++i)
+    return 0;
+}
+unsigned RampInt16_SSE2(short* samples, const float* gains, unsigned channels, unsigned frames)
+{
+    if (channels == 1)
     {
-        out->channels[i] = channel_values[i];
+        const auto end = frames & ~7u;
+        for (unsigned i=0; i<end; i+=8)
+        {
+            __m128 lo, hi;
+            LoadInt16_SSE2(samples + i, &lo, &hi);
+            StoreInt16_SSE2(samples + i, _mm_mul_ps(lo, _mm_loadu_ps(gains + i)),
+                                         _mm_mul_ps(hi, _mm_loadu_ps(gains + i + 4)));
+        }
+        return end;
     }
-
-    /*
-    for (unsigned i=0; i<ChannelCount; ++i)
+    else if (channels == 2)
     {
-        float channel_value = 0.0f;
+        const auto end = frames & ~3u;
+        for (unsigned i=0; i<end; i+=4)
+        {
+            const auto g  = _mm_loadu_ps(gains + i);
+            __m128 lo, hi;
+            LoadInt16_SSE2(samples + i*2, &lo, &hi);
+            StoreInt16_SSE2(samples + i*2, _mm_mul_ps(lo, _mm_unpacklo_ps(g, g)),
+                                           _mm_mul_ps(hi, _mm_unpackhi_ps(g, g)));
+        }
+        return end;
+    }
+    return 0;
+}
+#endif // AUDIO_SIMD_SSE2
 
+#if defined(AUDIO_SIMD_AVX2)
+AUDIO_TARGET_AVX2
+unsigned MixFloat_AVX2(const float* const* srcs, unsigned src_count, float src_gain, float* out, unsigned count)
+{
+    const auto gain = _mm256_set1_ps(src_gain);
+    const auto end  = count & ~7u;
+    for (unsigned i=0; i<end; i+=8)
+    {
+        auto sum = _mm256_setzero_ps();
+        for (unsigned j=0; j<src_count; ++j)
+            sum = _mm256_add_ps(sum, _mm256_mul_ps(gain, _mm256_loadu_ps(srcs[j] + i)));
+        _mm256_storeu_ps(out + i, sum);
+    }
+    // avoid AVX-SSE transition penalties in the following SSE code
+    // also in unoptimized builds where the compiler doesn't do this.
+    _mm256_zeroupper();
+    return end;
+}
+AUDIO_TARGET_AVX2
+inline void LoadInt16_AVX2(const short* ptr, __m256* lo, __m256* hi)
+{
+    const auto s = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(ptr));
+    *lo = _mm256_cvtepi32_ps(_mm256_cvtepi16_epi32(_mm256_castsi256_si128(s)));
+    *hi = _mm256_cvtepi32_ps(_mm256_cvtepi16_epi32(_mm256_extracti128_si256(s, 1)));
+}
+AUDIO_TARGET_AVX2
+inline void StoreInt16_AVX2(short* ptr, __m256 lo, __m256 hi)
+{
+    const auto min = _mm256_set1_ps(-32767.0f);
+    const auto max = _mm256_set1_ps( 32767.0f);
+    lo = _mm256_min_ps(_mm256_max_ps(lo, min), max);
+    hi = _mm256_min_ps(_mm256_max_ps(hi, min), max);
+    // the pack works within the 128 bit lanes so the
+    // 64 bit quarters need to be put back in order.
+    const auto s = _mm256_packs_epi32(_mm256_cvttps_epi32(lo), _mm256_cvttps_epi32(hi));
+    _mm256_storeu_si256(reinterpret_cast<__m256i*>(ptr), _mm256_permute4x64_epi64(s, 0xD8));
+}
+AUDIO_TARGET_AVX2
+unsigned MixInt16_AVX2(const short* const* srcs, unsigned src_count, float src_gain, short* out, unsigned count)
+{
+    const auto gain = _mm256_set1_ps(src_gain);
+    const auto end  = count & ~15u;
+    for (unsigned i=0; i<end; i+=16)
+    {
+        auto sum_lo = _mm256_setzero_ps();
+        auto sum_hi = _mm256_setzero_ps();
         for (unsigned j=0; j<src_count; ++j)
         {
-            channel_value += (src_gain * srcs[j]->channels[i]);
+            __m256 lo, hi;
+            LoadInt16_AVX2(srcs[j] + i, &lo, &hi);
+            sum_lo = _mm256_cvtepi32_ps(_mm256_cvttps_epi32(_mm256_add_ps(sum_lo, _mm256_mul_ps(gain, lo))));
+            sum_hi = _mm256_cvtepi32_ps(_mm256_cvttps_epi32(_mm256_add_ps(sum_hi, _mm256_mul_ps(gain, hi))));
         }
-        out->channels[i] = channel_value;
+        StoreInt16_AVX2(out + i, sum_lo, sum_hi);
     }
-     */
+    // avoid AVX-SSE transition penalties in the following SSE code
+    // also in unoptimized builds where the compiler doesn't do this.
+    _mm256_zeroupper();
+    return end;
 }
-template<typename Type, unsigned ChannelCount>
-void MixFrames(Frame<Type, ChannelCount>** srcs, unsigned count, float src_gain,
-               Frame<Type, ChannelCount>* out)
+AUDIO_TARGET_AVX2
+unsigned GainFloat_AVX2(float* samples, float gain, unsigned count)
 {
-    static_assert(std::is_integral<Type>::value);
+    const auto g   = _mm256_set1_ps(gain);
+    const auto end = count & ~7u;
+    for (unsigned i=0; i<end; i+=8)
+        _mm256_storeu_ps(samples + i, _mm256_mul_ps(_mm256_loadu_ps(samples + i), g));
+    // avoid AVX-SSE transition penalties in the following SSE code
+    // also in unoptimized builds where the compiler doesn't do this.
+    _mm256_zeroupper();
+    return end;
+}
+AUDIO_TARGET_AVX2
+unsigned GainInt16_AVX2(short* samples, float gain, unsigned count)
+{
+    const auto g   = _mm256_set1_ps(gain);
+    const auto end = count & ~15u;
+    for (unsigned i=0; i<end; i+=16)
+    {
+        __m256 lo, hi;
+        LoadInt16_AVX2(samples + i, &lo, &hi);
+        StoreInt16_AVX2(samples + i, _mm256_mul_ps(lo, g), _mm256_mul_ps(hi, g));
+    }
+    // avoid AVX-SSE transition penalties in the following SSE code
+    // also in unoptimized builds where the compiler doesn't do this.
+    _mm256_zeroupper();
+    return end;
+}
+#endif // AUDIO_SIMD_AVX2
 
-    for (unsigned i=0; i<ChannelCount; ++i)
+#if defined(AUDIO_SIMD_NEON)
+unsigned MixFloat_NEON(const float* const* srcs, unsigned src_count, float src_gain, float* out, unsigned count)
+{
+    const auto gain = vdupq_n_f32(src_gain);
+    const auto end  = count & ~3u;
+    for (unsigned i=0; i<end; i+=4)
     {
-        std::int64_t channel_value = 0;
-        for (unsigned j=0; j<count; ++j)
+        auto sum = vdupq_n_f32(0.0f);
+        // no fused multiply-add in order to match the scalar results.
+        for (unsigned j=0; j<src_count; ++j)
+            sum = vaddq_f32(sum, vmulq_f32(gain, vld1q_f32(srcs[j] + i)));
+        vst1q_f32(out + i, sum);
+    }
+    return end;
+}
+inline void LoadInt16_NEON(const short* ptr, float32x4_t* lo, float32x4_t* hi)
+{
+    const auto s = vld1q_s16(ptr);
+    *lo = vcvtq_f32_s32(vmovl_s16(vget_low_s16(s)));
+    *hi = vcvtq_f32_s32(vmovl_s16(vget_high_s16(s)));
+}
+inline void StoreInt16_NEON(short* ptr, float32x4_t lo, float32x4_t hi)
+{
+    const auto min = vdupq_n_f32(-32767.0f);
+    const auto max = vdupq_n_f32( 32767.0f);
+    lo = vminq_f32(vmaxq_f32(lo, min), max);
+    hi = vminq_f32(vmaxq_f32(hi, min), max);
+    vst1q_s16(ptr, vcombine_s16(vmovn_s32(vcvtq_s32_f32(lo)), vmovn_s32(vcvtq_s32_f32(hi))));
+}
+unsigned MixInt16_NEON(const short* const* srcs, unsigned src_count, float src_gain, short* out, unsigned count)
+{
+    const auto gain = vdupq_n_f32(src_gain);
+    const auto end  = count & ~7u;
+    for (unsigned i=0; i<end; i+=8)
+    {
+        auto sum_lo = vdupq_n_f32(0.0f);
+        auto sum_hi = vdupq_n_f32(0.0f);
+        for (unsigned j=0; j<src_count; ++j)
         {
-            // todo: this could still wrap around.
-            channel_value += (src_gain * srcs[j]->channels[i]);
+            float32x4_t lo, hi;
+            LoadInt16_NEON(srcs[j] + i, &lo, &hi);
+            sum_lo = vcvtq_f32_s32(vcvtq_s32_f32(vaddq_f32(sum_lo, vmulq_f32(gain, lo))));
+            sum_hi = vcvtq_f32_s32(vcvtq_s32_f32(vaddq_f32(sum_hi, vmulq_f32(gain, hi))));
         }
-        constexpr std::int64_t min = SampleBits<Type>::Bits * -1;
-        constexpr std::int64_t max = SampleBits<Type>::Bits;
-        out->channels[i] = math::clamp(min, max, channel_value);
+        StoreInt16_NEON(out + i, sum_lo, sum_hi);
+    }
+    return end;
+}
+unsigned GainFloat_NEON(float* samples, float gain, unsigned count)
+{
+    const auto g   = vdupq_n_f32(gain);
+    const auto end = count & ~3u;
+    for (unsigned i=0; i<end; i+=4)
+        vst1q_f32(samples + i, vmulq_f32(vld1q_f32(samples + i), g));
+    return end;
+}
+unsigned GainInt16_NEON(short* samples, float gain, unsigned count)
+{
+    const auto g   = vdupq_n_f32(gain);
+    const auto end = count & ~7u;
+    for (unsigned i=0; i<end; i+=8)
+    {
+        float32x4_t lo, hi;
+        LoadInt16_NEON(samples + i, &lo, &hi);
+        StoreInt16_NEON(samples + i, vmulq_f32(lo, g), vmulq_f32(hi, g));
+    }
+    return end;
+}
+#endif // AUDIO_SIMD_NEON
+
+unsigned MixFloat_None(const float* const*, unsigned, float, float*, unsigned)
+{ return 0; }
+unsigned MixInt16_None(const short* const*, unsigned, float, short*, unsigned)
+{ return 0; }
+unsigned GainFloat_None(float*, float, unsigned)
+{ return 0; }
+unsigned GainInt16_None(short*, float, unsigned)
+{ return 0; }
+unsigned RampFloat_None(float*, const float*, unsigned, unsigned)
+{ return 0; }
+unsigned RampInt16_None(short*, const float*, unsigned, unsigned)
+{ return 0; }
+
+struct AudioKernels {
+    MixFloatFunc  mix_float  = &MixFloat_None;
+    MixInt16Func  mix_int16  = &MixInt16_None;
+    GainFloatFunc gain_float = &GainFloat_None;
+    GainInt16Func gain_int16 = &GainInt16_None;
+    RampFloatFunc ramp_float = &RampFloat_None;
+    RampInt16Func ramp_int16 = &RampInt16_None;
+};
+
+#if defined(AUDIO_SIMD_AVX2)
+bool HasAVX2()
+{
+#  if defined(_MSC_VER) && !defined(__clang__)
+    int info[4];
+    __cpuid(info, 0);
+    if (info[0] < 7)
+        return false;
+    __cpuid(info, 1);
+    // check that the OS saves the YMM registers.
+    const bool osxsave = (info[2] & (1 << 27)) != 0;
+    const bool avx     = (info[2] & (1 << 28)) != 0;
+    if (!osxsave || !avx || (_xgetbv(0) & 0x6) != 0x6)
+        return false;
+    __cpuidex(info, 7, 0);
+    return (info[1] & (1 << 5)) != 0;
+#  else
+    __builtin_cpu_init();
+    return __builtin_cpu_supports("avx2");
+#  endif
+}
+#endif
+
+AudioKernels SelectAudioKernels()
+{
+    AudioKernels kernels;
+#if defined(AUDIO_SIMD_SSE2)
+    kernels.mix_float  = &MixFloat_SSE2;
+    kernels.mix_int16  = &MixInt16_SSE2;
+    kernels.gain_float = &GainFloat_SSE2;
+    kernels.gain_int16 = &GainInt16_SSE2;
+    kernels.ramp_float = &RampFloat_SSE2;
+    kernels.ramp_int16 = &RampInt16_SSE2;
+#endif
+#if defined(AUDIO_SIMD_AVX2)
+    if (HasAVX2())
+    {
+        kernels.mix_float  = &MixFloat_AVX2;
+        kernels.mix_int16  = &MixInt16_AVX2;
+        kernels.gain_float = &GainFloat_AVX2;
+        kernels.gain_int16 = &GainInt16_AVX2;
+    }
+#endif
+#if defined(AUDIO_SIMD_NEON)
+    kernels.mix_float  = &MixFloat_NEON;
+    kernels.mix_int16  = &MixInt16_NEON;
+    kernels.gain_float = &GainFloat_NEON;
+    kernels.gain_int16 = &GainInt16_NEON;
+#endif
+    return kernels;
+}
+
+#if defined(AUDIO_SIMD_SSE2) || defined(AUDIO_SIMD_NEON)
+bool EnableAudioSIMD = true;
+#else
+bool EnableAudioSIMD = false;
+#endif
+
+const AudioKernels& GetAudioKernels()
+{
+    static const AudioKernels scalar;
+    static const AudioKernels simd = SelectAudioKernels();
+    return EnableAudioSIMD ? simd : scalar;
+}
+
+unsigned AdjustGainSIMD(float* samples, float gain, unsigned count)
+{ return GetAudioKernels().gain_float(samples, gain, count); }
+unsigned AdjustGainSIMD(short* samples, float gain, unsigned count)
+{ return GetAudioKernels().gain_int16(samples, gain, count); }
+unsigned AdjustGainSIMD(int* samples, float gain, unsigned count)
+{ return 0; }
+
+unsigned MixSamplesSIMD(const float* const* srcs, unsigned src_count, float src_gain, float* out, unsigned count)
+{ return GetAudioKernels().mix_float(srcs, src_count, src_gain, out, count); }
+unsigned MixSamplesSIMD(const short* const* srcs, unsigned src_count, float src_gain, short* out, unsigned count)
+{
+    // the SIMD kernels accumulate in 32bit, make sure the sum can't overflow.
+    if (src_count > 0xffff || std::abs(src_gain) > 1.0f)
+        return 0;
+    return GetAudioKernels().mix_int16(srcs, src_count, src_gain, out, count);
+}
+unsigned MixSamplesSIMD(const int* const* srcs, unsigned src_count, float src_gain, int* out, unsigned count)
+{ return 0; }
+
+unsigned RampGainSIMD(float* samples, const float* gains, unsigned channels, unsigned frames)
+{ return GetAudioKernels().ramp_float(samples, gains, channels, frames); }
+unsigned RampGainSIMD(short* samples, const float* gains, unsigned channels, unsigned frames)
+{ return GetAudioKernels().ramp_int16(samples, gains, channels, frames); }
+unsigned RampGainSIMD(int* samples, const float* gains, unsigned channels, unsigned frames)
+{ return 0; }
+
+inline void AdjustSampleGain(float* sample, float gain)
+{
+    // float's can exceed the -1.0f - 1.0f range.
+    *sample *= gain;
+}
+template<typename Type>
+void AdjustSampleGain(Type* sample, float gain)
+{
+    static_assert(std::is_integral<Type>::value);
+    // for integer formats clamp the values in order to avoid
+    // undefined overflow / wrapping over.
+    const std::int64_t value = *sample * gain;
+    const std::int64_t min = SampleBits<Type>::Bits * -1;
+    const std::int64_t max = SampleBits<Type>::Bits;
+    *sample = math::clamp(min, max, value);
+}
+
+template<typename Type>
+void AdjustGain(Type* samples, float gain, unsigned count)
+{
+    for (unsigned i=AdjustGainSIMD(samples, gain, count); i<count; ++i)
+    {
+        AdjustSampleGain(&samples[i], gain);
+    }
+}
+
+inline void MixSample(const float* const* srcs, unsigned src_count, float src_gain, float* out, unsigned index)
+{
+    float value = 0.0f;
+    for (unsigned j=0; j<src_count; ++j)
+    {
+        value += (src_gain * srcs[j][index]);
+    }
+    out[index] = value;
+}
+template<typename Type>
+void MixSample(const Type* const* srcs, unsigned src_count, float src_gain, Type* out, unsigned index)
+{
+    static_assert(std::is_integral<Type>::value);
+
+    std::int64_t value = 0;
+    for (unsigned j=0; j<src_count; ++j)
+    {
+        // todo: this could still wrap around.
+        value += (src_gain * srcs[j][index]);
+    }
+    constexpr std::int64_t min = SampleBits<Type>::Bits * -1;
+    constexpr std::int64_t max = SampleBits<Type>::Bits;
+    out[index] = math::clamp(min, max, value);
+}
+
+// Mix count samples from each source buffer into the output buffer.
+// The output buffer can be one of the source buffers.
+template<typename Type>
+void MixSamples(const Type* const* srcs, unsigned src_count, float src_gain, Type* out, unsigned count)
+{
+    for (unsigned i=MixSamplesSIMD(srcs, src_count, src_gain, out, count); i<count; ++i)
+    {
+        MixSample(srcs, src_count, src_gain, out, i);
+    }
+}
+
+// Apply a separate gain value to each frame of samples.
+template<typename Type, unsigned ChannelCount>
+void ApplyFrameGains(Type* samples, const float* gains, unsigned frames)
+{
+    for (unsigned i=RampGainSIMD(samples, gains, ChannelCount, frames); i<frames; ++i)
+    {
+        for (unsigned j=0; j<ChannelCount; ++j)
+            AdjustSampleGain(&samples[i*ChannelCount + j], gains[i]);
     }
 }
 
@@ -127,25 +564,65 @@ float FadeBuffer(BufferHandle buffer, float current_time, float start_time, floa
     const auto sample_rate = format.sample_rate;
     const auto sample_duration = 1000.0f / sample_rate;
 
-    auto* ptr = static_cast<AudioFrame*>(buffer->GetPtr());
+    // compute the gain values for each frame first and then apply
+    // them all at once. the scratch space is shared by all the effects
+    // running on the same thread.
+    static thread_local std::vector<float> gains;
+    if (gains.size() < num_frames)
+        gains.resize(num_frames);
+
     for (unsigned i=0; i<num_frames; ++i)
     {
         const auto effect_time = current_time - start_time;
         const auto effect_time_norm = math::clamp(0.0f, 1.0f, effect_time / duration);
         const auto effect_value = fade_in ? effect_time_norm : 1.0f - effect_time_norm;
-        const auto sample_gain = std::pow(effect_value, 2.2);
-        AdjustFrameGain(&ptr[i], sample_gain);
+        gains[i] = std::pow(effect_value, 2.2);
         current_time += sample_duration;
     }
+
+    auto* ptr = static_cast<Type*>(buffer->GetPtr());
+    ApplyFrameGains<Type, ChannelCount>(ptr, &gains[0], num_frames);
     return current_time;
 }
 
+// Ramp the gain linearly from start_gain to end_gain over the frames.
+template<typename Type, unsigned ChannelCount>
+void RampGain(Type* samples, unsigned frames, float start_gain, float end_gain)
+{
+    // compute the gain values in small blocks on the stack
+    // so that no scratch space is needed for the whole buffer.
+    constexpr unsigned BlockSize = 64;
+    float gains[BlockSize];
+
+    const float step = frames ? (end_gain - start_gain) / frames : 0.0f;
+    for (unsigned block=0; block<frames; block+=BlockSize)
+    {
+        const auto count = std::min(BlockSize, frames - block);
+        for (unsigned i=0; i<count; ++i)
+            gains[i] = start_gain + step * (block + i + 1);
+        ApplyFrameGains<Type, ChannelCount>(samples + block * ChannelCount, gains, count);
+    }
+}
+
+inline float GetSampleLevel(float sample)
+{ return std::abs(sample); }
+template<typename Type>
+float GetSampleLevel(Type sample)
+{
+    static_assert(std::is_integral<Type>::value);
+    return std::abs(static_cast<float>(sample)) / SampleBits<Type>::Bits;
+}
+
+// Mix the source buffers together. The src_ptrs is scratch space for
+// the sample pointers provided by the caller so that it can be reused
+// across calls without allocating. When the function returns src_buffers
+// and src_ptrs are empty.
 template<typename Type, unsigned ChannelCount>
-BufferHandle MixBuffers(std::vector<BufferHandle>& src_buffers, float src_gain)
+BufferHandle MixBuffers(std::vector<BufferHandle>& src_buffers, std::vector<const Type*>& src_ptrs, float src_gain)
 {
     using AudioFrame = Frame<Type, ChannelCount>;
 
-    std::vector<AudioFrame*> src_ptrs;
+    src_ptrs.clear();
 
     BufferHandle out_buffer;
     // find the maximum buffer for computing how many frames must be processed.
@@ -153,7 +630,7 @@ BufferHandle MixBuffers(std::vector<BufferHandle>& src_buffers, float src_gain)
     unsigned max_buffer_size = 0;
     for (const auto& buffer : src_buffers)
     {
-        auto* ptr = static_cast<AudioFrame*>(buffer->GetPtr());
+        const auto* ptr = static_cast<const Type*>(buffer->GetPtr());
         src_ptrs.push_back(ptr);
         if (buffer->GetByteSize() > max_buffer_size)
         {
@@ -171,19 +648,21 @@ BufferHandle MixBuffers(std::vector<BufferHandle>& src_buffers, float src_gain)
     const auto frame_size  = sizeof(AudioFrame);
     const auto max_num_frames = max_buffer_size / frame_size;
 
-    auto* out = static_cast<AudioFrame*>(out_buffer->GetPtr());
+    auto* out = static_cast<Type*>(out_buffer->GetPtr());
 
-    for (unsigned frame=0; frame<max_num_frames; ++frame, ++out)
+    // mix the frames in spans where the set of source buffers doesn't
+    // change, i.e. up to the end of the shortest remaining buffer.
+    unsigned frame = 0;
+    while (true)
     {
-        MixFrames(&src_ptrs[0], src_ptrs.size(), src_gain, out);
-
         ASSERT(src_buffers.size() == src_ptrs.size());
+        // drop the buffers that have been mixed completely.
         for (size_t i=0; i<src_buffers.size();)
         {
             const auto& buffer = src_buffers[i];
             const auto buffer_size = buffer->GetByteSize();
             const auto buffer_frames = buffer_size / frame_size;
-            if (buffer_frames == frame+1)
+            if (buffer_frames <= frame)
             {
                 const auto end = src_buffers.size() - 1;
                 std::swap(src_buffers[i], src_buffers[end]);
@@ -191,15 +670,55 @@ BufferHandle MixBuffers(std::vector<BufferHandle>& src_buffers, float src_gain)
                 src_buffers.pop_back();
                 src_ptrs.pop_back();
             }
-            else
-            {
-                ++src_ptrs[i++];
-            }
+            else ++i;
         }
-    }
+        if (src_buffers.empty() || frame >= max_num_frames)
+            break;
+
+        unsigned span_end = max_num_frames;
+        for (const auto& buffer : src_buffers)
+        {
+            const unsigned buffer_frames = buffer->GetByteSize() / frame_size;
+            span_end = std::min(span_end, buffer_frames);
+        }
+        const auto span_samples = (span_end - frame) * ChannelCount;
+        MixSamples(&src_ptrs[0], src_ptrs.size(), src_gain, out, span_samples);
+        for (auto& ptr : src_ptrs)
+            ptr += span_samples;
+        out += span_samples;
+        frame = span_end;
+    }
+    // any empty buffers are left over.
+    src_buffers.clear();
+    src_ptrs.clear();
     return out_buffer;
 }
 
+// Reusable scratch space for mixing buffers of any supported format.
+struct MixScratch {
+    std::vector<const int*> int_ptrs;
+    std::vector<const float*> float_ptrs;
+    std::vector<const short*> short_ptrs;
+};
+
+BufferHandle MixBuffers(std::vector<BufferHandle>& src_buffers, const audio::Format& format, float src_gain)
+{
+    // the scratch space is shared between all the mixers
+    // running on the same thread.
+    static thread_local MixScratch scratch;
+
+    if (format.sample_type == SampleType::Int32)
+        return format.channel_count == 1 ? MixBuffers<int, 1>(src_buffers, scratch.int_ptrs, src_gain)
+                                         : MixBuffers<int, 2>(src_buffers, scratch.int_ptrs, src_gain);
+    else if (format.sample_type == SampleType::Float32)
+        return format.channel_count == 1 ? MixBuffers<float, 1>(src_buffers, scratch.float_ptrs, src_gain)
+                                         : MixBuffers<float, 2>(src_buffers, scratch.float_ptrs, src_gain);
+    else if (format.sample_type == SampleType::Int16)
+        return format.channel_count == 1 ? MixBuffers<short, 1>(src_buffers, scratch.short_ptrs, src_gain)
+                                         : MixBuffers<short, 2>(src_buffers, scratch.short_ptrs, src_gain);
+    return nullptr;
+}
+
 } // namespace
 
 namespace audio
@@ -646,7 +1165,9 @@ void Mixer::Process(Allocator& allocator, EventQueue& events, unsigned milliseco
 
     const float src_gain = 1.0f/mSrcs.size();
 
-    std::vector<BufferHandle> src_buffers;
+    // use the member vector in order to avoid allocating on every call.
+    auto& src_buffers = mSrcBuffers;
+    src_buffers.clear();
     for (auto& port :mSrcs)
     {
         BufferHandle buffer;
@@ -656,19 +1177,14 @@ void Mixer::Process(Allocator& allocator, EventQueue& events, unsigned milliseco
     if (src_buffers.size() == 0)
         return;
 
-    BufferHandle ret;
-
     const auto& format = mSrcs[0].GetFormat();
-    if (format.sample_type == SampleType::Int32)
-        ret = format.channel_count == 1 ? MixBuffers<int, 1>(src_buffers, src_gain)
-                                        : MixBuffers<int, 2>(src_buffers, src_gain);
-    else if (format.sample_type == SampleType::Float32)
-        ret = format.channel_count == 1 ? MixBuffers<float, 1>(src_buffers,src_gain)
-                                        : MixBuffers<float, 2>(src_buffers, src_gain);
-    else if (format.sample_type == SampleType::Int16)
-        ret = format.channel_count == 1 ? MixBuffers<short, 1>(src_buffers, src_gain)
-                                        : MixBuffers<short, 2>(src_buffers, src_gain);
-    else WARN("Audio mixer input buffer has unsupported format. [elem=%1, format=%2]", mName, format.sample_type);
+    BufferHandle ret = MixBuffers(src_buffers, format, src_gain);
+    if (!ret)
+    {
+        WARN("Audio mixer input buffer has unsupported format. [elem=%1, format=%2]", mName, format.sample_type);
+        src_buffers.clear();
+        return;
+    }
     mOut.PushBuffer(ret);
 }
 
@@ -748,6 +1264,12 @@ void Effect::Process(Allocator& allocator, EventQueue& events, unsigned millisec
     else WARN("Audio effect input buffer has incompatible format. [elem=%1, format=%2]", mName, format.sample_type);
 }
 
+bool Effect::Skip(unsigned milliseconds)
+{
+    mSampleTime += milliseconds;
+    return true;
+}
+
 void Effect::ReceiveCommand(Command& cmd)
 {
     if (auto* ptr = cmd.GetIf<SetEffectCmd>())
@@ -793,6 +1315,7 @@ Gain::Gain(const std::string& name, float gain)
   , mIn("in")
   , mOut("out")
   , mGain(gain)
+  , mCurrentGain(gain)
 {}
 Gain::Gain(const std::string& name, const std::string& id, float gain)
   : mName(name)
@@ -800,6 +1323,7 @@ Gain::Gain(const std::string& name, const std::string& id, float gain)
   , mIn("in")
   , mOut("out")
   , mGain(gain)
+  , mCurrentGain(gain)
 {}
 
 bool Gain::Prepare(const Loader& loader, const PrepareParams& params)
@@ -847,14 +1371,339 @@ void Gain::AdjustGain(BufferHandle buffer)
     const auto num_frames  = buffer_size / frame_size;
     ASSERT((buffer_size % frame_size) == 0);
 
-    auto* ptr = static_cast<AudioFrame*>(buffer->GetPtr());
+    auto* ptr = static_cast<DataType*>(buffer->GetPtr());
+    if (mCurrentGain == mGain)
+        ::AdjustGain(ptr, mGain, num_frames * ChannelCount);
+    else RampGain<DataType, ChannelCount>(ptr, num_frames, mCurrentGain, mGain);
+
+    mCurrentGain = mGain;
+    mOut.PushBuffer(buffer);
+}
+
+BiquadFilter::BiquadFilter(const std::string& name, Type filter, float cutoff, float q)
+  : mName(name)
+  , mId(base::RandomString(10))
+  , mIn("in")
+  , mOut("out")
+  , mFilter(filter)
+  , mCutoff(cutoff)
+  , mQ(q)
+{}
+BiquadFilter::BiquadFilter(const std::string& name, const std::string& id, Type filter, float cutoff, float q)
+  : mName(name)
+  , mId(id)
+  , mIn("in")
+  , mOut("out")
+  , mFilter(filter)
+  , mCutoff(cutoff)
+  , mQ(q)
+{}
+
+bool BiquadFilter::Prepare(const Loader& loader, const PrepareParams& params)
+{
+    const auto& format = mIn.GetFormat();
+    if (format.sample_type != SampleType::Float32)
+    {
+        ERROR("Audio biquad filter requires float32 input. [elem=%1, input=%2]", mName, format.sample_type);
+        return false;
+    }
+    mSampleRate = format.sample_rate;
+    mOut.SetFormat(format);
+    ComputeCoefficients();
+    std::fill(std::begin(mZ1), std::end(mZ1), 0.0f);
+    std::fill(std::begin(mZ2), std::end(mZ2), 0.0f);
+    DEBUG("Audio biquad filter prepared successfully. [name=%1, filter=%2, cutoff=%3, q=%4, output=%5]",
+          mName, mFilter, mCutoff, mQ, format);
+    return true;
+}
+
+void BiquadFilter::Process(Allocator& allocator, EventQueue& events, unsigned milliseconds)
+{
+    BufferHandle buffer;
+    if (!mIn.PullBuffer(buffer))
+        return;
+
+    const auto& format = mIn.GetFormat();
+    if (format.channel_count == 1)
+        Filter<1>(buffer);
+    else if (format.channel_count == 2)
+        Filter<2>(buffer);
+    else WARN("Unsupported format %1", format);
+}
+
+void BiquadFilter::ReceiveCommand(Command& cmd)
+{
+    if (auto* ptr = cmd.GetIf<SetFilterCmd>())
+    {
+        SetFilter(ptr->filter, ptr->cutoff, ptr->q);
+        DEBUG("Received audio filter command. [elem=%1, filter=%2, cutoff=%3, q=%4]", mName, mFilter, mCutoff, mQ);
+    }
+    else BUG("Unexpected command.");
+}
+
+void BiquadFilter::SetFilter(Type filter, float cutoff, float q)
+{
+    mFilter = filter;
+    mCutoff = cutoff;
+    mQ      = q;
+    ComputeCoefficients();
+}
+
+void BiquadFilter::ComputeCoefficients()
+{
+    // the coefficients depend on the sample rate which
+    // is only known once the element has been prepared.
+    if (mSampleRate == 0)
+        return;
+
+    const double nyquist = mSampleRate * 0.5;
+    const double cutoff  = math::clamp(1.0, nyquist * 0.99, (double)mCutoff);
+    const double q       = std::max(0.01, (double)mQ);
+    const double w0      = 2.0 * math::Pi * cutoff / mSampleRate;
+    const double cos_w0  = std::cos(w0);
+    const double alpha   = std::sin(w0) / (2.0 * q);
+
+    double b0 = 1.0;
+    double b1 = 0.0;
+    double b2 = 0.0;
+    if (mFilter == Type::LowPass)
+    {
+        b0 = (1.0 - cos_w0) * 0.5;
+        b1 = (1.0 - cos_w0);
+        b2 = (1.0 - cos_w0) * 0.5;
+    }
+    else if (mFilter == Type::HighPass)
+    {
+        b0 =  (1.0 + cos_w0) * 0.5;
+        b1 = -(1.0 + cos_w0);
+        b2 =  (1.0 + cos_w0) * 0.5;
+    }
+    else if (mFilter == Type::BandPass)
+    {
+        // constant 0dB peak gain.
+        b0 =  alpha;
+        b1 =  0.0;
+        b2 = -alpha;
+    }
+    const double a0 = 1.0 + alpha;
+    mB0 = b0 / a0;
+    mB1 = b1 / a0;
+    mB2 = b2 / a0;
+    mA1 = (-2.0 * cos_w0) / a0;
+    mA2 = (1.0 - alpha) / a0;
+}
+
+template<unsigned ChannelCount>
+void BiquadFilter::Filter(BufferHandle buffer)
+{
+    using AudioFrame = Frame<float, ChannelCount>;
+    const auto frame_size  = sizeof(AudioFrame);
+    const auto buffer_size = buffer->GetByteSize();
+    const auto num_frames  = buffer_size / frame_size;
+    ASSERT((buffer_size % frame_size) == 0);
+
+    // copy the coefficients and the state into locals so that
+    // the compiler can keep them in registers during the loop.
+    const float b0 = mB0;
+    const float b1 = mB1;
+    const float b2 = mB2;
+    const float a1 = mA1;
+    const float a2 = mA2;
+    float z1[ChannelCount];
+    float z2[ChannelCount];
+    for (unsigned c=0; c<ChannelCount; ++c)
+    {
+        z1[c] = mZ1[c];
+        z2[c] = mZ2[c];
+    }
+
+    auto* ptr = static_cast<float*>(buffer->GetPtr());
     for (unsigned i=0; i<num_frames; ++i)
     {
-        AdjustFrameGain(&ptr[i], mGain);
+        for (unsigned c=0; c<ChannelCount; ++c)
+        {
+            const float x = ptr[i*ChannelCount + c];
+            const float y = b0 * x + z1[c];
+            z1[c] = b1 * x - a1 * y + z2[c];
+            z2[c] = b2 * x - a2 * y;
+            ptr[i*ChannelCount + c] = y;
+        }
+    }
+
+    // flush the decaying state to zero so that the filter
+    // doesn't end up processing denormals on silent input.
+    for (unsigned c=0; c<ChannelCount; ++c)
+    {
+        mZ1[c] = std::abs(z1[c]) < 1e-20f ? 0.0f : z1[c];
+        mZ2[c] = std::abs(z2[c]) < 1e-20f ? 0.0f : z2[c];
+    }
+    mOut.PushBuffer(buffer);
+}
+
+Compressor::Compressor(const std::string& name, float threshold, float ratio, float attack, float release, float makeup)
+  : mName(name)
+  , mId(base::RandomString(10))
+  , mIn("in")
+  , mOut("out")
+{
+    SetParams(threshold, ratio, attack, release, makeup);
+}
+Compressor::Compressor(const std::string& name, const std::string& id, float threshold, float ratio, float attack, float release, float makeup)
+  : mName(name)
+  , mId(id)
+  , mIn("in")
+  , mOut("out")
+{
+    SetParams(threshold, ratio, attack, release, makeup);
+}
+
+bool Compressor::Prepare(const Loader& loader, const PrepareParams& params)
+{
+    const auto& format = mIn.GetFormat();
+    mSampleRate = format.sample_rate;
+    mOut.SetFormat(format);
+    ComputeCoefficients();
+    mEnvelope = 0.0f;
+    mGain     = 1.0f;
+    DEBUG("Audio compressor prepared successfully. [name=%1, threshold=%2, ratio=%3, output=%4]",
+          mName, mThreshold, mRatio, format);
+    return true;
+}
+
+void Compressor::Process(Allocator& allocator, EventQueue& events, unsigned milliseconds)
+{
+    BufferHandle buffer;
+    if (!mIn.PullBuffer(buffer))
+        return;
+
+    const auto& format = mIn.GetFormat();
+    if (format.sample_type == SampleType::Int32)
+        format.channel_count == 1 ? Compress<int, 1>(buffer)
+                                  : Compress<int, 2>(buffer);
+    else if (format.sample_type == SampleType::Float32)
+        format.channel_count == 1 ? Compress<float, 1>(buffer)
+                                  : Compress<float, 2>(buffer);
+    else if (format.sample_type == SampleType::Int16)
+        format.channel_count == 1 ? Compress<short, 1>(buffer)
+                                  : Compress<short, 2>(buffer);
+    else WARN("Unsupported format %1", format.sample_type);
+}
+
+void Compressor::ReceiveCommand(Command& cmd)
+{
+    if (auto* ptr = cmd.GetIf<SetCompressorCmd>())
+    {
+        SetParams(ptr->threshold, ptr->ratio, ptr->attack, ptr->release, ptr->makeup);
+        DEBUG("Received audio compressor command. [elem=%1, threshold=%2, ratio=%3]", mName, mThreshold, mRatio);
+    }
+    else BUG("Unexpected command.");
+}
+
+void Compressor::SetParams(float threshold, float ratio, float attack, float release, float makeup)
+{
+    mThreshold = threshold;
+    mRatio     = std::max(1.0f, ratio);
+    mAttack    = std::max(0.0f, attack);
+    mRelease   = std::max(0.0f, release);
+    mMakeup    = makeup;
+    ComputeCoefficients();
+}
+
+float Compressor::GetGainReduction() const
+{
+    return 20.0f * std::log10(mGain);
+}
+
+void Compressor::ComputeCoefficients()
+{
+    if (mSampleRate == 0)
+        return;
+    // one pole smoothing coefficients for reaching ~63% of
+    // the target level in the attack/release time.
+    mAttackCoeff  = mAttack  > 0.0f ? std::exp(-1000.0f / (mAttack * mSampleRate)) : 0.0f;
+    mReleaseCoeff = mRelease > 0.0f ? std::exp(-1000.0f / (mRelease * mSampleRate)) : 0.0f;
+}
+
+template<typename DataType, unsigned ChannelCount>
+void Compressor::Compress(BufferHandle buffer)
+{
+    using AudioFrame = Frame<DataType, ChannelCount>;
+    const auto frame_size  = sizeof(AudioFrame);
+    const auto buffer_size = buffer->GetByteSize();
+    const unsigned num_frames = buffer_size / frame_size;
+    ASSERT((buffer_size % frame_size) == 0);
+
+    // the gain reduction is computed once per block of frames
+    // which keeps the expensive log/pow out of the inner loop.
+    constexpr unsigned BlockSize = 32;
+    float gains[BlockSize];
+
+    // with an infinite ratio the slope is 1.0 which
+    // turns the compressor into a limiter.
+    const float slope  = 1.0f - 1.0f / mRatio;
+    const float makeup = std::pow(10.0f, mMakeup / 20.0f);
+
+    auto* ptr = static_cast<DataType*>(buffer->GetPtr());
+    for (unsigned block=0; block<num_frames; block+=BlockSize)
+    {
+        const auto count = std::min(BlockSize, num_frames - block);
+        auto* samples = ptr + block * ChannelCount;
+
+        // follow the peak level of all channels and find the
+        // maximum envelope level within the block.
+        float envelope = mEnvelope;
+        float level = 0.0f;
+        for (unsigned i=0; i<count; ++i)
+        {
+            float peak = 0.0f;
+            for (unsigned c=0; c<ChannelCount; ++c)
+                peak = std::max(peak, GetSampleLevel(samples[i*ChannelCount + c]));
+            const float coeff = peak > envelope ? mAttackCoeff : mReleaseCoeff;
+            envelope = peak + coeff * (envelope - peak);
+            level = std::max(level, envelope);
+        }
+        mEnvelope = envelope;
+
+        float target = 1.0f;
+        if (level > 0.0f)
+        {
+            const float over = 20.0f * std::log10(level) - mThreshold;
+            if (over > 0.0f)
+                target = std::pow(10.0f, -over * slope / 20.0f);
+        }
+        // when the gain must go down the reduction applies to the whole
+        // block right away so that the level never overshoots. when the
+        // gain goes back up it's ramped over the block.
+        const float start = std::min(target, mGain);
+        mGain = target;
+        if (start == 1.0f && target == 1.0f && makeup == 1.0f)
+            continue;
+
+        const float step = (target - start) / count;
+        for (unsigned i=0; i<count; ++i)
+            gains[i] = (start + step * (i + 1)) * makeup;
+        ApplyFrameGains<DataType, ChannelCount>(samples, gains, count);
     }
     mOut.PushBuffer(buffer);
 }
 
+Limiter::Limiter(const std::string& name, float threshold, float release)
+  : Compressor(name, threshold, std::numeric_limits<float>::infinity(), 0.0f, release, 0.0f)
+{}
+Limiter::Limiter(const std::string& name, const std::string& id, float threshold, float release)
+  : Compressor(name, id, threshold, std::numeric_limits<float>::infinity(), 0.0f, release, 0.0f)
+{}
+
+void Limiter::ReceiveCommand(Command& cmd)
+{
+    if (auto* ptr = cmd.GetIf<SetLimiterCmd>())
+    {
+        SetParams(ptr->threshold, std::numeric_limits<float>::infinity(), 0.0f, ptr->release, 0.0f);
+        DEBUG("Received audio limiter command. [elem=%1, threshold=%2, release=%3]", GetName(), ptr->threshold, ptr->release);
+    }
+    else BUG("Unexpected command.");
+}
+
 Resampler::Resampler(const std::string& name, unsigned sample_rate)
   : mName(name)
   , mId(base::RandomString(10))
@@ -885,19 +1734,28 @@ bool Resampler::Prepare(const Loader& loader, const PrepareParams& params)
         return false;
     }
 
-    int error = 0;
-    mState = ::src_new(SRC_SINC_BEST_QUALITY, in.channel_count, &error);
-    if (mState == NULL)
-    {
-        ERROR("Audio re-sampler prepare error. [elem=%1, error=%2, what='%3']", mName, error, ::src_strerror(error));
-        return false;
-    }
-
     Format format;
     format.sample_type   = SampleType::Float32;
     format.channel_count = in.channel_count;
     format.sample_rate   = mSampleRate;
     mOut.SetFormat(format);
+
+    // the input is already at the right sample rate (for example the audio
+    // file was transcoded when the game was packaged) and the buffers are
+    // passed through as-is without any re-sampler state.
+    if (in.sample_rate == mSampleRate)
+    {
+        DEBUG("Audio re-sampler is a pass through. [elem=%1, output=%2]", mName, format);
+        return true;
+    }
+
+    int error = 0;
+    mState = ::src_new(SRC_SINC_BEST_QUALITY, in.channel_count, &error);
+    if (mState == NULL)
+    {
+        ERROR("Audio re-sampler prepare error. [elem=%1, error=%2, what='%3']", mName, error, ::src_strerror(error));
+        return false;
+    }
     DEBUG("Audio re-sampler prepared successfully. [elem=%1, output=%2]", mName, format);
     return true;
 }
@@ -954,7 +1812,9 @@ void Resampler::Process(Allocator& allocator, EventQueue& events, unsigned milli
 
 // raw PCM data blob
 struct FileSource::PCMBuffer {
-    bool complete = false;
+    // set by the audio thread once all the PCM data has been
+    // decoded, read when preparing a file source.
+    std::atomic<bool> complete = {false};
     unsigned rate        = 0;
     unsigned channels    = 0;
     unsigned frame_count = 0;
@@ -995,6 +1855,11 @@ public:
     {
         mFrame = 0;
     }
+    virtual bool Seek(unsigned frame) override
+    {
+        mFrame = std::min(frame, mBuffer->frame_count);
+        return true;
+    }
 private:
     template<typename T>
     size_t ReadFrames(T* ptr, size_t frames)
@@ -1012,8 +1877,142 @@ private:
     std::uint64_t mFrame = 0;
 };
 
+// Cache of decoded PCM buffers shared by all file sources and keyed
+// by the file source ID. The cache has a byte budget and when the
+// budget is exceeded the least recently used entries are evicted.
+// Only complete buffers (or buffers whose decoding was abandoned)
+// can be evicted since the incomplete ones are still being filled
+// by some file source on the audio thread.
+class FileSource::PCMCache
+{
+public:
+    // Find a PCM buffer in the cache. The returned buffer is either
+    // complete and ready for playback or still being decoded by some
+    // other file source. Returns nullptr if no such buffer exists.
+    std::shared_ptr<PCMBuffer> Find(const std::string& id)
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+        auto it = mEntries.find(id);
+        if (it == mEntries.end())
+        {
+            ++mStats.misses;
+            return nullptr;
+        }
+        auto& entry = it->second;
+        if (!entry.buffer->complete && entry.buffer.use_count() == 1)
+        {
+            // the source that was decoding the buffer went away before
+            // finishing, the buffer will never complete.
+            Erase(it);
+            ++mStats.misses;
+            return nullptr;
+        }
+        mLRU.splice(mLRU.begin(), mLRU, entry.lru);
+        if (entry.buffer->complete)
+            ++mStats.hits;
+        else ++mStats.misses;
+        return entry.buffer;
+    }
+    // Insert a new PCM buffer in the cache. The size of the buffer
+    // is the (reserved) capacity of the PCM data. Returns false if
+    // the buffer is too large to be cached at all.
+    bool Insert(const std::string& id, std::shared_ptr<PCMBuffer> buffer)
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+        const auto bytes = buffer->pcm.capacity();
+        if (mBudget && bytes > mBudget)
+            return false;
+
+        auto it = mEntries.find(id);
+        if (it != mEntries.end())
+            Erase(it);
+
+        mLRU.push_front(id);
+        Entry entry;
+        entry.buffer = std::move(buffer);
+        entry.bytes  = bytes;
+        entry.lru    = mLRU.begin();
+        mEntries[id] = std::move(entry);
+        mBytes += bytes;
+        Evict();
+        return true;
+    }
+    void SetBudget(std::size_t bytes)
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+        mBudget = bytes;
+        Evict();
+    }
+    CacheStats GetStats() const
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+        CacheStats ret = mStats;
+        ret.entries = mEntries.size();
+        ret.bytes   = mBytes;
+        ret.budget  = mBudget;
+        return ret;
+    }
+    void Clear()
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+        mEntries.clear();
+        mLRU.clear();
+        mBytes = 0;
+    }
+private:
+    struct Entry {
+        std::shared_ptr<PCMBuffer> buffer;
+        std::size_t bytes = 0;
+        std::list<std::string>::iterator lru;
+    };
+    using EntryMap = std::unordered_map<std::string, Entry>;
+
+    void Erase(EntryMap::iterator it)
+    {
+        mBytes -= it->second.bytes;
+        mLRU.erase(it->second.lru);
+        mEntries.erase(it);
+    }
+    void Evict()
+    {
+        if (mBudget == 0)
+            return;
+        // walk from the least recently used entry towards the most
+        // recently used one. the most recent entry is never evicted.
+        auto it = mLRU.end();
+        while (mBytes > mBudget && it != mLRU.begin())
+        {
+            --it;
+            if (it == mLRU.begin())
+                break;
+            auto entry = mEntries.find(*it);
+            ASSERT(entry != mEntries.end());
+            const auto& buffer = entry->second.buffer;
+            if (!buffer->complete && buffer.use_count() > 1)
+                continue;
+            DEBUG("Evict audio PCM buffer. [id=%1, bytes=%2]", *it, entry->second.bytes);
+            it = mLRU.erase(it);
+            mBytes -= entry->second.bytes;
+            mEntries.erase(entry);
+            ++mStats.evictions;
+        }
+    }
+private:
+    mutable std::mutex mMutex;
+    EntryMap mEntries;
+    // LRU list of entry IDs, most recently used first.
+    std::list<std::string> mLRU;
+    std::size_t mBytes  = 0;
+    std::size_t mBudget = 0;
+    CacheStats mStats;
+};
+
 // static
-FileSource::PCMCache FileSource::pcm_cache;
+FileSource::PCMCache& FileSource::GetPCMCache()
+{
+    static PCMCache cache;
+    return cache;
+}
 
 FileSource::FileSource(const std::string& name, const std::string& file, SampleType type, unsigned loops)
   : mName(name)
@@ -1054,11 +2053,7 @@ bool FileSource::Prepare(const Loader& loader, const PrepareParams& params)
 
     const bool enable_pcm_caching = params.enable_pcm_caching && mEnablePcmCaching;
     if (enable_pcm_caching)
-    {
-        auto it = pcm_cache.find(mId);
-        if (it != pcm_cache.end())
-            cached_pcm_buffer = it->second;
-    }
+        cached_pcm_buffer = GetPCMCache().Find(mId);
 
     // if there already exists a complete PCM blob for the
     // contents of this (as identified by ID) FileSource
@@ -1071,42 +2066,25 @@ bool FileSource::Prepare(const Loader& loader, const PrepareParams& params)
     }
     else
     {
-        auto source = loader.OpenAudioStream(mFile, mIOStrategy, mEnableFileCaching);
-        if (!source)
+        decoder = OpenDecoder(loader);
+        if (!decoder)
             return false;
 
-        const auto& upper = base::ToUpperUtf8(mFile);
-        if (base::EndsWith(upper, ".MP3"))
-        {
-            auto dec = std::make_unique<Mpg123Decoder>();
-            if (!dec->Open(source, mFormat.sample_type))
-                return false;
-            decoder = std::move(dec);
-        }
-        else if (base::EndsWith(upper, ".OGG") ||
-                 base::EndsWith(upper, ".WAV") ||
-                 base::EndsWith(upper, ".FLAC"))
-        {
-            auto dec = std::make_unique<SndFileDecoder>();
-            if (!dec->Open(source))
-                return false;
-            decoder = std::move(dec);
-        }
-        else
+        if (params.enable_read_ahead)
         {
-            ERROR("Audio file source file format is unsupported. [elem=%1, file='%2']", mName, mFile);
-            return false;
+            decoder = std::make_unique<ReadAheadDecoder>(std::move(decoder), mFormat.sample_type);
+            DEBUG("Using audio read ahead decoder. [elem=%1, file='%2']", mName, mFile);
         }
-        if (!cached_pcm_buffer && enable_pcm_caching)
+
+        // the read ahead decoder fills in silence on underrun so the
+        // PCM data it produces can't be cached for later playback.
+        if (!cached_pcm_buffer && enable_pcm_caching && !params.enable_read_ahead)
         {
-            cached_pcm_buffer = std::make_shared<PCMBuffer>();
-            cached_pcm_buffer->complete    = false;
-            cached_pcm_buffer->channels    = decoder->GetNumChannels();
-            cached_pcm_buffer->rate        = decoder->GetSampleRate();
-            cached_pcm_buffer->frame_count = decoder->GetNumFrames();
-            cached_pcm_buffer->type        = mFormat.sample_type;
-            pcm_cache[mId] = cached_pcm_buffer;
-            mPCMBuffer = cached_pcm_buffer;
+            cached_pcm_buffer = CreatePCMBuffer(*decoder);
+            if (GetPCMCache().Insert(mId, cached_pcm_buffer))
+                mPCMBuffer = cached_pcm_buffer;
+            else WARN("Audio PCM buffer exceeds the PCM cache budget. [elem=%1, file='%2', bytes=%3]", mName, mFile,
+                      cached_pcm_buffer->pcm.capacity());
         }
     }
     Format format;
@@ -1120,8 +2098,108 @@ bool FileSource::Prepare(const Loader& loader, const PrepareParams& params)
     return true;
 }
 
+bool FileSource::Preload(const Loader& loader)
+{
+    if (!mEnablePcmCaching)
+        return true;
+
+    auto& cache = GetPCMCache();
+    if (auto buffer = cache.Find(mId))
+        return true;
+
+    auto decoder = OpenDecoder(loader);
+    if (!decoder)
+        return false;
+
+    Format format;
+    format.channel_count = decoder->GetNumChannels();
+    format.sample_rate   = decoder->GetSampleRate();
+    format.sample_type   = mFormat.sample_type;
+    const auto frame_size  = GetFrameSizeInBytes(format);
+    const auto frame_count = decoder->GetNumFrames();
+
+    auto buffer = CreatePCMBuffer(*decoder);
+    buffer->pcm.resize(std::size_t(frame_count) * frame_size);
+
+    std::size_t ret = 0;
+    if (mFormat.sample_type == SampleType::Float32)
+        ret = decoder->ReadFrames((float*)buffer->pcm.data(), frame_count);
+    else if (mFormat.sample_type == SampleType::Int32)
+        ret = decoder->ReadFrames((int*)buffer->pcm.data(), frame_count);
+    else if (mFormat.sample_type == SampleType::Int16)
+        ret = decoder->ReadFrames((short*)buffer->pcm.data(), frame_count);
+    if (ret != frame_count)
+        ERROR_RETURN(false, "Unexpected number of audio frames decoded. [elem=%1, file='%2', expected=%3, decoded=%4]",
+                     mName, mFile, frame_count, ret);
+
+    buffer->complete = true;
+    if (!cache.Insert(mId, buffer))
+        ERROR_RETURN(false, "Audio PCM buffer exceeds the PCM cache budget. [elem=%1, file='%2', bytes=%3]",
+                     mName, mFile, buffer->pcm.size());
+
+    DEBUG("Audio file was preloaded into PCM cache. [elem=%1, file='%2', id=%3, bytes=%4]", mName, mFile, mId, buffer->pcm.size());
+    return true;
+}
+
+std::unique_ptr<Decoder> FileSource::OpenDecoder(const Loader& loader) const
+{
+    auto source = loader.OpenAudioStream(mFile, mIOStrategy, mEnableFileCaching);
+    if (!source)
+        return nullptr;
+
+    const auto& upper = base::ToUpperUtf8(mFile);
+    if (base::EndsWith(upper, ".MP3"))
+    {
+        auto dec = std::make_unique<Mpg123Decoder>();
+        if (!dec->Open(source, mFormat.sample_type))
+            return nullptr;
+        return dec;
+    }
+    else if (base::EndsWith(upper, ".OGG") ||
+             base::EndsWith(upper, ".WAV") ||
+             base::EndsWith(upper, ".FLAC"))
+    {
+        // plain PCM WAV files (such as the files transcoded when the
+        // game was packaged) are read directly without decoding.
+        if (base::EndsWith(upper, ".WAV"))
+        {
+            auto dec = std::make_unique<WavDecoder>();
+            if (dec->Open(source))
+                return dec;
+        }
+        auto dec = std::make_unique<SndFileDecoder>();
+        if (!dec->Open(source))
+            return nullptr;
+        return dec;
+    }
+    ERROR("Audio file source file format is unsupported. [elem=%1, file='%2']", mName, mFile);
+    return nullptr;
+}
+
+std::shared_ptr<FileSource::PCMBuffer> FileSource::CreatePCMBuffer(const Decoder& decoder) const
+{
+    Format format;
+    format.channel_count = decoder.GetNumChannels();
+    format.sample_rate   = decoder.GetSampleRate();
+    format.sample_type   = mFormat.sample_type;
+
+    auto buffer = std::make_shared<PCMBuffer>();
+    buffer->complete    = false;
+    buffer->channels    = format.channel_count;
+    buffer->rate        = format.sample_rate;
+    buffer->frame_count = decoder.GetNumFrames();
+    buffer->type        = format.sample_type;
+    // reserve the whole PCM blob up front so that appending the
+    // decoded PCM data on the audio thread doesn't reallocate.
+    buffer->pcm.reserve(std::size_t(buffer->frame_count) * GetFrameSizeInBytes(format));
+    return buffer;
+}
+
 void FileSource::Process(Allocator& allocator, EventQueue& events, unsigned milliseconds)
 {
+    if (mFramesSkipped)
+        DiscardSkippedFrames(allocator);
+
     const auto frame_size = GetFrameSizeInBytes(mFormat);
     const auto frames_per_ms = mFormat.sample_rate / 1000;
     const auto frames_wanted = (unsigned)(frames_per_ms * milliseconds);
@@ -1133,13 +2211,7 @@ void FileSource::Process(Allocator& allocator, EventQueue& events, unsigned mill
     buffer->SetByteSize(frame_size * frames);
     void* buff = buffer->GetPtr();
 
-    size_t ret = 0;
-    if (mFormat.sample_type == SampleType::Float32)
-        ret = mDecoder->ReadFrames((float*)buff, frames);
-    else if (mFormat.sample_type == SampleType::Int32)
-        ret = mDecoder->ReadFrames((int*)buff, frames);
-    else if (mFormat.sample_type == SampleType::Int16)
-        ret = mDecoder->ReadFrames((short*)buff, frames);
+    const auto ret = ReadFrames(buff, frames);
 
     if (mPCMBuffer && !mPCMBuffer->complete)
     {
@@ -1184,6 +2256,43 @@ void FileSource::Process(Allocator& allocator, EventQueue& events, unsigned mill
     mPort.PushBuffer(buffer);
 }
 
+bool FileSource::Skip(unsigned milliseconds)
+{
+    // the skipped frames are only counted here. when the source is
+    // processed again the decoder is moved forward by seeking (or by
+    // reading and discarding the skipped frames if the decoder can't
+    // seek). if the source runs out while skipping no decoding is
+    // needed at all.
+    const auto frames_available = mDecoder->GetNumFrames();
+    auto frames = (mFormat.sample_rate / 1000) * milliseconds;
+
+    // the PCM buffer can't be completed when frames are skipped.
+    mPCMBuffer.reset();
+
+    while (frames && !IsSourceDone())
+    {
+        const auto position = mFramesRead + mFramesSkipped;
+        const auto skip = std::min(frames_available - position, frames);
+        mFramesSkipped += skip;
+        frames -= skip;
+        if (position + skip < frames_available)
+            break;
+
+        mFramesSkipped = 0;
+        if (++mPlayCount != mLoopCount)
+        {
+            mDecoder->Reset();
+            mFramesRead = 0;
+        }
+        else
+        {
+            mFramesRead = frames_available;
+            DEBUG("Audio file source is done. [elem=%1, file='%2']", mName, mFile);
+        }
+    }
+    return true;
+}
+
 void FileSource::Shutdown()
 {
     mDecoder.reset();
@@ -1194,6 +2303,45 @@ bool FileSource::IsSourceDone() const
     return mFramesRead == mDecoder->GetNumFrames();
 }
 
+std::size_t FileSource::ReadFrames(void* buff, unsigned frames)
+{
+    if (mFormat.sample_type == SampleType::Float32)
+        return mDecoder->ReadFrames((float*)buff, frames);
+    else if (mFormat.sample_type == SampleType::Int32)
+        return mDecoder->ReadFrames((int*)buff, frames);
+    else if (mFormat.sample_type == SampleType::Int16)
+        return mDecoder->ReadFrames((short*)buff, frames);
+    return 0;
+}
+
+void FileSource::DiscardSkippedFrames(Allocator& allocator)
+{
+    if (mDecoder->Seek(mFramesRead + mFramesSkipped))
+    {
+        mFramesRead   += mFramesSkipped;
+        mFramesSkipped = 0;
+        return;
+    }
+
+    // the decoder can't seek, move it forward by decoding.
+    const auto frame_size = GetFrameSizeInBytes(mFormat);
+    const auto max_frames = std::min(mFramesSkipped, 4096u);
+    auto buffer = allocator.Allocate(frame_size * max_frames);
+
+    while (mFramesSkipped)
+    {
+        const auto frames = std::min(mFramesSkipped, max_frames);
+        const auto ret = ReadFrames(buffer->GetPtr(), frames);
+        mFramesRead    += ret;
+        mFramesSkipped -= frames;
+        if (ret != frames)
+        {
+            WARN("Unexpected number of audio frames decoded. [elem=%1, expected=%2, decoded=%3]", mName, frames, ret);
+            mFramesSkipped = 0;
+        }
+    }
+}
+
 // static
 bool FileSource::ProbeFile(const std::string& file, FileInfo* info)
 {
@@ -1227,9 +2375,19 @@ bool FileSource::ProbeFile(const std::string& file, FileInfo* info)
     return true;
 }
 // static
+void FileSource::SetCacheBudget(std::size_t bytes)
+{
+    GetPCMCache().SetBudget(bytes);
+}
+// static
+FileSource::CacheStats FileSource::GetCacheStats()
+{
+    return GetPCMCache().GetStats();
+}
+// static
 void FileSource::ClearCache()
 {
-    pcm_cache.clear();
+    GetPCMCache().Clear();
 }
 
 StreamSource::StreamSource(const std::string& name, std::shared_ptr<const SourceStream> buffer,
@@ -1328,6 +2486,83 @@ bool StreamSource::IsSourceDone() const
     return mFramesRead == mDecoder->GetNumFrames();
 }
 
+void MixerSource::AllocateVoices()
+{
+    auto& voices = mVoices;
+    voices.clear();
+
+    unsigned active = 0;
+    bool limited = mMaxVoices != 0;
+    for (auto& pair : mSources)
+    {
+        auto& source = pair.second;
+        if (source.paused || source.stolen || source.element->IsSourceDone())
+            continue;
+        voices.push_back(&source);
+        limited = limited || source.voice.max_voices;
+    }
+
+    if (limited)
+    {
+        // prefer sources with higher priority and then newer sources.
+        std::sort(voices.begin(), voices.end(), [](const Source* lhs, const Source* rhs) {
+            if (lhs->voice.priority != rhs->voice.priority)
+                return lhs->voice.priority > rhs->voice.priority;
+            return lhs->serial > rhs->serial;
+        });
+        std::fill(mGroupVoices.begin(), mGroupVoices.end(), 0);
+    }
+    for (auto* source : voices)
+    {
+        const auto& voice = source->voice;
+        if (source->group != NoGroup)
+        {
+            auto& count = mGroupVoices[source->group];
+            if (count == voice.max_voices)
+            {
+                source->stolen = true;
+                ++mStolenVoices;
+                mStolenVoicesChanged = true;
+                DEBUG("Audio mixer source was stolen. [elem=%1, source=%2, group=%3]", mName,
+                      source->element->GetName(), voice.group);
+                continue;
+            }
+            ++count;
+        }
+        source->virtualized = mMaxVoices && active == mMaxVoices;
+        if (!source->virtualized)
+            ++active;
+    }
+}
+
+void MixerSource::UpdateVoiceCounts(EventQueue& events)
+{
+    unsigned active = 0;
+    unsigned virtualized = 0;
+    for (const auto& pair : mSources)
+    {
+        const auto& source = pair.second;
+        if (source.paused)
+            continue;
+        if (source.virtualized)
+            ++virtualized;
+        else ++active;
+    }
+    if (active == mActiveVoices && virtualized == mVirtualVoices && !mStolenVoicesChanged)
+        return;
+
+    mActiveVoices  = active;
+    mVirtualVoices = virtualized;
+    mStolenVoicesChanged = false;
+
+    VoiceCountEvent event;
+    event.mixer  = mName;
+    event.active = mActiveVoices;
+    event.virtualized = mVirtualVoices;
+    event.stolen = mStolenVoices;
+    events.push(MakeEvent(std::move(event)));
+}
+
 void MixerSource::FadeIn::Apply(BufferHandle buffer)
 {
     const auto& format = buffer->GetFormat();
@@ -1376,9 +2611,20 @@ MixerSource::MixerSource(MixerSource&& other)
   , mFormat(other.mFormat)
   , mSources(std::move(other.mSources))
   , mOut(std::move(other.mOut))
+  , mMaxVoices(other.mMaxVoices)
+  , mSerial(other.mSerial)
+  , mGroups(std::move(other.mGroups))
+  , mGroupVoices(std::move(other.mGroupVoices))
+  , mGraphProfiles(std::move(other.mGraphProfiles))
+  , mProfiling(other.mProfiling)
 {}
 
 Element* MixerSource::AddSourcePtr(std::unique_ptr<Element> source, bool paused)
+{
+    return AddSourcePtr(std::move(source), paused, VoiceParams());
+}
+
+Element* MixerSource::AddSourcePtr(std::unique_ptr<Element> source, bool paused, const VoiceParams& voice)
 {
     ASSERT(source->IsSource());
     ASSERT(source->GetNumOutputPorts());
@@ -1392,7 +2638,23 @@ Element* MixerSource::AddSourcePtr(std::unique_ptr<Element> source, bool paused)
 
     Source src;
     src.element = std::move(source);
+    src.voice   = voice;
+    src.group   = NoGroup;
+    src.serial  = mSerial++;
     src.paused  = paused;
+    if (voice.max_voices && !voice.group.empty())
+    {
+        auto it = mGroups.find(voice.group);
+        if (it == mGroups.end())
+        {
+            it = mGroups.insert({voice.group, (unsigned)mGroups.size()}).first;
+            mGroupVoices.resize(mGroups.size());
+        }
+        src.group = it->second;
+    }
+    if (mProfiling && ret->GetType() == "Graph")
+        static_cast<Graph*>(ret)->EnableProfiling(true);
+
     mSources[key] = std::move(src);
     DEBUG("Add audio mixer source object. [elem=%1, key=%2, paused=%3]", mName, key, paused);
     return ret;
@@ -1423,12 +2685,15 @@ void MixerSource::DeleteSource(const std::string& name)
     auto it = mSources.find(name);
     if (it == mSources.end())
         return;
+    AccumulateProfile(it->second);
     mSources.erase(it);
     DEBUG("Delete audio mixer source. [elem=%1, source=%2]", mName, name);
 }
 
 void MixerSource::DeleteSources()
 {
+    for (auto& pair : mSources)
+        AccumulateProfile(pair.second);
     mSources.clear();
     DEBUG("Delete all audio mixer sources. [elem=%1]", mName);
 }
@@ -1451,6 +2716,49 @@ void MixerSource::SetSourceEffect(const std::string& name, std::unique_ptr<Effec
     it->second.effect = std::move(effect);
 }
 
+void MixerSource::EnableProfiling(bool on_off)
+{
+    mProfiling = on_off;
+    for (auto& pair : mSources)
+    {
+        auto& element = pair.second.element;
+        if (element->GetType() == "Graph")
+            static_cast<Graph*>(element.get())->EnableProfiling(on_off);
+    }
+    if (!on_off)
+        mGraphProfiles.clear();
+}
+
+void MixerSource::CollectGraphProfiles(std::vector<GraphClassProfile>* profiles)
+{
+    for (auto& pair : mSources)
+        AccumulateProfile(pair.second);
+
+    for (auto& profile : mGraphProfiles)
+    {
+        auto it = std::find_if(profiles->begin(), profiles->end(), [&profile](const auto& other) {
+            return other.klass == profile.klass;
+        });
+        if (it == profiles->end())
+        {
+            profiles->push_back(std::move(profile));
+            continue;
+        }
+        auto& elements = it->elements;
+        if (elements.size() < profile.elements.size())
+            elements.resize(profile.elements.size());
+        for (std::size_t i=0; i<profile.elements.size(); ++i)
+        {
+            const auto& src = profile.elements[i];
+            auto& dst = elements[i];
+            dst.calls      += src.calls;
+            dst.total_time += src.total_time;
+            dst.max_time    = std::max(dst.max_time, src.max_time);
+        }
+    }
+    mGraphProfiles.clear();
+}
+
 bool MixerSource::IsSourceDone() const
 {
     if (mNeverDone) return false;
@@ -1503,60 +2811,129 @@ void MixerSource::Advance(unsigned int ms)
 
 void MixerSource::Process(Allocator& allocator, EventQueue& events, unsigned milliseconds)
 {
-    std::vector<BufferHandle> src_buffers;
+    // use the member vector in order to avoid allocating on every call.
+    auto& src_buffers = mSrcBuffers;
+    src_buffers.clear();
+
+    AllocateVoices();
+
+    // use the member vector in order to avoid allocating on every call.
+    auto& active = mActiveSources;
+    active.clear();
 
     for (auto& pair : mSources)
     {
         auto& source  = pair.second;
         auto& element = source.element;
-        if (source.paused || source.element->IsSourceDone())
+        if (source.paused || source.stolen || source.element->IsSourceDone())
             continue;
 
-        element->Process(allocator, events, milliseconds);
-        for (unsigned i=0;i<element->GetNumOutputPorts(); ++i)
+        // virtual sources keep their time running without producing
+        // any audio. a source that can't skip is stolen instead.
+        if (source.virtualized)
+        {
+            if (!element->Skip(milliseconds))
+            {
+                source.stolen = true;
+                ++mStolenVoices;
+                mStolenVoicesChanged = true;
+                DEBUG("Audio mixer source can't be virtualized. [elem=%1, source=%2]", mName, pair.first);
+            }
+            else if (source.effect)
+                source.effect->Skip(milliseconds);
+            continue;
+        }
+        active.push_back(&source);
+    }
+
+    // The sources are independent of each other so when there's a worker
+    // pool they're evaluated in parallel. The buffers and the events of
+    // each source are collected separately and then combined in the same
+    // order as with serial evaluation so that the mixed output is the same.
+    auto* pool = WorkerPool::GetCurrent();
+    const auto count = static_cast<unsigned>(active.size());
+    if (pool && count > 1)
+    {
+        if (mTaskBuffers.size() < count)
+            mTaskBuffers.resize(count);
+        if (mTaskEvents.size() < count)
+            mTaskEvents.resize(count);
+
+        pool->ParallelFor(count, allocator, [this, milliseconds](unsigned index, Allocator& allocator) {
+            ProcessSource(*mActiveSources[index], allocator, mTaskEvents[index], mTaskBuffers[index], milliseconds);
+        });
+        for (unsigned i=0; i<count; ++i)
         {
-            auto& port = element->GetOutputPort(i);
-            BufferHandle buffer;
-            if (port.PullBuffer(buffer))
+            auto& buffers = mTaskBuffers[i];
+            auto& queue   = mTaskEvents[i];
+            for (auto& buffer : buffers)
+                src_buffers.push_back(std::move(buffer));
+            buffers.clear();
+            while (!queue.empty())
             {
-                if (source.effect)
-                    source.effect->Apply(buffer);
-                src_buffers.push_back(buffer);
+                events.push(std::move(queue.front()));
+                queue.pop();
             }
         }
     }
+    else
+    {
+        for (auto* source : active)
+            ProcessSource(*source, allocator, events, src_buffers, milliseconds);
+    }
+    active.clear();
+
     RemoveDoneEffects(events);
     RemoveDoneSources(events);
 
+    UpdateVoiceCounts(events);
+
     if (src_buffers.size() == 0)
         return;
     else if (src_buffers.size() == 1)
     {
         mOut.PushBuffer(src_buffers[0]);
+        src_buffers.clear();
         return;
     }
 
-    BufferHandle ret;
     const float src_gain = 1.0f; // / src_buffers.size();
     const auto& format   = mFormat;
 
-    if (format.sample_type == SampleType::Int32)
-        ret = format.channel_count == 1 ? MixBuffers<int, 1>(src_buffers, src_gain)
-                                        : MixBuffers<int, 2>(src_buffers, src_gain);
-    else if (format.sample_type == SampleType::Float32)
-        ret = format.channel_count == 1 ? MixBuffers<float, 1>(src_buffers,src_gain)
-                                        : MixBuffers<float, 2>(src_buffers, src_gain);
-    else if (format.sample_type == SampleType::Int16)
-        ret = format.channel_count == 1 ? MixBuffers<short, 1>(src_buffers, src_gain)
-                                        : MixBuffers<short, 2>(src_buffers, src_gain);
-    else WARN("Audio mixer output format is unsupported. [elem=%1, format=%2]", mName, format.sample_type);
+    BufferHandle ret = MixBuffers(src_buffers, format, src_gain);
+    if (!ret)
+    {
+        WARN("Audio mixer output format is unsupported. [elem=%1, format=%2]", mName, format.sample_type);
+        src_buffers.clear();
+        return;
+    }
     mOut.PushBuffer(ret);
 }
 
+void MixerSource::ProcessSource(Source& source, Allocator& allocator, EventQueue& events,
+                                std::vector<BufferHandle>& buffers, unsigned milliseconds)
+{
+    auto& element = source.element;
+    element->Process(allocator, events, milliseconds);
+    for (unsigned i=0;i<element->GetNumOutputPorts(); ++i)
+    {
+        auto& port = element->GetOutputPort(i);
+        BufferHandle buffer;
+        if (port.PullBuffer(buffer))
+        {
+            if (source.effect)
+                source.effect->Apply(buffer);
+            buffers.push_back(buffer);
+        }
+    }
+}
+
 void MixerSource::ReceiveCommand(Command& cmd)
 {
     if (auto* ptr = cmd.GetIf<AddSourceCmd>())
-        AddSourcePtr(std::move(ptr->src), ptr->paused);
+        AddSourcePtr(std::move(ptr->src), ptr->paused, ptr->voice);
+    else if (auto* ptr = cmd.GetIf<SetMaxVoicesCmd>())
+        SetMaxVoices(ptr->max_voices);
     else if (auto* ptr = cmd.GetIf<CancelSourceCmdCmd>())
         CancelSourceCommands(ptr->name);
     else if (auto* ptr = cmd.GetIf<SetEffectCmd>())
@@ -1629,9 +3006,10 @@ void MixerSource::RemoveDoneSources(EventQueue& events)
     {
         auto& source = it->second;
         auto& element = source.element;
-        if (element->IsSourceDone())
+        if (element->IsSourceDone() || source.stolen)
         {
             element->Shutdown();
+            AccumulateProfile(source);
 
             SourceDoneEvent event;
             event.mixer = mName;
@@ -1644,6 +3022,30 @@ void MixerSource::RemoveDoneSources(EventQueue& events)
     }
 }
 
+void MixerSource::AccumulateProfile(Source& source)
+{
+    if (!mProfiling || source.voice.group.empty())
+        return;
+    auto& element = source.element;
+    if (element->GetType() != "Graph")
+        return;
+
+    auto* graph = static_cast<Graph*>(element.get());
+    auto it = std::find_if(mGraphProfiles.begin(), mGraphProfiles.end(), [&source](const auto& profile) {
+        return profile.klass == source.voice.group;
+    });
+    if (it == mGraphProfiles.end())
+    {
+        GraphClassProfile profile;
+        profile.klass = source.voice.group;
+        it = mGraphProfiles.insert(mGraphProfiles.end(), std::move(profile));
+    }
+    graph->AccumulateProfile(&it->elements);
+    graph->ResetProfile();
+    // the graph could have mixers of its own.
+    graph->CollectGraphProfiles(&mGraphProfiles);
+}
+
 ZeroSource::ZeroSource(const std::string& name, const std::string& id, const Format& format)
   : mName(name)
   , mId(id)
@@ -1734,6 +3136,16 @@ void SineSource::Process(Allocator& allocator, EventQueue& events, unsigned mill
     mMilliSecs += milliseconds;
 }
 
+bool SineSource::Skip(unsigned milliseconds)
+{
+    if (mDuration)
+        milliseconds = std::min(milliseconds, mDuration - mMilliSecs);
+
+    mSampleCount += mFormat.sample_rate / 1000 * milliseconds;
+    mMilliSecs += milliseconds;
+    return true;
+}
+
 template<typename DataType, unsigned ChannelCount>
 void SineSource::Generate(BufferHandle buffer, unsigned frames)
 {
@@ -1825,6 +3237,18 @@ std::unique_ptr<Type> Construct(const std::string& name,
     if (!arg0 || !arg1 || !arg2) return nullptr;
     return std::make_unique<Type>(name, id, *arg0, *arg1, *arg2);
 }
+template<typename Type, typename Arg0, typename Arg1, typename Arg2, typename Arg3, typename Arg4> inline
+std::unique_ptr<Type> Construct(const std::string& name,
+                                   const std::string& id,
+                                   const Arg0* arg0,
+                                   const Arg1* arg1,
+                                   const Arg2* arg2,
+                                   const Arg3* arg3,
+                                   const Arg4* arg4)
+{
+    if (!arg0 || !arg1 || !arg2 || !arg3 || !arg4) return nullptr;
+    return std::make_unique<Type>(name, id, *arg0, *arg1, *arg2, *arg3, *arg4);
+}
 
 std::vector<std::string> ListAudioElements()
 {
@@ -1837,6 +3261,9 @@ std::vector<std::string> ListAudioElements()
         list.push_back("Resampler");
         list.push_back("Effect");
         list.push_back("Gain");
+        list.push_back("BiquadFilter");
+        list.push_back("Compressor");
+        list.push_back("Limiter");
         list.push_back("Null");
         list.push_back("StereoSplitter");
         list.push_back("StereoJoiner");
@@ -1883,6 +3310,7 @@ const ElementDesc* FindElementDesc(const std::string& type)
             file.args["pcm_caching"] = false;
             file.args["file_caching"] = false;
             file.args["io_strategy"] = FileSource::IOStrategy::Default;
+            file.args["packing"] = FileSource::Packing::KeepCompressed;
             file.output_ports.push_back({"out"});
             map["FileSource"] = file;
         }
@@ -1900,6 +3328,34 @@ const ElementDesc* FindElementDesc(const std::string& type)
             gain.output_ports.push_back({"out"});
             map["Gain"] = gain;
         }
+        {
+            ElementDesc filter;
+            filter.args["filter"] = BiquadFilter::Type::LowPass;
+            filter.args["cutoff"] = 1000.0f;
+            filter.args["q"]      = 0.7071f;
+            filter.input_ports.push_back({"in"});
+            filter.output_ports.push_back({"out"});
+            map["BiquadFilter"] = filter;
+        }
+        {
+            ElementDesc compressor;
+            compressor.args["threshold"] = -12.0f;
+            compressor.args["ratio"]     = 4.0f;
+            compressor.args["attack"]    = 10.0f;
+            compressor.args["release"]   = 100.0f;
+            compressor.args["makeup"]    = 0.0f;
+            compressor.input_ports.push_back({"in"});
+            compressor.output_ports.push_back({"out"});
+            map["Compressor"] = compressor;
+        }
+        {
+            ElementDesc limiter;
+            limiter.args["threshold"] = -1.0f;
+            limiter.args["release"]   = 50.0f;
+            limiter.input_ports.push_back({"in"});
+            limiter.output_ports.push_back({"out"});
+            map["Limiter"] = limiter;
+        }
         {
             ElementDesc effect;
             effect.args["time"] = 0u;
@@ -1992,6 +3448,22 @@ std::unique_ptr<Element> CreateElement(const ElementCreateArgs& desc)
     else if (desc.type == "Gain")
         return Construct<Gain>(desc.name, desc.id, 
             GetArg<float>(args, "gain", name));
+    else if (desc.type == "BiquadFilter")
+        return Construct<BiquadFilter>(desc.name, desc.id,
+            GetArg<BiquadFilter::Type>(args, "filter", name),
+            GetArg<float>(args, "cutoff", name),
+            GetArg<float>(args, "q", name));
+    else if (desc.type == "Compressor")
+        return Construct<Compressor>(desc.name, desc.id,
+            GetArg<float>(args, "threshold", name),
+            GetArg<float>(args, "ratio", name),
+            GetArg<float>(args, "attack", name),
+            GetArg<float>(args, "release", name),
+            GetArg<float>(args, "makeup", name));
+    else if (desc.type == "Limiter")
+        return Construct<Limiter>(desc.name, desc.id,
+            GetArg<float>(args, "threshold", name),
+            GetArg<float>(args, "release", name));
     else if (desc.type == "Resampler")
         return Construct<Resampler>(desc.name, desc.id, 
             GetArg<unsigned>(args, "sample_rate", name));
@@ -2026,5 +3498,16 @@ void ClearCaches()
     FileSource::ClearCache();
 }
 
+void EnableAudioSIMD(bool on_off)
+{
+#if defined(AUDIO_SIMD_SSE2) || defined(AUDIO_SIMD_NEON)
+    ::EnableAudioSIMD = on_off;
+#endif
+}
+bool IsAudioSIMDEnabled()
+{
+    return ::EnableAudioSIMD;
+}
+
 } // namespace
 
@@ -22,6 +22,7 @@
 #include <memory>
 #include <vector>
 #include <queue>
+#include <deque>
 #include <variant>
 #include <unordered_map>
 
@@ -146,6 +147,28 @@ namespace audio
 
     using SingleSlotPort = detail::BasicPort<detail::SingleSlotQueue>;
 
+    // Accumulated processing time of a single element in an audio graph.
+    // The times are in milliseconds. The data only has numeric fields
+    // so that it can be copied on the audio thread without allocating
+    // strings.
+    struct ElementProfile {
+        // The number of times the element has been processed.
+        std::uint64_t calls = 0;
+        // The total time spent in the element's Process.
+        double total_time = 0.0;
+        // The worst case time spent in a single Process call.
+        double max_time = 0.0;
+    };
+    // Accumulated processing times of all the graphs created from the
+    // same graph class that have been played through a mixer source.
+    struct GraphClassProfile {
+        // The ID of the graph class, i.e. the voice group of the graphs
+        // when they were added to the mixer.
+        std::string klass;
+        // The per element data in the graph class element order.
+        std::vector<ElementProfile> elements;
+    };
+
     // Audio processing element. Each element can have multiple input
     // and output ports with various port format settings. During
     // audio processing the element will normally read a buffer of PCM
@@ -162,6 +185,9 @@ namespace audio
 
         struct PrepareParams {
             bool enable_pcm_caching = false;
+            // Decode file sources ahead of playback on a separate
+            // decoder thread instead of decoding on the audio thread.
+            bool enable_read_ahead = false;
         };
 
         virtual ~Element() = default;
@@ -194,6 +220,16 @@ namespace audio
         // Advance the element time in milliseconds based on the latest
         // duration of the latest audio buffer sent to the audio device.
         virtual void Advance(unsigned int ms) {}
+        // Skip 'milliseconds' worth of audio data without producing any
+        // audio buffers. A source element that supports skipping moves
+        // its play position forward as if the audio had been processed
+        // and becomes done when the skipped audio runs past its end.
+        // A non-source element whose processing depends on the stream
+        // time, for example a fade effect, moves its time forward too.
+        // Returns false if the element doesn't support skipping. The
+        // result is only meaningful for source elements.
+        virtual bool Skip(unsigned milliseconds)
+        { return false; }
         // Perform element shutdown/cleanup.
         virtual void Shutdown() {}
         // Get the number of input ports this element has.
@@ -529,6 +565,8 @@ namespace audio
         const std::string mId;
         std::vector<SingleSlotPort> mSrcs;
         SingleSlotPort mOut;
+        // scratch space for the buffers being mixed.
+        std::vector<BufferHandle> mSrcBuffers;
     };
 
     class Delay : public Element
@@ -611,6 +649,7 @@ namespace audio
             if (index == 0) return mIn;
             BUG("No such input port.");
         }
+        virtual bool Skip(unsigned milliseconds) override;
         virtual void ReceiveCommand(Command& cmd) override;
 
         void SetEffect(Kind effect, unsigned time, unsigned duration);
@@ -632,7 +671,9 @@ namespace audio
         unsigned mSampleRate = 0;
     };
 
-    // Adjust the stream's gain (volume) setting.
+    // Adjust the stream's gain (volume) setting. When the gain is
+    // changed the new gain is ramped in over the next buffer in order
+    // to avoid the clicks that a sudden step in the gain would cause.
     class Gain : public Element
     {
     public:
@@ -675,7 +716,180 @@ namespace audio
         const std::string mId;
         SingleSlotPort mIn;
         SingleSlotPort mOut;
+        // the target gain.
         float mGain = 1.0f;
+        // the gain that was applied to the end of the previous buffer.
+        float mCurrentGain = 1.0f;
+    };
+
+    // Second order IIR (biquad) filter. The filter coefficients are
+    // computed based on the RBJ audio EQ cookbook formulas. Each channel
+    // is filtered separately. Requires float32 input.
+    class BiquadFilter : public Element
+    {
+    public:
+        // The possible filter response types.
+        enum class Type {
+            // Attenuate frequencies above the cutoff frequency.
+            LowPass,
+            // Attenuate frequencies below the cutoff frequency.
+            HighPass,
+            // Attenuate frequencies outside the band around the
+            // center (cutoff) frequency.
+            BandPass
+        };
+        struct SetFilterCmd {
+            Type filter  = Type::LowPass;
+            float cutoff = 1000.0f;
+            float q      = 0.7071f;
+        };
+
+        BiquadFilter(const std::string& name, Type filter, float cutoff, float q = 0.7071f);
+        BiquadFilter(const std::string& name, const std::string& id, Type filter, float cutoff, float q);
+        virtual std::string GetId() const override
+        { return mId; }
+        virtual std::string GetName() const override
+        { return mName; }
+        virtual std::string GetType() const override
+        { return "BiquadFilter"; }
+        virtual bool Prepare(const Loader& loader, const PrepareParams& params) override;
+        virtual void Process(Allocator& allocator, EventQueue& events, unsigned milliseconds) override;
+        virtual unsigned GetNumOutputPorts() const override
+        { return 1; }
+        virtual unsigned GetNumInputPorts() const override
+        { return 1; }
+        virtual Port& GetOutputPort(unsigned index) override
+        {
+            if (index == 0)  return mOut;
+            BUG("No such output port.");
+        }
+        virtual Port& GetInputPort(unsigned index) override
+        {
+            if (index == 0) return mIn;
+            BUG("No such input port.");
+        }
+        virtual void ReceiveCommand(Command& cmd) override;
+
+        // Change the filter parameters. The filter state is kept
+        // so that the change doesn't cause a discontinuity.
+        void SetFilter(Type filter, float cutoff, float q);
+    private:
+        void ComputeCoefficients();
+        template<unsigned ChannelCount>
+        void Filter(BufferHandle buffer);
+    private:
+        const std::string mName;
+        const std::string mId;
+        SingleSlotPort mIn;
+        SingleSlotPort mOut;
+        Type mFilter = Type::LowPass;
+        float mCutoff = 1000.0f;
+        float mQ = 0.7071f;
+        // current stream sample rate.
+        unsigned mSampleRate = 0;
+        // normalized filter coefficients.
+        float mB0 = 1.0f;
+        float mB1 = 0.0f;
+        float mB2 = 0.0f;
+        float mA1 = 0.0f;
+        float mA2 = 0.0f;
+        // transposed direct form II state for each channel.
+        float mZ1[2] = {0.0f, 0.0f};
+        float mZ2[2] = {0.0f, 0.0f};
+    };
+
+    // Feed-forward dynamic range compressor. The input level is
+    // followed with a peak envelope that is linked across the channels
+    // and when the level exceeds the threshold the stream gain is
+    // reduced according to the compression ratio. The gain is computed
+    // for small blocks of frames and ramped between the blocks.
+    class Compressor : public Element
+    {
+    public:
+        struct SetCompressorCmd {
+            // threshold level in dBFS
+            float threshold = -12.0f;
+            // compression ratio, for example 4.0 for 4:1
+            float ratio     = 4.0f;
+            // attack time in milliseconds.
+            float attack    = 10.0f;
+            // release time in milliseconds.
+            float release   = 100.0f;
+            // makeup gain in dB
+            float makeup    = 0.0f;
+        };
+
+        Compressor(const std::string& name, float threshold, float ratio, float attack, float release, float makeup = 0.0f);
+        Compressor(const std::string& name, const std::string& id, float threshold, float ratio, float attack, float release, float makeup);
+        virtual std::string GetId() const override
+        { return mId; }
+        virtual std::string GetName() const override
+        { return mName; }
+        virtual std::string GetType() const override
+        { return "Compressor"; }
+        virtual bool Prepare(const Loader& loader, const PrepareParams& params) override;
+        virtual void Process(Allocator& allocator, EventQueue& events, unsigned milliseconds) override;
+        virtual unsigned GetNumOutputPorts() const override
+        { return 1; }
+        virtual unsigned GetNumInputPorts() const override
+        { return 1; }
+        virtual Port& GetOutputPort(unsigned index) override
+        {
+            if (index == 0)  return mOut;
+            BUG("No such output port.");
+        }
+        virtual Port& GetInputPort(unsigned index) override
+        {
+            if (index == 0) return mIn;
+            BUG("No such input port.");
+        }
+        virtual void ReceiveCommand(Command& cmd) override;
+
+        void SetParams(float threshold, float ratio, float attack, float release, float makeup);
+        // Get the current gain reduction in dB (0 or negative).
+        float GetGainReduction() const;
+    private:
+        void ComputeCoefficients();
+        template<typename DataType, unsigned ChannelCount>
+        void Compress(BufferHandle buffer);
+    private:
+        const std::string mName;
+        const std::string mId;
+        SingleSlotPort mIn;
+        SingleSlotPort mOut;
+        float mThreshold = 0.0f;
+        float mRatio     = 1.0f;
+        float mAttack    = 0.0f;
+        float mRelease   = 0.0f;
+        float mMakeup    = 0.0f;
+        // current stream sample rate.
+        unsigned mSampleRate = 0;
+        // envelope follower coefficients.
+        float mAttackCoeff  = 0.0f;
+        float mReleaseCoeff = 0.0f;
+        // the current envelope level (linear)
+        float mEnvelope = 0.0f;
+        // the gain reduction (linear) applied to the end of the previous block.
+        float mGain = 1.0f;
+    };
+
+    // Brick wall peak limiter, i.e. a compressor with an infinite ratio
+    // and an instant attack. The output never exceeds the threshold.
+    class Limiter : public Compressor
+    {
+    public:
+        struct SetLimiterCmd {
+            // threshold (ceiling) level in dBFS
+            float threshold = -1.0f;
+            // release time in milliseconds.
+            float release   = 50.0f;
+        };
+
+        Limiter(const std::string& name, float threshold, float release = 50.0f);
+        Limiter(const std::string& name, const std::string& id, float threshold, float release);
+        virtual std::string GetType() const override
+        { return "Limiter"; }
+        virtual void ReceiveCommand(Command& cmd) override;
     };
 
     // Resample the input stream.
@@ -721,6 +935,18 @@ namespace audio
     {
     public:
         using IOStrategy = audio::IOStrategy;
+        // How the audio file is packaged with the game.
+        enum class Packing {
+            // Keep the file as-is, i.e. compressed, and decode it when
+            // it's played. Good for long audio files such as music that
+            // is streamed.
+            KeepCompressed,
+            // Transcode the file into PCM in the game's audio sample rate
+            // when the game is packaged. Then the file doesn't need to be
+            // decoded or resampled when it's played. Good for short sound
+            // effects.
+            Transcode
+        };
 
         FileSource(const std::string& name,
                    const std::string& file,
@@ -741,6 +967,7 @@ namespace audio
         { return "FileSource"; }
         virtual bool Prepare(const Loader& loader, const PrepareParams& params) override;
         virtual void Process(Allocator& allocator, EventQueue& events, unsigned milliseconds) override;
+        virtual bool Skip(unsigned milliseconds) override;
         virtual void Shutdown() override;
         virtual bool IsSourceDone() const override;
         virtual bool IsSource() const override
@@ -762,6 +989,13 @@ namespace audio
         { mEnableFileCaching = on_off; }
         void SetIOStrategy(IOStrategy strategy)
         { mIOStrategy = strategy; }
+        // Decode the whole audio file into the PCM cache ahead of time
+        // so that the source doesn't need to do any decoding when it's
+        // played. Does nothing if PCM caching isn't enabled on this source
+        // or when the file is already in the cache.
+        // Returns false if the file could not be decoded.
+        bool Preload(const Loader& loader);
+
         struct FileInfo {
             unsigned channels    = 0;
             unsigned frames      = 0;
@@ -769,13 +1003,38 @@ namespace audio
             float seconds = 0;
         };
         static bool ProbeFile(const std::string& file, FileInfo* info);
+
+        // PCM cache statistics.
+        struct CacheStats {
+            // Number of times a complete PCM buffer was found in the cache.
+            std::size_t hits = 0;
+            // Number of times the audio had to be decoded.
+            std::size_t misses = 0;
+            // Number of PCM buffers evicted from the cache.
+            std::size_t evictions = 0;
+            // The current number of PCM buffers in the cache.
+            std::size_t entries = 0;
+            // The current number of PCM bytes in the cache.
+            std::size_t bytes = 0;
+            // The current cache budget in bytes. 0 for no budget.
+            std::size_t budget = 0;
+        };
+        // Set the maximum number of decoded PCM bytes to keep in the cache
+        // shared by all file sources. When the budget is exceeded the least
+        // recently used complete PCM buffers are evicted. Buffers that are
+        // larger than the budget are never cached. 0 for no budget.
+        static void SetCacheBudget(std::size_t bytes);
+        static CacheStats GetCacheStats();
         static void ClearCache();
     private:
         class  PCMDecoder;
+        class  PCMCache;
         struct PCMBuffer;
-        using PCMCache = std::unordered_map<std::string,
-            std::shared_ptr<PCMBuffer>>;
-        static PCMCache pcm_cache;
+        static PCMCache& GetPCMCache();
+        std::unique_ptr<Decoder> OpenDecoder(const Loader& loader) const;
+        std::shared_ptr<PCMBuffer> CreatePCMBuffer(const Decoder& decoder) const;
+        std::size_t ReadFrames(void* buff, unsigned frames);
+        void DiscardSkippedFrames(Allocator& allocator);
     private:
         const std::string mName;
         const std::string mId;
@@ -785,6 +1044,8 @@ namespace audio
         SingleSlotPort mPort;
         Format mFormat;
         unsigned mFramesRead = 0;
+        // Frames that have been skipped but not yet read from the decoder.
+        unsigned mFramesSkipped = 0;
         unsigned mPlayCount  = 0;
         unsigned mLoopCount  = 1;
         bool mEnablePcmCaching  = false;
@@ -844,6 +1105,9 @@ namespace audio
         public:
             virtual ~Effect() = default;
             virtual void Apply(BufferHandle buffer) = 0;
+            // Move the effect time forward without applying the
+            // effect, i.e. while the source is virtual.
+            virtual void Skip(unsigned milliseconds) = 0;
             virtual bool IsDone() const = 0;
             virtual std::string GetName() const = 0;
         private:
@@ -857,6 +1121,8 @@ namespace audio
             FadeIn(unsigned millisecs) : mDuration(millisecs)
             {}
             virtual void Apply(BufferHandle buffer) override;
+            virtual void Skip(unsigned milliseconds) override
+            { mTime += milliseconds; }
             virtual bool IsDone() const override
             { return mTime >= mDuration; }
             virtual std::string GetName() const override
@@ -877,6 +1143,8 @@ namespace audio
             FadeOut(unsigned millisecs) : mDuration(millisecs)
             {}
             virtual void Apply(BufferHandle buffer) override;
+            virtual void Skip(unsigned milliseconds) override
+            { mTime += milliseconds; }
             virtual bool IsDone() const override
             { return mTime >= mDuration; }
             virtual std::string GetName() const override
@@ -889,6 +1157,23 @@ namespace audio
             float mTime = 0.0f;
         };
 
+        // Voice allocation parameters of a mixer source. When more
+        // sources are playing than the limits allow the mixer steals
+        // (deletes) or virtualizes the sources with the lowest priority
+        // and after that the oldest sources first.
+        struct VoiceParams {
+            // The voice group of the source. For example the name of the
+            // audio graph class. Empty group has no group voice limit.
+            std::string group;
+            // The maximum number of concurrently playing sources in the
+            // group. When exceeded the excess sources are stolen, i.e.
+            // they're deleted from the mixer. 0 for no limit.
+            unsigned max_voices = 0;
+            // The priority of the source. Sources with higher priority
+            // are preferred over sources with lower priority.
+            int priority = 0;
+        };
+
         // Command to add a new source stream to the mixer.
         // The element needs to be a source, i.e. IsSource is true.
         // Subsequent commands can refer to the same source
@@ -896,6 +1181,14 @@ namespace audio
         struct AddSourceCmd {
             std::unique_ptr<Element> src;
             bool paused = false;
+            VoiceParams voice;
+        };
+        // Set the maximum number of audible sources. Any sources in
+        // excess are virtualized, i.e. their time keeps running but
+        // they're not processed or mixed until they become audible again.
+        // A source that can't be skipped is stolen instead.
+        struct SetMaxVoicesCmd {
+            unsigned max_voices = 0;
         };
         // Commands to modify the state of the source identified
         // by its name. If no such source is found then nothing is done.
@@ -937,6 +1230,15 @@ namespace audio
             std::string src;
             std::unique_ptr<Effect> effect;
         };
+        // Sent when the number of active (audible) or virtual sources
+        // or the number of stolen sources changes.
+        struct VoiceCountEvent {
+            std::string mixer;
+            unsigned active  = 0;
+            unsigned virtualized = 0;
+            // The total number of sources stolen so far.
+            unsigned stolen  = 0;
+        };
 
         // Create a new mixer with the given name and format.
         MixerSource(const std::string& name, const Format& format);
@@ -946,12 +1248,26 @@ namespace audio
         // and have at least 1 output port with the same format that the
         // mixer source itself has.
         Element* AddSourcePtr(std::unique_ptr<Element> source, bool paused=false);
+        // Add a new source element with voice allocation parameters.
+        Element* AddSourcePtr(std::unique_ptr<Element> source, bool paused, const VoiceParams& voice);
 
         // Enable/disable never done flag. When never done flag is one
         // the source is never considered done regardless of whether the
         // current sources are done or not.
         void SetNeverDone(bool on_off)
         { mNeverDone = on_off; }
+        // Set the maximum number of audible sources. 0 for no limit.
+        void SetMaxVoices(unsigned max_voices)
+        { mMaxVoices = max_voices; }
+        // Enable/disable profiling the audio graph sources. The graph
+        // profiles are combined by the graph's voice group which should
+        // be the ID of the graph class. Graphs without a group are not
+        // profiled.
+        void EnableProfiling(bool on_off);
+        // Move the graph profiling data accumulated since the previous
+        // call into the given vector. The data of graphs that were already
+        // removed from the mixer is included as well.
+        void CollectGraphProfiles(std::vector<GraphClassProfile>* profiles);
 
         template<typename Source>
         Source* AddSource(Source&& source, bool paused=false)
@@ -993,11 +1309,18 @@ namespace audio
         virtual void ReceiveCommand(Command& cmd) override;
         virtual bool DispatchCommand(const std::string& dest, Command& cmd) override;
     private:
+        struct Source;
+        static constexpr unsigned NoGroup = ~0u;
         void ExecuteCommand(const DeleteAllSrcCmd& cmd);
         void ExecuteCommand(const DeleteSourceCmd& cmd);
         void ExecuteCommand(const PauseSourceCmd& cmd);
         void RemoveDoneEffects(EventQueue& events);
         void RemoveDoneSources(EventQueue& events);
+        void AccumulateProfile(Source& source);
+        void AllocateVoices();
+        void UpdateVoiceCounts(EventQueue& events);
+        void ProcessSource(Source& source, Allocator& allocator, EventQueue& events,
+                           std::vector<BufferHandle>& buffers, unsigned milliseconds);
     private:
         const std::string mName;
         const std::string mId;
@@ -1005,7 +1328,15 @@ namespace audio
         struct Source {
             std::unique_ptr<Element> element;
             std::unique_ptr<Effect> effect;
-            bool paused = false;
+            VoiceParams voice;
+            // Index of the voice group in the group voice counts or
+            // NoGroup if the source has no group voice limit.
+            unsigned group = 0;
+            // Order of the source being added. Used to find the oldest sources.
+            std::uint64_t serial = 0;
+            bool paused  = false;
+            bool virtualized = false;
+            bool stolen  = false;
         };
         using LateCommand = std::variant<PauseSourceCmd,
                 DeleteSourceCmd>;
@@ -1013,6 +1344,30 @@ namespace audio
         std::unordered_map<std::string, Source> mSources;
         SingleSlotPort mOut;
         bool mNeverDone = false;
+        unsigned mMaxVoices = 0;
+        std::uint64_t mSerial = 0;
+        // current voice counts.
+        unsigned mActiveVoices  = 0;
+        unsigned mVirtualVoices = 0;
+        unsigned mStolenVoices  = 0;
+        bool mStolenVoicesChanged = false;
+        // scratch space for the buffers being mixed.
+        std::vector<BufferHandle> mSrcBuffers;
+        // voice group name to group index. Assigned when a source
+        // is added so that voice allocation doesn't need to look up
+        // the groups by name.
+        std::unordered_map<std::string, unsigned> mGroups;
+        // scratch space for voice allocation.
+        std::vector<Source*> mVoices;
+        // per group voice counts indexed by the group index.
+        std::vector<unsigned> mGroupVoices;
+        // scratch space for (parallel) source evaluation.
+        std::vector<Source*> mActiveSources;
+        std::vector<std::vector<BufferHandle>> mTaskBuffers;
+        std::deque<EventQueue> mTaskEvents;
+        // graph source profiling data per graph class.
+        std::vector<GraphClassProfile> mGraphProfiles;
+        bool mProfiling = false;
     };
 
     // Generate endless audio buffers with 0 (silence) for audio content.
@@ -1029,6 +1384,7 @@ namespace audio
         { return "ZeroSource"; }
         virtual bool IsSource() const override { return true; }
         virtual bool IsSourceDone() const override { return false; }
+        virtual bool Skip(unsigned milliseconds) override { return true; }
         virtual bool Prepare(const Loader& loader, const PrepareParams& params) override;
         virtual void Process(Allocator& allocator, EventQueue& events, unsigned milliseconds) override;
         virtual unsigned GetNumOutputPorts() const override
@@ -1077,6 +1433,7 @@ namespace audio
         { return mPort; }
         virtual bool Prepare(const Loader& loader, const PrepareParams& params) override;
         virtual void Process(Allocator& allocator, EventQueue& events, unsigned milliseconds) override;
+        virtual bool Skip(unsigned milliseconds) override;
         void SetSampleType(SampleType type)
         { mFormat.sample_type = type; }
     private:
@@ -1102,8 +1459,10 @@ namespace audio
             SampleType,
             Format,
             FileSource::IOStrategy,
+            FileSource::Packing,
             StereoMaker::Channel,
-            Effect::Kind>;
+            Effect::Kind,
+            BiquadFilter::Type>;
 
     template<typename T> inline
     const T* FindElementArg(const std::unordered_map<std::string, ElementArg>& args,
@@ -1138,4 +1497,14 @@ namespace audio
 
     void ClearCaches();
 
+    // Enable/disable the SIMD implementation of the mixing, gain and fade
+    // kernels used by the audio elements. The best implementation (SSE2/AVX2/NEON)
+    // is selected at runtime based on the CPU. When disabled or when no SIMD
+    // implementation is available the scalar code path is used. Both paths
+    // produce the same results. Mostly useful for testing and benchmarking.
+    // On by default.
+    void EnableAudioSIMD(bool on_off);
+    // Returns true if a SIMD implementation is available and enabled.
+    bool IsAudioSIMDEnabled();
+
 } // namespace
@@ -36,6 +36,7 @@ namespace audio
     class MixerSource;
     class GraphClass;
     class Graph;
+    class WorkerPool;
 #ifdef AUDIO_ENABLE_TEST_SOUND
     class SineSource;
 #endif
@@ -18,6 +18,8 @@
 
 #include <unordered_set>
 #include <set>
+#include <algorithm>
+#include <chrono>
 
 #include "base/utility.h"
 #include "base/format.h"
@@ -27,6 +29,7 @@
 #include "data/reader.h"
 #include "audio/graph.h"
 #include "audio/element.h"
+#include "audio/worker.h"
 
 namespace audio
 {
@@ -46,6 +49,8 @@ std::size_t GraphClass::GetHash() const
     hash = base::hash_combine(hash, mId);
     hash = base::hash_combine(hash, mSrcElemId);
     hash = base::hash_combine(hash, mSrcElemPort);
+    hash = base::hash_combine(hash, mMaxVoices);
+    hash = base::hash_combine(hash, mVoicePriority);
     for (const auto& link : mLinks)
     {
         hash = base::hash_combine(hash, link.id);
@@ -88,6 +93,8 @@ void GraphClass::IntoJson(data::Writer& writer) const
     writer.Write("id",   mId);
     writer.Write("src_elem_id", mSrcElemId);
     writer.Write("src_elem_port", mSrcElemPort);
+    writer.Write("max_voices", mMaxVoices);
+    writer.Write("voice_priority", mVoicePriority);
     for (const auto& link : mLinks)
     {
         auto chunk = writer.NewWriteChunk();
@@ -141,6 +148,9 @@ std::optional<GraphClass> GraphClass::FromJson(const data::Reader& reader)
     if (!reader.Read("src_elem_id",   &ret.mSrcElemId) ||
         !reader.Read("src_elem_port", &ret.mSrcElemPort))
         return std::nullopt;
+    // these are optional for backwards compatibility.
+    reader.Read("max_voices",     &ret.mMaxVoices);
+    reader.Read("voice_priority", &ret.mVoicePriority);
 
     for (unsigned i=0; i<reader.GetNumChunks("links"); ++i)
     {
@@ -259,6 +269,10 @@ Graph::Graph(Graph&& other)
   , mPortMap(std::move(other.mPortMap))
   , mElements(std::move(other.mElements))
   , mTopoOrder(std::move(other.mTopoOrder))
+  , mLevels(std::move(other.mLevels))
+  , mProfile(std::move(other.mProfile))
+  , mProfileElement(std::move(other.mProfileElement))
+  , mProfiling(other.mProfiling)
   , mFormat(std::move(other.mFormat))
   , mPort(std::move(other.mPort))
   , mDone(other.mDone)
@@ -597,8 +611,51 @@ bool Graph::Prepare(const Loader& loader, const PrepareParams& params)
             }
         }
     }
+    // Group the elements into levels so that the elements on the same
+    // level don't depend on each other and can be evaluated in parallel.
+    // An element's level is one more than the highest level of its sources.
+    std::unordered_map<Element*, std::size_t> levels;
+    std::size_t max_level = 0;
+    for (auto* element : order)
+    {
+        std::size_t level = 0;
+        auto it = mSrcMap.find(element);
+        if (it != mSrcMap.end())
+        {
+            for (auto* src : it->second)
+                level = std::max(level, levels[src] + 1);
+        }
+        levels[element] = level;
+        max_level = std::max(max_level, level);
+    }
+    std::stable_sort(order.begin(), order.end(), [&levels](Element* lhs, Element* rhs) {
+        return levels[lhs] < levels[rhs];
+    });
+    mLevels.clear();
+    for (std::size_t i=0; i<order.size(); ++i)
+    {
+        if (i+1 == order.size() || levels[order[i]] != levels[order[i+1]])
+            mLevels.push_back(i+1);
+    }
+    ASSERT(mLevels.size() == (order.empty() ? 0 : max_level + 1));
+
     mTopoOrder = std::move(order);
     mFormat    = mPort.GetFormat();
+    mProfile.clear();
+    mProfile.resize(mTopoOrder.size());
+    mProfileElement.clear();
+    for (const auto* element : mTopoOrder)
+    {
+        for (std::size_t i=0; i<mElements.size(); ++i)
+        {
+            if (mElements[i].get() == element)
+            {
+                mProfileElement.push_back(i);
+                break;
+            }
+        }
+    }
+    ASSERT(mProfileElement.size() == mTopoOrder.size());
     if (!IsValid(mFormat))
     {
         ERROR("Audio graph output format is not valid. [graph=%1, format=%2]", mName, mFormat);
@@ -610,59 +667,200 @@ bool Graph::Prepare(const Loader& loader, const PrepareParams& params)
 
 void Graph::Process(Allocator& allocator, EventQueue& events, unsigned milliseconds)
 {
-    // Evaluate the elements in topological order and then
-    // dispatch the buffers according to the element/port links.
-    for (auto& source : mTopoOrder)
+    // Evaluate the elements level by level. The elements on the same
+    // level are independent of each other so when there's a worker pool
+    // they're evaluated in parallel. Each parallel task collects its events
+    // into its own queue and the queues are merged in the schedule order
+    // afterwards so the result is the same as with serial evaluation.
+    auto* pool = WorkerPool::GetCurrent();
+
+    std::size_t begin = 0;
+    for (auto end : mLevels)
     {
-        // this element could be done but the pipeline could still
-        // have pending buffers in the port queues.
-        if (source->IsSource() && source->IsSourceDone())
-            continue;
-
-        bool backpressure = false;
-        // find out if the next element is putting back pressure
-        // on the source element by not consuming the input buffers.
-        // if this is the case the producer evaluation is skipped
-        // and the graph will subsequently likely stop producing
-        // output buffers.
-        for (unsigned i=0; i<source->GetNumOutputPorts(); ++i)
+        const auto count = static_cast<unsigned>(end - begin);
+        if (pool && count > 1)
         {
-            auto& src = source->GetOutputPort(i);
-            auto* dst = FindDstPort(&src);
-            if (dst && dst->IsFull())
+            if (mTaskEvents.size() < count)
+                mTaskEvents.resize(count);
+
+            pool->ParallelFor(count, allocator, [this, begin, milliseconds](unsigned index, Allocator& allocator) {
+                ProcessElement(begin + index, allocator, mTaskEvents[index], milliseconds);
+            });
+            for (unsigned i=0; i<count; ++i)
             {
-                backpressure = true;
-                break;
+                auto& queue = mTaskEvents[i];
+                while (!queue.empty())
+                {
+                    events.push(std::move(queue.front()));
+                    queue.pop();
+                }
             }
         }
-        if (backpressure)
-            continue;
+        else
+        {
+            for (auto i=begin; i<end; ++i)
+                ProcessElement(i, allocator, events, milliseconds);
+        }
+        begin = end;
+    }
+
+    UpdateDone();
+}
+
+void Graph::ProcessElement(std::size_t index, Allocator& allocator, EventQueue& events, unsigned milliseconds)
+{
+    auto* source = mTopoOrder[index];
 
-        // process the audio buffers.
+    // this element could be done but the pipeline could still
+    // have pending buffers in the port queues.
+    if (source->IsSource() && source->IsSourceDone())
+        return;
+
+    // find out if the next element is putting back pressure
+    // on the source element by not consuming the input buffers.
+    // if this is the case the producer evaluation is skipped
+    // and the graph will subsequently likely stop producing
+    // output buffers.
+    for (unsigned i=0; i<source->GetNumOutputPorts(); ++i)
+    {
+        auto& src = source->GetOutputPort(i);
+        auto* dst = FindDstPort(&src);
+        if (dst && dst->IsFull())
+            return;
+    }
+
+    // process the audio buffers.
+    if (mProfiling)
+    {
+        using clock = std::chrono::steady_clock;
+        const auto start = clock::now();
+        source->Process(allocator, events, milliseconds);
+        const auto end = clock::now();
+        const auto time = std::chrono::duration<double, std::milli>(end - start).count();
+        auto& profile = mProfile[index];
+        profile.calls++;
+        profile.total_time += time;
+        profile.max_time = std::max(profile.max_time, time);
+    }
+    else
+    {
         source->Process(allocator, events, milliseconds);
+    }
 
-        // dispatch the resulting buffers by iterating over the output
-        // ports and finding their assigned input ports.
-        for (unsigned i=0; i<source->GetNumOutputPorts(); ++i)
-        {
-            auto& output = source->GetOutputPort(i);
-            BufferHandle buffer;
-            if (!output.PullBuffer(buffer))
-                continue;
+    // dispatch the resulting buffers by iterating over the output
+    // ports and finding their assigned input ports.
+    for (unsigned i=0; i<source->GetNumOutputPorts(); ++i)
+    {
+        auto& output = source->GetOutputPort(i);
+        BufferHandle buffer;
+        if (!output.PullBuffer(buffer))
+            continue;
+
+        Buffer::InfoTag tag;
+        tag.element.name   = source->GetName();
+        tag.element.id     = source->GetId();
+        tag.element.source = source->IsSource();
+        tag.element.source_done = source->IsSourceDone();
+        buffer->AddInfoTag(tag);
+
+        if (auto* dst = FindDstPort(&output))
+            dst->PushBuffer(buffer);
+    }
+}
+
+std::vector<Graph::ScheduledElement> Graph::GetSchedule() const
+{
+    std::vector<ScheduledElement> ret;
+    for (const auto* element : mTopoOrder)
+    {
+        ScheduledElement info;
+        info.id   = element->GetId();
+        info.name = element->GetName();
+        info.type = element->GetType();
+        ret.push_back(std::move(info));
+    }
+    return ret;
+}
+
+void Graph::EnableProfiling(bool on_off)
+{
+    mProfiling = on_off;
+    for (auto& element : mElements)
+    {
+        if (element->GetType() == "MixerSource")
+            static_cast<MixerSource*>(element.get())->EnableProfiling(on_off);
+    }
+}
+
+void Graph::ResetProfile()
+{
+    for (auto& profile : mProfile)
+    {
+        profile.calls      = 0;
+        profile.total_time = 0.0;
+        profile.max_time   = 0.0;
+    }
+}
+
+void Graph::AccumulateProfile(std::vector<ElementProfile>* profile) const
+{
+    if (profile->size() < mElements.size())
+        profile->resize(mElements.size());
 
-            Buffer::InfoTag tag;
-            tag.element.name   = source->GetName();
-            tag.element.id     = source->GetId();
-            tag.element.source = source->IsSource();
-            tag.element.source_done = source->IsSourceDone();
-            buffer->AddInfoTag(tag);
+    for (std::size_t i=0; i<mProfile.size(); ++i)
+    {
+        const auto& src = mProfile[i];
+        auto& dst = (*profile)[mProfileElement[i]];
+        dst.calls      += src.calls;
+        dst.total_time += src.total_time;
+        dst.max_time    = std::max(dst.max_time, src.max_time);
+    }
+}
 
-            if (auto* dst = FindDstPort(&output))
-                dst->PushBuffer(buffer);
+void Graph::CollectGraphProfiles(std::vector<GraphClassProfile>* profiles)
+{
+    for (auto& element : mElements)
+    {
+        if (element->GetType() == "MixerSource")
+            static_cast<MixerSource*>(element.get())->CollectGraphProfiles(profiles);
+    }
+}
+
+bool Graph::Skip(unsigned milliseconds)
+{
+    for (auto& element : mTopoOrder)
+    {
+        // the non-source elements that track the stream time, such as
+        // effects, move their time forward as well so that they're in
+        // sync with the sources once the graph is processed again.
+        if (!element->IsSource())
+            element->Skip(milliseconds);
+        else if (element->IsSourceDone())
+            continue;
+        else if (!element->Skip(milliseconds))
+            return false;
+    }
+    // any buffers still queued in the ports are stale now.
+    BufferHandle buffer;
+    for (auto& element : mTopoOrder)
+    {
+        for (unsigned i=0; i<element->GetNumInputPorts(); ++i)
+        {
+            auto& port = element->GetInputPort(i);
+            while (port.PullBuffer(buffer));
+        }
+        for (unsigned i=0; i<element->GetNumOutputPorts(); ++i)
+        {
+            auto& port = element->GetOutputPort(i);
+            while (port.PullBuffer(buffer));
         }
     }
+    UpdateDone();
+    return true;
+}
 
-    // check if we're all done
+void Graph::UpdateDone()
+{
     bool graph_done = true;
     for (const auto& element : mTopoOrder)
     {
@@ -745,6 +943,7 @@ AudioGraph::AudioGraph(const std::string& name, Graph&& graph)
 AudioGraph::AudioGraph(AudioGraph&& other)
   : mName(other.mName)
   , mGraph(std::move(other.mGraph))
+  , mProfileInterval(other.mProfileInterval)
 {}
 
 bool AudioGraph::Prepare(const Loader& loader, const PrepareParams& params)
@@ -804,13 +1003,18 @@ unsigned AudioGraph::FillBuffer(void* buff, unsigned max_bytes)
         return min_bytes;
     }
 
+    // Reuse the device buffer view unless some element is still
+    // holding on to it from a previous round.
+    if (!mDeviceBuffer || mDeviceBuffer.use_count() > 1)
+        mDeviceBuffer = std::make_shared<BufferView>(buff, max_bytes);
+    else mDeviceBuffer->Reset(buff, max_bytes);
+
     class Allocator : public BufferAllocator {
     public:
-        Allocator(void* native_buffer, unsigned native_buffer_size)
-        {
-            mDeviceBuffer = std::make_shared<BufferView>(native_buffer,
-                                                         native_buffer_size);
-        }
+        Allocator(BufferHandle device_buffer, BufferPool& pool)
+          : mDeviceBuffer(std::move(device_buffer))
+          , mPool(pool)
+        {}
         virtual BufferHandle Allocate(size_t bytes) override
         {
             if (mDeviceBuffer && mDeviceBuffer->GetCapacity() >= bytes)
@@ -819,15 +1023,47 @@ unsigned AudioGraph::FillBuffer(void* buff, unsigned max_bytes)
                 mDeviceBuffer.reset();
                 return ret;
             }
-            return std::make_shared<VectorBuffer>(bytes);
-            mDeviceBuffer.reset();
+            return mPool.Allocate(bytes);
         }
     private:
         BufferHandle mDeviceBuffer;
-    } allocator(buff, max_bytes);
+        BufferPool& mPool;
+    } allocator(mDeviceBuffer, mBufferPool);
 
-    mGraph.Process(allocator, mEvents, milliseconds);
-    mGraph.Advance(milliseconds);
+    if (mProfileInterval)
+    {
+        using clock = std::chrono::steady_clock;
+        const auto start = clock::now();
+        mGraph.Process(allocator, mEvents, milliseconds);
+        mGraph.Advance(milliseconds);
+        const auto end = clock::now();
+        const auto time = std::chrono::duration<double, std::milli>(end - start).count();
+        const auto margin = milliseconds - time;
+        mProfile.min_margin = mProfile.callbacks ? std::min(mProfile.min_margin, margin) : margin;
+        mProfile.max_time    = std::max(mProfile.max_time, time);
+        mProfile.total_time += time;
+        mProfile.audio_time += milliseconds;
+        mProfile.callbacks++;
+        if (mProfile.audio_time >= mProfileInterval)
+        {
+            ProfileEvent event;
+            event.callbacks  = mProfile.callbacks;
+            event.total_time = mProfile.total_time;
+            event.max_time   = mProfile.max_time;
+            event.audio_time = mProfile.audio_time;
+            event.min_margin = mProfile.min_margin;
+            event.elements   = mGraph.GetProfile();
+            mGraph.CollectGraphProfiles(&event.graphs);
+            mEvents.push(MakeEvent(std::move(event)));
+            mProfile = ProfileEvent{};
+            mGraph.ResetProfile();
+        }
+    }
+    else
+    {
+        mGraph.Process(allocator, mEvents, milliseconds);
+        mGraph.Advance(milliseconds);
+    }
     mMillisecs += milliseconds;
 
     BufferHandle buffer;
@@ -887,9 +1123,21 @@ void AudioGraph::RecvCommand(std::unique_ptr<Command> cmd) noexcept
         if (!mGraph.DispatchCommand(ptr->dest, *ptr->cmd))
             WARN("Audio graph command receiver element not found. [graph=%1, elem=%2]", mName, ptr->dest);
     }
+    else if (auto* ptr = cmd->GetIf<SetProfilingCmd>())
+    {
+        SetProfilingInterval(ptr->interval);
+    }
     else BUG("Unexpected command.");
 }
 
+void AudioGraph::SetProfilingInterval(unsigned milliseconds)
+{
+    mProfileInterval = milliseconds;
+    mProfile = ProfileEvent{};
+    mGraph.EnableProfiling(milliseconds != 0);
+    mGraph.ResetProfile();
+}
+
 std::unique_ptr<Event> AudioGraph::GetEvent() noexcept
 {
     if (mEvents.empty()) return nullptr;
@@ -22,9 +22,11 @@
 #include <memory>
 #include <vector>
 #include <queue>
+#include <deque>
 #include <unordered_map>
 #include <unordered_set>
 #include <variant>
+#include <cstdint>
 
 #include "base/utility.h"
 #include "data/fwd.h"
@@ -71,6 +73,20 @@ namespace audio
         { mSrcElemId = id; }
         void SetGraphOutputElementPort(const std::string& name)
         { mSrcElemPort = name; }
+        // Set the maximum number of concurrently playing instances
+        // (voices) of this graph when played as a sound effect.
+        // When exceeded the oldest instances are stopped. 0 for no limit.
+        void SetMaxVoices(unsigned max_voices)
+        { mMaxVoices = max_voices; }
+        // Set the voice priority of this graph when played as a sound effect.
+        // When there are more sound effects playing than can be heard
+        // the ones with a lower priority are the first to be virtualized.
+        void SetVoicePriority(int priority)
+        { mVoicePriority = priority; }
+        unsigned GetMaxVoices() const
+        { return mMaxVoices; }
+        int GetVoicePriority() const
+        { return mVoicePriority; }
         std::size_t GetHash() const;
         std::string GetName() const
         { return mName; }
@@ -132,6 +148,8 @@ namespace audio
         std::string mId;
         std::string mSrcElemId;
         std::string mSrcElemPort;
+        unsigned mMaxVoices = 0;
+        int mVoicePriority = 0;
         std::vector<Link> mLinks;
         std::vector<Element> mElements;
     };
@@ -139,6 +157,15 @@ namespace audio
     class Graph :  public Element
     {
     public:
+        // The per element profiling data. The element is identified
+        // by the index in the schedule.
+        using ElementProfile = audio::ElementProfile;
+        // An element in the graph's evaluation schedule.
+        struct ScheduledElement {
+            std::string id;
+            std::string name;
+            std::string type;
+        };
         // Create new audio graph with the given human-readable name.
         // The name will be audio stream name on the device, and will be
         // shown for example in Pavucontrol on Linux.
@@ -259,6 +286,33 @@ namespace audio
         Format GetFormat() const
         { return mFormat; }
 
+        // Enable/disable measuring the processing time of each element
+        // in the graph. Profiling is off by default.
+        // Any graphs that are played through the mixer sources in this
+        // graph are profiled as well. See CollectGraphProfiles.
+        void EnableProfiling(bool on_off);
+        bool IsProfilingEnabled() const
+        { return mProfiling; }
+        // Get the per element profiling data accumulated since the graph
+        // was prepared or since the last call to ResetProfile. The elements
+        // are in the order in which they're evaluated.
+        const std::vector<ElementProfile>& GetProfile() const
+        { return mProfile; }
+        // Get the elements in the order in which they're evaluated, i.e.
+        // in the same order as the profiling data. Available after the
+        // graph has been prepared. Use this to resolve the profiling data
+        // to elements before the graph is given to the player.
+        std::vector<ScheduledElement> GetSchedule() const;
+        // Reset the accumulated per element profiling data.
+        void ResetProfile();
+        // Add the accumulated per element profiling data to the given
+        // vector in the element order, i.e. in the graph class element order
+        // when the graph was created from a graph class.
+        void AccumulateProfile(std::vector<ElementProfile>* profile) const;
+        // Move the profiling data of the graphs played through the mixer
+        // sources in this graph into the given vector.
+        void CollectGraphProfiles(std::vector<GraphClassProfile>* profiles);
+
         // Element implementation note that  GetName is already part of the Source impl
         virtual std::string GetId() const override
         { return mId; }
@@ -272,6 +326,7 @@ namespace audio
         { return mDone; }
         virtual bool Prepare(const Loader& loader, const PrepareParams& params) override;
         virtual void Process(Allocator& allocator, EventQueue& events, unsigned milliseconds) override;
+        virtual bool Skip(unsigned milliseconds) override;
         virtual void Shutdown() override;
         virtual void Advance(unsigned int ms) override;
         virtual unsigned GetNumOutputPorts() const override
@@ -283,6 +338,12 @@ namespace audio
         }
         virtual bool DispatchCommand(const std::string& dest, Element::Command& cmd) override;
         Graph& operator=(const Graph&) = delete;
+    private:
+        // Check whether all the source elements are done and there are
+        // no more buffers queued in the ports and update the done flag.
+        void UpdateDone();
+        // Evaluate a single element and dispatch its output buffers.
+        void ProcessElement(std::size_t index, Allocator& allocator, EventQueue& events, unsigned milliseconds);
     private:
         using AdjacencyList = std::unordered_set<Element*>;
         const std::string mName;
@@ -300,6 +361,18 @@ namespace audio
         // The schedule, i.e. topological order in which
         // the elements need to be operated on.
         std::vector<Element*> mTopoOrder;
+        // The end offsets of the levels in the schedule. The elements
+        // on the same level don't depend on each other.
+        std::vector<std::size_t> mLevels;
+        // Event queues for the parallel element evaluation tasks.
+        std::deque<EventQueue> mTaskEvents;
+        // The profiling data for each element in the schedule order.
+        // Each element only ever touches its own entry so this is safe
+        // with the parallel evaluation.
+        std::vector<ElementProfile> mProfile;
+        // The index of each element in the schedule in the element container.
+        std::vector<std::size_t> mProfileElement;
+        bool mProfiling = false;
         // The current output format as per determined from
         // the last element on the graph
         audio::Format mFormat;
@@ -318,6 +391,33 @@ namespace audio
     public:
         using PrepareParams = Graph::PrepareParams;
 
+        // Sent periodically when profiling is enabled. The times are in
+        // milliseconds and accumulated over the profiling interval.
+        struct ProfileEvent {
+            // The number of FillBuffer calls that produced new audio.
+            std::uint64_t callbacks = 0;
+            // The total time spent processing the graph.
+            double total_time = 0.0;
+            // The worst case time spent processing the graph in a single call.
+            double max_time = 0.0;
+            // The total amount of audio produced.
+            double audio_time = 0.0;
+            // The smallest remaining time between the time spent processing
+            // the graph and the duration of the audio produced in a single call.
+            // When this goes negative the graph can't keep up with the device.
+            double min_margin = 0.0;
+            // The per element data over the same interval in the graph's
+            // schedule order. See Graph::GetSchedule.
+            std::vector<Graph::ElementProfile> elements;
+            // The data of the graphs played through the mixer sources
+            // in the graph over the same interval.
+            std::vector<GraphClassProfile> graphs;
+        };
+        // Command to change the profiling interval. 0 to disable profiling.
+        struct SetProfilingCmd {
+            unsigned interval = 0;
+        };
+
         AudioGraph(const std::string& name);
         AudioGraph(const std::string& name, Graph&& graph);
         AudioGraph(AudioGraph&& other);
@@ -343,6 +443,18 @@ namespace audio
         virtual void RecvCommand(std::unique_ptr<Command> cmd) noexcept override;
         virtual std::unique_ptr<Event> GetEvent() noexcept override;
 
+        // Get the statistics of the graph's buffer allocations. Once the
+        // graph is in steady state playback the number of allocations
+        // should no longer increase.
+        const BufferPool::Stats& GetBufferStats() const
+        { return mBufferPool.GetStats(); }
+
+        // Set the interval in milliseconds (of produced audio) for measuring
+        // the graph's processing times and sending a ProfileEvent.
+        // 0 to disable profiling. Once the graph has been given to the
+        // player use SetProfilingCmd instead.
+        void SetProfilingInterval(unsigned milliseconds);
+
         // quick access to the underlying graph.
         Graph& GetGraph()
         { return mGraph; }
@@ -374,6 +486,14 @@ namespace audio
         std::uint64_t mMillisecs = 0;
         std::size_t mPendingOffset = 0;
         BufferHandle mPendingBuffer;
+        // Pool for the graph's PCM buffers. Only used on the audio thread.
+        BufferPool mBufferPool;
+        // Buffer view for the audio device's current PCM buffer.
+        std::shared_ptr<BufferView> mDeviceBuffer;
+        // Profiling state. The profile is sent when the amount of
+        // audio produced since the last event exceeds the interval.
+        unsigned mProfileInterval = 0;
+        ProfileEvent mProfile;
     };
 
 } // namespace
@@ -72,6 +72,8 @@ namespace audio
         virtual ~Loader() = default;
         // Load the contents of the given file into an audio buffer object.
         // Returns nullptr (null stream handle) if the file could not be loaded.
+        // This can be called from a background thread when audio graphs are
+        // prepared asynchronously so the implementation must be thread safe.
         virtual SourceStreamHandle OpenAudioStream(const std::string& file,
             AudioIOStrategy strategy = AudioIOStrategy::Default,
             bool enable_file_caching= false)  const
@@ -116,6 +116,12 @@ void Mpg123Decoder::Reset()
         throw std::runtime_error("mpg123_seek_frame failed");
 }
 
+bool Mpg123Decoder::Seek(unsigned frame)
+{
+    // the offset is in PCM samples per channel, i.e. in frames.
+    return mpg123_seek(mHandle, off_t(frame), SEEK_SET) == off_t(frame);
+}
+
 bool Mpg123Decoder::Open(std::shared_ptr<const SourceStream> source, SampleType format)
 {
     ASSERT(!mIsOpen);
@@ -45,6 +45,7 @@ namespace audio
         virtual size_t ReadFrames(short* ptr, size_t frames) override;
         virtual size_t ReadFrames(int* ptr, size_t frames) override;
         virtual void Reset() override;
+        virtual bool Seek(unsigned frame) override;
 
         bool Open(std::shared_ptr<const SourceStream> io, SampleType format = SampleType::Int16);
     private:
@@ -0,0 +1,275 @@
+// Copyright (C) 2020-2021 Sami Väisänen
+// Copyright (C) 2020-2021 Ensisoft http://www.ensisoft.com
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+#include "config.h"
+
+#include <fstream>
+#include <algorithm>
+#include <cstring>
+#include <cmath>
+
+#include "base/assert.h"
+#include "base/logging.h"
+#include "base/utility.h"
+#include "audio/null.h"
+#include "audio/stream.h"
+#include "audio/wav.h"
+
+namespace audio
+{
+
+class NullDevice::PlaybackStream : public Stream
+{
+public:
+    PlaybackStream(std::unique_ptr<Source> source,
+                   std::shared_ptr<Recorder> recorder,
+                   unsigned buffer_duration, bool capture)
+      : mSource(std::move(source))
+      , mRecorder(std::move(recorder))
+      , mCapture(capture)
+    {
+        const auto channels   = mSource->GetNumChannels();
+        const auto samplerate = mSource->GetRateHz();
+        const auto format     = mSource->GetFormat();
+        DEBUG("Creating new null playback stream. [name='%1', channels=%2, rate=%3, format=%4]",
+              mSource->GetName(), channels, samplerate, format);
+        if (channels == 0 || samplerate < 1000)
+            throw std::runtime_error("invalid audio format");
+
+        mBytesPerMs = channels * Source::ByteSize(format) * (samplerate / 1000);
+        mBuffer.resize(Source::BuffSize(format, channels, samplerate, buffer_duration));
+        mSource->Prepare(mBuffer.size());
+        mOutput.name        = mSource->GetName();
+        mOutput.format      = format;
+        mOutput.sample_rate = samplerate;
+        mOutput.channels    = channels;
+        mState = State::Ready;
+    }
+   ~PlaybackStream()
+    {
+        Finish();
+    }
+    virtual State GetState() const override
+    { return mState; }
+    virtual std::unique_ptr<Source> GetFinishedSource() override
+    { return std::move(mSource); }
+    virtual std::string GetName() const override
+    { return mOutput.name; }
+    virtual std::uint64_t GetStreamTime() const override
+    { return mCurrentBytes / mBytesPerMs; }
+    virtual std::uint64_t GetStreamBytes() const override
+    { return mCurrentBytes; }
+    virtual void Play() override
+    { mPlaying = true; }
+    virtual void Pause() override
+    { mPlaying = false; }
+    virtual void Resume() override
+    { mPlaying = true; }
+    virtual void Cancel() override
+    {
+        mPlaying = false;
+        Finish();
+    }
+    virtual void SendCommand(std::unique_ptr<Command> cmd) override
+    { mSource->RecvCommand(std::move(cmd)); }
+    virtual std::unique_ptr<Event> GetEvent() override
+    { return mSource->GetEvent(); }
+
+    // Pull the given number of buffers from the source.
+    void Render(unsigned buffers)
+    {
+        for (unsigned i=0; i<buffers; ++i)
+        {
+            if (!mPlaying || mState != State::Ready)
+                return;
+
+            if (!mSource->HasMore(mCurrentBytes))
+            {
+                mState = State::Complete;
+                Finish();
+                return;
+            }
+            try
+            {
+                const auto start = std::chrono::steady_clock::now();
+                const auto bytes = mSource->FillBuffer(&mBuffer[0], mBuffer.size());
+                const auto end   = std::chrono::steady_clock::now();
+                const auto callback_ms = std::chrono::duration<double, std::milli>(end - start).count();
+                const auto audio_ms = bytes / (double)mBytesPerMs;
+                if (mCapture)
+                    mOutput.pcm.insert(mOutput.pcm.end(), mBuffer.begin(), mBuffer.begin() + bytes);
+                mCurrentBytes += bytes;
+
+                std::lock_guard<decltype(mRecorder->mutex)> lock(mRecorder->mutex);
+                auto& stats = mRecorder->stats;
+                stats.callbacks++;
+                stats.bytes += bytes;
+                stats.audio_time += audio_ms;
+                stats.total_callback_time += callback_ms;
+                stats.max_callback_time = std::max(stats.max_callback_time, callback_ms);
+                if (callback_ms > audio_ms)
+                    stats.deadline_misses++;
+            }
+            catch (const std::exception& e)
+            {
+                ERROR("Audio stream error. [name='%1', error='%2']", mOutput.name, e.what());
+                mState = State::Error;
+                Finish();
+                return;
+            }
+        }
+    }
+private:
+    void Finish()
+    {
+        if (mFinished)
+            return;
+        mFinished = true;
+        if (!mCapture)
+            return;
+        std::lock_guard<decltype(mRecorder->mutex)> lock(mRecorder->mutex);
+        mRecorder->outputs.push_back(std::move(mOutput));
+    }
+private:
+    std::unique_ptr<Source> mSource;
+    std::shared_ptr<Recorder> mRecorder;
+    const bool mCapture = false;
+    State mState = State::None;
+    std::vector<char> mBuffer;
+    std::uint64_t mCurrentBytes = 0;
+    unsigned mBytesPerMs = 0;
+    Output mOutput;
+    bool mPlaying  = false;
+    bool mFinished = false;
+};
+
+std::shared_ptr<Stream> NullDevice::Prepare(std::unique_ptr<Source> source)
+{
+    const auto& name = source->GetName();
+    try
+    {
+        auto stream = std::make_shared<PlaybackStream>(std::move(source), mRecorder,
+                                                       mBufferSize, mParams.capture);
+        mStreams.push_back(stream);
+        return stream;
+    }
+    catch (const std::exception& e)
+    { ERROR("Audio source failed to prepare: [name=%1, error=%2]", name, e.what()); }
+    return nullptr;
+}
+
+void NullDevice::Poll()
+{
+    unsigned buffers = 1;
+    if (mParams.clock == Clock::Realtime)
+    {
+        const auto now = std::chrono::steady_clock::now();
+        mPendingTime += std::chrono::duration<double, std::milli>(now - mLastPoll).count();
+        mLastPoll = now;
+        buffers = (unsigned)(mPendingTime / mBufferSize);
+        if (buffers && !mStreams.empty())
+        {
+            // the oldest buffer that is due became due this long ago.
+            const auto latency = mPendingTime - mBufferSize;
+            std::lock_guard<decltype(mRecorder->mutex)> lock(mRecorder->mutex);
+            auto& stats = mRecorder->stats;
+            stats.max_latency = std::max(stats.max_latency, latency);
+        }
+        mPendingTime -= buffers * mBufferSize;
+    }
+
+    for (auto it = mStreams.begin(); it != mStreams.end();)
+    {
+        auto stream = it->lock();
+        if (!stream)
+        {
+            it = mStreams.erase(it);
+            continue;
+        }
+        stream->Render(buffers);
+        ++it;
+    }
+}
+
+void NullDevice::WaitEvents(unsigned max_milliseconds)
+{
+    double wait = max_milliseconds;
+    if (mParams.clock == Clock::Realtime)
+    {
+        // wait until the next buffer is due.
+        const auto now = std::chrono::steady_clock::now();
+        const auto pending = mPendingTime + std::chrono::duration<double, std::milli>(now - mLastPoll).count();
+        wait = std::min(wait, std::max(0.0, mBufferSize - pending));
+    }
+    else if (!mStreams.empty())
+    {
+        // with the simulated clock every poll renders a buffer
+        // so there's no point in waiting.
+        wait = 0.0;
+    }
+    Device::WaitEvents((unsigned)std::ceil(wait));
+}
+
+void NullDevice::Init()
+{
+    ASSERT(mState == State::None);
+    mLastPoll = std::chrono::steady_clock::now();
+    mState = State::Ready;
+}
+
+NullDevice::Stats NullDevice::GetStats() const
+{
+    std::lock_guard<decltype(mRecorder->mutex)> lock(mRecorder->mutex);
+    return mRecorder->stats;
+}
+
+std::vector<NullDevice::Output> NullDevice::TakeOutputs()
+{
+    std::lock_guard<decltype(mRecorder->mutex)> lock(mRecorder->mutex);
+    std::vector<Output> ret;
+    std::swap(ret, mRecorder->outputs);
+    return ret;
+}
+
+// static
+bool NullDevice::WriteWAV(const std::string& file, const Output& output)
+{
+    auto out = base::OpenBinaryOutputStream(file);
+    if (!out.is_open())
+    {
+        ERROR("Failed to open WAV file for writing. [file='%1']", file);
+        return false;
+    }
+    Format format;
+    format.channel_count = output.channels;
+    format.sample_rate   = output.sample_rate;
+    if (output.format == Source::Format::Float32)
+        format.sample_type = SampleType::Float32;
+    else if (output.format == Source::Format::Int32)
+        format.sample_type = SampleType::Int32;
+    else format.sample_type = SampleType::Int16;
+
+    const auto& wav = EncodeWav(format, output.pcm.data(), output.pcm.size());
+    out.write((const char*)wav.data(), wav.size());
+    if (!out.good())
+    {
+        ERROR("Failed to write WAV file. [file='%1']", file);
+        return false;
+    }
+    return true;
+}
+
+} // namespace
@@ -0,0 +1,129 @@
+// Copyright (C) 2020-2021 Sami Väisänen
+// Copyright (C) 2020-2021 Ensisoft http://www.ensisoft.com
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+#pragma once
+
+#include "config.h"
+
+#include <string>
+#include <vector>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <chrono>
+#include <cstdint>
+
+#include "audio/device.h"
+#include "audio/source.h"
+
+namespace audio
+{
+    // Audio device implementation that doesn't need any audio hardware
+    // or platform audio system. The PCM data is pulled from the sources
+    // when the device is polled and then either discarded or captured in
+    // memory. This is meant for running the audio system headless, for
+    // example for benchmarking the audio graphs and for regression tests.
+    // The time spent in each source callback is measured.
+    class NullDevice : public Device
+    {
+    public:
+        enum class Clock {
+            // Each call to Poll advances every playing stream by exactly
+            // one buffer regardless of the wall time. Polling in a loop
+            // renders the audio as fast as possible.
+            Simulated,
+            // Each call to Poll advances every playing stream by as many
+            // buffers as there's wall time elapsed since the previous poll.
+            // This works like a real device.
+            Realtime
+        };
+        struct Params {
+            Clock clock = Clock::Simulated;
+            // Keep the PCM data pulled from the sources in memory.
+            bool capture = false;
+        };
+        // Captured output of a stream.
+        struct Output {
+            std::string name;
+            Source::Format format = Source::Format::Float32;
+            unsigned sample_rate = 0;
+            unsigned channels    = 0;
+            std::vector<char> pcm;
+        };
+        // Source callback statistics over all streams.
+        struct Stats {
+            // The number of source callbacks (FillBuffer calls).
+            std::uint64_t callbacks = 0;
+            // The number of PCM bytes produced.
+            std::uint64_t bytes = 0;
+            // The amount of audio produced in milliseconds summed over
+            // all streams.
+            double audio_time = 0.0;
+            // Total and maximum time spent in the source callbacks in
+            // milliseconds.
+            double total_callback_time = 0.0;
+            double max_callback_time   = 0.0;
+            // The number of callbacks that took longer than the duration
+            // of the audio buffer they produced.
+            std::uint64_t deadline_misses = 0;
+            // The worst case time in milliseconds between a buffer becoming
+            // due and the device getting polled to render it. Only measured
+            // with the realtime clock.
+            double max_latency = 0.0;
+        };
+
+        NullDevice() = default;
+        explicit NullDevice(const Params& params)
+          : mParams(params)
+        {}
+        virtual std::shared_ptr<Stream> Prepare(std::unique_ptr<Source> source) override;
+        virtual void Poll() override;
+        virtual void WaitEvents(unsigned max_milliseconds) override;
+        virtual void Init() override;
+        virtual State GetState() const override
+        { return mState; }
+        virtual void SetBufferSize(unsigned milliseconds) override
+        { mBufferSize = milliseconds; }
+
+        // Get the current callback statistics.
+        Stats GetStats() const;
+        // Get the captured output of the streams that have finished
+        // (completed, failed or cancelled) so far. The outputs are
+        // removed from the device.
+        std::vector<Output> TakeOutputs();
+
+        // Write the captured PCM output into a WAV file.
+        static bool WriteWAV(const std::string& file, const Output& output);
+    private:
+        class PlaybackStream;
+        // State shared with the streams so that the output of a stream
+        // can be collected even if the stream outlives the device.
+        struct Recorder {
+            std::mutex mutex;
+            std::vector<Output> outputs;
+            Stats stats;
+        };
+    private:
+        const Params mParams;
+        State mState = State::None;
+        unsigned mBufferSize = 20;
+        std::list<std::weak_ptr<PlaybackStream>> mStreams;
+        std::shared_ptr<Recorder> mRecorder = std::make_shared<Recorder>();
+        std::chrono::steady_clock::time_point mLastPoll;
+        double mPendingTime = 0.0;
+    };
+
+} // namespace
@@ -22,6 +22,7 @@
 #endif
 
 #include <list>
+#include <algorithm>
 #include <chrono>
 #include <thread>
 
@@ -116,6 +117,12 @@ public:
             ++it;
         }
     }
+    virtual void WaitEvents(unsigned max_milliseconds) override
+    {
+        // OpenAL has no way to signal that a stream has processed its
+        // buffers so the streams need to be polled at short intervals.
+        Device::WaitEvents(mStreams.empty() ? max_milliseconds : std::min(max_milliseconds, 5u));
+    }
     virtual void Init() override
     {
         ASSERT(mContext == NULL);
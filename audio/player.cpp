@@ -26,6 +26,7 @@
 #include "audio/source.h"
 #include "audio/stream.h"
 #include "audio/command.h"
+#include "audio/worker.h"
 
 namespace {
 struct EnqueueCmd {
@@ -39,11 +40,14 @@ namespace audio
 {
 
 Player::Player(std::unique_ptr<Device> device)
+  :
 #if defined(AUDIO_LOCK_FREE_QUEUE)
-  : track_actions_(128)
+    track_actions_(128),
 #endif
+    events_(1024)
 {
 #if defined(AUDIO_USE_PLAYER_THREAD)
+    device_ = device.get();
     run_thread_.test_and_set(std::memory_order_acquire);
     thread_.reset(new std::thread(std::bind(&Player::AudioThreadLoop, this, device.get())));
     device.release();
@@ -58,7 +62,13 @@ Player::~Player()
 #if defined(AUDIO_USE_PLAYER_THREAD)
     // signal the audio thread to exit
     run_thread_.clear(std::memory_order_release);
+    WakeupAudioThread();
     thread_->join();
+
+    // discard any actions that the audio thread never got to.
+    Action action;
+    while (DequeueAction(&action))
+        delete action.cmd;
 #else
     for (auto& p : track_list_)
     {
@@ -129,12 +139,7 @@ void Player::AskProgress(std::size_t id)
 
 bool Player::GetEvent(Event* event)
 {
-    std::lock_guard<std::mutex> lock(event_mutex_);
-    if (events_.empty())
-        return false;
-    *event = std::move(events_.front());
-    events_.pop();
-    return true;
+    return events_.Pop(event);
 }
 
 #if !defined(AUDIO_USE_PLAYER_THREAD)
@@ -152,8 +157,24 @@ void Player::QueueAction(Action&& action)
     std::unique_lock<decltype(action_mutex_)> lock(action_mutex_);
     track_actions_.push(std::move(action));
 #endif
+
+#if defined(AUDIO_USE_PLAYER_THREAD)
+    // wake up the audio thread in order to have the action
+    // take effect without waiting for the device.
+    WakeupAudioThread();
+#endif
 }
 
+#if defined(AUDIO_USE_PLAYER_THREAD)
+void Player::WakeupAudioThread()
+{
+    // the mutex is only ever contended when the audio thread is exiting.
+    std::lock_guard<std::mutex> lock(device_mutex_);
+    if (device_)
+        device_->Wakeup();
+}
+#endif
+
 bool Player::DequeueAction(Action* action)
 {
 #if defined(AUDIO_LOCK_FREE_QUEUE)
@@ -172,10 +193,10 @@ void Player::AudioThreadLoop(Device* device)
 {
 #if defined(AUDIO_USE_PLAYER_THREAD)
     DEBUG("Hello from audio player thread.");
+
+    std::unique_ptr<Device> raii(device);
     try
     {
-        std::unique_ptr<Device> raii(device);
-
         // call device init on *this* thread in case the device
         // has thread affinity.
         device->Init();
@@ -185,12 +206,11 @@ void Player::AudioThreadLoop(Device* device)
         while (run_thread_.test_and_set(std::memory_order_acquire))
         {
             RunAudioUpdateOnce(*device, track_list);
-            // this wait is here to avoid "overheating the cpu" so to speak.
-            // however this creates two problems.
-            // a) it increases latency in terms of starting the playback of new audio sample.
-            // b) creates possibility for a buffer underruns in the audio playback stream.
-            // todo: probably need something more sophisticated ?
-            std::this_thread::sleep_for(std::chrono::milliseconds(5));
+            // wait until the device has something to do, for example a stream
+            // needs more data, or until the game thread queues a new action.
+            // the timeout is only a safety net for flushing events that didn't
+            // fit in the event queue.
+            device->WaitEvents(10);
         }
 
         // cancel pending audio streams
@@ -203,15 +223,48 @@ void Player::AudioThreadLoop(Device* device)
     {
         ERROR("Audio thread error. [error=%1]", e.what());
     }
+
+    // stop the game thread from waking up the device before it's
+    // destroyed. actions queued after this are simply never processed.
+    {
+        std::lock_guard<std::mutex> lock(device_mutex_);
+        device_ = nullptr;
+    }
+    raii.reset();
     DEBUG("Audio player thread exiting.");
 #endif
 }
 
+void Player::PushEvent(Event&& event)
+{
+    // the events must stay in order so if there are older events
+    // still waiting then this event must wait as well.
+    if (pending_events_.empty() && events_.Push(std::move(event)))
+        return;
+    pending_events_.push(std::move(event));
+}
+
+void Player::FlushEvents()
+{
+    while (!pending_events_.empty())
+    {
+        if (!events_.Push(std::move(pending_events_.front())))
+            return;
+        pending_events_.pop();
+    }
+}
+
 void Player::RunAudioUpdateOnce(Device& device, std::list<Track>& track_list)
 {
+    // the sources are processed (inside the device) on this thread
+    // so pick up the current worker pool for the audio graphs.
+    WorkerPool::SetCurrent(worker_pool_.load(std::memory_order_acquire));
+
     // iterate audio device state once. (dispatches stream/device state changes)
     device.Poll();
 
+    FlushEvents();
+
     // dispatch the queued track actions
     Action track_action;
     while (DequeueAction(&track_action))
@@ -226,8 +279,7 @@ void Player::RunAudioUpdateOnce(Device& device, std::list<Track>& track_list)
                 SourceCompleteEvent event;
                 event.id      = track_action.track_id;
                 event.status  = TrackStatus::Failure;
-                std::lock_guard<std::mutex> lock(event_mutex_);
-                events_.push(std::move(event));
+                PushEvent(std::move(event));
             }
             else
             {
@@ -274,8 +326,7 @@ void Player::RunAudioUpdateOnce(Device& device, std::list<Track>& track_list)
             event.id    = p.id;
             event.time  = p.stream->GetStreamTime();
             event.bytes = p.stream->GetStreamBytes();
-            std::lock_guard<std::mutex> lock(event_mutex_);
-            events_.push(std::move(event));
+            PushEvent(std::move(event));
         }
     }
 
@@ -290,8 +341,7 @@ void Player::RunAudioUpdateOnce(Device& device, std::list<Track>& track_list)
             SourceEvent ev;
             ev.id    = track.id;
             ev.event = std::move(event);
-            std::lock_guard<std::mutex> lock(event_mutex_);
-            events_.push(std::move(ev));
+            PushEvent(std::move(ev));
         }
 
         const auto state = track.stream->GetState();
@@ -304,8 +354,7 @@ void Player::RunAudioUpdateOnce(Device& device, std::list<Track>& track_list)
             event.status  = state == Stream::State::Complete
                             ? TrackStatus::Success
                             : TrackStatus::Failure;
-            std::lock_guard<std::mutex> lock(event_mutex_);
-            events_.push(std::move(event));
+            PushEvent(std::move(event));
             source->Shutdown();
             it = track_list.erase(it);
         }
@@ -30,12 +30,14 @@
 #endif
 
 #include "audio/command.h"
+#include "audio/queue.h"
 
 namespace audio
 {
     class Device;
     class Stream;
     class Source;
+    class WorkerPool;
 
     // Play audio samples using the given audio device. Once audio 
     // is played the results are stored in TrackEvents which can be
@@ -111,10 +113,18 @@ namespace audio
         // Ask for a stream progress event for some particular track.
         void AskProgress(std::size_t id);
 
-        // Get next playback event if any.
+        // Get next playback event if any. The events are delivered through
+        // a wait-free queue so this never blocks the audio thread. Only one
+        // thread may call GetEvent.
         // Returns true if there was an event otherwise false.
         bool GetEvent(Event* event);
 
+        // Set the worker pool for processing the audio graphs of the
+        // played sources in parallel. The pool must outlive the player.
+        // nullptr to process the sources serially on the audio thread.
+        void SetWorkerPool(WorkerPool* pool)
+        { worker_pool_.store(pool, std::memory_order_release); }
+
 #if !defined(AUDIO_USE_PLAYER_THREAD)
         void ProcessOnce();
 #endif
@@ -140,6 +150,14 @@ namespace audio
         };
         void QueueAction(Action&& action);
         bool DequeueAction(Action* action);
+        // Push a new event for the game thread. Only call on the audio thread.
+        void PushEvent(Event&& event);
+        // Push the events that didn't previously fit in the event queue.
+        void FlushEvents();
+#if defined(AUDIO_USE_PLAYER_THREAD)
+        // Wake up the audio thread if it's still running.
+        void WakeupAudioThread();
+#endif
     private:
 #if defined(AUDIO_LOCK_FREE_QUEUE)
         // queue of actions for tracks (pause/resume)
@@ -150,16 +168,25 @@ namespace audio
 #endif
         // unique track id
         std::size_t trackid_ = 1;
+        // the worker pool for processing the sources if any.
+        std::atomic<WorkerPool*> worker_pool_ = {nullptr};
 
-        // queue of track completion events of tracks
-        // that were played.
-        std::mutex event_mutex_;
-        std::queue<Event> events_;
+        // queue of events from the audio thread to the game thread.
+        SpscQueue<Event> events_;
+        // events that didn't fit in the event queue when it was full.
+        // only touched by the audio thread.
+        std::queue<Event> pending_events_;
 
 #if defined(AUDIO_USE_PLAYER_THREAD)
         // audio thread stop flag
         std::atomic_flag run_thread_ = ATOMIC_FLAG_INIT;
         std::unique_ptr<std::thread> thread_;
+        // the device owned by the audio thread. only used for waking
+        // up the audio thread when there are new actions. the audio
+        // thread resets this under the mutex before destroying the
+        // device so it's only valid while the audio thread is alive.
+        std::mutex device_mutex_;
+        Device* device_ = nullptr;
 #else
         std::list<Track> track_list_;
         std::unique_ptr<Device> device_;
@@ -106,6 +106,23 @@ public:
         pa_mainloop_iterate(loop_, 0, nullptr);
     }
 
+    virtual void WaitEvents(unsigned max_milliseconds) override
+    {
+        // block in the main loop until there's activity on the PA
+        // connection (such as a stream write request), a wakeup or
+        // a timeout and then dispatch whatever happened.
+        if (pa_mainloop_prepare(loop_, max_milliseconds * 1000) < 0)
+            return;
+        if (pa_mainloop_poll(loop_) < 0)
+            return;
+        pa_mainloop_dispatch(loop_);
+    }
+
+    virtual void Wakeup() override
+    {
+        pa_mainloop_wakeup(loop_);
+    }
+
     virtual void Init() override
     { }
 
@@ -0,0 +1,90 @@
+// Copyright (C) 2020-2021 Sami Väisänen
+// Copyright (C) 2020-2021 Ensisoft http://www.ensisoft.com
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+#pragma once
+
+#include "config.h"
+
+#include <vector>
+#include <atomic>
+#include <cstddef>
+
+namespace audio
+{
+    // Bounded wait-free queue for passing objects from exactly one
+    // producer thread to exactly one consumer thread, for example
+    // events from the audio thread to the game thread. Neither side
+    // ever blocks or allocates. When the queue is full Push fails and
+    // it's up to the producer to decide what to do with the object.
+    // The object type must be default constructible and move assignable.
+    template<typename T>
+    class SpscQueue
+    {
+    public:
+        // Create a new queue that can hold up to capacity objects.
+        explicit SpscQueue(std::size_t capacity)
+          : mSlots(capacity + 1)
+        {}
+        SpscQueue(const SpscQueue&) = delete;
+
+        // Push a new object to the end of the queue. Only call on the
+        // producer thread. Returns false if the queue is full in which
+        // case the object is not moved from.
+        bool Push(T&& value)
+        {
+            const auto tail = mTail.load(std::memory_order_relaxed);
+            const auto next = Next(tail);
+            if (next == mHead.load(std::memory_order_acquire))
+                return false;
+            mSlots[tail] = std::move(value);
+            mTail.store(next, std::memory_order_release);
+            return true;
+        }
+        // Pop the object at the front of the queue. Only call on the
+        // consumer thread. Returns false if the queue is empty.
+        bool Pop(T* value)
+        {
+            const auto head = mHead.load(std::memory_order_relaxed);
+            if (head == mTail.load(std::memory_order_acquire))
+                return false;
+            *value = std::move(mSlots[head]);
+            mHead.store(Next(head), std::memory_order_release);
+            return true;
+        }
+        // Check whether the queue is currently empty. The result
+        // is only a snapshot when called from the producer thread.
+        bool IsEmpty() const
+        {
+            return mHead.load(std::memory_order_acquire) ==
+                   mTail.load(std::memory_order_acquire);
+        }
+        std::size_t GetCapacity() const
+        { return mSlots.size() - 1; }
+
+        SpscQueue& operator=(const SpscQueue&) = delete;
+    private:
+        std::size_t Next(std::size_t index) const
+        { return index + 1 == mSlots.size() ? 0 : index + 1; }
+    private:
+        // The consumer and the producer indices are kept on separate
+        // cache lines so that the threads don't keep invalidating
+        // each other's cache line.
+        alignas(64) std::atomic<std::size_t> mHead = {0};
+        alignas(64) std::atomic<std::size_t> mTail = {0};
+        std::vector<T> mSlots;
+    };
+
+} // namespace
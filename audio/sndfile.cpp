@@ -49,6 +49,8 @@ size_t SndFileDecoder::ReadFrames(int* ptr, size_t frames)
 
 void SndFileDecoder::Reset()
 { sf_seek(mFile, 0, SEEK_SET); }
+bool SndFileDecoder::Seek(unsigned frame)
+{ return sf_seek(mFile, frame, SEEK_SET) == sf_count_t(frame); }
 
 bool SndFileDecoder::Open(std::shared_ptr<const SourceStream> source)
 {
@@ -16,16 +16,32 @@
 
 #include "config.h"
 
+#include <algorithm>
 #include <iostream>
 #include <string>
+#include <random>
+#include <thread>
+#include <chrono>
+#include <cstring>
+#include <fstream>
+#include <cmath>
 
 #include "base/test_minimal.h"
 #include "base/test_float.h"
+#include "base/test_help.h"
 #include "base/logging.h"
+#include "base/math.h"
 #include "data/json.h"
 #include "audio/element.h"
 #include "audio/graph.h"
 #include "audio/loader.h"
+#include "audio/decoder.h"
+#include "audio/stream.h"
+#include "audio/null.h"
+#include "audio/worker.h"
+#include "audio/wav.h"
+#include "audio/queue.h"
+#include "audio/player.h"
 
 class TestBuffer : public audio::Buffer
 {
@@ -816,6 +832,1628 @@ void unit_test_oversized_buffer()
     }
 }
 
+void unit_test_buffer_pool()
+{
+    // buffers are recycled once they're no longer used.
+    {
+        audio::BufferPool pool;
+        auto a = pool.Allocate(100);
+        TEST_REQUIRE(a->GetCapacity() >= 100);
+        TEST_REQUIRE(a->GetByteSize() == 0);
+        a->SetByteSize(100);
+        a->AddInfoTag(audio::Buffer::InfoTag{});
+        const void* ptr = a->GetPtr();
+
+        // still in use, need a new buffer.
+        auto b = pool.Allocate(100);
+        TEST_REQUIRE(b->GetPtr() != ptr);
+        TEST_REQUIRE(pool.GetStats().allocations == 2);
+
+        a.reset();
+        auto c = pool.Allocate(50);
+        TEST_REQUIRE(c->GetPtr() == ptr);
+        TEST_REQUIRE(c->GetByteSize() == 0);
+        TEST_REQUIRE(c->GetNumInfoTags() == 0);
+        TEST_REQUIRE(pool.GetStats().allocations == 2);
+        TEST_REQUIRE(pool.GetStats().requests == 3);
+        TEST_REQUIRE(pool.GetStats().buffers == 2);
+
+        // different size class needs a new buffer.
+        auto d = pool.Allocate(4096);
+        TEST_REQUIRE(d->GetCapacity() >= 4096);
+        TEST_REQUIRE(pool.GetStats().allocations == 3);
+
+        b.reset();
+        d.reset();
+        pool.Purge();
+        TEST_REQUIRE(pool.GetStats().buffers == 1);
+    }
+
+    // steady state playback doesn't allocate any more buffers.
+    {
+        audio::Format format;
+        format.channel_count = 2;
+        format.sample_rate   = 16000;
+        format.sample_type   = audio::SampleType::Float32;
+
+        audio::Graph graph("graph");
+        graph.AddElement(audio::ZeroSource("zero0", "zero0", format));
+        graph.AddElement(audio::ZeroSource("zero1", "zero1", format));
+        graph.AddElement(audio::Mixer("mixer", "mixer", 2));
+        TEST_REQUIRE(graph.LinkElements("zero0", "out", "mixer", "in0"));
+        TEST_REQUIRE(graph.LinkElements("zero1", "out", "mixer", "in1"));
+        TEST_REQUIRE(graph.LinkGraph("mixer", "out"));
+
+        audio::Loader loader;
+        audio::AudioGraph source("graph", std::move(graph));
+        audio::AudioGraph::PrepareParams p;
+        TEST_REQUIRE(source.Prepare(loader, p));
+
+        std::vector<uint8_t> buffer;
+        buffer.resize(audio::GetMillisecondByteCount(format) * 5);
+        for (int i=0; i<10; ++i)
+            TEST_REQUIRE(source.FillBuffer(&buffer[0], buffer.size()) == buffer.size());
+
+        const auto allocations = source.GetBufferStats().allocations;
+        for (int i=0; i<100; ++i)
+            TEST_REQUIRE(source.FillBuffer(&buffer[0], buffer.size()) == buffer.size());
+        TEST_REQUIRE(source.GetBufferStats().allocations == allocations);
+        TEST_REQUIRE(source.GetBufferStats().requests > allocations);
+    }
+}
+
+std::string MakeRandomPCM(const audio::Format& format, unsigned frames, unsigned seed)
+{
+    std::mt19937 gen(seed);
+    const auto samples = frames * format.channel_count;
+    std::string pcm;
+    if (format.sample_type == audio::SampleType::Float32)
+    {
+        // floats are allowed to go beyond the -1.0f - 1.0f range.
+        std::uniform_real_distribution<float> dist(-1.5f, 1.5f);
+        std::vector<float> data(samples);
+        for (auto& sample : data)
+            sample = dist(gen);
+        pcm.assign((const char*)data.data(), samples * sizeof(float));
+    }
+    else if (format.sample_type == audio::SampleType::Int16)
+    {
+        std::uniform_int_distribution<int> dist(-32767, 32767);
+        std::vector<short> data(samples);
+        for (auto& sample : data)
+            sample = dist(gen);
+        pcm.assign((const char*)data.data(), samples * sizeof(short));
+    }
+    return pcm;
+}
+
+void PrepareElement(audio::Element& element, const audio::Format& format)
+{
+    audio::Loader loader;
+    audio::Element::PrepareParams p;
+    for (unsigned i=0; i<element.GetNumInputPorts(); ++i)
+        element.GetInputPort(i).SetFormat(format);
+    TEST_REQUIRE(element.Prepare(loader, p));
+}
+
+std::string RunElement(audio::Element& element, const audio::Format& format, const std::vector<std::string>& inputs)
+{
+    for (unsigned i=0; i<inputs.size(); ++i)
+    {
+        auto buffer = std::make_shared<audio::VectorBuffer>(inputs[i].size());
+        buffer->SetFormat(format);
+        buffer->CopyData(inputs[i].data(), inputs[i].size());
+        TEST_REQUIRE(element.GetInputPort(i).PushBuffer(buffer));
+    }
+    audio::BufferAllocator allocator;
+    audio::Element::EventQueue events;
+    element.Process(allocator, events, 10);
+
+    audio::BufferHandle buffer;
+    TEST_REQUIRE(element.GetOutputPort(0).PullBuffer(buffer));
+    return std::string((const char*)buffer->GetPtr(), buffer->GetByteSize());
+}
+
+std::string ProcessElement(audio::Element& element, const audio::Format& format, const std::vector<std::string>& inputs)
+{
+    PrepareElement(element, format);
+    return RunElement(element, format, inputs);
+}
+
+void unit_test_simd_kernels()
+{
+    const audio::Format formats[] = {
+        {audio::SampleType::Float32, 44100, 1},
+        {audio::SampleType::Float32, 44100, 2},
+        {audio::SampleType::Int16,   44100, 1},
+        {audio::SampleType::Int16,   44100, 2}
+    };
+    for (const auto& format : formats)
+    {
+        // odd sizes for testing the tails after the SIMD blocks.
+        const auto& a = MakeRandomPCM(format, 1003, 1);
+        const auto& b = MakeRandomPCM(format, 777, 2);
+        const auto& c = MakeRandomPCM(format, 1000, 3);
+
+        std::string results[2][6];
+        for (int i=0; i<2; ++i)
+        {
+            audio::EnableAudioSIMD(i == 1);
+
+            audio::Gain gain("gain", 0.75f);
+            results[i][0] = ProcessElement(gain, format, {a});
+
+            audio::Gain loud("gain", 200.0f);
+            results[i][1] = ProcessElement(loud, format, {a});
+
+            audio::Mixer mixer("mixer", 3);
+            results[i][2] = ProcessElement(mixer, format, {a, b, c});
+
+            audio::Effect effect("effect", 5, 15, audio::Effect::Kind::FadeIn);
+            results[i][3] = ProcessElement(effect, format, {a});
+
+            audio::Gain ramp("gain", 1.0f);
+            PrepareElement(ramp, format);
+            ramp.SetGain(0.25f);
+            results[i][4] = RunElement(ramp, format, {a});
+
+            audio::Compressor compressor("compressor", -6.0f, 4.0f, 1.0f, 10.0f, 3.0f);
+            results[i][5] = ProcessElement(compressor, format, {a});
+        }
+        for (int j=0; j<6; ++j)
+        {
+            TEST_REQUIRE(results[0][j].size() == results[1][j].size());
+            TEST_REQUIRE(results[0][j] == results[1][j]);
+        }
+        // the mixer output is the size of the longest input.
+        TEST_REQUIRE(results[0][2].size() == a.size());
+    }
+
+    // check the scalar mixing against known values.
+    {
+        audio::EnableAudioSIMD(false);
+
+        const audio::Format format = {audio::SampleType::Int16, 8000, 1};
+        const short a[] = {100, -100, 32767, -32767, 1};
+        const short b[] = {200, -200, 32767, -32767};
+        audio::Mixer mixer("mixer", 2);
+        const auto& ret = ProcessElement(mixer, format, {
+            std::string((const char*)a, sizeof(a)),
+            std::string((const char*)b, sizeof(b))
+        });
+        TEST_REQUIRE(ret.size() == sizeof(a));
+        const auto* out = (const short*)ret.data();
+        TEST_REQUIRE(out[0] == 150);
+        TEST_REQUIRE(out[1] == -150);
+        // the integer sum is truncated after each source.
+        TEST_REQUIRE(out[2] == 32766);
+        TEST_REQUIRE(out[3] == -32766);
+        TEST_REQUIRE(out[4] == 0);
+    }
+    audio::EnableAudioSIMD(true);
+}
+
+void perf_test_audio_kernels()
+{
+    base::EnableDebugLog(false);
+
+    const audio::Format formats[] = {
+        {audio::SampleType::Float32, 48000, 2},
+        {audio::SampleType::Int16,   48000, 2}
+    };
+    for (const auto& format : formats)
+    {
+        // 32 sources with 10ms worth of audio each.
+        std::vector<std::string> srcs;
+        for (unsigned i=0; i<32; ++i)
+            srcs.push_back(MakeRandomPCM(format, 480, i));
+
+        const std::string type = format.sample_type == audio::SampleType::Float32 ? "float" : "int16";
+
+        for (int i=0; i<2; ++i)
+        {
+            const bool simd = i == 1;
+            audio::EnableAudioSIMD(simd);
+            const std::string suffix = simd ? (audio::IsAudioSIMDEnabled() ? " (SIMD)" : " (SIMD not available)") : " (scalar)";
+
+            audio::Mixer mixer("mixer", 32);
+            PrepareElement(mixer, format);
+            auto test = base::TimedTest(1000, [&]() {
+                RunElement(mixer, format, srcs);
+            });
+            base::PrintTestTimes(("Mix 32x10ms " + type + suffix).c_str(), test);
+
+            audio::Gain gain("gain", 0.5f);
+            PrepareElement(gain, format);
+            test = base::TimedTest(1000, [&]() {
+                for (unsigned i=0; i<32; ++i)
+                    RunElement(gain, format, {srcs[i]});
+            });
+            base::PrintTestTimes(("Gain 32x10ms " + type + suffix).c_str(), test);
+
+            // long fade so that every buffer is processed.
+            audio::Effect effect("effect", 0, 1000000, audio::Effect::Kind::FadeOut);
+            PrepareElement(effect, format);
+            test = base::TimedTest(1000, [&]() {
+                for (unsigned i=0; i<32; ++i)
+                    RunElement(effect, format, {srcs[i]});
+            });
+            base::PrintTestTimes(("Fade 32x10ms " + type + suffix).c_str(), test);
+
+            audio::Compressor compressor("compressor", -12.0f, 4.0f, 10.0f, 100.0f, 3.0f);
+            PrepareElement(compressor, format);
+            test = base::TimedTest(1000, [&]() {
+                for (unsigned i=0; i<32; ++i)
+                    RunElement(compressor, format, {srcs[i]});
+            });
+            base::PrintTestTimes(("Compressor 32x10ms " + type + suffix).c_str(), test);
+
+            if (format.sample_type != audio::SampleType::Float32)
+                continue;
+
+            // the filter has no SIMD path but is measured
+            // with both settings for comparison.
+            audio::BiquadFilter filter("filter", audio::BiquadFilter::Type::LowPass, 1000.0f);
+            PrepareElement(filter, format);
+            test = base::TimedTest(1000, [&]() {
+                for (unsigned i=0; i<32; ++i)
+                    RunElement(filter, format, {srcs[i]});
+            });
+            base::PrintTestTimes(("Biquad 32x10ms " + type + suffix).c_str(), test);
+        }
+    }
+    audio::EnableAudioSIMD(true);
+}
+
+// Decoder that produces a ramp of sample values where each sample
+// (for each channel) in a frame is the frame index.
+class RampDecoder : public audio::Decoder
+{
+public:
+    RampDecoder(unsigned frames, unsigned channels = 2)
+      : mFrames(frames)
+      , mChannels(channels)
+    {}
+    virtual unsigned GetSampleRate() const override
+    { return 44100; }
+    virtual unsigned GetNumChannels() const override
+    { return mChannels; }
+    virtual unsigned GetNumFrames() const override
+    { return mFrames; }
+    virtual size_t ReadFrames(float* ptr, size_t frames) override
+    { TEST_REQUIRE(!"not implemented."); return 0; }
+    virtual size_t ReadFrames(short* ptr, size_t frames) override
+    { TEST_REQUIRE(!"not implemented."); return 0; }
+    virtual size_t ReadFrames(int* ptr, size_t frames) override
+    {
+        while (mStall)
+            std::this_thread::yield();
+        if (mThrowAt && mFrame >= mThrowAt)
+            throw std::runtime_error("decoder error");
+        const auto ret = std::min(frames, size_t(mFrames - mFrame));
+        for (size_t i=0; i<ret; ++i, ++mFrame)
+        {
+            for (unsigned c=0; c<mChannels; ++c)
+                *ptr++ = (int)mFrame;
+        }
+        return ret;
+    }
+    virtual void Reset() override
+    { mFrame = 0; }
+    virtual bool Seek(unsigned frame) override
+    {
+        if (!mSeekable)
+            return false;
+        mFrame = std::min(frame, mFrames);
+        return true;
+    }
+    void ThrowAt(unsigned frame)
+    { mThrowAt = frame; }
+    void Stall(bool on_off)
+    { mStall = on_off; }
+    void EnableSeek(bool on_off)
+    { mSeekable = on_off; }
+private:
+    const unsigned mFrames = 0;
+    const unsigned mChannels = 0;
+    unsigned mFrame = 0;
+    unsigned mThrowAt = 0;
+    bool mSeekable = false;
+    std::atomic<bool> mStall = {false};
+};
+
+bool ReadRamp(audio::Decoder& decoder, unsigned frames, unsigned first, unsigned chunk)
+{
+    std::vector<int> buffer;
+    unsigned expected = first;
+    unsigned frames_read = 0;
+    while (frames_read < frames)
+    {
+        const auto count = std::min(chunk, frames - frames_read);
+        buffer.resize(count * 2);
+        const auto ret = decoder.ReadFrames(buffer.data(), count);
+        if (ret != count)
+            return false;
+        for (unsigned i=0; i<count; ++i, ++expected)
+        {
+            if (buffer[i*2+0] != (int)expected || buffer[i*2+1] != (int)expected)
+                return false;
+        }
+        frames_read += count;
+    }
+    return true;
+}
+
+// Read a ramp out of a read ahead decoder without underruns by
+// waiting for the decoder thread to decode each chunk first.
+bool ReadAheadRamp(audio::ReadAheadDecoder& decoder, unsigned frames, unsigned first, unsigned chunk)
+{
+    unsigned frames_read = 0;
+    while (frames_read < frames)
+    {
+        const auto count = std::min(chunk, frames - frames_read);
+        while (decoder.GetNumBufferedFrames() < count)
+            std::this_thread::yield();
+        if (!ReadRamp(decoder, count, first + frames_read, count))
+            return false;
+        frames_read += count;
+    }
+    return decoder.GetNumUnderruns() == 0;
+}
+
+void unit_test_read_ahead_decoder()
+{
+    audio::ReadAheadDecoder::Params params;
+    params.block_frames = 100;
+    params.num_blocks   = 4;
+
+    // read the whole stream in chunks that don't align with the blocks.
+    {
+        audio::ReadAheadDecoder decoder(std::make_unique<RampDecoder>(1000),
+                                        audio::SampleType::Int32, params);
+        TEST_REQUIRE(decoder.GetNumFrames() == 1000);
+        TEST_REQUIRE(decoder.GetNumChannels() == 2);
+        TEST_REQUIRE(decoder.GetSampleRate() == 44100);
+        TEST_REQUIRE(ReadAheadRamp(decoder, 1000, 0, 33));
+
+        // end of stream.
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+        int frame[2];
+        TEST_REQUIRE(decoder.ReadFrames(frame, 1) == 0);
+        TEST_REQUIRE(decoder.GetNumUnderruns() == 0);
+    }
+
+    // the decoder thread decodes ahead but no further than the ring.
+    {
+        audio::ReadAheadDecoder decoder(std::make_unique<RampDecoder>(1000),
+                                        audio::SampleType::Int32, params);
+        while (decoder.GetNumBufferedFrames() != 400)
+            std::this_thread::yield();
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+        TEST_REQUIRE(decoder.GetNumBufferedFrames() == 400);
+
+        TEST_REQUIRE(ReadRamp(decoder, 150, 0, 150));
+        TEST_REQUIRE(decoder.GetNumBufferedFrames() <= 400);
+        TEST_REQUIRE(decoder.GetNumBufferedFrames() >= 250);
+    }
+
+    // reset for looping after the stream has been read.
+    {
+        audio::ReadAheadDecoder decoder(std::make_unique<RampDecoder>(250),
+                                        audio::SampleType::Int32, params);
+        for (int i=0; i<3; ++i)
+        {
+            TEST_REQUIRE(ReadAheadRamp(decoder, 250, 0, 64));
+            decoder.Reset();
+        }
+    }
+
+    // reset in the middle of the stream. the blocks decoded before
+    // the reset are discarded.
+    {
+        audio::ReadAheadDecoder decoder(std::make_unique<RampDecoder>(1000),
+                                        audio::SampleType::Int32, params);
+        TEST_REQUIRE(ReadAheadRamp(decoder, 321, 0, 50));
+        while (decoder.GetNumBufferedFrames() != 400 - 21)
+            std::this_thread::yield();
+        decoder.Reset();
+        TEST_REQUIRE(ReadAheadRamp(decoder, 1000, 0, 77));
+    }
+
+    // seek is done by the decoder thread either by seeking the wrapped
+    // decoder or by decoding up to the seek position.
+    for (bool seekable : {true, false})
+    {
+        auto ramp = std::make_unique<RampDecoder>(1000);
+        ramp->EnableSeek(seekable);
+        audio::ReadAheadDecoder decoder(std::move(ramp), audio::SampleType::Int32, params);
+        TEST_REQUIRE(ReadAheadRamp(decoder, 100, 0, 50));
+        TEST_REQUIRE(decoder.Seek(650));
+        TEST_REQUIRE(ReadAheadRamp(decoder, 350, 650, 70));
+        TEST_REQUIRE(decoder.Seek(10));
+        TEST_REQUIRE(ReadAheadRamp(decoder, 90, 10, 45));
+    }
+
+    // underrun fills silence without waiting for the decoder thread
+    // and the stream continues in sync once the decoder catches up.
+    {
+        auto ramp = std::make_unique<RampDecoder>(1000);
+        auto* ptr = ramp.get();
+        ptr->Stall(true);
+        audio::ReadAheadDecoder decoder(std::move(ramp), audio::SampleType::Int32, params);
+
+        std::vector<int> buffer(50 * 2, -1);
+        TEST_REQUIRE(decoder.ReadFrames(buffer.data(), 50) == 50);
+        TEST_REQUIRE(std::all_of(buffer.begin(), buffer.end(), [](int sample) { return sample == 0; }));
+        TEST_REQUIRE(decoder.GetNumUnderruns() == 1);
+        TEST_REQUIRE(decoder.GetNumUnderrunFrames() == 50);
+
+        ptr->Stall(false);
+        while (decoder.GetNumBufferedFrames() < 100)
+            std::this_thread::yield();
+        TEST_REQUIRE(ReadRamp(decoder, 100, 50, 100));
+        TEST_REQUIRE(decoder.GetNumUnderruns() == 1);
+    }
+
+    // decoder exception is propagated to the reader.
+    {
+        auto ramp = std::make_unique<RampDecoder>(1000);
+        ramp->ThrowAt(200);
+        audio::ReadAheadDecoder decoder(std::move(ramp), audio::SampleType::Int32, params);
+        TEST_REQUIRE(ReadAheadRamp(decoder, 200, 0, 50));
+        bool exception = false;
+        for (int i=0; i<1000 && !exception; ++i)
+        {
+            try
+            {
+                int frame[2];
+                decoder.ReadFrames(frame, 1);
+                std::this_thread::sleep_for(std::chrono::milliseconds(1));
+            }
+            catch (const std::exception& e)
+            {
+                exception = true;
+            }
+        }
+        TEST_REQUIRE(exception);
+    }
+
+    const auto& stats = audio::ReadAheadDecoder::GetStats();
+    TEST_REQUIRE(stats.decoders == 0);
+    TEST_REQUIRE(stats.depth_ms == 0);
+}
+
+std::vector<char> RenderSine(audio::NullDevice& device, unsigned millisecs)
+{
+    audio::Format format;
+    format.channel_count = 2;
+    format.sample_rate   = 44100;
+    format.sample_type   = audio::SampleType::Float32;
+
+    audio::Graph graph("graph");
+    graph.AddElement(audio::SineSource("sine", format, 440, millisecs));
+    TEST_REQUIRE(graph.LinkGraph("sine", "out"));
+
+    audio::Loader loader;
+    auto source = std::make_unique<audio::AudioGraph>("sine", std::move(graph));
+    audio::AudioGraph::PrepareParams p;
+    TEST_REQUIRE(source->Prepare(loader, p));
+
+    auto stream = device.Prepare(std::move(source));
+    TEST_REQUIRE(stream);
+    TEST_REQUIRE(stream->GetState() == audio::Stream::State::Ready);
+
+    // paused stream doesn't produce anything.
+    device.Poll();
+    TEST_REQUIRE(stream->GetStreamBytes() == 0);
+
+    stream->Play();
+    for (unsigned i=0; i<1000 && stream->GetState() == audio::Stream::State::Ready; ++i)
+        device.Poll();
+    TEST_REQUIRE(stream->GetState() == audio::Stream::State::Complete);
+    TEST_REQUIRE(stream->GetStreamTime() == millisecs);
+    TEST_REQUIRE(stream->GetStreamBytes() == millisecs * 44 * 8);
+
+    auto outputs = device.TakeOutputs();
+    TEST_REQUIRE(outputs.size() == 1);
+    TEST_REQUIRE(outputs[0].name == "sine");
+    TEST_REQUIRE(outputs[0].channels == 2);
+    TEST_REQUIRE(outputs[0].sample_rate == 44100);
+    TEST_REQUIRE(outputs[0].format == audio::Source::Format::Float32);
+    TEST_REQUIRE(outputs[0].pcm.size() == stream->GetStreamBytes());
+    return std::move(outputs[0].pcm);
+}
+
+void unit_test_null_device()
+{
+    audio::NullDevice::Params params;
+    params.capture = true;
+    audio::NullDevice device(params);
+    device.SetBufferSize(20);
+    device.Init();
+    TEST_REQUIRE(device.GetState() == audio::Device::State::Ready);
+
+    // one buffer per poll with the simulated clock.
+    const auto& first = RenderSine(device, 1000);
+    auto stats = device.GetStats();
+    TEST_REQUIRE(stats.callbacks == 50);
+    TEST_REQUIRE(stats.bytes == first.size());
+    TEST_REQUIRE(stats.audio_time == real::float32(1000.0f));
+    TEST_REQUIRE(stats.max_callback_time <= stats.total_callback_time);
+
+    // rendering is deterministic.
+    const auto& second = RenderSine(device, 1000);
+    TEST_REQUIRE(first == second);
+    stats = device.GetStats();
+    TEST_REQUIRE(stats.callbacks == 100);
+
+    audio::NullDevice::Output output;
+    output.name        = "sine";
+    output.format      = audio::Source::Format::Float32;
+    output.channels    = 2;
+    output.sample_rate = 44100;
+    output.pcm         = first;
+    TEST_REQUIRE(audio::NullDevice::WriteWAV("null-device.wav", output));
+    const auto& wav = base::LoadBinaryFile("null-device.wav");
+    TEST_REQUIRE(wav.size() == 44 + first.size());
+    TEST_REQUIRE(std::memcmp(&wav[0], "RIFF", 4) == 0);
+    TEST_REQUIRE(std::memcmp(&wav[8], "WAVE", 4) == 0);
+    TEST_REQUIRE(std::memcmp(&wav[44], &first[0], first.size()) == 0);
+}
+
+void unit_test_voice_limits()
+{
+    audio::Format format;
+    format.channel_count = 2;
+    format.sample_rate   = 44100;
+    format.sample_type   = audio::SampleType::Float32;
+
+    audio::Loader loader;
+    audio::Element::PrepareParams p;
+    audio::BufferAllocator allocator;
+    audio::Element::EventQueue events;
+
+    std::vector<std::string> done;
+    audio::MixerSource::VoiceCountEvent voices;
+
+    auto Process = [&](audio::MixerSource& mixer, unsigned millisecs) {
+        mixer.Process(allocator, events, millisecs);
+        audio::BufferHandle buffer;
+        mixer.GetOutputPort(0).PullBuffer(buffer);
+        while (!events.empty())
+        {
+            auto event = std::move(events.front());
+            events.pop();
+            if (auto* ptr = event->GetIf<audio::MixerSource::SourceDoneEvent>())
+                done.push_back(ptr->src->GetName());
+            else if (auto* ptr = event->GetIf<audio::MixerSource::VoiceCountEvent>())
+                voices = *ptr;
+        }
+    };
+    auto IsDone = [&done](const std::string& name) {
+        return std::find(done.begin(), done.end(), name) != done.end();
+    };
+
+    // group voice limit steals the oldest voices and virtual voices
+    // keep their time.
+    {
+        audio::MixerSource mixer("mixer", format);
+        TEST_REQUIRE(mixer.Prepare(loader, p));
+
+        auto AddSine = [&](const std::string& name, unsigned millisecs, const audio::MixerSource::VoiceParams& voice) {
+            auto sine = std::make_unique<audio::SineSource>(name, format, 440, millisecs);
+            TEST_REQUIRE(sine->Prepare(loader, p));
+            mixer.AddSourcePtr(std::move(sine), false, voice);
+        };
+
+        audio::MixerSource::VoiceParams laser;
+        laser.group      = "laser";
+        laser.max_voices = 2;
+        AddSine("a", 1000, laser);
+        AddSine("b", 1000, laser);
+        AddSine("c", 1000, laser);
+        Process(mixer, 10);
+        TEST_REQUIRE(done.size() == 1);
+        TEST_REQUIRE(IsDone("a"));
+        TEST_REQUIRE(voices.active == 2);
+        TEST_REQUIRE(voices.virtualized == 0);
+        TEST_REQUIRE(voices.stolen == 1);
+
+        // higher priority voice is audible and the rest are virtual.
+        audio::MixerSource::VoiceParams alarm;
+        alarm.priority = 1;
+        mixer.SetMaxVoices(1);
+        AddSine("d", 200, alarm);
+        Process(mixer, 10);
+        TEST_REQUIRE(voices.active == 1);
+        TEST_REQUIRE(voices.virtualized == 2);
+        TEST_REQUIRE(voices.stolen == 1);
+
+        for (unsigned i=0; i<19; ++i)
+            Process(mixer, 10);
+        TEST_REQUIRE(IsDone("d"));
+        Process(mixer, 10);
+        TEST_REQUIRE(voices.active == 1);
+        TEST_REQUIRE(voices.virtualized == 1);
+
+        // b and c end at the same time regardless of c being
+        // audible and b being virtual.
+        for (unsigned i=0; i<77; ++i)
+            Process(mixer, 10);
+        TEST_REQUIRE(!IsDone("b"));
+        TEST_REQUIRE(!IsDone("c"));
+        Process(mixer, 10);
+        TEST_REQUIRE(IsDone("b"));
+        TEST_REQUIRE(IsDone("c"));
+        TEST_REQUIRE(mixer.IsSourceDone());
+        TEST_REQUIRE(voices.active == 0);
+        TEST_REQUIRE(voices.virtualized == 0);
+    }
+
+    // a source that can't skip is stolen instead of being virtualized.
+    {
+        done.clear();
+
+        audio::MixerSource mixer("mixer", format);
+        TEST_REQUIRE(mixer.Prepare(loader, p));
+        mixer.SetMaxVoices(1);
+
+        auto sine = std::make_unique<audio::SineSource>("sine", format, 440, 1000);
+        TEST_REQUIRE(sine->Prepare(loader, p));
+        mixer.AddSourcePtr(std::move(sine));
+
+        audio::MixerSource::VoiceParams low;
+        low.priority = -1;
+        auto src = std::make_unique<SrcElement>("src", "src");
+        src->GetOutputPort(0).SetFormat(format);
+        mixer.AddSourcePtr(std::move(src), false, low);
+
+        Process(mixer, 10);
+        TEST_REQUIRE(done.size() == 1);
+        TEST_REQUIRE(IsDone("src"));
+        TEST_REQUIRE(voices.active == 1);
+        TEST_REQUIRE(voices.stolen == 1);
+    }
+
+    // skipping a graph moves the time of its effects forward too.
+    {
+        auto MakeGraph = [&](unsigned fade_duration) {
+            audio::Graph graph("graph");
+            graph.AddElement(audio::SineSource("sine", "sine", format, 440, 1000));
+            graph.AddElement(audio::Effect("effect", "effect", 0, fade_duration, audio::Effect::Kind::FadeIn));
+            TEST_REQUIRE(graph.LinkElements("sine", "out", "effect", "in"));
+            TEST_REQUIRE(graph.LinkGraph("effect", "out"));
+            TEST_REQUIRE(graph.Prepare(loader, p));
+            return graph;
+        };
+        auto Render = [&](audio::Graph& graph) {
+            graph.Process(allocator, events, 10);
+            audio::BufferHandle buffer;
+            TEST_REQUIRE(graph.GetOutputPort(0).PullBuffer(buffer));
+            return std::string((const char*)buffer->GetPtr(), buffer->GetByteSize());
+        };
+        auto fade = MakeGraph(100);
+        auto none = MakeGraph(0);
+        TEST_REQUIRE(fade.Skip(100));
+        TEST_REQUIRE(none.Skip(100));
+        TEST_REQUIRE(Render(fade) == Render(none));
+    }
+
+    // the mixer source effect keeps its time while the source is virtual.
+    {
+        audio::MixerSource mixer("mixer", format);
+        TEST_REQUIRE(mixer.Prepare(loader, p));
+        mixer.SetMaxVoices(1);
+
+        audio::MixerSource::VoiceParams high;
+        high.priority = 1;
+        auto loud = std::make_unique<audio::SineSource>("loud", format, 440, 1000);
+        TEST_REQUIRE(loud->Prepare(loader, p));
+        mixer.AddSourcePtr(std::move(loud), false, high);
+        auto quiet = std::make_unique<audio::SineSource>("quiet", format, 440, 1000);
+        TEST_REQUIRE(quiet->Prepare(loader, p));
+        mixer.AddSourcePtr(std::move(quiet));
+        mixer.SetSourceEffect("quiet", std::make_unique<audio::MixerSource::FadeIn>(100u));
+
+        bool effect_done = false;
+        for (unsigned i=0; i<10; ++i)
+        {
+            mixer.Process(allocator, events, 10);
+            audio::BufferHandle buffer;
+            mixer.GetOutputPort(0).PullBuffer(buffer);
+            while (!events.empty())
+            {
+                auto event = std::move(events.front());
+                events.pop();
+                if (auto* ptr = event->GetIf<audio::MixerSource::EffectDoneEvent>())
+                    effect_done = ptr->src == "quiet";
+                else if (auto* ptr = event->GetIf<audio::MixerSource::VoiceCountEvent>())
+                    voices = *ptr;
+            }
+        }
+        TEST_REQUIRE(voices.virtualized == 1);
+        TEST_REQUIRE(effect_done);
+    }
+}
+
+std::vector<char> RenderBranches(unsigned millisecs)
+{
+    audio::Format format;
+    format.channel_count = 2;
+    format.sample_rate   = 44100;
+    format.sample_type   = audio::SampleType::Float32;
+
+    audio::Loader loader;
+    audio::Graph::PrepareParams p;
+
+    // independent sine -> gain branches mixed together, plus a mixer
+    // source with sub graphs as its sources.
+    audio::Graph graph("graph");
+    graph.AddElement(audio::Mixer("mixer", 5));
+    for (unsigned i=0; i<4; ++i)
+    {
+        const auto& sine = base::FormatString("sine%1", i);
+        const auto& gain = base::FormatString("gain%1", i);
+        graph.AddElement(audio::SineSource(sine, format, 100 + i * 110, millisecs));
+        graph.AddElement(audio::Gain(gain, 0.1f + i * 0.2f));
+        TEST_REQUIRE(graph.LinkElements(sine, "out", gain, "in"));
+        TEST_REQUIRE(graph.LinkElements(gain, "out", "mixer", base::FormatString("in%1", i)));
+    }
+    auto* effects = graph.AddElement(audio::MixerSource("effects", format));
+    for (unsigned i=0; i<4; ++i)
+    {
+        auto sub_graph = std::make_unique<audio::Graph>(base::FormatString("effect%1", i));
+        sub_graph->AddElement(audio::SineSource("sine", format, 1000 + i * 333, millisecs / (i+1)));
+        sub_graph->AddElement(audio::Gain("gain", 0.25f));
+        TEST_REQUIRE(sub_graph->LinkElements("sine", "out", "gain", "in"));
+        TEST_REQUIRE(sub_graph->LinkGraph("gain", "out"));
+        TEST_REQUIRE(sub_graph->Prepare(loader, p));
+        effects->AddSourcePtr(std::move(sub_graph));
+    }
+    TEST_REQUIRE(graph.LinkElements("effects", "out", "mixer", "in4"));
+    TEST_REQUIRE(graph.LinkGraph("mixer", "out"));
+    TEST_REQUIRE(graph.Prepare(loader, p));
+
+    std::vector<char> pcm;
+    audio::BufferPool allocator;
+    audio::Element::EventQueue events;
+    for (unsigned i=0; i<millisecs / 10; ++i)
+    {
+        graph.Process(allocator, events, 10);
+        graph.Advance(10);
+
+        audio::BufferHandle buffer;
+        TEST_REQUIRE(graph.GetOutputPort(0).PullBuffer(buffer));
+        const auto* ptr = static_cast<const char*>(buffer->GetPtr());
+        pcm.insert(pcm.end(), ptr, ptr + buffer->GetByteSize());
+    }
+    return pcm;
+}
+
+void unit_test_worker_pool()
+{
+    // every task is run exactly once.
+    {
+        audio::WorkerPool pool(3);
+        TEST_REQUIRE(pool.GetNumThreads() == 3);
+
+        audio::BufferAllocator allocator;
+        for (unsigned round=0; round<100; ++round)
+        {
+            std::vector<unsigned> counts(round % 10, 0);
+            pool.ParallelFor(counts.size(), allocator, [&counts](unsigned index, audio::BufferAllocator&) {
+                counts[index]++;
+            });
+            for (auto count : counts)
+                TEST_REQUIRE(count == 1);
+        }
+
+        // nested tasks run serially.
+        std::vector<unsigned> counts(16, 0);
+        pool.ParallelFor(4, allocator, [&pool, &counts](unsigned outer, audio::BufferAllocator& allocator) {
+            pool.ParallelFor(4, allocator, [&counts, outer](unsigned inner, audio::BufferAllocator&) {
+                counts[outer * 4 + inner]++;
+            });
+        });
+        for (auto count : counts)
+            TEST_REQUIRE(count == 1);
+    }
+
+    // parallel graph evaluation produces the same output as serial evaluation.
+    {
+        const auto& serial = RenderBranches(1000);
+        TEST_REQUIRE(serial.size() == 1000 * 44 * 8);
+
+        audio::WorkerPool pool(3);
+        audio::WorkerPool::SetCurrent(&pool);
+        const auto& parallel = RenderBranches(1000);
+        TEST_REQUIRE(serial == parallel);
+
+        // the current pool is per thread.
+        audio::WorkerPool* other = &pool;
+        std::thread thread([&other]() {
+            other = audio::WorkerPool::GetCurrent();
+        });
+        thread.join();
+        TEST_REQUIRE(other == nullptr);
+        audio::WorkerPool::SetCurrent(nullptr);
+    }
+}
+
+void unit_test_wav_transcode()
+{
+    audio::Format format;
+    format.channel_count = 2;
+    format.sample_rate   = 44100;
+    format.sample_type   = audio::SampleType::Float32;
+
+    std::vector<float> pcm;
+    for (unsigned i=0; i<1000; ++i)
+    {
+        const float value = std::sin(i * 0.05f) * 0.5f;
+        pcm.push_back(value);
+        pcm.push_back(-value);
+    }
+    const auto& wav = audio::EncodeWav(format, pcm.data(), pcm.size() * sizeof(float));
+    TEST_REQUIRE(wav.size() == 44 + pcm.size() * sizeof(float));
+    {
+        std::ofstream out("transcode-test.wav", std::ios::binary);
+        out.write((const char*)wav.data(), wav.size());
+    }
+
+    // float PCM is read as-is.
+    {
+        audio::WavDecoder decoder;
+        TEST_REQUIRE(decoder.Open(audio::OpenFileStream("transcode-test.wav")));
+        TEST_REQUIRE(decoder.GetFileSampleType() == audio::SampleType::Float32);
+        TEST_REQUIRE(decoder.GetNumChannels() == 2);
+        TEST_REQUIRE(decoder.GetSampleRate() == 44100);
+        TEST_REQUIRE(decoder.GetNumFrames() == 1000);
+
+        std::vector<float> out(pcm.size());
+        TEST_REQUIRE(decoder.ReadFrames(&out[0], 600) == 600);
+        TEST_REQUIRE(decoder.ReadFrames(&out[1200], 600) == 400);
+        TEST_REQUIRE(decoder.ReadFrames(&out[0], 600) == 0);
+        TEST_REQUIRE(out == pcm);
+        decoder.Reset();
+        TEST_REQUIRE(decoder.ReadFrames(&out[0], 1000) == 1000);
+        TEST_REQUIRE(out == pcm);
+
+        // seek to a frame offset without reading the frames before it.
+        TEST_REQUIRE(decoder.Seek(250));
+        TEST_REQUIRE(decoder.ReadFrames(&out[0], 1000) == 750);
+        TEST_REQUIRE(std::equal(pcm.begin() + 500, pcm.end(), out.begin()));
+        TEST_REQUIRE(decoder.Seek(1000));
+        TEST_REQUIRE(decoder.ReadFrames(&out[0], 1) == 0);
+    }
+
+    // transcode to 16bit PCM at the same sample rate.
+    {
+        std::vector<std::uint8_t> int16_wav;
+        TEST_REQUIRE(audio::TranscodeToWav("transcode-test.wav", audio::SampleType::Int16, 44100, &int16_wav));
+        TEST_REQUIRE(int16_wav.size() == 44 + pcm.size() * sizeof(short));
+
+        std::ofstream out("transcode-test-int16.wav", std::ios::binary);
+        out.write((const char*)int16_wav.data(), int16_wav.size());
+    }
+    {
+        audio::WavDecoder decoder;
+        TEST_REQUIRE(decoder.Open(audio::OpenFileStream("transcode-test-int16.wav")));
+        TEST_REQUIRE(decoder.GetFileSampleType() == audio::SampleType::Int16);
+        TEST_REQUIRE(decoder.GetNumFrames() == 1000);
+
+        std::vector<float> out(pcm.size());
+        TEST_REQUIRE(decoder.ReadFrames(&out[0], 1000) == 1000);
+        for (size_t i=0; i<pcm.size(); ++i)
+            TEST_REQUIRE(std::abs(out[i] - pcm[i]) <= 1.0f / 32768.0f);
+    }
+
+    // not a WAV file.
+    {
+        std::ofstream out("transcode-test.txt", std::ios::binary);
+        out << "hello world, this is not a wav file";
+    }
+    audio::WavDecoder decoder;
+    TEST_REQUIRE(!decoder.Open(audio::OpenFileStream("transcode-test.txt")));
+}
+
+void unit_test_pcm_cache()
+{
+    audio::Format format;
+    format.channel_count = 2;
+    format.sample_rate   = 44100;
+    format.sample_type   = audio::SampleType::Float32;
+
+    // 1000 stereo float frames, 8000 bytes of PCM per cached file.
+    std::vector<float> pcm;
+    for (unsigned i=0; i<1000; ++i)
+    {
+        const float value = std::sin(i * 0.05f) * 0.5f;
+        pcm.push_back(value);
+        pcm.push_back(-value);
+    }
+    const auto pcm_bytes = pcm.size() * sizeof(float);
+    const auto& wav = audio::EncodeWav(format, pcm.data(), pcm_bytes);
+    {
+        std::ofstream out("pcm-cache-test.wav", std::ios::binary);
+        out.write((const char*)wav.data(), wav.size());
+    }
+
+    audio::Loader loader;
+    audio::Element::PrepareParams p;
+    p.enable_pcm_caching = true;
+    audio::BufferAllocator allocator;
+    audio::Element::EventQueue events;
+
+    // the cache is keyed by the file source ID, every ID is a separate
+    // cache entry even though the file is the same.
+    auto MakeSource = [](const std::string& id) {
+        auto source = std::make_unique<audio::FileSource>(id, id, "pcm-cache-test.wav", audio::SampleType::Float32);
+        source->EnablePcmCaching(true);
+        return source;
+    };
+    auto Preload = [&](const std::string& id) {
+        return MakeSource(id)->Preload(loader);
+    };
+
+    audio::FileSource::ClearCache();
+    audio::FileSource::SetCacheBudget(0);
+
+    // preload decodes the file into the cache once.
+    {
+        const auto before = audio::FileSource::GetCacheStats();
+        TEST_REQUIRE(Preload("a"));
+        auto stats = audio::FileSource::GetCacheStats();
+        TEST_REQUIRE(stats.entries == 1);
+        TEST_REQUIRE(stats.bytes == pcm_bytes);
+        TEST_REQUIRE(stats.misses == before.misses + 1);
+
+        TEST_REQUIRE(Preload("a"));
+        stats = audio::FileSource::GetCacheStats();
+        TEST_REQUIRE(stats.entries == 1);
+        TEST_REQUIRE(stats.hits == before.hits + 1);
+
+        // no caching on the source, nothing to preload.
+        audio::FileSource source("b", "b", "pcm-cache-test.wav", audio::SampleType::Float32);
+        TEST_REQUIRE(source.Preload(loader));
+        TEST_REQUIRE(audio::FileSource::GetCacheStats().entries == 1);
+
+        // a preloaded source plays from the cached PCM.
+        auto cached = MakeSource("a");
+        TEST_REQUIRE(cached->Prepare(loader, p));
+        TEST_REQUIRE(audio::FileSource::GetCacheStats().hits == before.hits + 2);
+        cached->Process(allocator, events, 10);
+        audio::BufferHandle buffer;
+        TEST_REQUIRE(cached->GetOutputPort(0).PullBuffer(buffer));
+        TEST_REQUIRE(buffer->GetByteSize() == 440 * 2 * sizeof(float));
+        TEST_REQUIRE(!std::memcmp(buffer->GetPtr(), pcm.data(), buffer->GetByteSize()));
+    }
+
+    // least recently used entries are evicted first.
+    {
+        audio::FileSource::ClearCache();
+        audio::FileSource::SetCacheBudget(3 * pcm_bytes);
+
+        const auto before = audio::FileSource::GetCacheStats();
+        TEST_REQUIRE(Preload("a"));
+        TEST_REQUIRE(Preload("b"));
+        TEST_REQUIRE(Preload("c"));
+        TEST_REQUIRE(audio::FileSource::GetCacheStats().entries == 3);
+        TEST_REQUIRE(audio::FileSource::GetCacheStats().evictions == before.evictions);
+
+        // touch a, b is now the least recently used.
+        TEST_REQUIRE(Preload("a"));
+        TEST_REQUIRE(Preload("d"));
+        auto stats = audio::FileSource::GetCacheStats();
+        TEST_REQUIRE(stats.entries == 3);
+        TEST_REQUIRE(stats.bytes == 3 * pcm_bytes);
+        TEST_REQUIRE(stats.evictions == before.evictions + 1);
+
+        stats = audio::FileSource::GetCacheStats();
+        TEST_REQUIRE(Preload("a"));
+        TEST_REQUIRE(Preload("c"));
+        TEST_REQUIRE(Preload("d"));
+        TEST_REQUIRE(audio::FileSource::GetCacheStats().hits == stats.hits + 3);
+        TEST_REQUIRE(audio::FileSource::GetCacheStats().misses == stats.misses);
+        TEST_REQUIRE(Preload("b"));
+        TEST_REQUIRE(audio::FileSource::GetCacheStats().misses == stats.misses + 1);
+    }
+
+    // a buffer that is larger than the budget is not cached.
+    {
+        audio::FileSource::ClearCache();
+        audio::FileSource::SetCacheBudget(pcm_bytes / 2);
+
+        TEST_REQUIRE(!Preload("a"));
+        TEST_REQUIRE(audio::FileSource::GetCacheStats().entries == 0);
+
+        // the source still plays but decodes the file itself.
+        auto source = MakeSource("a");
+        TEST_REQUIRE(source->Prepare(loader, p));
+        TEST_REQUIRE(audio::FileSource::GetCacheStats().entries == 0);
+        TEST_REQUIRE(audio::FileSource::GetCacheStats().bytes == 0);
+    }
+
+    // an incomplete buffer that is still being filled by a source
+    // is not evicted.
+    {
+        audio::FileSource::ClearCache();
+        audio::FileSource::SetCacheBudget(2 * pcm_bytes);
+
+        const auto before = audio::FileSource::GetCacheStats();
+        auto source = MakeSource("playing");
+        TEST_REQUIRE(source->Prepare(loader, p));
+        TEST_REQUIRE(audio::FileSource::GetCacheStats().entries == 1);
+
+        // playing is the least recently used entry but is skipped
+        // and a is evicted instead.
+        TEST_REQUIRE(Preload("a"));
+        TEST_REQUIRE(Preload("b"));
+        auto stats = audio::FileSource::GetCacheStats();
+        TEST_REQUIRE(stats.entries == 2);
+        TEST_REQUIRE(stats.bytes == 2 * pcm_bytes);
+        TEST_REQUIRE(stats.evictions == before.evictions + 1);
+
+        // play the source to the end which completes the buffer.
+        while (!source->IsSourceDone())
+        {
+            source->Process(allocator, events, 10);
+            audio::BufferHandle buffer;
+            source->GetOutputPort(0).PullBuffer(buffer);
+        }
+        source.reset();
+
+        stats = audio::FileSource::GetCacheStats();
+        TEST_REQUIRE(Preload("playing"));
+        TEST_REQUIRE(Preload("b"));
+        TEST_REQUIRE(audio::FileSource::GetCacheStats().hits == stats.hits + 2);
+    }
+
+    // an incomplete buffer whose source went away is dropped
+    // when it's looked up.
+    {
+        audio::FileSource::ClearCache();
+        audio::FileSource::SetCacheBudget(0);
+
+        auto source = MakeSource("abandoned");
+        TEST_REQUIRE(source->Prepare(loader, p));
+        source->Process(allocator, events, 10);
+        audio::BufferHandle buffer;
+        source->GetOutputPort(0).PullBuffer(buffer);
+        source.reset();
+        TEST_REQUIRE(audio::FileSource::GetCacheStats().entries == 1);
+
+        // the abandoned buffer is replaced by a complete one.
+        const auto before = audio::FileSource::GetCacheStats();
+        TEST_REQUIRE(Preload("abandoned"));
+        TEST_REQUIRE(audio::FileSource::GetCacheStats().misses == before.misses + 1);
+        TEST_REQUIRE(audio::FileSource::GetCacheStats().entries == 1);
+        TEST_REQUIRE(audio::FileSource::GetCacheStats().bytes == pcm_bytes);
+        TEST_REQUIRE(Preload("abandoned"));
+        TEST_REQUIRE(audio::FileSource::GetCacheStats().hits == before.hits + 1);
+    }
+
+    audio::FileSource::ClearCache();
+    audio::FileSource::SetCacheBudget(0);
+}
+
+void unit_test_profiling()
+{
+    audio::Format format;
+    format.channel_count = 2;
+    format.sample_rate   = 16000;
+    format.sample_type   = audio::SampleType::Float32;
+
+    audio::Graph graph("graph");
+    graph.AddElement(audio::ZeroSource("zero", "zero", format));
+    graph.AddElement(audio::Gain("gain", "gain", 0.5f));
+    TEST_REQUIRE(graph.LinkElements("zero", "out", "gain", "in"));
+    TEST_REQUIRE(graph.LinkGraph("gain", "out"));
+
+    audio::Loader loader;
+    audio::AudioGraph source("graph", std::move(graph));
+    audio::AudioGraph::PrepareParams p;
+    TEST_REQUIRE(source.Prepare(loader, p));
+
+    std::vector<uint8_t> buffer;
+    buffer.resize(audio::GetMillisecondByteCount(format) * 5);
+
+    // no profiling by default.
+    for (int i=0; i<10; ++i)
+        TEST_REQUIRE(source.FillBuffer(&buffer[0], buffer.size()) == buffer.size());
+    TEST_REQUIRE(source.GetEvent() == nullptr);
+    for (const auto& element : source->GetProfile())
+        TEST_REQUIRE(element.calls == 0);
+
+    source.SetProfilingInterval(100);
+    for (int i=0; i<19; ++i)
+        TEST_REQUIRE(source.FillBuffer(&buffer[0], buffer.size()) == buffer.size());
+    TEST_REQUIRE(source.GetEvent() == nullptr);
+    TEST_REQUIRE(source->GetProfile().size() == 2);
+    TEST_REQUIRE(source->GetProfile()[0].calls == 19);
+    TEST_REQUIRE(source->GetProfile()[1].calls == 19);
+
+    // the profiling data is in the schedule order.
+    const auto& schedule = source->GetSchedule();
+    TEST_REQUIRE(schedule.size() == 2);
+    TEST_REQUIRE(schedule[0].name == "zero");
+    TEST_REQUIRE(schedule[1].name == "gain");
+    TEST_REQUIRE(schedule[1].type == "Gain");
+
+    TEST_REQUIRE(source.FillBuffer(&buffer[0], buffer.size()) == buffer.size());
+    auto event = source.GetEvent();
+    TEST_REQUIRE(event);
+    const auto* profile = event->GetIf<audio::AudioGraph::ProfileEvent>();
+    TEST_REQUIRE(profile);
+    TEST_REQUIRE(profile->callbacks == 20);
+    TEST_REQUIRE(profile->audio_time == 100.0);
+    TEST_REQUIRE(profile->total_time >= profile->max_time);
+    TEST_REQUIRE(profile->min_margin <= 5.0);
+    TEST_REQUIRE(profile->elements.size() == 2);
+    for (const auto& element : profile->elements)
+    {
+        TEST_REQUIRE(element.calls == 20);
+        TEST_REQUIRE(element.total_time >= element.max_time);
+        TEST_REQUIRE(element.max_time >= 0.0);
+    }
+    // the accumulated data is reset after every event.
+    TEST_REQUIRE(source->GetProfile()[0].calls == 0);
+
+    // disable profiling with a command.
+    source.RecvCommand(audio::MakeCommand(audio::AudioGraph::SetProfilingCmd{0}));
+    for (int i=0; i<40; ++i)
+        TEST_REQUIRE(source.FillBuffer(&buffer[0], buffer.size()) == buffer.size());
+    TEST_REQUIRE(source.GetEvent() == nullptr);
+    TEST_REQUIRE(!source->IsProfilingEnabled());
+
+    // the graphs played through a mixer are profiled per graph class.
+    {
+        audio::GraphClass klass("effect");
+        audio::GraphClass::Element gain;
+        gain.id = base::RandomString(10);
+        gain.args = audio::FindElementDesc("Gain")->args;
+        gain.type = "Gain";
+        gain.name = "gain";
+        audio::GraphClass::Element zero;
+        zero.id = base::RandomString(10);
+        zero.args = audio::FindElementDesc("ZeroSource")->args;
+        zero.args["format"] = format;
+        zero.type = "ZeroSource";
+        zero.name = "zero";
+        audio::GraphClass::Link link;
+        link.id = base::RandomString(10);
+        link.src_element = zero.id;
+        link.dst_element = gain.id;
+        link.src_port = "out";
+        link.dst_port = "in";
+        // the class element order is different from the schedule order.
+        klass.AddElement(gain);
+        klass.AddElement(zero);
+        klass.AddLink(link);
+        klass.SetGraphOutputElementId(gain.id);
+        klass.SetGraphOutputElementPort("out");
+
+        audio::MixerSource mixer("mixer", format);
+        mixer.SetNeverDone(true);
+        audio::Graph graph("graph");
+        graph.AddElement(std::move(mixer));
+        TEST_REQUIRE(graph.LinkGraph("mixer", "out"));
+        audio::AudioGraph source("graph", std::move(graph));
+        TEST_REQUIRE(source.Prepare(loader, p));
+        source.SetProfilingInterval(100);
+
+        for (const std::string name : {"a", "b"})
+        {
+            auto effect = std::make_unique<audio::Graph>(name, klass);
+            TEST_REQUIRE(effect->Prepare(loader, p));
+            audio::MixerSource::AddSourceCmd cmd;
+            cmd.src = std::move(effect);
+            cmd.voice.group = klass.GetId();
+            source.RecvCommand(audio::AudioGraph::MakeCommand("mixer", std::move(cmd)));
+        }
+        for (int i=0; i<10; ++i)
+            TEST_REQUIRE(source.FillBuffer(&buffer[0], buffer.size()) == buffer.size());
+
+        // the data of a deleted graph is still included.
+        audio::MixerSource::DeleteSourceCmd del;
+        del.name = "b";
+        source.RecvCommand(audio::AudioGraph::MakeCommand("mixer", std::move(del)));
+        for (int i=0; i<10; ++i)
+            TEST_REQUIRE(source.FillBuffer(&buffer[0], buffer.size()) == buffer.size());
+
+        // the mixer sends its voice count events as well.
+        auto get_profile = [&source]() {
+            std::unique_ptr<audio::Event> ret;
+            while (auto event = source.GetEvent())
+            {
+                if (event->GetIf<audio::AudioGraph::ProfileEvent>())
+                    ret = std::move(event);
+            }
+            return ret;
+        };
+        auto event = get_profile();
+        TEST_REQUIRE(event);
+        const auto* profile = event->GetIf<audio::AudioGraph::ProfileEvent>();
+        TEST_REQUIRE(profile->elements.size() == 1);
+        TEST_REQUIRE(profile->elements[0].calls == 20);
+        TEST_REQUIRE(profile->graphs.size() == 1);
+        TEST_REQUIRE(profile->graphs[0].klass == klass.GetId());
+        TEST_REQUIRE(profile->graphs[0].elements.size() == 2);
+        TEST_REQUIRE(profile->graphs[0].elements[0].calls == 30);
+        TEST_REQUIRE(profile->graphs[0].elements[1].calls == 30);
+        TEST_REQUIRE(profile->graphs[0].elements[0].total_time >= profile->graphs[0].elements[0].max_time);
+
+        // the data is reset after every event.
+        for (int i=0; i<20; ++i)
+            TEST_REQUIRE(source.FillBuffer(&buffer[0], buffer.size()) == buffer.size());
+        event = get_profile();
+        TEST_REQUIRE(event);
+        profile = event->GetIf<audio::AudioGraph::ProfileEvent>();
+        TEST_REQUIRE(profile->graphs.size() == 1);
+        TEST_REQUIRE(profile->graphs[0].elements[0].calls == 20);
+    }
+}
+
+void unit_test_event_queue()
+{
+    // bounded, keeps the order and doesn't consume the value on failure.
+    {
+        audio::SpscQueue<std::unique_ptr<int>> queue(4);
+        TEST_REQUIRE(queue.GetCapacity() == 4);
+        TEST_REQUIRE(queue.IsEmpty());
+
+        std::unique_ptr<int> value;
+        TEST_REQUIRE(!queue.Pop(&value));
+        for (int round=0; round<10; ++round)
+        {
+            for (int i=0; i<4; ++i)
+                TEST_REQUIRE(queue.Push(std::make_unique<int>(round * 4 + i)));
+            auto extra = std::make_unique<int>(123);
+            TEST_REQUIRE(!queue.Push(std::move(extra)));
+            TEST_REQUIRE(extra && *extra == 123);
+            for (int i=0; i<4; ++i)
+            {
+                TEST_REQUIRE(queue.Pop(&value));
+                TEST_REQUIRE(*value == round * 4 + i);
+            }
+            TEST_REQUIRE(!queue.Pop(&value));
+            TEST_REQUIRE(queue.IsEmpty());
+        }
+    }
+
+    // one producer and one consumer thread.
+    {
+        audio::SpscQueue<unsigned> queue(16);
+        constexpr unsigned count = 100000;
+        std::thread producer([&queue]() {
+            for (unsigned i=0; i<count; ++i)
+            {
+                unsigned value = i;
+                while (!queue.Push(std::move(value)))
+                    std::this_thread::yield();
+            }
+        });
+        unsigned next = 0;
+        while (next < count)
+        {
+            unsigned value = 0;
+            if (!queue.Pop(&value))
+                continue;
+            TEST_REQUIRE(value == next);
+            ++next;
+        }
+        producer.join();
+        TEST_REQUIRE(queue.IsEmpty());
+    }
+}
+
+void unit_test_player_events()
+{
+    audio::Format format;
+    format.channel_count = 2;
+    format.sample_rate   = 44100;
+    format.sample_type   = audio::SampleType::Float32;
+
+    audio::Graph graph("graph");
+    graph.AddElement(audio::SineSource("sine", format, 440, 300));
+    TEST_REQUIRE(graph.LinkGraph("sine", "out"));
+
+    audio::Loader loader;
+    auto source = std::make_unique<audio::AudioGraph>("sine", std::move(graph));
+    audio::AudioGraph::PrepareParams p;
+    TEST_REQUIRE(source->Prepare(loader, p));
+    source->SetProfilingInterval(50);
+
+    audio::NullDevice::Params params;
+    params.clock = audio::NullDevice::Clock::Realtime;
+    auto device = std::make_unique<audio::NullDevice>(params);
+    device->SetBufferSize(10);
+    auto* null = device.get();
+
+    audio::Player player(std::move(device));
+    const auto id = player.Play(std::move(source));
+
+    unsigned source_events = 0;
+    bool complete = false;
+    const auto start = std::chrono::steady_clock::now();
+    while (!complete && std::chrono::steady_clock::now() - start < std::chrono::seconds(5))
+    {
+        audio::Player::Event event;
+        while (player.GetEvent(&event))
+        {
+            if (auto* ptr = std::get_if<audio::Player::SourceEvent>(&event))
+            {
+                TEST_REQUIRE(!complete);
+                TEST_REQUIRE(ptr->id == id);
+                TEST_REQUIRE(ptr->event->GetIf<audio::AudioGraph::ProfileEvent>());
+                ++source_events;
+            }
+            else if (auto* ptr = std::get_if<audio::Player::SourceCompleteEvent>(&event))
+            {
+                TEST_REQUIRE(ptr->id == id);
+                TEST_REQUIRE(ptr->status == audio::Player::TrackStatus::Success);
+                complete = true;
+            }
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    TEST_REQUIRE(complete);
+    TEST_REQUIRE(source_events == 6);
+
+    const auto& stats = null->GetStats();
+    TEST_REQUIRE(stats.callbacks == 30);
+    TEST_REQUIRE(stats.audio_time == real::float32(300.0f));
+    TEST_REQUIRE(stats.max_latency >= 0.0);
+}
+
+// Device that fails to initialize which ends the audio thread.
+class FailingDevice : public audio::Device
+{
+public:
+    virtual std::shared_ptr<audio::Stream> Prepare(std::unique_ptr<audio::Source>) override
+    { return nullptr; }
+    virtual void Poll() override {}
+    virtual void Init() override
+    { throw std::runtime_error("device init failed"); }
+    virtual State GetState() const override
+    { return State::Error; }
+    virtual void SetBufferSize(unsigned) override {}
+};
+
+void unit_test_player_dead_thread()
+{
+    // the game thread must be able to keep using the player after the
+    // audio thread has exited and destroyed the device.
+    audio::Player player(std::make_unique<FailingDevice>());
+    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+
+    for (unsigned i=0; i<100; ++i)
+    {
+        const auto id = player.Play(std::make_unique<audio::AudioGraph>("graph"));
+        player.Pause(id);
+        player.AskProgress(id);
+    }
+    audio::Player::Event event;
+    TEST_REQUIRE(!player.GetEvent(&event));
+}
+
+std::string MakeSinePCM(unsigned sample_rate, unsigned channels, unsigned frames, float frequency, float amplitude = 1.0f)
+{
+    std::vector<float> data;
+    for (unsigned i=0; i<frames; ++i)
+    {
+        const float sample = amplitude * std::sin(2.0 * math::Pi * frequency * i / sample_rate);
+        for (unsigned c=0; c<channels; ++c)
+            data.push_back(sample);
+    }
+    return std::string((const char*)data.data(), data.size() * sizeof(float));
+}
+std::string MakeDCPCM(unsigned channels, unsigned frames, float value)
+{
+    std::vector<float> data(channels * frames, value);
+    return std::string((const char*)data.data(), data.size() * sizeof(float));
+}
+
+// compute the RMS level over the second half of the PCM data
+// in order to skip the filter's transient response.
+float GetTailRMS(const std::string& pcm)
+{
+    const auto* samples = (const float*)pcm.data();
+    const auto count = pcm.size() / sizeof(float);
+    double sum = 0.0;
+    for (size_t i=count/2; i<count; ++i)
+        sum += samples[i] * samples[i];
+    return std::sqrt(sum / (count - count/2));
+}
+float GetLastSample(const std::string& pcm)
+{
+    const auto* samples = (const float*)pcm.data();
+    return samples[pcm.size() / sizeof(float) - 1];
+}
+
+void unit_test_dsp_elements()
+{
+    const audio::Format mono = {audio::SampleType::Float32, 48000, 1};
+    const audio::Format stereo = {audio::SampleType::Float32, 48000, 2};
+
+    // filter responses.
+    {
+        const auto& low  = MakeSinePCM(48000, 2, 4800, 100.0f);
+        const auto& high = MakeSinePCM(48000, 2, 4800, 10000.0f);
+        const auto& dc   = MakeDCPCM(2, 4800, 0.5f);
+
+        audio::BiquadFilter lowpass("filter", audio::BiquadFilter::Type::LowPass, 1000.0f);
+        PrepareElement(lowpass, stereo);
+        TEST_REQUIRE(std::abs(GetTailRMS(RunElement(lowpass, stereo, {low})) - 0.7071f) < 0.01f);
+        TEST_REQUIRE(GetTailRMS(RunElement(lowpass, stereo, {high})) < 0.01f);
+        TEST_REQUIRE(std::abs(GetLastSample(RunElement(lowpass, stereo, {dc})) - 0.5f) < 0.001f);
+
+        audio::BiquadFilter highpass("filter", audio::BiquadFilter::Type::HighPass, 1000.0f);
+        PrepareElement(highpass, stereo);
+        TEST_REQUIRE(GetTailRMS(RunElement(highpass, stereo, {low})) < 0.01f);
+        TEST_REQUIRE(std::abs(GetTailRMS(RunElement(highpass, stereo, {high})) - 0.7071f) < 0.01f);
+        TEST_REQUIRE(std::abs(GetLastSample(RunElement(highpass, stereo, {dc}))) < 0.001f);
+
+        audio::BiquadFilter bandpass("filter", audio::BiquadFilter::Type::BandPass, 1000.0f, 2.0f);
+        PrepareElement(bandpass, stereo);
+        TEST_REQUIRE(std::abs(GetTailRMS(RunElement(bandpass, stereo, {MakeSinePCM(48000, 2, 4800, 1000.0f)})) - 0.7071f) < 0.01f);
+        TEST_REQUIRE(GetTailRMS(RunElement(bandpass, stereo, {low})) < 0.05f);
+        TEST_REQUIRE(GetTailRMS(RunElement(bandpass, stereo, {high})) < 0.05f);
+
+        // change the filter type at runtime.
+        auto cmd = audio::Element::MakeCommand(audio::BiquadFilter::SetFilterCmd{audio::BiquadFilter::Type::HighPass, 1000.0f, 0.7071f});
+        lowpass.ReceiveCommand(*cmd);
+        TEST_REQUIRE(GetTailRMS(RunElement(lowpass, stereo, {low})) < 0.01f);
+
+        // preparing again resets the filter state.
+        audio::BiquadFilter reset("filter", audio::BiquadFilter::Type::LowPass, 1000.0f);
+        const auto& first = ProcessElement(reset, stereo, {dc});
+        TEST_REQUIRE(ProcessElement(reset, stereo, {dc}) == first);
+
+        // only float32 is supported.
+        audio::BiquadFilter filter("filter", audio::BiquadFilter::Type::LowPass, 1000.0f);
+        audio::Loader loader;
+        audio::Element::PrepareParams p;
+        filter.GetInputPort(0).SetFormat({audio::SampleType::Int16, 48000, 2});
+        TEST_REQUIRE(!filter.Prepare(loader, p));
+    }
+
+    // compressor gain reduction.
+    {
+        // 20dB above the threshold with 4:1 ratio gives 15dB of gain reduction.
+        audio::Compressor compressor("compressor", -20.0f, 4.0f, 0.0f, 100.0f);
+        PrepareElement(compressor, stereo);
+        const auto& ret = RunElement(compressor, stereo, {MakeDCPCM(2, 480, 1.0f)});
+        const auto* samples = (const float*)ret.data();
+        for (unsigned i=0; i<480*2; ++i)
+            TEST_REQUIRE(std::abs(samples[i] - 0.17783f) < 0.001f);
+        TEST_REQUIRE(std::abs(compressor.GetGainReduction() + 15.0f) < 0.01f);
+
+        // below threshold the stream is untouched.
+        audio::Compressor quiet("compressor", -20.0f, 4.0f, 0.0f, 100.0f);
+        const auto& pcm = MakeSinePCM(48000, 2, 480, 440.0f, 0.05f);
+        TEST_REQUIRE(ProcessElement(quiet, stereo, {pcm}) == pcm);
+
+        // makeup gain.
+        audio::Compressor makeup("compressor", 0.0f, 4.0f, 10.0f, 100.0f, 6.0f);
+        TEST_REQUIRE(std::abs(GetLastSample(ProcessElement(makeup, mono, {pcm})) / GetLastSample(pcm) - 1.9953f) < 0.001f);
+
+        // preparing again resets the envelope and the gain.
+        audio::Compressor reset("compressor", -20.0f, 4.0f, 10.0f, 100.0f);
+        const auto& first = ProcessElement(reset, stereo, {MakeDCPCM(2, 480, 1.0f)});
+        TEST_REQUIRE(ProcessElement(reset, stereo, {MakeDCPCM(2, 480, 1.0f)}) == first);
+
+        // a 1:1 ratio disables the compression and the gain is ramped back up.
+        auto cmd = audio::Element::MakeCommand(audio::Compressor::SetCompressorCmd{-20.0f, 1.0f, 0.0f, 100.0f, 0.0f});
+        compressor.ReceiveCommand(*cmd);
+        RunElement(compressor, stereo, {MakeDCPCM(2, 480, 1.0f)});
+        TEST_REQUIRE(RunElement(compressor, stereo, {MakeDCPCM(2, 480, 1.0f)}) == MakeDCPCM(2, 480, 1.0f));
+        TEST_REQUIRE(compressor.GetGainReduction() == 0.0f);
+    }
+
+    // limiter ceiling.
+    {
+        const audio::Format formats[] = {
+            {audio::SampleType::Float32, 48000, 2},
+            {audio::SampleType::Int16,   48000, 2}
+        };
+        for (const auto& format : formats)
+        {
+            audio::Limiter limiter("limiter", -6.0f, 50.0f);
+            PrepareElement(limiter, format);
+            for (unsigned i=0; i<10; ++i)
+            {
+                const auto& ret = RunElement(limiter, format, {MakeRandomPCM(format, 480, i)});
+                if (format.sample_type == audio::SampleType::Float32)
+                {
+                    const auto* samples = (const float*)ret.data();
+                    for (unsigned j=0; j<480*2; ++j)
+                        TEST_REQUIRE(std::abs(samples[j]) <= 0.5012f);
+                }
+                else
+                {
+                    const auto* samples = (const short*)ret.data();
+                    for (unsigned j=0; j<480*2; ++j)
+                        TEST_REQUIRE(std::abs(samples[j]) <= 16423);
+                }
+            }
+        }
+        audio::Limiter limiter("limiter", 0.0f, 50.0f);
+        PrepareElement(limiter, mono);
+        auto cmd = audio::Element::MakeCommand(audio::Limiter::SetLimiterCmd{-12.0f, 50.0f});
+        limiter.ReceiveCommand(*cmd);
+        const auto& ret = RunElement(limiter, mono, {MakeDCPCM(1, 480, 1.0f)});
+        TEST_REQUIRE(std::abs(GetLastSample(ret) - 0.25119f) < 0.001f);
+    }
+
+    // gain changes are ramped in over the next buffer.
+    {
+        audio::Gain gain("gain", 1.0f);
+        PrepareElement(gain, mono);
+        auto cmd = audio::Element::MakeCommand(audio::Gain::SetGainCmd{0.0f});
+        gain.ReceiveCommand(*cmd);
+
+        const auto& ret = RunElement(gain, mono, {MakeDCPCM(1, 100, 1.0f)});
+        const auto* samples = (const float*)ret.data();
+        TEST_REQUIRE(samples[0] > 0.98f);
+        for (unsigned i=1; i<100; ++i)
+            TEST_REQUIRE(samples[i] < samples[i-1]);
+        TEST_REQUIRE(samples[99] == 0.0f);
+        TEST_REQUIRE(RunElement(gain, mono, {MakeDCPCM(1, 100, 1.0f)}) == MakeDCPCM(1, 100, 0.0f));
+    }
+
+    // graph class with the DSP elements.
+    {
+        audio::GraphClass klass("graph");
+        audio::GraphClass::Element sine;
+        sine.id = base::RandomString(10);
+        sine.args = audio::FindElementDesc("SineSource")->args;
+        sine.args["format"] = stereo;
+        sine.args["duration"] = 100u;
+        sine.type = "SineSource";
+        sine.name = "sine";
+        klass.AddElement(sine);
+
+        std::string prev = sine.id;
+        for (const std::string type : {"BiquadFilter", "Compressor", "Limiter"})
+        {
+            audio::GraphClass::Element elem;
+            elem.id = base::RandomString(10);
+            elem.args = audio::FindElementDesc(type)->args;
+            elem.type = type;
+            elem.name = type;
+            if (type == "BiquadFilter")
+                elem.args["filter"] = audio::BiquadFilter::Type::HighPass;
+            klass.AddElement(elem);
+
+            audio::GraphClass::Link link;
+            link.id = base::RandomString(10);
+            link.src_element = prev;
+            link.dst_element = elem.id;
+            link.src_port = "out";
+            link.dst_port = "in";
+            klass.AddLink(link);
+            prev = elem.id;
+        }
+        klass.SetGraphOutputElementId(prev);
+        klass.SetGraphOutputElementPort("out");
+
+        data::JsonObject json;
+        klass.IntoJson(json);
+        auto other = audio::GraphClass::FromJson(json);
+        TEST_REQUIRE(other.has_value());
+        TEST_REQUIRE(other->GetHash() == klass.GetHash());
+
+        audio::Graph graph(*other);
+        audio::Graph::PrepareParams p;
+        audio::Loader loader;
+        TEST_REQUIRE(graph.Prepare(loader, p));
+        TEST_REQUIRE(graph.GetFormat() == stereo);
+        const auto& desc = graph.Describe();
+        TEST_REQUIRE(desc[0] == "sine:out -> BiquadFilter:in BiquadFilter:out -> Compressor:in "
+                                "Compressor:out -> Limiter:in Limiter:out -> graph:port graph:port -> nil");
+    }
+}
 
 int test_main(int argc, char* argv[])
 {
@@ -830,5 +2468,28 @@ int test_main(int argc, char* argv[])
     unit_test_graph_in_graph();
     unit_test_graph_class();
     unit_test_oversized_buffer();
+    unit_test_buffer_pool();
+    unit_test_simd_kernels();
+    unit_test_read_ahead_decoder();
+    unit_test_null_device();
+    unit_test_voice_limits();
+    unit_test_worker_pool();
+    unit_test_wav_transcode();
+    unit_test_pcm_cache();
+    unit_test_profiling();
+    unit_test_event_queue();
+    unit_test_player_events();
+    unit_test_player_dead_thread();
+    unit_test_dsp_elements();
+
+    bool perf_test = false;
+    for (int i=1; i<argc; ++i)
+    {
+        if (!std::strcmp("--perftest", argv[i]))
+            perf_test = true;
+        else std::printf("Unrecognized cmdline param: '%s'\n", argv[i]);
+    }
+    if (perf_test)
+        perf_test_audio_kernels();
     return 0;
 }
@@ -0,0 +1,301 @@
+// Copyright (C) 2020-2021 Sami Väisänen
+// Copyright (C) 2020-2021 Ensisoft http://www.ensisoft.com
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+#include "config.h"
+
+#include <samplerate.h>
+
+#include <algorithm>
+#include <cstring>
+#include <cmath>
+#include <type_traits>
+
+#include "base/assert.h"
+#include "base/logging.h"
+#include "base/utility.h"
+#include "audio/wav.h"
+#include "audio/loader.h"
+#include "audio/sndfile.h"
+#include "audio/mpg123.h"
+
+namespace {
+std::uint32_t ReadLE32(const std::uint8_t* ptr)
+{
+    return std::uint32_t(ptr[0]) | (std::uint32_t(ptr[1]) << 8) |
+          (std::uint32_t(ptr[2]) << 16) | (std::uint32_t(ptr[3]) << 24);
+}
+std::uint16_t ReadLE16(const std::uint8_t* ptr)
+{
+    return std::uint16_t(ptr[0]) | (std::uint16_t(ptr[1]) << 8);
+}
+template<typename T>
+void WriteLE(std::vector<std::uint8_t>& out, T value)
+{
+    for (unsigned i=0; i<sizeof(T); ++i)
+        out.push_back((value >> (8 * i)) & 0xff);
+}
+
+// Sample conversions. These match what libsndfile does, i.e. integer
+// samples are normalized to [-1.0, 1.0) range by dividing by 0x8000 or
+// 0x80000000 and float samples are scaled and clipped when converting
+// to integers.
+template<typename From, typename To>
+To ConvertSample(From value);
+template<> inline float ConvertSample(short value)
+{ return value / 32768.0f; }
+template<> inline int ConvertSample(short value)
+{ return int(value) * 65536; }
+template<> inline short ConvertSample(float value)
+{ return (short)std::lround(std::clamp(value * 32768.0f, -32768.0f, 32767.0f)); }
+template<> inline int ConvertSample(float value)
+{ return (int)std::llround(std::clamp(double(value) * 2147483648.0, -2147483648.0, 2147483647.0)); }
+
+} // namespace
+
+namespace audio
+{
+
+bool WavDecoder::Open(std::shared_ptr<const SourceStream> io)
+{
+    ASSERT(mSource == nullptr);
+
+    const auto size = io->GetSize();
+    if (size < 12)
+        return false;
+
+    std::uint8_t header[12];
+    io->Read(header, 0, sizeof(header));
+    if (std::memcmp(&header[0], "RIFF", 4) || std::memcmp(&header[8], "WAVE", 4))
+        return false;
+
+    bool have_format = false;
+    std::uint64_t offset = 12;
+    while (offset + 8 <= size)
+    {
+        std::uint8_t chunk[8];
+        io->Read(chunk, offset, sizeof(chunk));
+        const auto chunk_size = ReadLE32(&chunk[4]);
+        const auto chunk_data = offset + 8;
+        if (!std::memcmp(chunk, "fmt ", 4))
+        {
+            std::uint8_t fmt[16];
+            if (chunk_size < sizeof(fmt) || chunk_data + sizeof(fmt) > size)
+                return false;
+            io->Read(fmt, chunk_data, sizeof(fmt));
+            const auto format_tag  = ReadLE16(&fmt[0]);
+            const auto channels    = ReadLE16(&fmt[2]);
+            const auto sample_rate = ReadLE32(&fmt[4]);
+            const auto sample_bits = ReadLE16(&fmt[14]);
+            if (format_tag == 1 && sample_bits == 16)
+                mType = SampleType::Int16;
+            else if (format_tag == 3 && sample_bits == 32)
+                mType = SampleType::Float32;
+            else return false;
+            if (channels == 0 || sample_rate == 0)
+                return false;
+            mChannels   = channels;
+            mSampleRate = sample_rate;
+            have_format = true;
+        }
+        else if (!std::memcmp(chunk, "data", 4))
+        {
+            if (!have_format)
+                return false;
+            const auto frame_size = mChannels * (mType == SampleType::Int16 ? 2u : 4u);
+            const auto data_size  = std::min<std::uint64_t>(chunk_size, size - chunk_data);
+            mDataOffset = chunk_data;
+            mFrames     = static_cast<unsigned>(data_size / frame_size);
+            mFrame      = 0;
+            mSource     = io;
+            DEBUG("Opened WAV PCM audio stream. [name='%1', type=%2, channels=%3, rate=%4, frames=%5]",
+                  io->GetName(), mType, mChannels, mSampleRate, mFrames);
+            return true;
+        }
+        // chunks are padded to even size.
+        offset = chunk_data + chunk_size + (chunk_size & 1);
+    }
+    return false;
+}
+
+size_t WavDecoder::ReadFrames(float* ptr, size_t frames)
+{ return ReadSamples(ptr, frames); }
+size_t WavDecoder::ReadFrames(short* ptr, size_t frames)
+{ return ReadSamples(ptr, frames); }
+size_t WavDecoder::ReadFrames(int* ptr, size_t frames)
+{ return ReadSamples(ptr, frames); }
+
+template<typename Sample>
+size_t WavDecoder::ReadSamples(Sample* ptr, size_t frames)
+{
+    frames = std::min<size_t>(frames, mFrames - mFrame);
+    if (frames == 0)
+        return 0;
+
+    const auto samples = frames * mChannels;
+    const auto sample_size = mType == SampleType::Int16 ? sizeof(short) : sizeof(float);
+    const auto offset = mDataOffset + std::uint64_t(mFrame) * mChannels * sample_size;
+    mFrame += static_cast<unsigned>(frames);
+
+    // happy path, the samples are already in the right format.
+    if ((mType == SampleType::Int16   && std::is_same<Sample, short>::value) ||
+        (mType == SampleType::Float32 && std::is_same<Sample, float>::value))
+    {
+        mSource->Read(ptr, offset, samples * sample_size);
+        return frames;
+    }
+
+    mScratch.resize(samples * sample_size);
+    mSource->Read(mScratch.data(), offset, mScratch.size());
+    if (mType == SampleType::Int16)
+    {
+        const auto* src = reinterpret_cast<const short*>(mScratch.data());
+        for (size_t i=0; i<samples; ++i)
+        {
+            if constexpr (std::is_same<Sample, short>::value)
+                ptr[i] = src[i];
+            else ptr[i] = ConvertSample<short, Sample>(src[i]);
+        }
+    }
+    else
+    {
+        const auto* src = reinterpret_cast<const float*>(mScratch.data());
+        for (size_t i=0; i<samples; ++i)
+        {
+            if constexpr (std::is_same<Sample, float>::value)
+                ptr[i] = src[i];
+            else ptr[i] = ConvertSample<float, Sample>(src[i]);
+        }
+    }
+    return frames;
+}
+
+std::vector<std::uint8_t> EncodeWav(const Format& format, const void* pcm, std::size_t bytes)
+{
+    ASSERT(format.sample_type == SampleType::Int16 ||
+           format.sample_type == SampleType::Int32 ||
+           format.sample_type == SampleType::Float32);
+
+    const std::uint16_t format_tag  = format.sample_type == SampleType::Float32 ? 3 : 1;
+    const std::uint16_t sample_size = format.sample_type == SampleType::Int16 ? 2 : 4;
+    const std::uint16_t block_align = sample_size * format.channel_count;
+    const std::uint32_t data_size   = static_cast<std::uint32_t>(bytes);
+
+    std::vector<std::uint8_t> out;
+    out.reserve(44 + bytes);
+    out.insert(out.end(), {'R', 'I', 'F', 'F'});
+    WriteLE<std::uint32_t>(out, 36 + data_size);
+    out.insert(out.end(), {'W', 'A', 'V', 'E'});
+    out.insert(out.end(), {'f', 'm', 't', ' '});
+    WriteLE<std::uint32_t>(out, 16);
+    WriteLE<std::uint16_t>(out, format_tag);
+    WriteLE<std::uint16_t>(out, format.channel_count);
+    WriteLE<std::uint32_t>(out, format.sample_rate);
+    WriteLE<std::uint32_t>(out, format.sample_rate * block_align);
+    WriteLE<std::uint16_t>(out, block_align);
+    WriteLE<std::uint16_t>(out, sample_size * 8);
+    out.insert(out.end(), {'d', 'a', 't', 'a'});
+    WriteLE<std::uint32_t>(out, data_size);
+    const auto* ptr = static_cast<const std::uint8_t*>(pcm);
+    out.insert(out.end(), ptr, ptr + bytes);
+    return out;
+}
+
+bool TranscodeToWav(const std::string& file, SampleType type, unsigned sample_rate,
+                    std::vector<std::uint8_t>* wav)
+{
+    auto source = OpenFileStream(file);
+    if (!source)
+        return false;
+
+    std::unique_ptr<Decoder> decoder;
+    const auto& upper = base::ToUpperUtf8(file);
+    if (base::EndsWith(upper, ".MP3"))
+    {
+        auto dec = std::make_unique<Mpg123Decoder>();
+        if (!dec->Open(source, SampleType::Float32))
+            return false;
+        decoder = std::move(dec);
+    }
+    else if (base::EndsWith(upper, ".WAV"))
+    {
+        auto dec = std::make_unique<WavDecoder>();
+        if (dec->Open(source))
+            decoder = std::move(dec);
+    }
+    if (!decoder && (base::EndsWith(upper, ".OGG") ||
+                     base::EndsWith(upper, ".WAV") ||
+                     base::EndsWith(upper, ".FLAC")))
+    {
+        auto dec = std::make_unique<SndFileDecoder>();
+        if (!dec->Open(source))
+            return false;
+        decoder = std::move(dec);
+    }
+    if (!decoder)
+        ERROR_RETURN(false, "Audio file format is unsupported for transcoding. [file='%1']", file);
+
+    const auto channels  = decoder->GetNumChannels();
+    const auto src_rate  = decoder->GetSampleRate();
+    const auto src_count = decoder->GetNumFrames();
+    std::vector<float> pcm(std::size_t(src_count) * channels);
+    std::size_t frames = 0;
+    while (frames < src_count)
+    {
+        const auto ret = decoder->ReadFrames(&pcm[frames * channels], src_count - frames);
+        if (ret == 0)
+            break;
+        frames += ret;
+    }
+    if (frames != src_count)
+        WARN("Unexpected number of audio frames decoded. [file='%1', expected=%2, decoded=%3]", file, src_count, frames);
+    pcm.resize(frames * channels);
+
+    if (src_rate != sample_rate)
+    {
+        const double ratio = double(sample_rate) / double(src_rate);
+        std::vector<float> out(std::size_t(std::ceil(frames * ratio) + 1) * channels);
+        SRC_DATA data = {};
+        data.data_in       = pcm.data();
+        data.input_frames  = static_cast<long>(frames);
+        data.data_out      = out.data();
+        data.output_frames = static_cast<long>(out.size() / channels);
+        data.src_ratio     = ratio;
+        const auto ret = ::src_simple(&data, SRC_SINC_BEST_QUALITY, channels);
+        if (ret != 0)
+            ERROR_RETURN(false, "Audio file resample error. [file='%1', error=%2, what='%3']", file, ret, ::src_strerror(ret));
+        out.resize(std::size_t(data.output_frames_gen) * channels);
+        pcm = std::move(out);
+    }
+
+    Format format;
+    format.channel_count = channels;
+    format.sample_rate   = sample_rate;
+    format.sample_type   = type == SampleType::Int16 ? SampleType::Int16 : SampleType::Float32;
+    if (format.sample_type == SampleType::Int16)
+    {
+        std::vector<short> samples(pcm.size());
+        for (size_t i=0; i<pcm.size(); ++i)
+            samples[i] = ConvertSample<float, short>(pcm[i]);
+        *wav = EncodeWav(format, samples.data(), samples.size() * sizeof(short));
+    }
+    else *wav = EncodeWav(format, pcm.data(), pcm.size() * sizeof(float));
+
+    DEBUG("Transcoded audio file. [file='%1', rate=%2 -> %3, format=%4, bytes=%5]", file, src_rate, sample_rate,
+          format.sample_type, wav->size());
+    return true;
+}
+
+} // namespace
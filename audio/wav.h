@@ -0,0 +1,96 @@
+// Copyright (C) 2020-2021 Sami Väisänen
+// Copyright (C) 2020-2021 Ensisoft http://www.ensisoft.com
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+#pragma once
+
+#include "config.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstddef>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "audio/decoder.h"
+#include "audio/format.h"
+
+namespace audio
+{
+    class SourceStream;
+
+    // Decoder for RIFF WAVE files that contain plain 16bit integer or
+    // 32bit float PCM data. The PCM data is read directly out of the
+    // source stream without any decoding. If the data is read with the
+    // same sample type as the file's sample type no conversion is
+    // needed either. This is the format the audio files are transcoded
+    // to when the game is packaged so that the short sound effects
+    // don't need to be decoded and resampled at runtime.
+    class WavDecoder : public Decoder
+    {
+    public:
+        virtual unsigned GetSampleRate() const override
+        { return mSampleRate; }
+        virtual unsigned GetNumChannels() const override
+        { return mChannels; }
+        virtual unsigned GetNumFrames() const override
+        { return mFrames; }
+        virtual size_t ReadFrames(float* ptr, size_t frames) override;
+        virtual size_t ReadFrames(short* ptr, size_t frames) override;
+        virtual size_t ReadFrames(int* ptr, size_t frames) override;
+        virtual void Reset() override
+        { mFrame = 0; }
+        virtual bool Seek(unsigned frame) override
+        {
+            mFrame = std::min(frame, mFrames);
+            return true;
+        }
+
+        // Try to open the decoder based on the given IO device. Returns
+        // false if the stream isn't a WAV file with PCM data that this
+        // decoder supports. In that case the stream can still be opened
+        // with some other decoder such as the SndFileDecoder.
+        bool Open(std::shared_ptr<const SourceStream> io);
+
+        // Get the sample type of the PCM data in the file.
+        SampleType GetFileSampleType() const
+        { return mType; }
+    private:
+        template<typename Sample>
+        size_t ReadSamples(Sample* ptr, size_t frames);
+    private:
+        std::shared_ptr<const SourceStream> mSource;
+        std::uint64_t mDataOffset = 0;
+        SampleType mType = SampleType::Float32;
+        unsigned mSampleRate = 0;
+        unsigned mChannels   = 0;
+        unsigned mFrames     = 0;
+        unsigned mFrame      = 0;
+        std::vector<std::uint8_t> mScratch;
+    };
+
+    // Encode the given PCM data into a RIFF WAVE file. The sample type
+    // must be either Int16, Int32 or Float32.
+    std::vector<std::uint8_t> EncodeWav(const Format& format, const void* pcm, std::size_t bytes);
+
+    // Transcode the given (mp3, ogg, flac or wav) audio file into a WAV
+    // file with the given sample rate and sample type. Int32 sample type
+    // is transcoded to Float32 PCM. The number of channels is kept as-is.
+    // Returns false if the file could not be decoded or resampled.
+    bool TranscodeToWav(const std::string& file, SampleType type, unsigned sample_rate,
+                        std::vector<std::uint8_t>* wav);
+
+} // namespace
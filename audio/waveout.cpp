@@ -54,13 +54,23 @@ class Waveout : public Device
 {
 public:
     Waveout(const char*)
-    {}
+    {
+        // auto-reset event that is signaled by the waveout callback
+        // whenever a stream has a message to process.
+        event_ = CreateEvent(NULL, FALSE, FALSE, NULL);
+        if (event_ == NULL)
+            throw std::runtime_error("failed to create waveout device event.");
+    }
+   ~Waveout()
+    {
+        CloseHandle(event_);
+    }
     virtual std::shared_ptr<Stream> Prepare(std::unique_ptr<Source> source) override
     {
         const auto name = source->GetName();
         try
         {
-            auto stream = std::make_shared<PlaybackStream>(std::move(source), buffer_size_);
+            auto stream = std::make_shared<PlaybackStream>(std::move(source), buffer_size_, event_);
             streams_.push_back(stream);
             return stream;
         } 
@@ -89,6 +99,16 @@ public:
         }
     }
 
+    virtual void WaitEvents(unsigned max_milliseconds) override
+    {
+        WaitForSingleObject(event_, max_milliseconds);
+    }
+
+    virtual void Wakeup() override
+    {
+        SetEvent(event_);
+    }
+
     virtual void Init()
     {}
 
@@ -209,7 +229,8 @@ private:
     class PlaybackStream : public Stream
     {
     public:
-        PlaybackStream(std::unique_ptr<Source> source, unsigned buffer_size_ms)
+        PlaybackStream(std::unique_ptr<Source> source, unsigned buffer_size_ms, HANDLE event)
+          : event_(event)
         {
             std::lock_guard<decltype(mutex_)> lock(mutex_);
 
@@ -446,6 +467,8 @@ private:
             // enqueue the message so that the main audio thread can process it.
             std::lock_guard<decltype(this_->mutex_)> lock(this_->mutex_);
             this_->message_queue_.push(message);
+            // wake up the audio thread waiting on the device.
+            SetEvent(this_->event_);
         }
 
     private:
@@ -454,6 +477,7 @@ private:
         std::uint64_t milliseconds_ = 0;
     private:
         HWAVEOUT handle_ = NULL;
+        HANDLE event_ = NULL;
 
         struct WaveOutMessage {
             UINT message = 0;
@@ -469,6 +493,7 @@ private:
     // currently active streams that we have to pump
     std::list<std::weak_ptr<PlaybackStream>> streams_;
     unsigned buffer_size_ = 20;
+    HANDLE event_ = NULL;
 };
 
 // static
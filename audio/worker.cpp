@@ -0,0 +1,174 @@
+// Copyright (C) 2020-2021 Sami Väisänen
+// Copyright (C) 2020-2021 Ensisoft http://www.ensisoft.com
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+#include "config.h"
+
+#include <chrono>
+
+#include "base/assert.h"
+#include "base/logging.h"
+#include "audio/worker.h"
+
+namespace {
+// the pool used for processing the audio graphs on this thread.
+thread_local audio::WorkerPool* current_pool = nullptr;
+// set when the current thread is running tasks, either as
+// one of the pool's threads or as the thread calling ParallelFor.
+thread_local bool running_tasks = false;
+
+inline std::uint32_t GetBatchId(std::uint64_t cursor)
+{ return static_cast<std::uint32_t>(cursor >> 32); }
+inline unsigned GetTaskCount(std::uint64_t cursor)
+{ return static_cast<unsigned>((cursor >> 16) & 0xffff); }
+inline unsigned GetTaskIndex(std::uint64_t cursor)
+{ return static_cast<unsigned>(cursor & 0xffff); }
+} // namespace
+
+namespace audio
+{
+
+WorkerPool::WorkerPool(unsigned threads)
+{
+    for (unsigned i=0; i<threads; ++i)
+    {
+        mBufferPools.push_back(std::make_unique<BufferPool>());
+    }
+    for (unsigned i=0; i<threads; ++i)
+    {
+        mThreads.emplace_back(&WorkerPool::ThreadLoop, this, i);
+    }
+    DEBUG("Created audio worker pool. [threads=%1]", threads);
+}
+
+WorkerPool::~WorkerPool()
+{
+    mShutdown.store(true, std::memory_order_release);
+    {
+        // take the lock so that no worker can be between
+        // checking the shutdown flag and going to sleep.
+        std::lock_guard<decltype(mMutex)> lock(mMutex);
+    }
+    mCondition.notify_all();
+    for (auto& thread : mThreads)
+    {
+        thread.join();
+    }
+    DEBUG("Deleted audio worker pool.");
+}
+
+// static
+void WorkerPool::SetCurrent(WorkerPool* pool)
+{
+    current_pool = pool;
+}
+
+// static
+WorkerPool* WorkerPool::GetCurrent()
+{
+    return current_pool;
+}
+
+void WorkerPool::Run(unsigned count, BufferAllocator& allocator, TaskFunc func, void* context)
+{
+    if (count <= 1 || count > 0xffff || running_tasks || mThreads.empty())
+    {
+        for (unsigned i=0; i<count; ++i)
+            func(context, i, allocator);
+        return;
+    }
+
+    // the previous batch has completed so no worker can be
+    // reading the batch function or the context anymore.
+    mTaskFunc    = func;
+    mTaskContext = context;
+    mCompleted.store(0, std::memory_order_relaxed);
+
+    const auto batch = GetBatchId(mCursor.load(std::memory_order_relaxed)) + 1;
+    mCursor.store((std::uint64_t(batch) << 32) | (std::uint64_t(count) << 16), std::memory_order_release);
+
+    // signal the workers without taking the mutex so that the calling
+    // (audio) thread never waits for a lower priority worker thread
+    // to release the lock. a worker that misses the signal will see
+    // the batch when its wait times out.
+    mCondition.notify_all();
+
+    // run the tasks that the workers haven't claimed.
+    running_tasks = true;
+    RunTasks(allocator);
+    running_tasks = false;
+
+    // wait for the tasks still running on the worker threads.
+    while (mCompleted.load(std::memory_order_acquire) != count)
+    {
+        std::this_thread::yield();
+    }
+}
+
+void WorkerPool::RunTasks(BufferAllocator& allocator)
+{
+    auto cursor = mCursor.load(std::memory_order_acquire);
+    for (;;)
+    {
+        // the batch id in the cursor makes sure that a thread that is
+        // late to wake up can't claim a task of a later batch based on
+        // an earlier cursor value.
+        if (GetTaskIndex(cursor) >= GetTaskCount(cursor))
+            return;
+        if (!mCursor.compare_exchange_weak(cursor, cursor + 1, std::memory_order_acq_rel, std::memory_order_acquire))
+            continue;
+
+        // the batch can't complete (and a new batch can't start) before
+        // the claimed task is done so the function and the context are
+        // the ones that belong to the claimed batch.
+        mTaskFunc(mTaskContext, GetTaskIndex(cursor), allocator);
+        mCompleted.fetch_add(1, std::memory_order_release);
+        cursor = mCursor.load(std::memory_order_acquire);
+    }
+}
+
+void WorkerPool::ThreadLoop(unsigned index)
+{
+    DEBUG("Hello from audio worker thread. [index=%1]", index);
+    running_tasks = true;
+
+    auto& allocator = *mBufferPools[index];
+    auto last_batch = GetBatchId(mCursor.load(std::memory_order_acquire));
+    for (;;)
+    {
+        {
+            // the signal for a new batch can be missed since it's sent
+            // without holding the mutex. the timeout limits how long a
+            // batch can go unnoticed, the calling thread runs the tasks
+            // in the meantime.
+            std::unique_lock<decltype(mMutex)> lock(mMutex);
+            mCondition.wait_for(lock, std::chrono::milliseconds(5), [this, last_batch]() {
+                return mShutdown.load(std::memory_order_acquire) ||
+                       GetBatchId(mCursor.load(std::memory_order_acquire)) != last_batch;
+            });
+        }
+        if (mShutdown.load(std::memory_order_acquire))
+            break;
+
+        const auto cursor = mCursor.load(std::memory_order_acquire);
+        if (GetBatchId(cursor) == last_batch)
+            continue;
+        last_batch = GetBatchId(cursor);
+        RunTasks(allocator);
+    }
+    DEBUG("Audio worker thread exiting. [index=%1]", index);
+}
+
+} // namespace
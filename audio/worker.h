@@ -0,0 +1,115 @@
+// Copyright (C) 2020-2021 Sami Väisänen
+// Copyright (C) 2020-2021 Ensisoft http://www.ensisoft.com
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+#pragma once
+
+#include "config.h"
+
+#include <vector>
+#include <memory>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <cstdint>
+
+#include "audio/buffer.h"
+
+namespace audio
+{
+    // Small pool of worker threads for processing independent parts
+    // of the audio graphs in parallel, for example independent graph
+    // branches or the sources of a mixer. The thread that runs the
+    // audio graphs (i.e. the audio player thread) hands out a batch of
+    // tasks with ParallelFor, takes part in running the tasks and
+    // then waits for the batch to complete. The tasks must only touch
+    // their own data so that the result is the same as when the tasks
+    // are run serially.
+    //
+    // The calling thread never blocks on a lock. It publishes the batch
+    // with atomics and signals the workers without holding the mutex.
+    // Any task that a worker hasn't claimed yet is run on the calling
+    // thread, so a worker that misses the signal or is slow to wake up
+    // only reduces the parallelism. The calling thread only waits for
+    // tasks that a worker has already started.
+    //
+    // Each worker thread has its own buffer pool so that the tasks can
+    // allocate audio buffers without locking. The calling thread uses
+    // the allocator that it passes to ParallelFor.
+    class WorkerPool
+    {
+    public:
+        // Create a new pool with the given number of worker threads.
+        explicit WorkerPool(unsigned threads);
+       ~WorkerPool();
+        WorkerPool(const WorkerPool&) = delete;
+
+        // Get the number of worker threads (not including the
+        // calling thread).
+        unsigned GetNumThreads() const
+        { return static_cast<unsigned>(mThreads.size()); }
+
+        // Run 'count' tasks by calling func(index, allocator) for each
+        // task index and wait until all the tasks have completed.
+        // If ParallelFor is called from within a task the tasks are
+        // simply run serially on the calling thread.
+        template<typename Function>
+        void ParallelFor(unsigned count, BufferAllocator& allocator, Function func)
+        {
+            Run(count, allocator, &Invoke<Function>, &func);
+        }
+
+        // Set the pool that is used for processing the audio graphs
+        // on the calling thread. The pool must outlive any audio graph
+        // processing on the thread. nullptr to process everything
+        // serially. Normally the audio player sets the pool that it
+        // has been given on the audio thread.
+        static void SetCurrent(WorkerPool* pool);
+        // Get the pool used for processing the audio graphs on
+        // the calling thread if any.
+        static WorkerPool* GetCurrent();
+    private:
+        using TaskFunc = void (*)(void* context, unsigned index, BufferAllocator& allocator);
+        template<typename Function> static
+        void Invoke(void* context, unsigned index, BufferAllocator& allocator)
+        {
+            (*static_cast<Function*>(context))(index, allocator);
+        }
+        void Run(unsigned count, BufferAllocator& allocator, TaskFunc func, void* context);
+        void RunTasks(BufferAllocator& allocator);
+        void ThreadLoop(unsigned index);
+    private:
+        std::vector<std::thread> mThreads;
+        std::vector<std::unique_ptr<BufferPool>> mBufferPools;
+        // the mutex and the condition are only used by the worker
+        // threads for sleeping between the batches.
+        std::mutex mMutex;
+        std::condition_variable mCondition;
+        std::atomic<bool> mShutdown = {false};
+        // The current batch function and context. Only written by the
+        // calling thread before the batch is published through the cursor
+        // and only read after a task of the batch has been claimed.
+        TaskFunc mTaskFunc = nullptr;
+        void* mTaskContext = nullptr;
+        // The id of the current batch in the high 32 bits, the number
+        // of tasks in the batch in the next 16 bits and the index of the
+        // next task to run in the low 16 bits.
+        std::atomic<std::uint64_t> mCursor = {0};
+        // The number of completed tasks in the current batch.
+        std::atomic<unsigned> mCompleted = {0};
+    };
+
+} // namespace
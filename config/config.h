@@ -44,3 +44,4 @@
 #endif
 #define AUDIO_LOCK_FREE_QUEUE
 #define AUDIO_USE_PLAYER_THREAD
+#define AUDIO_USE_PREPARE_THREAD
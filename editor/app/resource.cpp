@@ -265,7 +265,11 @@ void PackResource(audio::GraphClass& audio, ResourcePacker& packer)
                 WARN("Audio element doesn't have input file set. [graph='%1', elem='%2']", audio.GetName(), name);
                 continue;
             }
-            packer.CopyFile(*file_uri, "audio/");
+            const auto* packing = audio::FindElementArg<audio::FileSource::Packing>(elem.args, "packing");
+            const auto* type    = audio::FindElementArg<audio::SampleType>(elem.args, "type");
+            const bool transcode = packing && *packing == audio::FileSource::Packing::Transcode;
+            if (!transcode || !packer.TranscodeAudioFile(*file_uri, "audio/", type ? *type : audio::SampleType::Float32))
+                packer.CopyFile(*file_uri, "audio/");
             *file_uri = packer.MapUri(*file_uri);
         }
     }
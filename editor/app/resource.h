@@ -54,6 +54,12 @@ namespace app
         virtual void WriteFile(const std::string& uri, const std::string& dir, const void* data, size_t len) = 0;
         virtual bool ReadFile(const std::string& uri, QByteArray* bytes) const = 0;
         virtual std::string MapUri(const std::string& uri) const = 0;
+        // Transcode the audio file into PCM in the packaged game's native
+        // audio format and write it into the given dir. Returns false if the
+        // packer doesn't transcode audio files or if the transcoding failed.
+        // In that case the file should be copied as-is instead.
+        virtual bool TranscodeAudioFile(const std::string& uri, const std::string& dir, audio::SampleType type)
+        { return false; }
     private:
     };
 
@@ -56,8 +56,10 @@
 #include "editor/app/process.h"
 #include "graphics/resource.h"
 #include "graphics/color4f.h"
+#include "graphics/baked_texture.h"
 #include "engine/ui.h"
 #include "engine/data.h"
+#include "audio/wav.h"
 #include "data/json.h"
 #include "base/json.h"
 
@@ -483,9 +485,10 @@ private:
 class MyResourcePacker : public app::ResourcePacker
 {
 public:
-    MyResourcePacker(const QString& package_dir, const QString& workspace_dir)
+    MyResourcePacker(const QString& package_dir, const QString& workspace_dir, unsigned audio_sample_rate)
       : mPackageDir(package_dir)
       , mWorkspaceDir(workspace_dir)
+      , mAudioSampleRate(audio_sample_rate)
     {}
     virtual void CopyFile(const std::string& uri, const std::string& dir) override
     {
@@ -540,14 +543,40 @@ public:
         ASSERT(mapping);
         return *mapping;
     }
-    QString WriteFile(const QString& src_file, const QString& dst_dir, const void* data, size_t len)
+    virtual bool TranscodeAudioFile(const std::string& uri, const std::string& dir, audio::SampleType type) override
+    {
+        if (const auto* dupe = base::SafeFind(mUriMapping, uri))
+        {
+            DEBUG("Skipping duplicate audio file transcode. [file='%1']", uri);
+            return true;
+        }
+        const auto& src_file = MapFileToFilesystem(app::FromUtf8(uri));
+        std::vector<std::uint8_t> wav;
+        if (!audio::TranscodeToWav(app::ToUtf8(src_file), type, mAudioSampleRate, &wav))
+        {
+            WARN("Failed to transcode audio file. Copying file as-is. [file='%1']", src_file);
+            return false;
+        }
+        // the transcoded file is a .wav file so that the engine knows
+        // to read it with the WAV decoder.
+        const auto& dst_name = QFileInfo(src_file).completeBaseName() + ".wav";
+        const auto& dst_file = WriteFile(src_file, app::FromUtf8(dir), wav.data(), wav.size(), dst_name);
+        if (dst_file.isEmpty())
+            return false;
+        mUriMapping[uri] = app::ToUtf8(MapFileToPackage(dst_file));
+        mFileNames.insert(dst_file);
+        DEBUG("Transcoded audio file. [file='%1', dst='%2', rate=%3, type=%4]", uri, dst_file, mAudioSampleRate, type);
+        return true;
+    }
+    QString WriteFile(const QString& src_file, const QString& dst_dir, const void* data, size_t len,
+                      const QString& filename = QString(""))
     {
         if (!app::MakePath(app::JoinPath(mPackageDir, dst_dir)))
         {
             ERROR("Failed to create directory. [dir='%1/%2']", mPackageDir, dst_dir);
             return "";
         }
-        const auto& dst_file = CreateFileName(src_file, dst_dir, QString(""));
+        const auto& dst_file = CreateFileName(src_file, dst_dir, filename);
         if (dst_file.isEmpty())
             return "";
 
@@ -666,6 +695,7 @@ private:
 private:
     const QString mPackageDir;
     const QString mWorkspaceDir;
+    const unsigned mAudioSampleRate = 0;
     unsigned mNumErrors = 0;
     unsigned mNumCopies = 0;
     std::unordered_map<QString, QString> mFileMap;
@@ -681,7 +711,7 @@ public:
     GfxTexturePacker(const QString& outdir,
                      unsigned max_width, unsigned max_height,
                      unsigned pack_width, unsigned pack_height, unsigned padding,
-                     bool resize_large, bool pack_small)
+                     bool resize_large, bool pack_small, bool bake)
         : kOutDir(outdir)
         , kMaxTextureWidth(max_width)
         , kMaxTextureHeight(max_height)
@@ -690,6 +720,7 @@ public:
         , kTexturePadding(padding)
         , kResizeLargeTextures(resize_large)
         , kPackSmallTextures(pack_small)
+        , kBakeTextures(bake)
     {}
    ~GfxTexturePacker()
     {
@@ -714,6 +745,10 @@ public:
             mTextureMap[instance].allowed_to_combine = on_off;
         else if (flags == gfx::TexturePacker::TextureFlags::AllowedToResize)
             mTextureMap[instance].allowed_to_resize = on_off;
+        else if (flags == gfx::TexturePacker::TextureFlags::ColorSpace_sRGB)
+            mTextureMap[instance].srgb = on_off;
+        else if (flags == gfx::TexturePacker::TextureFlags::PremulAlpha)
+            mTextureMap[instance].premul_alpha = on_off;
         else BUG("Unhandled texture packing flag.");
     }
     virtual std::string GetPackedTextureId(ObjectHandle instance) const override
@@ -728,9 +763,85 @@ public:
         ASSERT(it != std::end(mTextureMap));
         return it->second.rect;
     }
+    virtual std::string GetBakedTextureId(ObjectHandle instance) const override
+    {
+        auto it = mTextureMap.find(instance);
+        ASSERT(it != std::end(mTextureMap));
+        return it->second.baked;
+    }
 
     using TexturePackingProgressCallback = std::function<void (std::string, int, int)>;
 
+    // Bake the packaged texture files into GPU ready texture containers
+    // that have the image already decoded, premultiplied and mipmapped
+    // so that the game doesn't need to do that work when loading.
+    // The same image can be used with different processing settings
+    // (color space, alpha premultiply) so the baked file is per image
+    // file *and* settings combination.
+    void BakeTextures(TexturePackingProgressCallback progress)
+    {
+        std::unordered_set<std::string> baked_files;
+
+        int cur_step = 0;
+        int max_step = static_cast<int>(mTextureMap.size());
+        for (auto& pair : mTextureMap)
+        {
+            progress("Baking textures...", cur_step++, max_step);
+
+            TextureSource& tex = pair.second;
+            if (!base::StartsWith(tex.file, "pck://"))
+                continue;
+
+            const auto& baked_uri = gfx::GetBakedTextureName(tex.file, tex.srgb, tex.premul_alpha);
+            if (baked_files.find(baked_uri) != baked_files.end())
+            {
+                tex.baked = baked_uri;
+                continue;
+            }
+            const auto& img_file = app::JoinPath(kOutDir, app::FromUtf8(tex.file.substr(6)));
+            const auto& dst_file = app::JoinPath(kOutDir, app::FromUtf8(baked_uri.substr(6)));
+
+            std::vector<char> img_data;
+            if (!app::ReadBinaryFile(img_file, img_data))
+            {
+                ERROR("Failed to open image file. [file='%1']", img_file);
+                mNumErrors++;
+                continue;
+            }
+            gfx::Image img;
+            if (!img.Load(&img_data[0], img_data.size()))
+            {
+                ERROR("Failed to decompress image file. [file='%1']", img_file);
+                mNumErrors++;
+                continue;
+            }
+            std::unique_ptr<gfx::IBitmap> bitmap;
+            if (img.GetDepthBits() == 8)
+                bitmap = std::make_unique<gfx::AlphaMask>(img.AsBitmap<gfx::Grayscale>());
+            else if (img.GetDepthBits() == 24)
+                bitmap = std::make_unique<gfx::RgbBitmap>(img.AsBitmap<gfx::RGB>());
+            else if (img.GetDepthBits() == 32)
+                bitmap = std::make_unique<gfx::RgbaBitmap>(img.AsBitmap<gfx::RGBA>());
+
+            std::vector<char> baked;
+            if (!bitmap || !gfx::BakeTexture(*bitmap, tex.srgb, tex.premul_alpha, &baked))
+            {
+                ERROR("Failed to bake texture. [file='%1']", img_file);
+                mNumErrors++;
+                continue;
+            }
+            if (!app::WriteBinaryFile(dst_file, baked))
+            {
+                ERROR("Failed to write baked texture file. [file='%1']", dst_file);
+                mNumErrors++;
+                continue;
+            }
+            DEBUG("Baked texture file. [src='%1', dst='%2', bytes=%3]", img_file, dst_file, baked.size());
+            baked_files.insert(baked_uri);
+            tex.baked = baked_uri;
+        }
+    }
+
     void PackTextures(TexturePackingProgressCallback  progress, MyResourcePacker& packer)
     {
         if (mTextureMap.empty())
@@ -1110,6 +1221,9 @@ public:
                                   relocation.width * original_rect_width,
                                   relocation.height * original_rect_height);
         }
+
+        if (kBakeTextures)
+            BakeTextures(progress);
     }
     unsigned GetNumErrors() const
     { return mNumErrors; }
@@ -1122,14 +1236,19 @@ private:
     const unsigned kTexturePadding = 0;
     const bool kResizeLargeTextures = true;
     const bool kPackSmallTextures = true;
+    const bool kBakeTextures = false;
     unsigned mNumErrors = 0;
 
     struct TextureSource {
         std::string file;
+        // the baked texture file if any.
+        std::string baked;
         gfx::FRect  rect;
         bool can_be_combined = true;
         bool allowed_to_resize = true;
         bool allowed_to_combine = true;
+        bool srgb = false;
+        bool premul_alpha = false;
     };
     std::unordered_map<ObjectHandle, TextureSource> mTextureMap;
     std::vector<QString> mTempFiles;
@@ -3107,7 +3226,7 @@ bool Workspace::BuildReleasePackage(const std::vector<const Resource*>& resource
 
     DEBUG("Max texture size. [width=%1, height=%2]", options.max_texture_width, options.max_texture_height);
     DEBUG("Pack size. [width=%1, height=%2]", options.texture_pack_width, options.texture_pack_height);
-    DEBUG("Pack flags. [resize=%1, combine=%2]", options.resize_textures, options.combine_textures);
+    DEBUG("Pack flags. [resize=%1, combine=%2, bake=%3]", options.resize_textures, options.combine_textures, options.bake_textures);
 
     GfxTexturePacker texture_packer(outdir,
         options.max_texture_width,
@@ -3116,7 +3235,8 @@ bool Workspace::BuildReleasePackage(const std::vector<const Resource*>& resource
         options.texture_pack_height,
         options.texture_padding,
         options.resize_textures,
-        options.combine_textures);
+        options.combine_textures,
+        options.bake_textures);
 
     // collect the resources in the packer.
     for (int i=0; i<mutable_copies.size(); ++i)
@@ -3132,7 +3252,7 @@ bool Workspace::BuildReleasePackage(const std::vector<const Resource*>& resource
         }
     }
 
-    MyResourcePacker file_packer(outdir, mWorkspaceDir);
+    MyResourcePacker file_packer(outdir, mWorkspaceDir, mSettings.audio_sample_rate);
 
     unsigned errors = 0;
 
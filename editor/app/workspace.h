@@ -675,6 +675,9 @@ namespace app
             bool write_config_file = true;
             // Combine small textures into texture atlas files.
             bool combine_textures = true;
+            // Bake the textures into GPU ready texture files that have
+            // the image data already decoded and the mips computed.
+            bool bake_textures = false;
             // Resize large (oversized) textures to fit in the
             // specified min/maxtexture dimensions.
             bool resize_textures = true;
@@ -25,6 +25,7 @@
 #include "warnpop.h"
 
 #include <map>
+#include <algorithm>
 
 #include "audio/element.h"
 #include "audio/graph.h"
@@ -153,6 +154,11 @@ public:
     }
     void SetId(const std::string& id)
     { mId = id; }
+    void SetProfile(const QString& profile)
+    {
+        mProfile = profile;
+        update();
+    }
 
     void ApplyState(audio::GraphClass& klass) const
     {
@@ -588,6 +594,9 @@ public:
             painter->fillPath(p, QColor(0, 128, 0));
             painter->drawText(port.rect, Qt::AlignVCenter | Qt::AlignHCenter, app::FromUtf8(port.name));
         }
+        if (!mProfile.isEmpty())
+            painter->drawText(0, -10, mProfile);
+
         //if (mIsValid) return;
         QPen failure;
         failure.setColor(QColor(200, 0, 0));
@@ -726,6 +735,7 @@ private:
     std::vector<ArgDesc> mArgs;
     mutable QString mMessage;
     mutable bool mIsValid = true;
+    QString mProfile;
 };
 } // namespace
 
@@ -1106,6 +1116,8 @@ AudioWidget::AudioWidget(app::Workspace* workspace)
     PopulateFromEnum<audio::Channels>(mUI.channels);
     PopulateFromEnum<audio::Effect::Kind>(mUI.effect);
     PopulateFromEnum<audio::IOStrategy>(mUI.ioStrategy);
+    PopulateFromEnum<audio::FileSource::Packing>(mUI.packing);
+    PopulateFromEnum<audio::BiquadFilter::Type>(mUI.filter);
     SetValue(mUI.graphName, QString("My Graph"));
     SetValue(mUI.graphID, base::RandomString(10));
     SetEnabled(mUI.actionPause, false);
@@ -1139,6 +1151,8 @@ AudioWidget::AudioWidget(app::Workspace* workspace, const app::Resource& resourc
     SetValue(mUI.outElem, ListItemId(klass->GetGraphOutputElementId()));
     on_outElem_currentIndexChanged(0);
     SetValue(mUI.outPort, ListItemId(klass->GetGraphOutputElementPort()));
+    SetValue(mUI.maxVoices, klass->GetMaxVoices());
+    SetValue(mUI.voicePriority, klass->GetVoicePriority());
     GetSelectedElementProperties();
 
     mGraphHash = GetHash();
@@ -1238,6 +1252,8 @@ bool AudioWidget::SaveState(Settings& settings) const
     settings.SetValue("Audio", "graph_out_port", (QString)GetItemId(mUI.outPort));
     settings.SaveWidget("Audio", mUI.graphName);
     settings.SaveWidget("Audio", mUI.graphID);
+    settings.SaveWidget("Audio", mUI.maxVoices);
+    settings.SaveWidget("Audio", mUI.voicePriority);
     return true;
 }
 bool AudioWidget::LoadState(const Settings& settings)
@@ -1251,6 +1267,8 @@ bool AudioWidget::LoadState(const Settings& settings)
     settings.GetValue("Audio", "graph_out_port", &graph_out_port);
     settings.LoadWidget("Audio", mUI.graphName);
     settings.LoadWidget("Audio", mUI.graphID);
+    settings.LoadWidget("Audio", mUI.maxVoices);
+    settings.LoadWidget("Audio", mUI.voicePriority);
 
     mScene->FromJson(json);
 
@@ -1470,6 +1488,11 @@ void AudioWidget::on_actionPlay_triggered()
 
         const auto& port = (*source)->GetOutputPort(0);
         NOTE("Graph output %1", port.GetFormat());
+        source->SetProfilingInterval(500);
+        // the profiling data is in the graph's schedule order.
+        mProfileIds.clear();
+        for (const auto& element : (*source)->GetSchedule())
+            mProfileIds.push_back(element.id);
         mCurrentId = mPlayer->Play(std::move(source));
     }
     else
@@ -1501,6 +1524,7 @@ void AudioWidget::on_actionStop_triggered()
     SetEnabled(mUI.actionPause, false);
     SetEnabled(mUI.actionStop, false);
     mRefreshTimer.stop();
+    ClearProfile();
 }
 void AudioWidget::on_actionSave_triggered()
 {
@@ -1510,6 +1534,8 @@ void AudioWidget::on_actionSave_triggered()
     audio::GraphClass klass(GetValue(mUI.graphName),GetValue(mUI.graphID));
     klass.SetGraphOutputElementId(GetItemId(mUI.outElem));
     klass.SetGraphOutputElementPort(GetItemId(mUI.outPort));
+    klass.SetMaxVoices(GetValue(mUI.maxVoices));
+    klass.SetVoicePriority(GetValue(mUI.voicePriority));
     mScene->ApplyState(klass);
     const auto hash = klass.GetHash();
 
@@ -1835,6 +1861,42 @@ void AudioWidget::on_fileCaching_stateChanged(int)
 {
     SetSelectedElementProperties();
 }
+void AudioWidget::on_packing_currentIndexChanged(int)
+{
+    SetSelectedElementProperties();
+}
+void AudioWidget::on_filter_currentIndexChanged(int)
+{
+    SetSelectedElementProperties();
+}
+void AudioWidget::on_cutoff_valueChanged(double)
+{
+    SetSelectedElementProperties();
+}
+void AudioWidget::on_filterQ_valueChanged(double)
+{
+    SetSelectedElementProperties();
+}
+void AudioWidget::on_threshold_valueChanged(double)
+{
+    SetSelectedElementProperties();
+}
+void AudioWidget::on_ratio_valueChanged(double)
+{
+    SetSelectedElementProperties();
+}
+void AudioWidget::on_attack_valueChanged(double)
+{
+    SetSelectedElementProperties();
+}
+void AudioWidget::on_release_valueChanged(double)
+{
+    SetSelectedElementProperties();
+}
+void AudioWidget::on_makeup_valueChanged(double)
+{
+    SetSelectedElementProperties();
+}
 
 void AudioWidget::SceneSelectionChanged()
 {
@@ -1914,6 +1976,8 @@ size_t AudioWidget::GetHash() const
     audio::GraphClass klass(GetValue(mUI.graphName),GetValue(mUI.graphID));
     klass.SetGraphOutputElementId(GetItemId(mUI.outElem));
     klass.SetGraphOutputElementPort(GetItemId(mUI.outPort));
+    klass.SetMaxVoices(GetValue(mUI.maxVoices));
+    klass.SetVoicePriority(GetValue(mUI.voicePriority));
     mScene->ApplyState(klass);
     return klass.GetHash();
 }
@@ -1939,6 +2003,15 @@ void AudioWidget::GetSelectedElementProperties()
     SetValue(mUI.loopCount, 1);
     SetValue(mUI.pcmCaching, false);
     SetValue(mUI.fileCaching, false);
+    SetValue(mUI.packing, audio::FileSource::Packing::KeepCompressed);
+    SetValue(mUI.filter, audio::BiquadFilter::Type::LowPass);
+    SetValue(mUI.cutoff, 1000.0f);
+    SetValue(mUI.filterQ, 0.7071f);
+    SetValue(mUI.threshold, -12.0f);
+    SetValue(mUI.ratio, 4.0f);
+    SetValue(mUI.attack, 10.0f);
+    SetValue(mUI.release, 100.0f);
+    SetValue(mUI.makeup, 0.0f);
 
     SetEnabled(mUI.sampleType, false);
     SetEnabled(mUI.sampleRate, false);
@@ -1957,6 +2030,15 @@ void AudioWidget::GetSelectedElementProperties()
     SetEnabled(mUI.loopCount, false);
     SetEnabled(mUI.pcmCaching, false);
     SetEnabled(mUI.fileCaching, false);
+    SetEnabled(mUI.packing, false);
+    SetEnabled(mUI.filter, false);
+    SetEnabled(mUI.cutoff, false);
+    SetEnabled(mUI.filterQ, false);
+    SetEnabled(mUI.threshold, false);
+    SetEnabled(mUI.ratio, false);
+    SetEnabled(mUI.attack, false);
+    SetEnabled(mUI.release, false);
+    SetEnabled(mUI.makeup, false);
 
     /*
     SetVisible(mUI.sampleType, false);
@@ -2050,6 +2132,12 @@ void AudioWidget::GetSelectedElementProperties()
         SetVisible(mUI.fileCaching, true);
         SetValue(mUI.fileCaching, *val);
     }
+    if (const auto* val = item->GetArgValue<audio::FileSource::Packing>("packing"))
+    {
+        SetEnabled(mUI.packing, true);
+        SetVisible(mUI.packing, true);
+        SetValue(mUI.packing, *val);
+    }
 
     if (const auto* val = item->GetArgValue<float>("gain"))
     {
@@ -2086,6 +2174,46 @@ void AudioWidget::GetSelectedElementProperties()
         SetEnabled(mUI.effect, true);
         SetValue(mUI.effect, *val);
     }
+    if (const auto* val = item->GetArgValue<audio::BiquadFilter::Type>("filter"))
+    {
+        SetEnabled(mUI.filter, true);
+        SetValue(mUI.filter, *val);
+    }
+    if (const auto* val = item->GetArgValue<float>("cutoff"))
+    {
+        SetEnabled(mUI.cutoff, true);
+        SetValue(mUI.cutoff, *val);
+    }
+    if (const auto* val = item->GetArgValue<float>("q"))
+    {
+        SetEnabled(mUI.filterQ, true);
+        SetValue(mUI.filterQ, *val);
+    }
+    if (const auto* val = item->GetArgValue<float>("threshold"))
+    {
+        SetEnabled(mUI.threshold, true);
+        SetValue(mUI.threshold, *val);
+    }
+    if (const auto* val = item->GetArgValue<float>("ratio"))
+    {
+        SetEnabled(mUI.ratio, true);
+        SetValue(mUI.ratio, *val);
+    }
+    if (const auto* val = item->GetArgValue<float>("attack"))
+    {
+        SetEnabled(mUI.attack, true);
+        SetValue(mUI.attack, *val);
+    }
+    if (const auto* val = item->GetArgValue<float>("release"))
+    {
+        SetEnabled(mUI.release, true);
+        SetValue(mUI.release, *val);
+    }
+    if (const auto* val = item->GetArgValue<float>("makeup"))
+    {
+        SetEnabled(mUI.makeup, true);
+        SetValue(mUI.makeup, *val);
+    }
 
     if (item->IsFileSource())
     {
@@ -2152,6 +2280,24 @@ void AudioWidget::SetSelectedElementProperties()
         *val = GetValue(mUI.fileCaching);
     if (auto* val = item->GetArgValue<audio::FileSource::IOStrategy>("io_strategy"))
         *val = GetValue(mUI.ioStrategy);
+    if (auto* val = item->GetArgValue<audio::FileSource::Packing>("packing"))
+        *val = GetValue(mUI.packing);
+    if (auto* val = item->GetArgValue<audio::BiquadFilter::Type>("filter"))
+        *val = GetValue(mUI.filter);
+    if (auto* val = item->GetArgValue<float>("cutoff"))
+        *val = GetValue(mUI.cutoff);
+    if (auto* val = item->GetArgValue<float>("q"))
+        *val = GetValue(mUI.filterQ);
+    if (auto* val = item->GetArgValue<float>("threshold"))
+        *val = GetValue(mUI.threshold);
+    if (auto* val = item->GetArgValue<float>("ratio"))
+        *val = GetValue(mUI.ratio);
+    if (auto* val = item->GetArgValue<float>("attack"))
+        *val = GetValue(mUI.attack);
+    if (auto* val = item->GetArgValue<float>("release"))
+        *val = GetValue(mUI.release);
+    if (auto* val = item->GetArgValue<float>("makeup"))
+        *val = GetValue(mUI.makeup);
 
     mScene->invalidate();
 }
@@ -2182,6 +2328,7 @@ void AudioWidget::OnAudioPlayerEvent(const audio::Player::SourceCompleteEvent& e
         mCurrentId = 0;
         mPlayTime = 0;
         mRefreshTimer.stop();
+        ClearProfile();
     }
 }
 void AudioWidget::OnAudioPlayerEvent(const audio::Player::SourceProgressEvent& event)
@@ -2192,7 +2339,44 @@ void AudioWidget::OnAudioPlayerEvent(const audio::Player::SourceProgressEvent& e
 
 void AudioWidget::OnAudioPlayerEvent(const audio::Player::SourceEvent& event)
 {
+    if (event.id != mCurrentId)
+        return;
+
+    if (const auto* profile = event.event->GetIf<audio::AudioGraph::ProfileEvent>())
+    {
+        const auto callbacks = std::max(profile->callbacks, std::uint64_t(1));
+        SetValue(mUI.graphProfile, QString("Avg %1ms max %2ms margin %3ms")
+            .arg(profile->total_time / callbacks, 0, 'f', 3)
+            .arg(profile->max_time, 0, 'f', 3)
+            .arg(profile->min_margin, 0, 'f', 3));
 
+        const auto count = std::min(profile->elements.size(), mProfileIds.size());
+        for (std::size_t i=0; i<count; ++i)
+        {
+            const auto& element = profile->elements[i];
+            for (auto* item : mItems)
+            {
+                auto* ptr = dynamic_cast<AudioElement*>(item);
+                if (ptr->GetId() != mProfileIds[i])
+                    continue;
+                const auto calls = std::max(element.calls, std::uint64_t(1));
+                ptr->SetProfile(QString("Avg %1ms max %2ms")
+                    .arg(element.total_time / calls, 0, 'f', 3)
+                    .arg(element.max_time, 0, 'f', 3));
+                break;
+            }
+        }
+    }
+}
+
+void AudioWidget::ClearProfile()
+{
+    for (auto* item : mItems)
+    {
+        auto* ptr = dynamic_cast<AudioElement*>(item);
+        ptr->SetProfile("");
+    }
+    SetValue(mUI.graphProfile, tr("Not playing"));
 }
 
 void AudioWidget::keyPressEvent(QKeyEvent* key)
@@ -107,6 +107,7 @@ namespace gui
         void GetSelectedElementProperties();
         void SetSelectedElementProperties();
         void UpdateElementList();
+        void ClearProfile();
         void OnAudioPlayerEvent(const audio::Player::SourceCompleteEvent& event);
         void OnAudioPlayerEvent(const audio::Player::SourceProgressEvent& event);
         void OnAudioPlayerEvent(const audio::Player::SourceEvent& event);
@@ -143,6 +144,15 @@ namespace gui
         void on_loopCount_valueChanged(int);
         void on_pcmCaching_stateChanged(int);
         void on_fileCaching_stateChanged(int);
+        void on_packing_currentIndexChanged(int);
+        void on_filter_currentIndexChanged(int);
+        void on_cutoff_valueChanged(double);
+        void on_filterQ_valueChanged(double);
+        void on_threshold_valueChanged(double);
+        void on_ratio_valueChanged(double);
+        void on_attack_valueChanged(double);
+        void on_release_valueChanged(double);
+        void on_makeup_valueChanged(double);
 
         void SceneSelectionChanged();
         void AddElementAction();
@@ -158,6 +168,9 @@ namespace gui
         std::unique_ptr<AudioGraphScene> mScene;
         std::shared_ptr<audio::Player> mPlayer;
         std::vector<QGraphicsItem*> mItems;
+        // The IDs of the elements of the graph being played
+        // in the order of the graph's profiling data.
+        std::vector<std::string> mProfileIds;
         std::size_t mCurrentId = 0;
         std::size_t mGraphHash = 0;
         double mPlayTime = 0.0;
@@ -66,6 +66,7 @@ DlgPackage::DlgPackage(QWidget* parent, gui::AppSettings& settings, app::Workspa
     GetProperty(workspace, "packing_param_max_tex_width", mUI.cmbMaxTexWidth);
     GetProperty(workspace, "packing_param_tex_padding", mUI.spinTexPadding);
     GetProperty(workspace, "packing_param_combine_textures", mUI.chkCombineTextures);
+    GetProperty(workspace, "packing_param_bake_textures", mUI.chkBakeTextures);
     GetProperty(workspace, "packing_param_resize_large_textures", mUI.chkResizeTextures);
     GetProperty(workspace, "packing_param_delete_prev", mUI.chkDelete);
     GetProperty(workspace, "packing_param_write_config", mUI.chkWriteConfig);
@@ -190,6 +191,7 @@ void DlgPackage::on_btnStart_clicked()
     SetProperty(mWorkspace, "packing_param_max_tex_width", mUI.cmbMaxTexWidth);
     SetProperty(mWorkspace, "packing_param_tex_padding", mUI.spinTexPadding);
     SetProperty(mWorkspace, "packing_param_combine_textures", mUI.chkCombineTextures);
+    SetProperty(mWorkspace, "packing_param_bake_textures", mUI.chkBakeTextures);
     SetProperty(mWorkspace, "packing_param_resize_large_textures", mUI.chkResizeTextures);
     SetProperty(mWorkspace, "packing_param_delete_prev", mUI.chkDelete);
     SetProperty(mWorkspace, "packing_param_write_config", mUI.chkWriteConfig);
@@ -204,6 +206,7 @@ void DlgPackage::on_btnStart_clicked()
     options.package_name                  = "pack0";
     options.combine_textures              = GetValue(mUI.chkCombineTextures);
     options.resize_textures               = GetValue(mUI.chkResizeTextures);
+    options.bake_textures                 = GetValue(mUI.chkBakeTextures);
     options.texture_pack_height           = GetValue(mUI.cmbPackHeight);
     options.texture_pack_width            = GetValue(mUI.cmbPackWidth);
     options.max_texture_width             = GetValue(mUI.cmbMaxTexWidth);
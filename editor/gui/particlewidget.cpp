@@ -253,6 +253,7 @@ ParticleEditorWidget::ParticleEditorWidget(app::Workspace* workspace)
 
     PopulateFromEnum<gfx::KinematicsParticleEngineClass::CoordinateSpace>(mUI.space);
     PopulateFromEnum<gfx::KinematicsParticleEngineClass::Motion>(mUI.motion);
+    PopulateFromEnum<gfx::KinematicsParticleEngineClass::Simulation>(mUI.simulation);
     PopulateFromEnum<gfx::KinematicsParticleEngineClass::BoundaryPolicy>(mUI.boundary);
     PopulateFromEnum<gfx::KinematicsParticleEngineClass::SpawnPolicy>(mUI.when);
     PopulateFromEnum<gfx::KinematicsParticleEngineClass::EmitterShape>(mUI.shape);
@@ -633,6 +634,7 @@ void ParticleEditorWidget::SetParams()
     params.direction                        = GetValue(mUI.direction);
     params.mode                             = GetValue(mUI.when);
     params.boundary                         = GetValue(mUI.boundary);
+    params.simulation                       = GetValue(mUI.simulation);
     params.num_particles                    = GetValue(mUI.numParticles);
     params.max_xpos                         = GetValue(mUI.simWidth);
     params.max_ypos                         = GetValue(mUI.simHeight);
@@ -695,6 +697,7 @@ void ParticleEditorWidget::ShowParams()
     SetValue(mUI.direction,           params.direction);
     SetValue(mUI.when,                params.mode);
     SetValue(mUI.boundary,            params.boundary);
+    SetValue(mUI.simulation,          params.simulation);
     SetValue(mUI.numParticles,        params.num_particles);
     SetValue(mUI.simWidth,            params.max_xpos);
     SetValue(mUI.simHeight,           params.max_ypos);
@@ -890,6 +893,11 @@ void ParticleEditorWidget::on_boundary_currentIndexChanged(int)
     SetParams();
 }
 
+void ParticleEditorWidget::on_simulation_currentIndexChanged(int)
+{
+    SetParams();
+}
+
 void ParticleEditorWidget::on_when_currentIndexChanged(int)
 {
     SetParams();
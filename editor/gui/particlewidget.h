@@ -82,6 +82,7 @@ namespace gui
         void on_space_currentIndexChanged(int);
         void on_motion_currentIndexChanged(int);
         void on_boundary_currentIndexChanged(int);
+        void on_simulation_currentIndexChanged(int);
         void on_when_currentIndexChanged(int);
         void on_shape_currentIndexChanged(int);
         void on_placement_currentIndexChanged(int);
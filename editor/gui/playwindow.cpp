@@ -312,6 +312,8 @@ public:
 private:
     QString ResolveURI(const std::string& URI) const
     {
+        // audio streams are opened on the engine's audio graph prepare thread.
+        std::lock_guard<std::mutex> lock(mFileMapMutex);
         auto it = mFileMaps.find(URI);
         if (it != mFileMaps.end())
             return it->second;
@@ -343,6 +345,7 @@ private:
     const QString mGameDir;
     const QString mHostDir;
     mutable std::unordered_map<std::string, QString> mFileMaps;
+    mutable std::mutex mFileMapMutex;
     mutable std::unordered_map<std::string, engine::EngineDataHandle> mEngineDataBuffers;
     mutable std::unordered_map<std::string, gfx::ResourceHandle> mGraphicsBuffers;
 };
@@ -636,6 +639,7 @@ void PlayWindow::RunGameLoopOnce()
                                    stats.dynamic_vbo_mem_alloc;
             SetValue(mUI.statVBO, QString("%1/%2 kB")
                     .arg(vbo_use / kb, 0, 'f', 1, ' ').arg(vbo_alloc / kb, 0, 'f', 1, ' '));
+            SetValue(mUI.statPrograms, (unsigned)stats.num_programs_built_in_game);
         }
 
         mNumFrames++;
@@ -1362,7 +1362,14 @@ void InitDoc()
                                               "to later identify the audio track when calling functions such as ResumeMusic or PauseMusic.<br>"
                                               "The audio graph is initially only prepared and sent to the audio mixer in paused state.<br>"
                                               "In order to start the actual audio playback ResumeMusic must be called separately.<br>"
-                                              "Returns true if the audio graph was prepared successfully or false on error.",
+                                              "The audio graph is prepared in the background and handed over to the audio mixer asynchronously.<br>"
+                                              "Returns true if the audio graph was queued for preparation successfully or false on error.",
+                 "audio.GraphClass|string", "graph|graph_name");
+    DOC_METHOD_1("bool", "PreloadGraph", "Preload (decode) the audio files used by the audio graph into the audio PCM cache "
+                                         "so that playing the graph later doesn't require decoding any audio.<br>"
+                                         "Only the file sources that have PCM caching enabled are preloaded. This is meant to be called "
+                                         "when loading a level.<br>"
+                                         "Returns true if all the audio files were preloaded successfully or false on error.",
                  "audio.GraphClass|string", "graph|graph_name");
     DOC_METHOD_1("bool", "PlayMusic", "Similar to PrepareMusicGraph except the audio playback is also started immediately.",
                  "audio.GraphClass|string", "graph|graph_name");
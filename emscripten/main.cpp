@@ -296,6 +296,7 @@ public:
         mDebugOptions.debug_draw      = false;
         mDebugOptions.debug_show_fps  = false;
         mDebugOptions.debug_show_msg  = false;
+        mDebugOptions.debug_show_stats = false;
         mDebugOptions.debug_print_fps = false;
         if (json.contains("debug"))
         {
@@ -303,6 +304,7 @@ public:
             base::JsonReadSafe(debug_settings, "font",     &mDebugOptions.debug_font);
             base::JsonReadSafe(debug_settings, "show_fps", &mDebugOptions.debug_show_fps);
             base::JsonReadSafe(debug_settings, "show_msg", &mDebugOptions.debug_show_msg);
+            base::JsonReadSafe(debug_settings, "show_stats", &mDebugOptions.debug_show_stats);
             base::JsonReadSafe(debug_settings, "draw",     &mDebugOptions.debug_draw);
         }
         mEngine->SetDebugOptions(mDebugOptions);
@@ -346,6 +348,10 @@ public:
             base::JsonReadSafe(engine_settings, "clear_color", &config.clear_color);
             base::JsonReadSafe(engine_settings, "default_min_filter", &config.default_min_filter);
             base::JsonReadSafe(engine_settings, "default_mag_filter", &config.default_mag_filter);
+            base::JsonReadSafe(engine_settings, "texture_memory_budget", &config.texture_memory_budget);
+            base::JsonReadSafe(engine_settings, "program_prepare_budget", &config.program_prepare_budget);
+            base::JsonReadSafe(engine_settings, "texture_atlas", &config.texture_atlas);
+            base::JsonReadSafe(engine_settings, "ui_paint_cache", &config.ui_paint_cache);
             base::JsonReadSafe(engine_settings, "updates_per_second", &config.updates_per_second);
             base::JsonReadSafe(engine_settings, "ticks_per_second", &config.ticks_per_second);
             DEBUG("time_step = 1.0/%1, tick_step = 1.0/%2", config.updates_per_second, config.ticks_per_second);
@@ -368,6 +374,11 @@ public:
             base::JsonReadSafe(audio, "sample_type", &config.audio.sample_type);
             base::JsonReadSafe(audio, "buffer_size", &config.audio.buffer_size);
             base::JsonReadSafe(audio, "pcm_caching", &config.audio.enable_pcm_caching);
+            base::JsonReadSafe(audio, "pcm_cache_budget", &config.audio.pcm_cache_budget);
+            base::JsonReadSafe(audio, "read_ahead", &config.audio.enable_read_ahead);
+            base::JsonReadSafe(audio, "max_effect_voices", &config.audio.max_effect_voices);
+            base::JsonReadSafe(audio, "worker_threads", &config.audio.worker_threads);
+            base::JsonReadSafe(audio, "profiling_interval", &config.audio.profiling_interval);
         }
         mEngine->SetEngineConfig(config);
         // doesn't exist here.
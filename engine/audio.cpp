@@ -24,6 +24,7 @@
 #include "audio/graph.h"
 #include "audio/player.h"
 #include "audio/buffer.h"
+#include "audio/worker.h"
 #include "engine/audio.h"
 #include "engine/loader.h"
 #include "engine/data.h"
@@ -41,16 +42,40 @@ AudioEngine::AudioEngine(const std::string& name)
 
 AudioEngine::~AudioEngine()
 {
+#if defined(GAMESTUDIO_ENABLE_AUDIO) && defined(AUDIO_USE_PREPARE_THREAD)
+    if (mPrepareThread)
+    {
+        {
+            std::unique_lock<decltype(mPrepareMutex)> lock(mPrepareMutex);
+            mPrepareShutdown = true;
+            mPrepareCondition.notify_one();
+        }
+        mPrepareThread->join();
+        mPrepareThread.reset();
+    }
+#endif
 #if defined(GAMESTUDIO_ENABLE_AUDIO)
+    mPendingEffectActions.clear();
+    mPendingMusicActions.clear();
     if (mPlayer)
     {
         mPlayer->Cancel(mEffectGraphId);
         mPlayer->Cancel(mMusicGraphId);
     }
+    // the player (thread) must be gone before the worker pool.
+    mPlayer.reset();
+    mWorkerPool.reset();
 #endif
 }
 
 void AudioEngine::Start()
+{
+#if defined(GAMESTUDIO_ENABLE_AUDIO)
+    Start(audio::Device::Create(mName.c_str()));
+#endif
+}
+
+void AudioEngine::Start(std::unique_ptr<audio::Device> device)
 {
     ASSERT(!mPlayer);
     ASSERT(mEffectGraphId == 0);
@@ -63,9 +88,12 @@ void AudioEngine::Start()
     auto* effect_gain  = (*effect_graph)->AddElement(audio::Gain("gain", 1.0f));
     auto* effect_mixer = (*effect_graph)->AddElement(audio::MixerSource("mixer", mFormat));
     effect_mixer->SetNeverDone(true);
+    effect_mixer->SetMaxVoices(mMaxEffectVoices);
     ASSERT((*effect_graph)->LinkElements("mixer", "out", "gain", "in"));
     ASSERT((*effect_graph)->LinkGraph("gain", "out"));
     ASSERT(effect_graph->Prepare(*mLoader, p));
+    effect_graph->SetProfilingInterval(mProfilingInterval);
+    mEffectSchedule = (*effect_graph)->GetSchedule();
 
     auto music_graph = std::make_unique<audio::AudioGraph>("Music");
     auto* music_gain  = (*music_graph)->AddElement(audio::Gain("gain", 1.0f));
@@ -74,14 +102,20 @@ void AudioEngine::Start()
     ASSERT((*music_graph)->LinkElements("mixer", "out", "gain", "in"));
     ASSERT((*music_graph)->LinkGraph("gain", "out"));
     ASSERT(music_graph->Prepare(*mLoader, p));
+    music_graph->SetProfilingInterval(mProfilingInterval);
+    mMusicSchedule = (*music_graph)->GetSchedule();
 
-    auto device = audio::Device::Create(mName.c_str());
     device->SetBufferSize(mBufferSize);
     mPlayer = std::make_unique<audio::Player>(std::move(device));
+    mPlayer->SetWorkerPool(mWorkerPool.get());
     mEffectGraphId = mPlayer->Play(std::move(effect_graph));
     mMusicGraphId  = mPlayer->Play(std::move(music_graph));
     DEBUG("Audio effect graph is ready. [id=%1]", mEffectGraphId);
     DEBUG("Audio music graph is ready. [id=%1]", mMusicGraphId);
+
+#if defined(AUDIO_USE_PREPARE_THREAD)
+    mPrepareThread.reset(new std::thread(&AudioEngine::PrepareThreadLoop, this));
+#endif
 #endif
 }
 
@@ -105,23 +139,36 @@ bool AudioEngine::PrepareMusicGraph(const GraphHandle& graph)
 {
     ASSERT(graph);
 #if defined(GAMESTUDIO_ENABLE_AUDIO)
-    auto instance = std::make_unique<audio::Graph>(graph);
-    audio::Graph::PrepareParams p;
-    p.enable_pcm_caching = mEnableCaching;
-    if (!instance->Prepare(*mLoader, p))
-        ERROR_RETURN(false, "Audio engine music graph prepare error. [graph=%1]", graph->GetName());
-    const auto& port = instance->GetOutputPort(0);
-    if (port.GetFormat() != mFormat)
-        ERROR_RETURN(false, "Audio engine music graph has incompatible output format. [graph=%1, format=%2]", graph->GetName(), port.GetFormat());
-
-    audio::MixerSource::AddSourceCmd cmd;
-    cmd.src    = std::move(instance);
-    cmd.paused = true;
-    mPlayer->SendCommand(mMusicGraphId, audio::AudioGraph::MakeCommand("mixer", std::move(cmd)));
+    QueuePrepare(mMusicGraphId, graph, graph->GetName());
 #endif
     return true;
 }
 
+bool AudioEngine::PreloadGraph(const GraphHandle& graph)
+{
+    ASSERT(graph);
+    bool success = true;
+#if defined(GAMESTUDIO_ENABLE_AUDIO)
+    if (!mEnableCaching)
+        return true;
+
+    audio::Graph instance(graph);
+    for (size_t i=0; i<instance.GetNumElements(); ++i)
+    {
+        auto& element = instance.GetElement(i);
+        if (element.GetType() != "FileSource")
+            continue;
+        auto& file = static_cast<audio::FileSource&>(element);
+        if (!file.Preload(*mLoader))
+        {
+            ERROR("Audio engine audio graph preload error. [graph=%1, elem=%2]", graph->GetName(), file.GetName());
+            success = false;
+        }
+    }
+#endif
+    return success;
+}
+
 bool AudioEngine::PlayMusic(const GraphHandle& graph, unsigned when)
 {
 #if defined(GAMESTUDIO_ENABLE_AUDIO)
@@ -139,7 +186,7 @@ void AudioEngine::ResumeMusic(const std::string& track, unsigned when)
     cmd.name      = track;
     cmd.paused    = false;
     cmd.millisecs = when;
-    mPlayer->SendCommand(mMusicGraphId, audio::AudioGraph::MakeCommand("mixer", std::move(cmd)));
+    SendCommand(mMusicGraphId, audio::AudioGraph::MakeCommand("mixer", std::move(cmd)));
 #endif
 }
 
@@ -150,7 +197,7 @@ void AudioEngine::PauseMusic(const std::string& track, unsigned when)
     cmd.name      = track;
     cmd.paused    = true;
     cmd.millisecs = when;
-    mPlayer->SendCommand(mMusicGraphId, audio::AudioGraph::MakeCommand("mixer", std::move(cmd)));
+    SendCommand(mMusicGraphId, audio::AudioGraph::MakeCommand("mixer", std::move(cmd)));
 #endif
 }
 
@@ -160,7 +207,7 @@ void AudioEngine::KillMusic(const std::string& track, unsigned when)
     audio::MixerSource::DeleteSourceCmd cmd;
     cmd.name      = track;
     cmd.millisecs = when;
-    mPlayer->SendCommand(mMusicGraphId, audio::AudioGraph::MakeCommand("mixer", std::move(cmd)));
+    SendCommand(mMusicGraphId, audio::AudioGraph::MakeCommand("mixer", std::move(cmd)));
 #endif
 }
 void AudioEngine::KillAllMusic(unsigned int when)
@@ -168,7 +215,7 @@ void AudioEngine::KillAllMusic(unsigned int when)
 #if defined(GAMESTUDIO_ENABLE_AUDIO)
     audio::MixerSource::DeleteAllSrcCmd cmd;
     cmd.millisecs = when;
-    mPlayer->SendCommand(mMusicGraphId, audio::AudioGraph::MakeCommand("mixer", std::move(cmd)));
+    SendCommand(mMusicGraphId, audio::AudioGraph::MakeCommand("mixer", std::move(cmd)));
 #endif
 }
 
@@ -177,7 +224,7 @@ void AudioEngine::CancelMusicCmds(const std::string& track)
 #if defined(GAMESTUDIO_ENABLE_AUDIO)
     audio::MixerSource::CancelSourceCmdCmd cmd;
     cmd.name = track;
-    mPlayer->SendCommand(mMusicGraphId, audio::AudioGraph::MakeCommand("mixer", std::move(cmd)));
+    SendCommand(mMusicGraphId, audio::AudioGraph::MakeCommand("mixer", std::move(cmd)));
 #endif
 }
 
@@ -193,7 +240,7 @@ void AudioEngine::SetMusicEffect(const std::string& track, unsigned duration, Ef
     audio::MixerSource::SetEffectCmd cmd;
     cmd.src    = track;
     cmd.effect = std::move(mixer_effect);
-    mPlayer->SendCommand(mMusicGraphId, audio::AudioGraph::MakeCommand("mixer", std::move(cmd)));
+    SendCommand(mMusicGraphId, audio::AudioGraph::MakeCommand("mixer", std::move(cmd)));
 #endif
 }
 
@@ -202,48 +249,80 @@ void AudioEngine::SetMusicGain(float gain)
 #if defined(GAMESTUDIO_ENABLE_AUDIO)
     audio::Gain::SetGainCmd cmd;
     cmd.gain = gain;
-    mPlayer->SendCommand(mMusicGraphId, audio::AudioGraph::MakeCommand("gain", std::move(cmd)));
+    SendCommand(mMusicGraphId, audio::AudioGraph::MakeCommand("gain", std::move(cmd)));
 #endif
 }
 
 bool AudioEngine::PlaySoundEffect(const GraphHandle& handle, unsigned when)
 {
+    ASSERT(handle);
 #if defined(GAMESTUDIO_ENABLE_AUDIO)
-    const auto name   = "FX#" + std::to_string(mEffectCounter);
-    const auto paused = when != 0;
-
-    auto graph = std::make_unique<audio::Graph>(name, handle);
-    audio::Graph::PrepareParams p;
-    p.enable_pcm_caching = mEnableCaching;
-    if (!graph->Prepare(*mLoader, p))
-        ERROR_RETURN(false, "Audio engine sound effect audio graph prepare error. [graph=%1]", handle->GetName());
+    const auto name = "FX#" + std::to_string(mEffectCounter);
 
-    const auto& port = graph->GetOutputPort(0);
-    if (port.GetFormat() != mFormat)
-        ERROR_RETURN(false, "Audio engine sound effect graph has incompatible output format. [graph=%1, format=%2]", handle->GetName(), port.GetFormat());
-
-    audio::MixerSource::AddSourceCmd add_cmd;
-    add_cmd.src    = std::move(graph);
-    add_cmd.paused = true;
-    mPlayer->SendCommand(mEffectGraphId, audio::AudioGraph::MakeCommand("mixer", std::move(add_cmd)));
+    QueuePrepare(mEffectGraphId, handle, name);
 
     audio::MixerSource::PauseSourceCmd play_cmd;
     play_cmd.name      = name;
     play_cmd.paused    = false;
     play_cmd.millisecs = when;
-    mPlayer->SendCommand(mEffectGraphId, audio::AudioGraph::MakeCommand("mixer", std::move(play_cmd)));
+    SendCommand(mEffectGraphId, audio::AudioGraph::MakeCommand("mixer", std::move(play_cmd)));
 
     ++mEffectCounter;
 #endif
     return true;
 }
 
+void AudioEngine::SetMaxEffectVoices(unsigned max_voices)
+{
+    mMaxEffectVoices = max_voices;
+#if defined(GAMESTUDIO_ENABLE_AUDIO)
+    if (!mPlayer)
+        return;
+    audio::MixerSource::SetMaxVoicesCmd cmd;
+    cmd.max_voices = max_voices;
+    SendCommand(mEffectGraphId, audio::AudioGraph::MakeCommand("mixer", std::move(cmd)));
+#endif
+}
+
+void AudioEngine::SetWorkerThreads(unsigned threads)
+{
+#if defined(GAMESTUDIO_ENABLE_AUDIO) && defined(AUDIO_USE_PLAYER_THREAD)
+    if (mWorkerPool)
+    {
+        if (mWorkerPool->GetNumThreads() != threads)
+            WARN("Audio worker threads can't be changed once created. [threads=%1]", mWorkerPool->GetNumThreads());
+        return;
+    }
+    if (threads == 0)
+        return;
+    // the player thread picks up the pool the next time it evaluates
+    // the graphs. the pool is never changed after this.
+    mWorkerPool = std::make_unique<audio::WorkerPool>(threads);
+    if (mPlayer)
+        mPlayer->SetWorkerPool(mWorkerPool.get());
+    DEBUG("Audio graph worker threads enabled. [threads=%1]", threads);
+#endif
+}
+
+void AudioEngine::SetProfilingInterval(unsigned milliseconds)
+{
+    mProfilingInterval = milliseconds;
+#if defined(GAMESTUDIO_ENABLE_AUDIO)
+    if (!mPlayer)
+        return;
+    audio::AudioGraph::SetProfilingCmd cmd;
+    cmd.interval = milliseconds;
+    SendCommand(mEffectGraphId, audio::MakeCommand(audio::AudioGraph::SetProfilingCmd(cmd)));
+    SendCommand(mMusicGraphId, audio::MakeCommand(std::move(cmd)));
+#endif
+}
+
 void AudioEngine::SetSoundEffectGain(float gain)
 {
 #if defined(GAMESTUDIO_ENABLE_AUDIO)
     audio::Gain::SetGainCmd cmd;
     cmd.gain = gain;
-    mPlayer->SendCommand(mEffectGraphId, audio::AudioGraph::MakeCommand("gain", std::move(cmd)));
+    SendCommand(mEffectGraphId, audio::AudioGraph::MakeCommand("gain", std::move(cmd)));
 #endif
 }
 void AudioEngine::KillAllSoundEffects()
@@ -251,7 +330,7 @@ void AudioEngine::KillAllSoundEffects()
 #if defined(GAMESTUDIO_ENABLE_AUDIO)
     audio::MixerSource::DeleteAllSrcCmd cmd;
     cmd.millisecs = 0;
-    mPlayer->SendCommand(mEffectGraphId, audio::AudioGraph::MakeCommand("mixer", std::move(cmd)));
+    SendCommand(mEffectGraphId, audio::AudioGraph::MakeCommand("mixer", std::move(cmd)));
 #endif
 }
 
@@ -259,6 +338,10 @@ void AudioEngine::Update(AudioEventQueue* events)
 {
 #if defined(GAMESTUDIO_ENABLE_AUDIO)
 
+    // hand over any graphs that have finished preparing and
+    // the commands that were queued after them.
+    SendPendingActions();
+
 #if !defined(AUDIO_USE_PLAYER_THREAD)
     mPlayer->ProcessOnce();
 #endif
@@ -276,6 +359,135 @@ void AudioEngine::Update(AudioEventQueue* events)
 #endif
 }
 
+void AudioEngine::QueuePrepare(std::size_t stream, const GraphHandle& klass, const std::string& name)
+{
+    auto job = std::make_shared<PrepareJob>();
+    job->klass = klass;
+    job->name  = name;
+    job->enable_pcm_caching = mEnableCaching;
+#if defined(AUDIO_USE_PLAYER_THREAD)
+    // music tracks are long and streamed so they benefit from decoding
+    // ahead. sound effects are short and often cached as PCM.
+    job->enable_read_ahead = mEnableReadAhead && stream == mMusicGraphId;
+#endif
+
+#if defined(AUDIO_USE_PREPARE_THREAD)
+    {
+        std::unique_lock<decltype(mPrepareMutex)> lock(mPrepareMutex);
+        mPrepareQueue.push(job);
+        mPrepareCondition.notify_one();
+    }
+#else
+    PrepareGraph(*job);
+    job->done.store(true, std::memory_order_release);
+#endif
+    PendingAction action;
+    action.job = std::move(job);
+    GetPendingActions(stream).push_back(std::move(action));
+    SendPendingActions(stream);
+}
+
+void AudioEngine::SendCommand(std::size_t stream, std::unique_ptr<audio::Command> cmd)
+{
+    // if nothing is pending on the stream the command can go straight
+    // to the player. otherwise it must wait for the graphs queued on the
+    // same stream before it so that the command doesn't reach the mixer
+    // before the graph it refers to.
+    auto& queue = GetPendingActions(stream);
+    if (queue.empty())
+    {
+        mPlayer->SendCommand(stream, std::move(cmd));
+        return;
+    }
+    PendingAction action;
+    action.cmd = std::move(cmd);
+    queue.push_back(std::move(action));
+}
+
+AudioEngine::PendingActionQueue& AudioEngine::GetPendingActions(std::size_t stream)
+{
+    ASSERT(stream == mEffectGraphId || stream == mMusicGraphId);
+    return stream == mEffectGraphId ? mPendingEffectActions : mPendingMusicActions;
+}
+
+void AudioEngine::SendPendingActions()
+{
+    SendPendingActions(mEffectGraphId);
+    SendPendingActions(mMusicGraphId);
+}
+
+void AudioEngine::SendPendingActions(std::size_t stream)
+{
+    auto& queue = GetPendingActions(stream);
+    while (!queue.empty())
+    {
+        auto& action = queue.front();
+        if (auto& job = action.job)
+        {
+            if (!job->done.load(std::memory_order_acquire))
+                return;
+            if (job->graph)
+            {
+                audio::MixerSource::AddSourceCmd cmd;
+                cmd.src    = std::move(job->graph);
+                cmd.paused = true;
+                cmd.voice.group      = job->klass->GetId();
+                cmd.voice.max_voices = job->klass->GetMaxVoices();
+                cmd.voice.priority   = job->klass->GetVoicePriority();
+                mPlayer->SendCommand(stream, audio::AudioGraph::MakeCommand("mixer", std::move(cmd)));
+            }
+        }
+        else if (action.cmd)
+        {
+            mPlayer->SendCommand(stream, std::move(action.cmd));
+        }
+        queue.pop_front();
+    }
+}
+
+bool AudioEngine::PrepareGraph(PrepareJob& job) const
+{
+    const auto& klass = job.klass;
+
+    auto graph = std::make_unique<audio::Graph>(job.name, klass);
+    audio::Graph::PrepareParams p;
+    p.enable_pcm_caching = job.enable_pcm_caching;
+    p.enable_read_ahead  = job.enable_read_ahead;
+    if (!graph->Prepare(*mLoader, p))
+        ERROR_RETURN(false, "Audio engine audio graph prepare error. [graph=%1]", klass->GetName());
+
+    const auto& port = graph->GetOutputPort(0);
+    if (port.GetFormat() != mFormat)
+        ERROR_RETURN(false, "Audio engine audio graph has incompatible output format. [graph=%1, format=%2]", klass->GetName(), port.GetFormat());
+
+    job.graph = std::move(graph);
+    return true;
+}
+
+#if defined(AUDIO_USE_PREPARE_THREAD)
+void AudioEngine::PrepareThreadLoop()
+{
+    DEBUG("Hello from audio graph prepare thread.");
+    for (;;)
+    {
+        std::shared_ptr<PrepareJob> job;
+        {
+            std::unique_lock<decltype(mPrepareMutex)> lock(mPrepareMutex);
+            mPrepareCondition.wait(lock, [this]() {
+                return mPrepareShutdown || !mPrepareQueue.empty();
+            });
+            if (mPrepareShutdown)
+                break;
+            job = std::move(mPrepareQueue.front());
+            mPrepareQueue.pop();
+        }
+        PrepareGraph(*job);
+        job->done.store(true, std::memory_order_release);
+    }
+    DEBUG("Audio graph prepare thread exiting...");
+}
+#endif
+
 void AudioEngine::OnAudioPlayerEvent(const audio::Player::SourceCompleteEvent& event, AudioEventQueue* events)
 {
     DEBUG("Audio engine source event. [id=%1, status=%2]", event.id, event.status);
@@ -284,6 +496,25 @@ void AudioEngine::OnAudioPlayerEvent(const audio::Player::SourceCompleteEvent& e
 }
 void AudioEngine::OnAudioPlayerEvent(const audio::Player::SourceEvent& event, AudioEventQueue* events)
 {
+    if (auto* voices = event.event->GetIf<audio::MixerSource::VoiceCountEvent>())
+    {
+        if (event.id == mEffectGraphId)
+        {
+            mEffectVoices.active      = voices->active;
+            mEffectVoices.virtualized = voices->virtualized;
+            mEffectVoices.stolen      = voices->stolen;
+        }
+        return;
+    }
+    else if (auto* profile = event.event->GetIf<audio::AudioGraph::ProfileEvent>())
+    {
+        if (event.id == mEffectGraphId)
+            mEffectProfile = std::move(*profile);
+        else if (event.id == mMusicGraphId)
+            mMusicProfile = std::move(*profile);
+        return;
+    }
+
     DEBUG("Audio engine source event. [id=%1]", event.id == mMusicGraphId ? "Music" : "FX");
     if (events == nullptr)
         return;
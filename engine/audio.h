@@ -20,11 +20,17 @@
 
 #include <memory>
 #include <queue> // priority_queue
+#include <deque>
 #include <chrono>
+#include <thread>
+#include <mutex>
+#include <atomic>
+#include <condition_variable>
 
 #include "audio/fwd.h"
 #include "audio/format.h"
 #include "audio/element.h"
+#include "audio/graph.h"
 #include "audio/player.h"
 
 namespace engine
@@ -63,6 +69,29 @@ namespace engine
        ~AudioEngine();
         void EnableCaching(bool on_off)
         { mEnableCaching = on_off; }
+        // Enable/disable decoding the music audio files ahead of playback
+        // on a separate decoder thread. This only has effect when the audio
+        // is played on a separate audio (player) thread.
+        void EnableReadAhead(bool on_off)
+        { mEnableReadAhead = on_off; }
+        // Set the maximum number of audible sound effects. When more sound
+        // effects are playing the ones with the lowest priority and then
+        // the oldest ones become virtual, i.e. they're not decoded and mixed
+        // until they become audible again. 0 for no limit.
+        void SetMaxEffectVoices(unsigned max_voices);
+        // Set the number of worker threads used to evaluate independent
+        // parts of the audio graphs in parallel on top of the audio player
+        // thread. 0 to evaluate the graphs only on the audio player thread.
+        // The number of threads can't be changed once the worker threads
+        // have been created. This only has effect when the audio is played
+        // on a separate audio (player) thread.
+        void SetWorkerThreads(unsigned threads);
+        // Set the interval in milliseconds for measuring the processing
+        // times of the effect and music graphs and their elements.
+        // 0 to disable profiling.
+        void SetProfilingInterval(unsigned milliseconds);
+        unsigned GetProfilingInterval() const
+        { return mProfilingInterval; }
         void SetLoader(const audio::Loader* loader)
         { mLoader = loader; }
         void SetFormat(const audio::Format& format)
@@ -75,21 +104,69 @@ namespace engine
         { return mClassLib; }
         const audio::Loader* GetLoader() const
         { return mLoader; }
+        struct VoiceStats {
+            // The number of audible sound effects.
+            unsigned active = 0;
+            // The number of virtual (inaudible) sound effects.
+            unsigned virtualized = 0;
+            // The total number of sound effects stopped by the sound
+            // effect's graph class voice limit.
+            unsigned stolen = 0;
+        };
+        // Get the latest sound effect voice counts.
+        VoiceStats GetEffectVoiceStats() const
+        { return mEffectVoices; }
+        using GraphProfile = audio::AudioGraph::ProfileEvent;
+        // Get the latest effect graph profiling data. Only available
+        // when profiling is enabled. The data of the sound effect graphs
+        // is in the profile's graphs per sound effect graph class.
+        const GraphProfile& GetEffectGraphProfile() const
+        { return mEffectProfile; }
+        // Get the latest music graph profiling data. Only available
+        // when profiling is enabled.
+        const GraphProfile& GetMusicGraphProfile() const
+        { return mMusicProfile; }
+        using GraphSchedule = std::vector<audio::Graph::ScheduledElement>;
+        // Get the effect graph elements in the same order as the
+        // element profiling data.
+        const GraphSchedule& GetEffectGraphSchedule() const
+        { return mEffectSchedule; }
+        // Get the music graph elements in the same order as the
+        // element profiling data.
+        const GraphSchedule& GetMusicGraphSchedule() const
+        { return mMusicSchedule; }
+
         // Start the audio engine. You must call this before calling any
         // actual playback functions.
         void Start();
+        // Start the audio engine on the given audio device instead of
+        // the default platform audio device. For example audio::NullDevice
+        // can be used to run the audio engine without audio output.
+        void Start(std::unique_ptr<audio::Device> device);
         // Pause current audio streams.
         void SetDebugPause(bool on_off);
         // Add a new audio graph for music playback.
         // The audio graph is initially only prepared and sent to the audio
         // player but set to paused state. In order to begin playing the track
         // ResumeMusic must be called separately.
-        // Returns false if the music graph could not be loaded.
+        // The graph is prepared (audio files opened, decoders probed) on a
+        // background thread and handed over to the player in a later call
+        // to Update. Any music commands issued in between are kept in order
+        // and sent to the player only after the graph has been added.
+        // Returns false if the music graph could not be queued. Errors that
+        // happen when preparing the graph are only logged.
         bool PrepareMusicGraph(const GraphHandle& graph);
         // Similar to PrepareMusicGraph except that also schedules a command
         // to start the music playback after 'when' milliseconds elapses.
-        // Returns false if the music graph could not be loaded.
+        // Returns false if the music graph could not be queued.
         bool PlayMusic(const GraphHandle& graph, unsigned when = 0);
+        // Preload the audio files used by the audio graph into the PCM cache
+        // so that playing the graph later doesn't require decoding the
+        // audio. This is meant to be called when loading a level. Only the
+        // file sources that have PCM caching enabled are preloaded and only
+        // if caching is enabled in the audio engine.
+        // Returns false if some audio file could not be preloaded.
+        bool PreloadGraph(const GraphHandle& graph);
         // Schedule a command to start playing the named music track that
         // has previously been paused after 'when' milliseconds elapses.
         void ResumeMusic(const std::string& track, unsigned when = 0);
@@ -110,7 +187,9 @@ namespace engine
         // for the gain value but you likely want to keep this around (0.0f, 1.0f)
         void SetMusicGain(float gain);
         // Schedule a sound effect for playback after 'when' milliseconds elapse.
-        // Returns false if the audio effect could not be loaded.
+        // The effect graph is prepared asynchronously similar to music graphs.
+        // The 'when' delay begins when the prepared graph reaches the player.
+        // Returns false if the audio effect could not be queued.
         bool PlaySoundEffect(const GraphHandle& graph, unsigned when = 0);
         // Adjust the gain (volume) on the effects stream. There's no strict range
         // for the gain value but you likely want to keep this around (0.0f, 1.0f)
@@ -123,6 +202,39 @@ namespace engine
         // audio events that have happened.
         void Update(AudioEventQueue* events = nullptr);
     private:
+        // Audio graph preparation job. The graph is instantiated and
+        // prepared on the preparation thread and once done the result
+        // is picked up on the calling thread in Update.
+        struct PrepareJob {
+            // The class of the graph to instantiate.
+            GraphHandle klass;
+            // The name of the graph instance, i.e. the mixer source name.
+            std::string name;
+            // The prepared graph instance if the job was successful.
+            std::unique_ptr<audio::Graph> graph;
+            // Set by the preparation thread when the job is done.
+            std::atomic<bool> done = {false};
+            bool enable_pcm_caching = false;
+            bool enable_read_ahead  = false;
+        };
+        // A pending operation on one of the player streams. Operations
+        // are kept in a per stream queue in order to preserve the order
+        // in which they were issued in case some graph is still being
+        // prepared. The streams don't wait for each other's graphs.
+        struct PendingAction {
+            std::shared_ptr<PrepareJob> job;
+            std::unique_ptr<audio::Command> cmd;
+        };
+        using PendingActionQueue = std::deque<PendingAction>;
+        PendingActionQueue& GetPendingActions(std::size_t stream);
+        void QueuePrepare(std::size_t stream, const GraphHandle& klass, const std::string& name);
+        void SendCommand(std::size_t stream, std::unique_ptr<audio::Command> cmd);
+        void SendPendingActions(std::size_t stream);
+        void SendPendingActions();
+#if defined(AUDIO_USE_PREPARE_THREAD)
+        void PrepareThreadLoop();
+#endif
+        bool PrepareGraph(PrepareJob& job) const;
         void OnAudioPlayerEvent(const audio::Player::SourceCompleteEvent& event, AudioEventQueue* events);
         void OnAudioPlayerEvent(const audio::Player::SourceEvent& event, AudioEventQueue* events);
     private:
@@ -133,6 +245,8 @@ namespace engine
         audio::Format mFormat;
         // approximate default audio buffer size in milliseconds.
         unsigned mBufferSize = 20;
+        // the worker threads for audio graph evaluation. Must outlive the player.
+        std::unique_ptr<audio::WorkerPool> mWorkerPool;
         // the audio player.
         std::unique_ptr<audio::Player> mPlayer;
         // Id of the effect audio graph in the audio player.
@@ -144,6 +258,26 @@ namespace engine
         bool mEnableMusic = true;
         bool mEnableEffects = true;
         bool mEnableCaching = false;
+        bool mEnableReadAhead = true;
+        unsigned mMaxEffectVoices = 0;
+        unsigned mProfilingInterval = 0;
+        VoiceStats mEffectVoices;
+        GraphProfile mEffectProfile;
+        GraphProfile mMusicProfile;
+        GraphSchedule mEffectSchedule;
+        GraphSchedule mMusicSchedule;
+        // Actions waiting to be sent to the effect and music streams.
+        // Only touched on the calling (game) thread.
+        PendingActionQueue mPendingEffectActions;
+        PendingActionQueue mPendingMusicActions;
+#if defined(AUDIO_USE_PREPARE_THREAD)
+        // Queue of jobs for the graph preparation thread.
+        std::mutex mPrepareMutex;
+        std::condition_variable mPrepareCondition;
+        std::queue<std::shared_ptr<PrepareJob>> mPrepareQueue;
+        std::unique_ptr<std::thread> mPrepareThread;
+        bool mPrepareShutdown = false;
+#endif
     };
 
 } // namespace
@@ -27,13 +27,16 @@
 #include <memory>
 #include <vector>
 #include <stack>
+#include <algorithm>
 
 #include "base/logging.h"
 #include "base/trace.h"
+#include "base/utility.h"
 #include "game/entity.h"
 #include "game/treeop.h"
 #include "game/tilemap.h"
 #include "graphics/image.h"
+#include "graphics/bitmap.h"
 #include "graphics/device.h"
 #include "graphics/painter.h"
 #include "graphics/drawing.h"
@@ -41,6 +44,9 @@
 #include "graphics/transform.h"
 #include "graphics/resource.h"
 #include "graphics/material.h"
+#include "graphics/atlas.h"
+#include "audio/element.h"
+#include "audio/decoder.h"
 #include "engine/main/interface.h"
 #include "engine/audio.h"
 #include "engine/classlib.h"
@@ -59,6 +65,91 @@
 namespace
 {
 
+double GetAverageTime(const engine::AudioEngine::GraphProfile& profile)
+{
+    return profile.callbacks ? profile.total_time / profile.callbacks : 0.0;
+}
+double GetAverageTime(const audio::ElementProfile& profile)
+{
+    return profile.calls ? profile.total_time / profile.calls : 0.0;
+}
+struct HottestElement {
+    std::string name;
+    std::string type;
+    const audio::ElementProfile* profile = nullptr;
+};
+// Find the element with the highest average processing time in either
+// audio graph or in any graph played through them. Returns false if
+// there's no profiling data. The top level graph profiling data is in the
+// graph's schedule order which is used to look up the element's name and
+// type. The data of the graphs played through the mixers is per graph
+// class and in the class element order.
+bool FindHottestElement(const engine::AudioEngine& audio, HottestElement* hottest)
+{
+    const std::pair<const engine::AudioEngine::GraphProfile*,
+                    const engine::AudioEngine::GraphSchedule*> graphs[] = {
+        {&audio.GetEffectGraphProfile(), &audio.GetEffectGraphSchedule()},
+        {&audio.GetMusicGraphProfile(),  &audio.GetMusicGraphSchedule()}
+    };
+    const audio::Graph::ScheduledElement* schedule_info = nullptr;
+    for (const auto& [profile, schedule] : graphs)
+    {
+        const auto count = std::min(profile->elements.size(), schedule->size());
+        for (std::size_t i=0; i<count; ++i)
+        {
+            const auto& element = profile->elements[i];
+            if (!element.calls)
+                continue;
+            if (!hottest->profile || GetAverageTime(element) > GetAverageTime(*hottest->profile))
+            {
+                hottest->profile = &element;
+                schedule_info = &(*schedule)[i];
+            }
+        }
+    }
+    if (schedule_info)
+    {
+        hottest->name = schedule_info->name;
+        hottest->type = schedule_info->type;
+    }
+
+    const auto* library = audio.GetClassLibrary();
+    if (library == nullptr)
+        return hottest->profile != nullptr;
+
+    for (const auto* profile : {&audio.GetEffectGraphProfile(), &audio.GetMusicGraphProfile()})
+    {
+        for (const auto& graph : profile->graphs)
+        {
+            const audio::ElementProfile* graph_hottest = nullptr;
+            std::size_t graph_hottest_index = 0;
+            for (std::size_t i=0; i<graph.elements.size(); ++i)
+            {
+                const auto& element = graph.elements[i];
+                if (!element.calls)
+                    continue;
+                if (!graph_hottest || GetAverageTime(element) > GetAverageTime(*graph_hottest))
+                {
+                    graph_hottest = &element;
+                    graph_hottest_index = i;
+                }
+            }
+            if (!graph_hottest)
+                continue;
+            if (hottest->profile && GetAverageTime(*graph_hottest) <= GetAverageTime(*hottest->profile))
+                continue;
+            const auto klass = library->FindAudioGraphClassById(graph.klass);
+            if (!klass || graph_hottest_index >= klass->GetNumElements())
+                continue;
+            const auto& element = klass->GetElement(graph_hottest_index);
+            hottest->profile = graph_hottest;
+            hottest->name    = klass->GetName() + "/" + element.name;
+            hottest->type    = element.type;
+        }
+    }
+    return hottest->profile != nullptr;
+}
+
 // Default game engine implementation. Implements the main App interface
 // which is the interface that enables the game host to communicate
 // with the application/game implementation in order to update/tick/etc.
@@ -139,6 +230,10 @@ public:
 
         // set the unfortunate global gfx loader
         gfx::SetResourceLoader(env.graphics_loader);
+        // cache the generated bitmaps (such as noise textures) so
+        // that they don't need to be generated again on every start.
+        if (!env.game_home.empty())
+            gfx::SetBitmapCacheDirectory(base::JoinPath(env.game_home, "cache"));
         DEBUG("Game install directory: '%1'.", env.directory);
         DEBUG("Game home: '%1'.", env.game_home);
         DEBUG("User home: '%1'.", env.user_home);
@@ -152,6 +247,11 @@ public:
         mAudio->SetFormat(audio_format);
         mAudio->SetBufferSize(conf.audio.buffer_size);
         mAudio->EnableCaching(conf.audio.enable_pcm_caching);
+        mAudio->EnableReadAhead(conf.audio.enable_read_ahead);
+        mAudio->SetMaxEffectVoices(conf.audio.max_effect_voices);
+        mAudio->SetWorkerThreads(conf.audio.worker_threads);
+        mAudio->SetProfilingInterval(conf.audio.profiling_interval);
+        audio::FileSource::SetCacheBudget(std::size_t(conf.audio.pcm_cache_budget) * 1024 * 1024);
         DEBUG("Configure audio engine. [format=%1 buff_size=%2ms]", audio_format, conf.audio.buffer_size);
 
         mEnablePhysics = conf.physics.enabled;
@@ -162,6 +262,10 @@ public:
         mPhysics.SetTimestep(1.0f / conf.updates_per_second);
         mDevice->SetDefaultTextureFilter(conf.default_min_filter);
         mDevice->SetDefaultTextureFilter(conf.default_mag_filter);
+        mDevice->SetTextureMemoryBudget(std::size_t(conf.texture_memory_budget) * 1024 * 1024);
+        mProgramPrepareBudget = conf.program_prepare_budget / 1000.0;
+        mUIPainter.SetDevice(conf.ui_paint_cache ? mDevice.get() : nullptr);
+        mPainter->SetTextureAtlas(conf.texture_atlas ? &mTextureAtlas : nullptr);
         mClearColor = conf.clear_color;
         mGameTimeStep = 1.0f / conf.updates_per_second;
         mGameTickStep = 1.0f / conf.ticks_per_second;
@@ -196,6 +300,7 @@ public:
     {
         mDevice->BeginFrame();
         mDevice->ClearColor(mClearColor);
+        mTextureAtlas.BeginFrame();
         // rendering surface dimensions.
         const float surf_width  = (float)mSurfaceWidth;
         const float surf_height = (float)mSurfaceHeight;
@@ -299,9 +404,12 @@ public:
             mPainter->ResetViewMatrix();
             TRACE_CALL("UI::Paint",ui->Paint(mUIState, mUIPainter, base::GetTime(), nullptr));
         }
+        // release the paint cache of widgets that are no longer painted,
+        // including everything when there's no UI.
+        mUIPainter.PrunePaintCache();
 
         TRACE_ENTER(DebugDrawing);
-        if (mDebug.debug_show_fps || mDebug.debug_show_msg || mDebug.debug_draw || mShowMouseCursor)
+        if (mDebug.debug_show_fps || mDebug.debug_show_msg || mDebug.debug_show_stats || mDebug.debug_draw || mShowMouseCursor)
         {
             mPainter->SetPixelRatio(glm::vec2(1.0f, 1.0f));
             mPainter->SetOrthographicProjection(0, 0, surf_width, surf_height);
@@ -321,16 +429,64 @@ public:
                 mDebug.debug_font, 14, rect, gfx::Color::HotPink,
                 gfx::TextAlign::AlignLeft | gfx::TextAlign::AlignVCenter);
         }
+        // the debug text lines are stacked below each other.
+        gfx::FRect debug_text_rect(10, 30, 500, 20);
         if (mDebug.debug_show_msg && mShowDebugs)
         {
-            gfx::FRect rect(10, 30, 500, 20);
             for (const auto& print : mDebugPrints)
             {
-                gfx::FillRect(*mPainter, rect, gfx::Color4f(gfx::Color::Black, 0.6f));
+                gfx::FillRect(*mPainter, debug_text_rect, gfx::Color4f(gfx::Color::Black, 0.6f));
                 gfx::DrawTextRect(*mPainter, print.message,
-                    mDebug.debug_font, 14, rect, gfx::Color::HotPink,
+                    mDebug.debug_font, 14, debug_text_rect, gfx::Color::HotPink,
                    gfx::TextAlign::AlignLeft | gfx::TextAlign::AlignVCenter);
-                rect.Translate(0, 20);
+                debug_text_rect.Translate(0, 20);
+            }
+        }
+        if (mDebug.debug_show_stats && mShowDebugs)
+        {
+            // these are the numbers for the previous frame since the
+            // current frame is still being rendered.
+            const auto& fs = mFrameStats;
+            const auto& pcm = audio::FileSource::GetCacheStats();
+            const auto& read_ahead = audio::ReadAheadDecoder::GetStats();
+            const auto& voices = mAudio->GetEffectVoiceStats();
+            const auto& fx_profile = mAudio->GetEffectGraphProfile();
+            const auto& music_profile = mAudio->GetMusicGraphProfile();
+            char lines[9][256] = {};
+            // the audio profiling lines are only shown when profiling is enabled.
+            const auto line_count = mAudio->GetProfilingInterval() ? 9 : 7;
+            std::snprintf(lines[0], sizeof(lines[0]) - 1, "Draws: %u vertices: %u",
+                fs.draw_calls, (unsigned)fs.vertices);
+            std::snprintf(lines[1], sizeof(lines[1]) - 1, "Programs: %u uniforms: %u FBOs: %u",
+                fs.program_switches, fs.uniform_sets, fs.fbo_switches);
+            std::snprintf(lines[2], sizeof(lines[2]) - 1, "Texture binds: %u uploads: %u (%.1f KiB)",
+                fs.texture_binds, fs.texture_uploads, fs.texture_upload_bytes / 1024.0);
+            std::snprintf(lines[3], sizeof(lines[3]) - 1, "Buffer uploads: %u (%.1f KiB)",
+                fs.buffer_uploads, fs.buffer_upload_bytes / 1024.0);
+            std::snprintf(lines[4], sizeof(lines[4]) - 1, "PCM cache hits: %u misses: %u (%.1f MiB)",
+                (unsigned)pcm.hits, (unsigned)pcm.misses, pcm.bytes / (1024.0 * 1024.0));
+            std::snprintf(lines[5], sizeof(lines[5]) - 1, "Audio read ahead: %ums underruns: %u",
+                (unsigned)read_ahead.depth_ms, (unsigned)read_ahead.underruns);
+            std::snprintf(lines[6], sizeof(lines[6]) - 1, "Audio voices: %u virtual: %u stolen: %u",
+                voices.active, voices.virtualized, voices.stolen);
+            std::snprintf(lines[7], sizeof(lines[7]) - 1, "Audio FX: %.2fms (%.2fms) Music: %.2fms (%.2fms) margin: %.2fms",
+                GetAverageTime(fx_profile), fx_profile.max_time,
+                GetAverageTime(music_profile), music_profile.max_time,
+                std::min(fx_profile.min_margin, music_profile.min_margin));
+            HottestElement hottest;
+            FindHottestElement(*mAudio, &hottest);
+            std::snprintf(lines[8], sizeof(lines[8]) - 1, "Audio hottest: %s (%s) %.3fms (%.3fms)",
+                hottest.profile ? hottest.name.c_str() : "n/a",
+                hottest.profile ? hottest.type.c_str() : "n/a",
+                hottest.profile ? GetAverageTime(*hottest.profile) : 0.0,
+                hottest.profile ? hottest.profile->max_time : 0.0);
+            for (int i=0; i<line_count; ++i)
+            {
+                gfx::FillRect(*mPainter, debug_text_rect, gfx::Color4f(gfx::Color::Black, 0.6f));
+                gfx::DrawTextRect(*mPainter, lines[i],
+                    mDebug.debug_font, 14, debug_text_rect, gfx::Color::HotPink,
+                    gfx::TextAlign::AlignLeft | gfx::TextAlign::AlignVCenter);
+                debug_text_rect.Translate(0, 20);
             }
         }
         if (mDebug.debug_draw)
@@ -355,8 +511,12 @@ public:
         }
 
         TRACE_CALL("Device::Swap",mDevice->EndFrame(true));
-        // Note that we *don't* call CleanGarbage here since currently there should
-        // be nothing that is creating needless GPU resources.
+        mDevice->GetFrameStats(&mFrameStats);
+        // Clean up geometries that are no longer drawn, for example the
+        // static buffers of analytic particle emitters that were deleted.
+        // Textures and programs are not cleaned since currently there should
+        // be nothing that is creating needless texture or program resources.
+        mDevice->CleanGarbage(120, gfx::Device::GCFlags::Geometries);
     }
 
     virtual void BeginMainLoop() override
@@ -515,6 +675,45 @@ public:
         stats->dynamic_vbo_mem_use     = rs.dynamic_vbo_mem_use;
         stats->streaming_vbo_mem_alloc = rs.streaming_vbo_mem_alloc;
         stats->streaming_vbo_mem_use   = rs.streaming_vbo_mem_use;
+        stats->texture_mem_use         = rs.texture_mem_use;
+        stats->texture_mem_budget      = rs.texture_mem_budget;
+        stats->num_textures_evicted    = rs.num_textures_evicted;
+        stats->num_programs_built_in_game = rs.num_programs_created - mNumProgramsPrepared;
+        stats->frame_draw_calls        = mFrameStats.draw_calls;
+        stats->frame_vertices          = mFrameStats.vertices;
+        stats->frame_program_switches  = mFrameStats.program_switches;
+        stats->frame_texture_binds     = mFrameStats.texture_binds;
+        stats->frame_texture_uploads   = mFrameStats.texture_uploads;
+        stats->frame_texture_upload_bytes = mFrameStats.texture_upload_bytes;
+        stats->frame_buffer_uploads    = mFrameStats.buffer_uploads;
+        stats->frame_buffer_upload_bytes = mFrameStats.buffer_upload_bytes;
+        stats->frame_fbo_switches      = mFrameStats.fbo_switches;
+        stats->frame_uniform_sets      = mFrameStats.uniform_sets;
+
+        const auto& pcm = audio::FileSource::GetCacheStats();
+        stats->audio_pcm_cache_hits      = pcm.hits;
+        stats->audio_pcm_cache_misses    = pcm.misses;
+        stats->audio_pcm_cache_evictions = pcm.evictions;
+        stats->audio_pcm_cache_entries   = pcm.entries;
+        stats->audio_pcm_cache_bytes     = pcm.bytes;
+
+        const auto& read_ahead = audio::ReadAheadDecoder::GetStats();
+        stats->audio_read_ahead_decoders  = read_ahead.decoders;
+        stats->audio_read_ahead_underruns = read_ahead.underruns;
+        stats->audio_read_ahead_depth_ms  = read_ahead.depth_ms;
+
+        const auto& voices = mAudio->GetEffectVoiceStats();
+        stats->audio_effect_voices_active  = voices.active;
+        stats->audio_effect_voices_virtual = voices.virtualized;
+        stats->audio_effect_voices_stolen  = voices.stolen;
+
+        const auto& fx_profile = mAudio->GetEffectGraphProfile();
+        const auto& music_profile = mAudio->GetMusicGraphProfile();
+        stats->audio_effect_graph_avg_time = GetAverageTime(fx_profile);
+        stats->audio_effect_graph_max_time = fx_profile.max_time;
+        stats->audio_music_graph_avg_time  = GetAverageTime(music_profile);
+        stats->audio_music_graph_max_time  = music_profile.max_time;
+        stats->audio_min_deadline_margin   = std::min(fx_profile.min_margin, music_profile.min_margin);
         return true;
     }
     virtual void TakeScreenshot(const std::string& filename) const override
@@ -546,7 +745,10 @@ public:
         // materials and their textures/programs etc but that's more work
 
         if (bits & (unsigned)Engine::ResourceType::Textures)
+        {
             mDevice->DeleteTextures();
+            mTextureAtlas.Clear();
+        }
         if (bits & (unsigned)Engine::ResourceType::Shaders)
         {
             mDevice->DeleteShaders();
@@ -813,6 +1015,18 @@ private:
             ui->Style(mUIPainter);
         }
     }
+    void PrepareScenePrograms()
+    {
+        // build the shader programs up front so that the first frames
+        // don't stall when a drawable/material is drawn the first time.
+        // the programs built here are not counted as game play misses.
+        gfx::Device::ResourceStats before;
+        gfx::Device::ResourceStats after;
+        mDevice->GetResourceStats(&before);
+        TRACE_CALL("Renderer::PrepareScene", mRenderer.PrepareScene(*mScene, *mPainter, mProgramPrepareBudget));
+        mDevice->GetResourceStats(&after);
+        mNumProgramsPrepared += after.num_programs_created - before.num_programs_created;
+    }
     void OnAction(engine::PlayAction& action)
     {
         mScene = std::move(action.scene);
@@ -822,6 +1036,7 @@ private:
             mPhysics.CreateWorld(*mScene);
         }
         mRenderer.CreateScene(*mScene);
+        PrepareScenePrograms();
 
         const auto& klass = mScene->GetClass();
         if (klass.HasTilemap())
@@ -1054,6 +1269,8 @@ private:
     std::unique_ptr<gfx::Painter> mPainter;
     // The graphics device.
     std::shared_ptr<gfx::Device> mDevice;
+    // The runtime atlas for packing small textures.
+    gfx::TextureAtlas mTextureAtlas;
     // The rendering subsystem.
     engine::Renderer mRenderer;
     // The physics subsystem.
@@ -1085,6 +1302,8 @@ private:
     engine::Engine::DebugOptions mDebug;
     // last statistics about the rendering rate etc.
     engine::Engine::HostStats mLastStats;
+    // device counters for the last completed frame.
+    gfx::Device::FrameStats mFrameStats;
     // list of current debug print messages that
     // get printed to the display.
     struct DebugPrint {
@@ -1117,6 +1336,10 @@ private:
     bool mShowDebugs = true;
     // flag to control physics world creation. 
     bool mEnablePhysics = true;
+    // Time budget (in seconds) for preparing the scene programs.
+    double mProgramPrepareBudget = 0.0;
+    // The number of programs built when preparing scenes.
+    std::size_t mNumProgramsPrepared = 0;
     // The bitbag for storing game state.
     engine::KeyValueStore mStateStore;
     // Debug draw actions.
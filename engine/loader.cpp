@@ -25,6 +25,7 @@
 #include <vector>
 #include <unordered_map>
 #include <memory>
+#include <mutex>
 
 #if defined(POSIX_OS)
 #  include <sys/types.h>
@@ -166,29 +167,28 @@ using GameDataFileBuffer = FileBuffer<EngineData>;
 using GraphicsFileBuffer = FileBuffer<gfx::Resource>;
 
 #if defined(POSIX_OS)
-class AudioFileMap : public audio::SourceStream
+// Read only memory mapping of a file.
+class FileMap
 {
 public:
-    AudioFileMap(const std::string& filename)
+    FileMap(const std::string& filename)
       : mFileName(filename)
     {}
-    ~AudioFileMap()
+    ~FileMap()
     {
         if (mBase)
             ASSERT(::munmap(mBase, mSize) == 0);
         if (mFile)
             ASSERT(::close(mFile) == 0);
     }
-    virtual void Read(void* ptr, uint64_t offset, uint64_t bytes) const override
-    {
-        ASSERT(offset + bytes <= mSize);
-        bytes = std::min(mSize - offset, bytes);
-        const auto* base = static_cast<const char*>(mBase);
-        std::memcpy(ptr, &base[offset], bytes);
-    }
-    virtual std::uint64_t GetSize() const override
+    FileMap(const FileMap&) = delete;
+    FileMap& operator=(const FileMap&) = delete;
+
+    const void* GetBase() const
+    { return mBase; }
+    std::uint64_t GetSize() const
     { return mSize; }
-    virtual std::string GetName() const override
+    const std::string& GetName() const
     { return mFileName; }
 
     bool Map()
@@ -213,7 +213,7 @@ public:
             ERROR("Failed to mmap file. [file='%1', error='%2']", mFileName, strerror(errno));
             return false;
         }
-        DEBUG("Mapped audio file successfully. [file='%1', size='%2']", mFileName, mSize);
+        DEBUG("Mapped file successfully. [file='%1', size='%2']", mFileName, mSize);
         return true;
     }
 private:
@@ -245,13 +245,14 @@ std::string ErrorString()
     return FormatError(GetLastError());
 }
 
-class AudioFileMap : public audio::SourceStream
+// Read only memory mapping of a file.
+class FileMap
 {
 public:
-    AudioFileMap(const std::string& filename)
+    FileMap(const std::string& filename)
         : mFileName(filename)
     {}
-    ~AudioFileMap()
+    ~FileMap()
     {
         if (mBase != nullptr)
             ASSERT(UnmapViewOfFile(mBase) == TRUE);
@@ -260,21 +261,16 @@ public:
         if (mFile != INVALID_HANDLE_VALUE)
             ASSERT(CloseHandle(mFile) == TRUE);
     }
-    virtual void Read(void* ptr, uint64_t offset, uint64_t bytes) const override
-    {
-        ASSERT(offset + bytes <= mSize);
-        bytes = std::min(mSize - offset, bytes);
-        const auto* base = static_cast<const char*>(mBase);
-        std::memcpy(ptr, &base[offset], bytes);
-    }
-    virtual std::uint64_t GetSize() const override 
-    {
-        return mSize; 
-    }
-    virtual std::string GetName() const override
-    {
-        return mFileName;
-    }
+    FileMap(const FileMap&) = delete;
+    FileMap& operator=(const FileMap&) = delete;
+
+    const void* GetBase() const
+    { return mBase; }
+    std::uint64_t GetSize() const
+    { return mSize; }
+    const std::string& GetName() const
+    { return mFileName; }
+
     bool Map()
     {
         const auto& str = base::FromUtf8(mFileName);
@@ -319,7 +315,7 @@ public:
             ERROR("Failed to map view of file. [file='%1', error='%2']", str, ErrorString());
             return false;
         }
-        DEBUG("Mapped audio file successfully. [file='%1', size=%2]", str, mSize);
+        DEBUG("Mapped file successfully. [file='%1', size=%2]", str, mSize);
         return true;
     }
 private:
@@ -331,6 +327,53 @@ private:
 };
 #endif
 
+class AudioFileMap : public audio::SourceStream
+{
+public:
+    AudioFileMap(const std::string& filename)
+      : mMap(filename)
+    {}
+    virtual void Read(void* ptr, uint64_t offset, uint64_t bytes) const override
+    {
+        const auto size = mMap.GetSize();
+        ASSERT(offset + bytes <= size);
+        bytes = std::min(size - offset, bytes);
+        const auto* base = static_cast<const char*>(mMap.GetBase());
+        std::memcpy(ptr, &base[offset], bytes);
+    }
+    virtual std::uint64_t GetSize() const override
+    { return mMap.GetSize(); }
+    virtual std::string GetName() const override
+    { return mMap.GetName(); }
+    bool Map()
+    { return mMap.Map(); }
+private:
+    FileMap mMap;
+};
+
+// Graphics resource that is mapped directly into the address space
+// instead of being read into a buffer. Used for baked textures which
+// are ready to be uploaded to the device as-is.
+class GraphicsFileMap : public gfx::Resource
+{
+public:
+    GraphicsFileMap(const std::string& uri, const std::string& filename)
+      : mUri(uri)
+      , mMap(filename)
+    {}
+    virtual const void* GetData() const override
+    { return mMap.GetBase(); }
+    virtual std::size_t GetSize() const override
+    { return static_cast<std::size_t>(mMap.GetSize()); }
+    virtual std::string GetName() const override
+    { return mUri; }
+    bool Map()
+    { return mMap.Map(); }
+private:
+    const std::string mUri;
+    FileMap mMap;
+};
+
 class AudioStream : public audio::SourceStream
 {
 public:
@@ -377,6 +420,17 @@ public:
         if (it != mGraphicsFileBufferCache.end())
             return it->second;
 
+        // baked textures are uploaded as-is without any decoding
+        // so map them instead of reading into a buffer.
+        if (base::EndsWith(filename, ".gtx"))
+        {
+            auto map = std::make_shared<GraphicsFileMap>(uri, filename);
+            if (!map->Map())
+                return nullptr;
+            mGraphicsFileBufferCache[filename] = map;
+            return map;
+        }
+
         std::vector<char> buffer;
         if (!LoadFileBuffer(filename, &buffer))
             return nullptr;
@@ -449,6 +503,7 @@ public:
         const auto& filename = ResolveURI(uri);
         if (enable_file_caching)
         {
+            std::lock_guard<std::mutex> lock(mAudioStreamCacheMutex);
             auto it = mAudioStreamCache.find(filename);
             if (it != mAudioStreamCache.end())
                 return it->second;
@@ -474,7 +529,7 @@ public:
             if (!map->Map())
                 return nullptr;
             if (enable_file_caching)
-                mAudioStreamCache[filename] = map;
+                CacheAudioStream(filename, map);
             return map;
         }
 #elif defined(POSIX_OS)
@@ -501,7 +556,7 @@ public:
             if (!map->Map())
                 return nullptr;
             if (enable_file_caching)
-                mAudioStreamCache[filename] = map;
+                CacheAudioStream(filename, map);
             return map;
         }
 
@@ -518,7 +573,7 @@ public:
         // default implementation
         auto ret = audio::OpenFileStream(filename);
         if (ret && enable_file_caching)
-            mAudioStreamCache[filename] = ret;
+            CacheAudioStream(filename, ret);
         return ret;
     }
 
@@ -582,6 +637,9 @@ public:
                 if (!entry.is_regular_file())
                     continue;
                 const auto& file = entry.path().generic_u8string();
+                // baked textures are memory mapped on demand.
+                if (base::EndsWith(file, ".gtx"))
+                    continue;
                 std::vector<char> buffer;
                 if (!LoadFileBufferFromDisk(file, &buffer))
                     continue;
@@ -610,8 +668,15 @@ private:
         return true;
     }
 
+    void CacheAudioStream(const std::string& filename, std::shared_ptr<const audio::SourceStream> stream) const
+    {
+        std::lock_guard<std::mutex> lock(mAudioStreamCacheMutex);
+        mAudioStreamCache[filename] = std::move(stream);
+    }
+
     std::string ResolveURI(const std::string& URI) const
     {
+        std::lock_guard<std::mutex> lock(mUriCacheMutex);
         auto it = mUriCache.find(URI);
         if (it != mUriCache.end())
             return it->second;
@@ -642,13 +707,16 @@ private:
     // cache of URIs that have been resolved to file
     // names already.
     mutable std::unordered_map<std::string, std::string> mUriCache;
+    mutable std::mutex mUriCacheMutex;
     // cache of graphics file buffers that have already been loaded.
     mutable std::unordered_map<std::string,
-        std::shared_ptr<const GraphicsFileBuffer>> mGraphicsFileBufferCache;
+        std::shared_ptr<const gfx::Resource>> mGraphicsFileBufferCache;
     mutable std::unordered_map<std::string,
         std::shared_ptr<const GameDataFileBuffer>> mGameDataBufferCache;
     mutable std::unordered_map<std::string,
             std::shared_ptr<const audio::SourceStream>> mAudioStreamCache;
+    // audio streams are opened by the audio graph prepare thread.
+    mutable std::mutex mAudioStreamCacheMutex;
     DefaultAudioIOStrategy mDefaultAudioIO = DefaultAudioIOStrategy::Automatic;
     // the root of the resource dir against which to resolve the resource URIs.
     std::string mContentPath;
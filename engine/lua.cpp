@@ -3139,6 +3139,19 @@ void BindGameLib(sol::state& L)
                     throw GameError("No such audio graph: " + name);
                 return engine.PrepareMusicGraph(klass);
             });
+    audio["PreloadGraph"] = sol::overload(
+            [](AudioEngine& engine, std::shared_ptr<const audio::GraphClass> klass) {
+                if (!klass)
+                    throw GameError("Nil audio graph class.");
+                return engine.PreloadGraph(klass);
+            },
+            [](AudioEngine& engine, const std::string& name) {
+                const auto* lib = engine.GetClassLibrary();
+                auto klass = lib->FindAudioGraphClassByName(name);
+                if (!klass)
+                    throw GameError("No such audio graph: " + name);
+                return engine.PreloadGraph(klass);
+            });
     audio["PlayMusic"] = sol::overload(
             [](AudioEngine& engine, std::shared_ptr<const audio::GraphClass> klass) {
                 if (!klass)
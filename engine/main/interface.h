@@ -147,7 +147,10 @@ namespace engine
             bool debug_print_fps = false;
             // Show debug messages in the rendering output.
             bool debug_show_msg = false;
-            // Set the font URI for debug fps/msg text rendering.
+            // Show the device's per frame statistics (draw calls etc.)
+            // in the rendering output.
+            bool debug_show_stats = false;
+            // Set the font URI for debug fps/msg/stats text rendering.
             std::string debug_font;
         };
         // Set the debug options.
@@ -199,6 +202,23 @@ namespace engine
             gfx::Device::MinFilter default_min_filter = gfx::Device::MinFilter::Bilinear;
             // the default texture magnification filter setting.
             gfx::Device::MagFilter default_mag_filter = gfx::Device::MagFilter::Linear;
+            // The maximum amount of texture memory in megabytes that the
+            // game should use. When the budget is exceeded the least recently
+            // used textures are deleted. 0 for no budget.
+            unsigned texture_memory_budget = 0;
+            // The maximum amount of time in milliseconds to spend on
+            // building the shader programs used by a scene when the
+            // scene is loaded. Programs that don't get built within the
+            // budget are built when they're first used. 0 for no budget.
+            unsigned program_prepare_budget = 250;
+            // Whether to pack small textures into shared atlas textures
+            // at runtime in order to reduce texture rebinding between draws.
+            // The atlas textures have no mips so this is off by default.
+            bool texture_atlas = false;
+            // Whether to cache the paint results of static UI containers
+            // in offscreen render targets and reuse them on later frames
+            // instead of painting every widget again.
+            bool ui_paint_cache = false;
 
             // the current expected number of Update calls per second.
             unsigned updates_per_second = 60;
@@ -250,6 +270,25 @@ namespace engine
                 // that is flagged for PCM caching will be cached in order to
                 // avoid duplicate audio decoding.
                 bool enable_pcm_caching = false;
+                // The maximum amount of decoded PCM data in megabytes to keep
+                // in the PCM cache. When the budget is exceeded the least
+                // recently used PCM data is evicted. 0 for no budget.
+                unsigned pcm_cache_budget = 64;
+                // Flag to control decoding music ahead of playback on a
+                // separate decoder thread instead of the audio thread.
+                bool enable_read_ahead = true;
+                // The maximum number of audible sound effects. Sound effects
+                // in excess are virtualized (not decoded or mixed) until they
+                // become audible again. 0 for no limit.
+                unsigned max_effect_voices = 32;
+                // The number of worker threads used to evaluate independent
+                // audio graph branches and sound effects in parallel with the
+                // audio thread. 0 to use only the audio thread. Off by default
+                // until the benefit has been measured on the target platforms.
+                unsigned worker_threads = 0;
+                // The interval in milliseconds for measuring the audio graph
+                // and audio element processing times. 0 to disable profiling.
+                unsigned profiling_interval = 0;
             } audio;
             // the default clear color.
             Color4f clear_color = {0.2f, 0.3f, 0.4f, 1.0f};
@@ -362,6 +401,47 @@ namespace engine
             std::size_t static_vbo_mem_alloc  = 0;
             std::size_t streaming_vbo_mem_use = 0;
             std::size_t streaming_vbo_mem_alloc = 0;
+            std::size_t texture_mem_use       = 0;
+            std::size_t texture_mem_budget    = 0;
+            std::size_t num_textures_evicted  = 0;
+            // The number of programs that had to be built during the
+            // game play, i.e. that were not prepared at scene load.
+            std::size_t num_programs_built_in_game = 0;
+            // Device work submitted during the last completed frame.
+            unsigned frame_draw_calls       = 0;
+            std::size_t frame_vertices      = 0;
+            unsigned frame_program_switches = 0;
+            unsigned frame_texture_binds    = 0;
+            unsigned frame_texture_uploads  = 0;
+            std::size_t frame_texture_upload_bytes = 0;
+            unsigned frame_buffer_uploads   = 0;
+            std::size_t frame_buffer_upload_bytes = 0;
+            unsigned frame_fbo_switches     = 0;
+            unsigned frame_uniform_sets     = 0;
+            // Audio PCM cache statistics.
+            std::size_t audio_pcm_cache_hits    = 0;
+            std::size_t audio_pcm_cache_misses  = 0;
+            std::size_t audio_pcm_cache_evictions = 0;
+            std::size_t audio_pcm_cache_entries = 0;
+            std::size_t audio_pcm_cache_bytes   = 0;
+            // Audio read ahead decoder statistics.
+            std::size_t audio_read_ahead_decoders  = 0;
+            std::size_t audio_read_ahead_underruns = 0;
+            std::size_t audio_read_ahead_depth_ms  = 0;
+            // Sound effect voice statistics.
+            std::size_t audio_effect_voices_active  = 0;
+            std::size_t audio_effect_voices_virtual = 0;
+            std::size_t audio_effect_voices_stolen  = 0;
+            // Audio graph profiling statistics in milliseconds over
+            // the latest profiling interval.
+            double audio_effect_graph_avg_time = 0.0;
+            double audio_effect_graph_max_time = 0.0;
+            double audio_music_graph_avg_time  = 0.0;
+            double audio_music_graph_max_time  = 0.0;
+            // The smallest remaining time between processing the audio
+            // graphs and the duration of the audio produced. Negative
+            // when the audio processing can't keep up.
+            double audio_min_deadline_margin   = 0.0;
         };
         // Get the current statistics collected by the app implementation.
         // Returns false if not available.
@@ -360,6 +360,7 @@ int main(int argc, char* argv[])
         opt.Add("--debug-font", "Set debug font for debug messages.", std::string(""));
         opt.Add("--debug-show-fps", "Show FPS counter and stats. You'll need to use --debug-font.");
         opt.Add("--debug-show-msg", "Show debug messages. You'll need to use --debug-font.");
+        opt.Add("--debug-show-stats", "Show per frame rendering stats. You'll need to use --debug-font.");
         opt.Add("--debug-print-fps", "Print FPS counter and stats to log.");
         opt.Add("--trace", "Record engine function call trace and timing info into a file.", std::string("trace.txt"));
         opt.Add("--vsync", "Force vsync on or off.", false);
@@ -389,6 +390,7 @@ int main(int argc, char* argv[])
             debug.debug_draw      = true;
             debug.debug_show_fps  = true;
             debug.debug_show_msg  = true;
+            debug.debug_show_stats = true;
             debug.debug_print_fps = true;
         }
         else
@@ -400,11 +402,12 @@ int main(int argc, char* argv[])
             debug.debug_show_fps  = opt.WasGiven("--debug-show-fps");
             debug.debug_draw      = opt.WasGiven("--debug-draw");
             debug.debug_show_msg  = opt.WasGiven("--debug-show-msg");
+            debug.debug_show_stats = opt.WasGiven("--debug-show-stats");
             debug_context = opt.WasGiven("--debug-ctx");
         }
 
         debug.debug_font = opt.GetValue<std::string>("--debug-font");
-        if ((debug.debug_show_msg || debug.debug_show_fps) && debug.debug_font.empty())
+        if ((debug.debug_show_msg || debug.debug_show_fps || debug.debug_show_stats) && debug.debug_font.empty())
         {
             std::fprintf(stdout, "No debug font was given. Use --debug-font.\n");
             return 0;
@@ -647,6 +650,10 @@ int main(int argc, char* argv[])
             base::JsonReadSafe(engine_settings, "clear_color", &config.clear_color);
             base::JsonReadSafe(engine_settings, "default_min_filter", &config.default_min_filter);
             base::JsonReadSafe(engine_settings, "default_mag_filter", &config.default_mag_filter);
+            base::JsonReadSafe(engine_settings, "texture_memory_budget", &config.texture_memory_budget);
+            base::JsonReadSafe(engine_settings, "program_prepare_budget", &config.program_prepare_budget);
+            base::JsonReadSafe(engine_settings, "texture_atlas", &config.texture_atlas);
+            base::JsonReadSafe(engine_settings, "ui_paint_cache", &config.ui_paint_cache);
             base::JsonReadSafe(engine_settings, "updates_per_second", &config.updates_per_second);
             base::JsonReadSafe(engine_settings, "ticks_per_second", &config.ticks_per_second);
             DEBUG("time_step = 1.0/%1, tick_step = 1.0/%2", config.updates_per_second, config.ticks_per_second);
@@ -669,6 +676,11 @@ int main(int argc, char* argv[])
             base::JsonReadSafe(audio, "sample_type", &config.audio.sample_type);
             base::JsonReadSafe(audio, "buffer_size", &config.audio.buffer_size);
             base::JsonReadSafe(audio, "pcm_caching", &config.audio.enable_pcm_caching);
+            base::JsonReadSafe(audio, "pcm_cache_budget", &config.audio.pcm_cache_budget);
+            base::JsonReadSafe(audio, "read_ahead", &config.audio.enable_read_ahead);
+            base::JsonReadSafe(audio, "max_effect_voices", &config.audio.max_effect_voices);
+            base::JsonReadSafe(audio, "worker_threads", &config.audio.worker_threads);
+            base::JsonReadSafe(audio, "profiling_interval", &config.audio.profiling_interval);
         }
 
         // check whether there's a state file with previous window geometry
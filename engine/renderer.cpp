@@ -71,6 +71,107 @@ void Renderer::CreateScene(const game::Scene& scene)
 
 }
 
+std::size_t Renderer::PrepareScene(const game::Scene& scene, gfx::Painter& painter, double max_time)
+{
+    // collect the unique drawable/material combinations first.
+    struct Combination {
+        std::shared_ptr<gfx::Drawable> drawable;
+        std::shared_ptr<gfx::Material> material;
+    };
+    std::vector<Combination> combinations;
+    std::unordered_set<std::string> seen_combinations;
+    std::unordered_set<std::string> seen_classes;
+
+    std::shared_ptr<gfx::Material> mask_material = gfx::CreateMaterialInstance(gfx::CreateMaterialClassFromColor(gfx::Color::White));
+
+    const auto& scene_class = scene.GetClass();
+    for (size_t i=0; i<scene_class.GetNumNodes(); ++i)
+    {
+        const auto& entity = scene_class.GetNode(i).GetEntityClass();
+        if (!entity || !seen_classes.insert(entity->GetId()).second)
+            continue;
+
+        for (size_t j=0; j<entity->GetNumNodes(); ++j)
+        {
+            const auto& node = entity->GetNode(j);
+            if (const auto* item = node.GetDrawable())
+            {
+                const auto is_mask   = item->GetRenderPass() == RenderPass::Mask;
+                const auto is_points = item->GetRenderStyle() == RenderStyle::Points;
+                const auto& material = is_mask ? std::string("_mask") : item->GetMaterialId();
+                const auto& drawable = item->GetDrawableId();
+                const auto& key = drawable + "/" + material + (is_points ? "/points" : "");
+                if (!seen_combinations.insert(key).second)
+                    continue;
+
+                Combination combination;
+                if (auto klass = mClassLib->FindDrawableClassById(drawable))
+                    combination.drawable = gfx::CreateDrawableInstance(klass);
+                if (is_mask)
+                    combination.material = mask_material;
+                else if (auto klass = mClassLib->FindMaterialClassById(material))
+                    combination.material = gfx::CreateMaterialInstance(klass);
+                if (!combination.drawable || !combination.material)
+                    continue;
+                // the material shader depends on whether the drawable
+                // is rendered as points or not.
+                if (is_points)
+                    combination.drawable->SetStyle(gfx::Drawable::Style::Points);
+                else combination.drawable->SetStyle(gfx::Drawable::Style::Solid);
+                combinations.push_back(std::move(combination));
+            }
+            if (const auto* text = node.GetTextItem())
+            {
+                // see CreateDrawResources for how the text is drawn.
+                std::shared_ptr<gfx::GlyphAtlas> atlas;
+                if (!mEditingMode && !text->IsStatic())
+                    atlas = gfx::GlyphAtlas::Get(text->GetFontName(), text->GetFontSize());
+
+                const auto& key = atlas ? "_glyph_atlas" : "_rect/_text";
+                if (!seen_combinations.insert(key).second)
+                    continue;
+
+                Combination combination;
+                if (atlas)
+                {
+                    combination.material = std::make_shared<gfx::GlyphAtlasMaterial>(atlas);
+                    combination.drawable = std::make_shared<gfx::TextBatch>(atlas, gfx::TextBuffer(1, 1));
+                }
+                else
+                {
+                    combination.material = gfx::CreateMaterialInstance(gfx::TextBuffer(1, 1));
+                    if (auto klass = mClassLib->FindDrawableClassById("_rect"))
+                        combination.drawable = gfx::CreateDrawableInstance(klass);
+                }
+                if (!combination.drawable || !combination.material)
+                    continue;
+                combinations.push_back(std::move(combination));
+            }
+        }
+    }
+
+    base::ElapsedTimer timer;
+    timer.Start();
+
+    std::size_t count = 0;
+    for (const auto& combination : combinations)
+    {
+        if (max_time > 0.0 && timer.SinceStart() >= max_time)
+        {
+            INFO("Program preparation time budget exceeded. [prepared=%1, remaining=%2]",
+                 count, combinations.size() - count);
+            break;
+        }
+        if (!painter.PrepareProgram(*combination.drawable, *combination.material))
+            WARN("Failed to prepare program. [drawable='%1', material='%2']",
+                 combination.drawable->GetProgramId(), combination.material->GetProgramId());
+        ++count;
+    }
+    DEBUG("Prepared scene programs. [scene='%1', count=%2, time=%3s]",
+          scene_class.GetName(), count, timer.SinceStart());
+    return count;
+}
+
 void Renderer::UpdateScene(const game::Scene& scene)
 {
     const auto& nodes = scene.CollectNodes();
@@ -557,10 +658,28 @@ void Renderer::CreateDrawResources(PaintNode& paint_node)
                 buffer.SetAlignment(gfx::TextBuffer::HorizontalAlignment::AlignRight);
             buffer.AddText(std::move(text_and_style));
 
-            // setup material to shade text.
-            auto mat = gfx::CreateMaterialInstance(std::move(buffer));
-            mat->SetColor(text->GetTextColor());
-            paint_node.text_material = std::move(mat);
+            // dynamic text is likely to change frequently so instead of
+            // rasterizing the whole text into a new texture every time
+            // draw the text with glyphs from a shared glyph atlas.
+            std::shared_ptr<gfx::GlyphAtlas> atlas;
+            if (!mEditingMode && !text->IsStatic())
+                atlas = gfx::GlyphAtlas::Get(text->GetFontName(), text->GetFontSize());
+
+            if (atlas)
+            {
+                auto mat = std::make_shared<gfx::GlyphAtlasMaterial>(atlas);
+                mat->SetColor(text->GetTextColor());
+                paint_node.text_material = std::move(mat);
+                paint_node.text_drawable = std::make_shared<gfx::TextBatch>(atlas, std::move(buffer));
+            }
+            else
+            {
+                // setup material to shade text.
+                auto mat = gfx::CreateMaterialInstance(std::move(buffer));
+                mat->SetColor(text->GetTextColor());
+                paint_node.text_material = std::move(mat);
+                paint_node.text_drawable.reset();
+            }
             paint_node.text_material_id = material;
         }
         if (!paint_node.text_drawable)
@@ -786,6 +905,57 @@ void Renderer::DrawPackets(gfx::Painter& painter, std::vector<DrawPacket>& packe
             entity_layer.mask_list.push_back(shape);
         }
     }
+    // Merge the draws of adjacent particle engines that render with
+    // identical material state into particle batches so that each batch
+    // is a single vertex upload and a single draw call. Only adjacent
+    // draws are merged in order to keep the draw order unchanged.
+    static const glm::mat4 identity(1.0f);
+    std::size_t num_particle_batches = 0;
+    for (auto& scene_layer : layers)
+    {
+        for (auto& entity_layer : scene_layer)
+        {
+            auto& draw_list = entity_layer.draw_list;
+            bool merged = false;
+            for (size_t i=0; i+1<draw_list.size(); ++i)
+            {
+                auto& first = draw_list[i];
+                gfx::ParticleBatch* batch = nullptr;
+                for (size_t j=i+1; j<draw_list.size(); ++j)
+                {
+                    auto& other = draw_list[j];
+                    if (!gfx::ParticleBatch::CanCombine(*first.drawable, *first.material, *other.drawable, *other.material))
+                        break;
+                    if (batch == nullptr)
+                    {
+                        if (num_particle_batches == mParticleBatches.size())
+                            mParticleBatches.push_back(std::make_shared<gfx::ParticleBatch>());
+                        batch = mParticleBatches[num_particle_batches++].get();
+                        batch->Clear();
+                        batch->AddEngine(static_cast<const gfx::KinematicsParticleEngine*>(first.drawable), *first.transform);
+                    }
+                    batch->AddEngine(static_cast<const gfx::KinematicsParticleEngine*>(other.drawable), *other.transform);
+                    other.drawable = nullptr;
+                    i = j;
+                }
+                if (batch == nullptr)
+                    continue;
+                // the batch vertices are in the world space already and the
+                // batch is drawn with the first engine's material which is
+                // identical to the materials of the other engines.
+                first.drawable  = batch;
+                first.transform = &identity;
+                merged = true;
+            }
+            if (!merged)
+                continue;
+
+            draw_list.erase(std::remove_if(draw_list.begin(), draw_list.end(), [](const auto& draw) {
+                return draw.drawable == nullptr;
+            }), draw_list.end());
+        }
+    }
+
     for (const auto& scene_layer : layers)
     {
         for (const auto& entity_layer : scene_layer)
@@ -99,6 +99,14 @@ namespace engine
         void BeginFrame();
 
         void CreateScene(const game::Scene& scene);
+        // Prepare (compile and link) the device programs for every
+        // drawable/material combination used by the entity classes in
+        // the scene so that the programs don't need to be built when the
+        // combination is drawn for the first time during the game play.
+        // Preparing stops once max_time (in seconds) has been spent.
+        // Zero max_time means no time limit.
+        // Returns the number of program combinations that were prepared.
+        std::size_t PrepareScene(const game::Scene& scene, gfx::Painter& painter, double max_time = 0.0);
         void UpdateScene(const game::Scene& scene);
         void Draw(gfx::Painter& painter, EntityInstanceDrawHook* hook);
         void Update(float time, float dt);
@@ -219,6 +227,9 @@ namespace engine
         };
         using LayerPalette = std::vector<TilemapNode>;
         std::vector<LayerPalette> mTilemapPalette;
+        // particle batches for merging the draws of adjacent particle
+        // engines with identical materials. reused from frame to frame.
+        std::vector<std::shared_ptr<gfx::ParticleBatch>> mParticleBatches;
         bool mEditingMode = false;
     };
 
@@ -29,6 +29,10 @@
 #include "audio/format.h"
 #include "audio/loader.h"
 #include "audio/graph.h"
+#include "audio/element.h"
+#include "audio/stream.h"
+#include "audio/null.h"
+#include "audio/player.h"
 #include "graphics/device.h"
 #include "graphics/painter.h"
 #include "engine/audio.h"
@@ -44,6 +48,8 @@
 namespace {
 bool enable_pcm_caching=false;
 bool enable_file_caching=false;
+bool capture_audio=false;
+unsigned num_voices=32;
 
 // setup context for headless rendering.
 class TestContext : public gfx::Device::Context
@@ -193,6 +199,140 @@ public:
 private:
 };
 
+// Mix a number of simultaneously playing looping voices on the null
+// audio device as fast as possible. This measures the audio graph
+// throughput without any audio hardware/platform audio system, i.e.
+// how many voices a single core can mix in real time.
+class TestAudioVoicesHeadless : public TestCase
+{
+public:
+    virtual void Execute(Engine& engine) override
+    {
+        auto voice = std::make_shared<audio::GraphClass>("voice", "56718291");
+        audio::ElementCreateArgs elem;
+        elem.type = "FileSource";
+        elem.name = "file";
+        elem.id = base::RandomString(10);
+        elem.args["file"] = "assets/sounds/Laser_09.mp3";
+        elem.args["type"] = audio::SampleType::Float32;
+        elem.args["loops"] = 0u;
+        elem.args["pcm_caching"] = enable_pcm_caching;
+        elem.args["file_caching"] = enable_file_caching;
+        const auto& e = voice->AddElement(std::move(elem));
+        voice->SetGraphOutputElementId(e.id);
+        voice->SetGraphOutputElementPort("out");
+
+        audio::Format format;
+        format.channel_count = 2;
+        format.sample_rate   = 44100;
+        format.sample_type   = audio::SampleType::Float32;
+
+        audio::AudioGraph::PrepareParams p;
+        p.enable_pcm_caching = enable_pcm_caching;
+
+        auto graph = std::make_unique<audio::AudioGraph>("voices");
+        auto* mixer = (*graph)->AddElement(audio::MixerSource("mixer", format));
+        (*graph)->LinkGraph("mixer", "out");
+        graph->Prepare(*engine.audio_loader, p);
+        for (unsigned i=0; i<num_voices; ++i)
+        {
+            auto source = std::make_unique<audio::Graph>("voice " + std::to_string(i), voice);
+            source->Prepare(*engine.audio_loader, p);
+            mixer->AddSourcePtr(std::move(source));
+        }
+
+        audio::NullDevice::Params params;
+        params.capture = capture_audio;
+        audio::NullDevice device(params);
+        device.SetBufferSize(20);
+        device.Init();
+
+        // 10 seconds of audio in 20ms buffers.
+        auto stream = device.Prepare(std::move(graph));
+        stream->Play();
+        for (unsigned i=0; i<500; ++i)
+            device.Poll();
+        stream->Cancel();
+
+        const auto& stats = device.GetStats();
+        const auto realtime_factor = stats.audio_time / stats.total_callback_time;
+        std::printf("Mixed %u voices, %.1fs of audio in %.1fms, max callback %.2fms, deadline misses %u\n",
+                    num_voices, stats.audio_time / 1000.0, stats.total_callback_time,
+                    stats.max_callback_time, (unsigned)stats.deadline_misses);
+        std::printf("Realtime factor %.1fx, ~%.0f voices per core\n",
+                    realtime_factor, realtime_factor * num_voices);
+
+        for (const auto& output : device.TakeOutputs())
+        {
+            const auto& name = "audio-voices-headless.wav";
+            if (audio::NullDevice::WriteWAV(name, output))
+                INFO("Wrote audio capture '%1'", name);
+        }
+    }
+private:
+};
+
+// Measure the worst case audio callback latency on the null audio
+// device running in real time on the audio player thread. The test is
+// run once with an idle game thread and once with a game thread that
+// keeps polling for player events and asking for stream progress so
+// that the audio thread keeps producing events for it.
+class TestAudioLatency : public TestCase
+{
+public:
+    virtual void Execute(Engine& engine) override
+    {
+        Measure(*engine.audio_loader, false);
+        Measure(*engine.audio_loader, true);
+    }
+private:
+    static void Measure(const audio::Loader& loader, bool contention)
+    {
+        audio::Format format;
+        format.channel_count = 2;
+        format.sample_rate   = 44100;
+        format.sample_type   = audio::SampleType::Float32;
+
+        audio::Graph graph("graph");
+        graph.AddElement(audio::SineSource("sine", format, 440, 5000));
+        graph.LinkGraph("sine", "out");
+
+        audio::AudioGraph::PrepareParams p;
+        auto source = std::make_unique<audio::AudioGraph>("sine", std::move(graph));
+        source->Prepare(loader, p);
+        source->SetProfilingInterval(100);
+
+        audio::NullDevice::Params params;
+        params.clock = audio::NullDevice::Clock::Realtime;
+        auto device = std::make_unique<audio::NullDevice>(params);
+        device->SetBufferSize(10);
+        auto* null = device.get();
+
+        audio::Player player(std::move(device));
+        const auto id = player.Play(std::move(source));
+
+        unsigned events = 0;
+        bool complete = false;
+        while (!complete)
+        {
+            audio::Player::Event event;
+            while (player.GetEvent(&event))
+            {
+                if (std::holds_alternative<audio::Player::SourceCompleteEvent>(event))
+                    complete = true;
+                ++events;
+            }
+            if (contention)
+                player.AskProgress(id);
+            else std::this_thread::sleep_for(std::chrono::milliseconds(16));
+        }
+        const auto& stats = null->GetStats();
+        std::printf("Audio latency (%s game thread): max latency %.2fms, max callback %.2fms, deadline misses %u, events %u\n",
+                    contention ? "busy" : "idle", stats.max_latency, stats.max_callback_time,
+                    (unsigned)stats.deadline_misses, events);
+    }
+};
+
 class TestRenderRobots : public TestCase
 {
 public:
@@ -307,6 +447,8 @@ int test_main(int argc, char* argv[])
         TestCase* test   = nullptr;
     } tests[] = {
         {"audio-rapid-fire", false, new TestAudioRapidFire()},
+        {"audio-voices-headless", false, new TestAudioVoicesHeadless()},
+        {"audio-latency", false, new TestAudioLatency()},
         {"audio-decode-mp3", false, new TestAudioFileDecode("assets/sounds/Laser_09.mp3")},
         {"audio-decode-ogg", false, new TestAudioFileDecode("assets/sounds/Laser_09.ogg")},
         {"audio-decode-wav", false, new TestAudioFileDecode("assets/sounds/Laser_09.wav")},
@@ -326,6 +468,9 @@ int test_main(int argc, char* argv[])
     opt.Add("--timing", "Perform timing on tests.");
     opt.Add("--pcm-cache", "Enable audio PCM caching.");
     opt.Add("--enable-file-caching", "Enable file caching.");
+    opt.Add("--null-audio", "Run the audio engine on the null (headless) audio device.");
+    opt.Add("--capture-audio", "Capture the null audio device output into a WAV file.");
+    opt.Add("--voices", "Number of voices in headless audio tests.", 32u);
     opt.Add("--screenshot", "Take screenshot of test cases with visual output.");
     opt.Add("--trace", "Trace file to write.", std::string());
     for (const auto& test : tests)
@@ -344,6 +489,8 @@ int test_main(int argc, char* argv[])
     }
     enable_pcm_caching  = opt.WasGiven("--pcm-cache");
     enable_file_caching = opt.WasGiven("--file-cache");
+    capture_audio       = opt.WasGiven("--capture-audio");
+    num_voices          = opt.GetValue<unsigned>("--voices");
     base::EnableDebugLog(opt.WasGiven("--debug-log"));
 
     std::unique_ptr<base::TraceWriter> trace_writer;
@@ -381,7 +528,13 @@ int test_main(int argc, char* argv[])
     audio_engine.SetBufferSize(20); // milliseconds
     audio_engine.SetLoader(&audio_loader);
     audio_engine.SetFormat(audio_format);
-    audio_engine.Start();
+    if (opt.WasGiven("--null-audio"))
+    {
+        audio::NullDevice::Params params;
+        params.clock = audio::NullDevice::Clock::Realtime;
+        audio_engine.Start(std::make_unique<audio::NullDevice>(params));
+    }
+    else audio_engine.Start();
 
     engine::Renderer renderer;
     renderer.SetEditingMode(false);
@@ -21,6 +21,7 @@
 #include "warnpop.h"
 
 #include <algorithm>
+#include <cmath>
 
 #include "base/assert.h"
 #include "base/logging.h"
@@ -32,6 +33,10 @@
 #include "graphics/drawing.h"
 #include "graphics/painter.h"
 #include "graphics/transform.h"
+#include "graphics/device.h"
+#include "graphics/texture.h"
+#include "graphics/framebuffer.h"
+#include "graphics/bitmap.h"
 #include "engine/ui.h"
 #include "engine/classlib.h"
 #include "engine/data.h"
@@ -48,6 +53,27 @@ bool ReadColor(const nlohmann::json& json, const std::string& name, gfx::Color4f
     *out = gfx::Color(value);
     return true;
 }
+
+// Check whether the material's output changes over time in which
+// case any cached paint results using the material would go stale.
+bool IsAnimated(const gfx::Material* material)
+{
+    const auto* instance = dynamic_cast<const gfx::MaterialClassInst*>(material);
+    if (instance == nullptr)
+        return false;
+    const auto& klass = instance->GetClass();
+    const auto type = klass.GetType();
+    if (type == gfx::MaterialClass::Type::Sprite || type == gfx::MaterialClass::Type::Custom)
+        return true;
+    if (type == gfx::MaterialClass::Type::Texture)
+    {
+        const auto& texture = static_cast<const gfx::TextureMap2DClass&>(klass);
+        return texture.GetTextureVelocityX() != 0.0f ||
+               texture.GetTextureVelocityY() != 0.0f ||
+               texture.GetTextureVelocityZ() != 0.0f;
+    }
+    return false;
+}
 } // namespace
 
 namespace engine
@@ -769,6 +795,9 @@ void UIPainter::DrawProgressBar(const WidgetId& id, const PaintStruct& ps, std::
         }
         else
         {
+            // the busy indicator moves with time.
+            mAnimatedPaint = true;
+
             const auto width  = ps.rect.GetWidth();
             const auto height = ps.rect.GetHeight();
             const auto progress_width   = ps.rect.GetWidth();
@@ -800,11 +829,165 @@ void UIPainter::DrawProgressBar(const WidgetId& id, const PaintStruct& ps, std::
 
 bool UIPainter::ParseStyle(const std::string& tag, const std::string& style)
 {
+    DeletePaintCache();
     return mStyle->ParseStyleString(tag, style);
 }
 
+bool UIPainter::DrawCachedPaint(const WidgetId& id, const uik::FRect& rect, std::size_t hash)
+{
+    if (!mDevice || mRecording)
+        return false;
+
+    auto it = mPaintCache.find(id);
+    if (it == mPaintCache.end())
+        return false;
+
+    auto& cache = it->second;
+    cache.used = true;
+    if (cache.hash != hash || cache.no_cache || !cache.material)
+        return false;
+    // the device might have purged the texture if it wasn't used for a while.
+    if (!mDevice->FindTexture(cache.texture))
+        return false;
+
+    DrawPaintCache(id);
+    return true;
+}
+
+bool UIPainter::BeginPaintCache(const WidgetId& id, const uik::FRect& rect, std::size_t hash)
+{
+    if (!mDevice || mRecording)
+        return false;
+
+    auto& cache = mPaintCache[id];
+    cache.used = true;
+    if (cache.hash == hash && cache.no_cache)
+        return false;
+
+    // map the widget rectangle to render target pixels using the current
+    // projection and viewport so that the cached results have the same
+    // resolution as the results of painting directly.
+    const auto& projection = mPainter->GetProjectionMatrix();
+    const auto& viewport   = mPainter->GetViewport();
+    const float pixels_per_unit_x = std::abs(projection[0][0]) * viewport.GetWidth() * 0.5f;
+    const float pixels_per_unit_y = std::abs(projection[1][1]) * viewport.GetHeight() * 0.5f;
+    const auto width  = (unsigned)std::ceil(rect.GetWidth() * pixels_per_unit_x);
+    const auto height = (unsigned)std::ceil(rect.GetHeight() * pixels_per_unit_y);
+    if (width == 0 || height == 0)
+        return false;
+
+    const auto& name = "UI/" + id;
+    auto* fbo = mDevice->FindFramebuffer(name);
+    auto* texture = cache.texture.empty() ? nullptr : mDevice->FindTexture(cache.texture);
+    if (!fbo || !texture || cache.width != width || cache.height != height)
+    {
+        DeletePaintCacheResources(id, cache.texture);
+        cache.texture.clear();
+
+        // the texture is only ever rendered to. the bitmap is a placeholder
+        // for having a texture source that can be used with a material.
+        auto source = std::make_unique<gfx::detail::TextureBitmapBufferSource>(gfx::RgbaBitmap(1, 1));
+        source->SetName(name);
+
+        texture = mDevice->MakeTexture(source->GetGpuId());
+        texture->SetName(name);
+        texture->Upload(nullptr, width, height, gfx::Texture::Format::RGBA, false /*mips*/);
+        texture->SetFilter(gfx::Texture::MinFilter::Linear);
+        texture->SetFilter(gfx::Texture::MagFilter::Linear);
+        texture->SetContentHash(source->GetContentHash());
+
+        gfx::Framebuffer::Config conf;
+        conf.format = gfx::Framebuffer::Format::ColorRGBA8;
+        conf.width  = width;
+        conf.height = height;
+        fbo = mDevice->MakeFramebuffer(name);
+        fbo->SetColorTarget(texture);
+        if (!fbo->Create(conf))
+        {
+            WARN("Failed to create UI paint cache render target. [widget=%1]", id);
+            cache.hash     = hash;
+            cache.no_cache = true;
+            cache.material.reset();
+            return false;
+        }
+        cache.texture = source->GetGpuId();
+        cache.width   = width;
+        cache.height  = height;
+
+        // the render target contains premultiplied alpha. see the
+        // device blending setup for offscreen rendering.
+        gfx::TextureMap2DClass klass;
+        klass.SetSurfaceType(gfx::MaterialClass::SurfaceType::Transparent);
+        klass.SetFlag(gfx::MaterialClass::Flags::PremultipliedAlpha, true);
+        klass.SetTextureMinFilter(gfx::MaterialClass::MinTextureFilter::Linear);
+        klass.SetTextureMagFilter(gfx::MaterialClass::MagTextureFilter::Linear);
+        klass.SetTexture(std::move(source));
+        cache.material = gfx::CreateMaterialInstance(klass);
+    }
+    cache.hash     = hash;
+    cache.no_cache = false;
+    cache.rect     = gfx::FRect(rect.GetX(), rect.GetY(), width / pixels_per_unit_x, height / pixels_per_unit_y);
+
+    PaintCacheRecording recording;
+    recording.id         = id;
+    recording.projection = projection;
+    recording.viewport   = viewport;
+    recording.surface    = mPainter->GetSurfaceSize();
+    mRecording = std::move(recording);
+    mAnimatedPaint = false;
+
+    mDevice->SetFramebuffer(fbo);
+    mPainter->SetSurfaceSize(gfx::USize(width, height));
+    mPainter->SetViewport(gfx::IRect(0, 0, width, height));
+    mPainter->SetProjectionMatrix(gfx::Painter::MakeOrthographicProjection(cache.rect));
+    mPainter->Clear(gfx::Color4f(gfx::Color::Black, 0.0f));
+    return true;
+}
+
+void UIPainter::EndPaintCache(const WidgetId& id)
+{
+    ASSERT(mRecording && mRecording->id == id);
+
+    mDevice->SetFramebuffer(nullptr);
+    mPainter->SetSurfaceSize(mRecording->surface);
+    mPainter->SetViewport(mRecording->viewport);
+    mPainter->SetProjectionMatrix(mRecording->projection);
+    mRecording.reset();
+
+    auto& cache = mPaintCache[id];
+    cache.no_cache = mAnimatedPaint;
+    DrawPaintCache(id);
+}
+
+void UIPainter::DeletePaintCache()
+{
+    for (const auto& [id, cache] : mPaintCache)
+    {
+        DeletePaintCacheResources(id, cache.texture);
+    }
+    mPaintCache.clear();
+}
+
+void UIPainter::PrunePaintCache()
+{
+    for (auto it = mPaintCache.begin(); it != mPaintCache.end();)
+    {
+        auto& cache = it->second;
+        if (cache.used)
+        {
+            cache.used = false;
+            ++it;
+            continue;
+        }
+        DeletePaintCacheResources(it->first, cache.texture);
+        it = mPaintCache.erase(it);
+    }
+}
+
 void UIPainter::DeleteMaterialInstances(const std::string& filter)
 {
+    DeletePaintCache();
+
     for (auto it = mMaterials.begin(); it != mMaterials.end(); )
     {
         const auto& key = it->first;
@@ -816,6 +999,8 @@ void UIPainter::DeleteMaterialInstances(const std::string& filter)
 
 void UIPainter::DeleteMaterialInstanceByKey(const std::string& key)
 {
+    DeletePaintCache();
+
     auto it = mMaterials.find(key);
     if (it == mMaterials.end())
         return;
@@ -824,6 +1009,8 @@ void UIPainter::DeleteMaterialInstanceByKey(const std::string& key)
 
 void UIPainter::DeleteMaterialInstanceByClassId(const std::string& id)
 {
+    DeletePaintCache();
+
     for (auto it = mMaterials.begin(); it != mMaterials.end();)
     {
         gfx::Material* material = it->second.get();
@@ -839,6 +1026,7 @@ void UIPainter::DeleteMaterialInstanceByClassId(const std::string& id)
 void UIPainter::DeleteMaterialInstances()
 {
     mMaterials.clear();
+    DeletePaintCache();
 }
 
 void UIPainter::Update(double time, float dt)
@@ -851,6 +1039,32 @@ void UIPainter::Update(double time, float dt)
     }
 }
 
+void UIPainter::DrawPaintCache(const std::string& id) const
+{
+    const auto& cache = mPaintCache[id];
+    ASSERT(cache.material);
+
+    // the render target rows are stored bottom up so the
+    // quad needs to be flipped vertically.
+    gfx::Rectangle quad;
+    quad.SetCulling(gfx::Drawable::Culling::None);
+
+    gfx::Transform transform;
+    transform.Resize(cache.rect.GetWidth(), -cache.rect.GetHeight());
+    transform.MoveTo(cache.rect.GetX(), cache.rect.GetY() + cache.rect.GetHeight());
+    mPainter->Draw(quad, transform, *cache.material);
+}
+
+void UIPainter::DeletePaintCacheResources(const std::string& id, const std::string& texture)
+{
+    if (!mDevice)
+        return;
+    // delete the framebuffer first since it refers to the texture.
+    mDevice->DeleteFramebuffer("UI/" + id);
+    if (!texture.empty())
+        mDevice->DeleteTexture(texture);
+}
+
 void UIPainter::SetClip(const gfx::FRect& rect)
 {
     // todo:
@@ -929,6 +1143,8 @@ gfx::Material* UIPainter::GetWidgetMaterial(const std::string& id, const PaintSt
         ret = GetWidgetMaterial(id, ps.klass, "mouse-over/" + key);
     if (!ret)
         ret = GetWidgetMaterial(id, ps.klass, key);
+    if (mRecording && IsAnimated(ret))
+        mAnimatedPaint = true;
     return ret;
 }
 
@@ -19,10 +19,12 @@
 #include "warnpush.h"
 #  include <nlohmann/json_fwd.hpp>
 #  include <neargye/magic_enum.hpp>
+#  include <glm/mat4x4.hpp>
 #include "warnpop.h"
 
 #include <any>
 #include <string>
+#include <optional>
 #include <memory>
 #include <vector>
 #include <unordered_map>
@@ -33,6 +35,7 @@
 #include "uikit/painter.h"
 #include "graphics/color4f.h"
 #include "graphics/material.h"
+#include "graphics/types.h"
 #include "graphics/fwd.h"
 
 namespace engine
@@ -506,6 +509,9 @@ namespace engine
         virtual void DrawSlider(const WidgetId& id, const PaintStruct& ps, const uik::FRect& knob) const override;
         virtual void DrawProgressBar(const WidgetId&, const PaintStruct& ps, std::optional<float> percentage) const override;
         virtual bool ParseStyle(const std::string& tag, const std::string& style) override;
+        virtual bool DrawCachedPaint(const WidgetId& id, const uik::FRect& rect, std::size_t hash) override;
+        virtual bool BeginPaintCache(const WidgetId& id, const uik::FRect& rect, std::size_t hash) override;
+        virtual void EndPaintCache(const WidgetId& id) override;
 
         // About deleting material instances.
         // This is mostly useful when designing the UI in the editor and changes
@@ -522,6 +528,13 @@ namespace engine
         // as identified by the class id.
         void DeleteMaterialInstanceByClassId(const std::string& id);
 
+        // Delete all cached widget paint results.
+        void DeletePaintCache();
+        // Delete the cached widget paint results that have not been
+        // used since the previous call. This should be called once
+        // per frame after painting the UI.
+        void PrunePaintCache();
+
         // Update all materials for material animations.
         void Update(double time, float dt);
 
@@ -532,6 +545,15 @@ namespace engine
         // painting operations.
         void SetPainter(gfx::Painter* painter)
         { mPainter = painter; }
+        // Set the graphics device used to render cached widget paint
+        // results into offscreen render targets. When no device is set
+        // no paint caching is done.
+        void SetDevice(gfx::Device* device)
+        {
+            if (device != mDevice)
+                DeletePaintCache();
+            mDevice = device;
+        }
 
     private:
         void SetClip(const gfx::FRect& rect);
@@ -559,9 +581,46 @@ namespace engine
             const auto& p = GetWidgetProperty(id, ps, key);
             return p.GetValue(value);
         }
+        void DrawPaintCache(const std::string& id) const;
+        void DeletePaintCacheResources(const std::string& id, const std::string& texture);
     private:
         UIStyle* mStyle = nullptr;
         gfx::Painter* mPainter = nullptr;
+        gfx::Device* mDevice = nullptr;
+
+        // The results of painting a widget sub-tree into
+        // an offscreen render target.
+        struct PaintCache {
+            // the hash value of the widget state that produced the results.
+            std::size_t hash = 0;
+            // the window rectangle covered by the render target.
+            gfx::FRect rect;
+            // the render target size in pixels.
+            unsigned width  = 0;
+            unsigned height = 0;
+            // the GPU ID of the render target texture.
+            std::string texture;
+            // material for drawing the render target texture.
+            std::unique_ptr<gfx::Material> material;
+            // true when the paint results can't be reused, for example
+            // because they depend on time (animated materials) or because
+            // the render target could not be created.
+            bool no_cache = false;
+            // true when the entry has been used since the last prune.
+            bool used = false;
+        };
+        mutable std::unordered_map<std::string, PaintCache> mPaintCache;
+        // State of the painter that needs to be restored after
+        // painting into the cache render target.
+        struct PaintCacheRecording {
+            std::string id;
+            glm::mat4 projection;
+            gfx::IRect viewport;
+            gfx::USize surface;
+        };
+        std::optional<PaintCacheRecording> mRecording;
+        // set when painting anything that depends on time.
+        mutable bool mAnimatedPaint = false;
 
         // material instances.
         mutable std::unordered_map<std::string,
@@ -675,6 +675,118 @@ void unit_test_entity_lifecycle()
     }
 }
 
+void unit_test_prepare_programs()
+{
+    auto entity_klass = std::make_shared<game::EntityClass>();
+    {
+        const struct {
+            const char* drawable;
+            const char* material;
+        } items[] = {
+            {"rect", "red"},
+            {"rect", "red-green"},
+            {"rect", "red-green-sprite"},
+            {"rect", "custom"},
+            {"particles", "pink"}
+        };
+        for (const auto& item : items)
+        {
+            game::DrawableItemClass drawable;
+            drawable.SetDrawableId(item.drawable);
+            drawable.SetMaterialId(item.material);
+
+            game::EntityNodeClass node;
+            node.SetName(std::string(item.drawable) + "/" + item.material);
+            node.SetSize(glm::vec2(50.0f, 50.0f));
+            node.SetTranslation(glm::vec2(25.0f, 25.0f));
+            node.SetDrawable(drawable);
+            entity_klass->LinkChild(nullptr, entity_klass->AddNode(node));
+        }
+        entity_klass->SetName("entity");
+    }
+
+    auto scene_class = std::make_shared<game::SceneClass>();
+    {
+        // same entity class twice doesn't need more programs.
+        game::SceneNodeClass node;
+        node.SetEntity(entity_klass);
+        node.SetName("1");
+        scene_class->LinkChild(nullptr, scene_class->AddNode(node));
+        node.SetName("2");
+        scene_class->LinkChild(nullptr, scene_class->AddNode(node));
+        scene_class->SetName("scene");
+    }
+
+    auto draw_frame = [](gfx::Device& device, gfx::Painter& painter, engine::Renderer& renderer) {
+        engine::EntityInstanceDrawHook* hook = nullptr;
+        device.BeginFrame();
+        {
+            device.ClearColor(gfx::Color::Blue);
+            renderer.BeginFrame();
+            {
+                renderer.Draw(painter, hook);
+            }
+            renderer.EndFrame();
+        }
+        device.EndFrame(true);
+    };
+    auto num_programs = [](const gfx::Device& device) {
+        gfx::Device::ResourceStats stats;
+        device.GetResourceStats(&stats);
+        return stats.num_programs_created;
+    };
+
+    DummyClassLib classloader;
+
+    // without preparing the programs get built on the first frame.
+    std::size_t expected_programs = 0;
+    {
+        auto device = gfx::Device::Create(std::make_shared<TestContext>(256, 256));
+        auto painter = gfx::Painter::Create(device);
+        painter->SetEditingMode(false);
+        painter->SetOrthographicProjection(256, 256);
+        painter->SetViewport(0, 0, 256, 256);
+        painter->SetSurfaceSize(256, 256);
+
+        auto scene = game::CreateSceneInstance(scene_class);
+        engine::Renderer renderer(&classloader);
+        renderer.CreateScene(*scene);
+        TEST_REQUIRE(num_programs(*device) == 0);
+
+        draw_frame(*device, *painter, renderer);
+        expected_programs = num_programs(*device);
+        TEST_REQUIRE(expected_programs > 0);
+
+        draw_frame(*device, *painter, renderer);
+        TEST_REQUIRE(num_programs(*device) == expected_programs);
+    }
+
+    // with preparing no programs get built when drawing.
+    {
+        auto device = gfx::Device::Create(std::make_shared<TestContext>(256, 256));
+        auto painter = gfx::Painter::Create(device);
+        painter->SetEditingMode(false);
+        painter->SetOrthographicProjection(256, 256);
+        painter->SetViewport(0, 0, 256, 256);
+        painter->SetSurfaceSize(256, 256);
+
+        auto scene = game::CreateSceneInstance(scene_class);
+        engine::Renderer renderer(&classloader);
+        renderer.CreateScene(*scene);
+        TEST_REQUIRE(renderer.PrepareScene(*scene, *painter) == 5);
+        TEST_REQUIRE(num_programs(*device) == expected_programs);
+
+        draw_frame(*device, *painter, renderer);
+        TEST_REQUIRE(num_programs(*device) == expected_programs);
+        draw_frame(*device, *painter, renderer);
+        TEST_REQUIRE(num_programs(*device) == expected_programs);
+
+        // preparing again is a no-op.
+        TEST_REQUIRE(renderer.PrepareScene(*scene, *painter) == 5);
+        TEST_REQUIRE(num_programs(*device) == expected_programs);
+    }
+}
+
 int test_main(int argc, char* argv[])
 {
     unit_test_drawable_item();
@@ -682,5 +794,6 @@ int test_main(int argc, char* argv[])
     unit_test_entity_layering();
     unit_test_scene_layering();
     unit_test_entity_lifecycle();
+    unit_test_prepare_programs();
     return 0;
 }
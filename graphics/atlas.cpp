@@ -0,0 +1,396 @@
+// Copyright (C) 2020-2021 Sami Väisänen
+// Copyright (C) 2020-2021 Ensisoft http://www.ensisoft.com
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+#include "config.h"
+
+#include <algorithm>
+#include <limits>
+#include <cstring>
+
+#include "base/assert.h"
+#include "base/logging.h"
+#include "base/utility.h"
+#include "base/math.h"
+#include "graphics/atlas.h"
+#include "graphics/bitmap.h"
+#include "graphics/device.h"
+#include "graphics/material.h"
+
+namespace {
+unsigned BytesPerTexel(gfx::Texture::Format format)
+{
+    using Format = gfx::Texture::Format;
+    switch (format)
+    {
+        case Format::Grayscale: return 1;
+        case Format::RGB:       return 3;
+        case Format::sRGB:      return 3;
+        case Format::RGBA:      return 4;
+        case Format::sRGBA:     return 4;
+    }
+    BUG("Unknown texture format.");
+    return 0;
+}
+} // namespace
+
+namespace gfx
+{
+
+Texture* TextureAtlas::FindTexture(const TextureSource& source, bool check_content, Device& device, FRect* rect)
+{
+    const auto& key = source.GetGpuId();
+    auto it = mImages.find(key);
+    if (it == mImages.end())
+        return nullptr;
+
+    auto& image = it->second;
+    if (check_content && source.GetContentHash() != image.content_hash)
+    {
+        ReleaseImage(key);
+        return nullptr;
+    }
+    auto* texture = UsePage(mPages[image.page], device);
+    image.last_used = mFrameNumber;
+    *rect = GetImageRect(image);
+    return texture;
+}
+
+Texture* TextureAtlas::AddTexture(const TextureSource& source, const IBitmap& bitmap, std::size_t content_hash,
+                                  Device& device, FRect* rect)
+{
+    const auto width  = bitmap.GetWidth();
+    const auto height = bitmap.GetHeight();
+    if (width == 0 || height == 0 || !bitmap.GetDataPtr())
+        return nullptr;
+    if (width > mParams.max_image_size || height > mParams.max_image_size)
+        return nullptr;
+
+    const auto padded_width  = width + 2 * mParams.padding;
+    const auto padded_height = height + 2 * mParams.padding;
+    if (padded_width > mParams.page_size || padded_height > mParams.page_size)
+        return nullptr;
+
+    const auto srgb   = source.GetColorSpace() == TextureSource::ColorSpace::sRGB;
+    const auto format = Texture::DepthToFormat(bitmap.GetDepthBits(), srgb);
+
+    // drop the previous version of the image if any.
+    const auto& key = source.GetGpuId();
+    ReleaseImage(key);
+
+    URect space;
+    const auto page_index = FindSpace(format, padded_width, padded_height, &space);
+    if (page_index == mPages.size())
+        return nullptr;
+
+    auto& page = mPages[page_index];
+    const auto bpp = BytesPerTexel(format);
+    CopyImage(page, space, (const std::uint8_t*)bitmap.GetDataPtr(), width * bpp, width, height);
+    page.live += padded_width * padded_height;
+    page.dirty_rect = base::Union(page.dirty_rect, space);
+
+    Image image;
+    image.page         = page_index;
+    image.rect         = URect(space.GetX() + mParams.padding, space.GetY() + mParams.padding, width, height);
+    image.content_hash = content_hash;
+    image.last_used    = mFrameNumber;
+    mImages[key] = image;
+
+    *rect = GetImageRect(image);
+    return UsePage(page, device);
+}
+
+void TextureAtlas::BeginFrame()
+{
+    ++mFrameNumber;
+}
+
+void TextureAtlas::Clear()
+{
+    mPages.clear();
+    mImages.clear();
+}
+
+TextureAtlas::Stats TextureAtlas::GetStats() const
+{
+    Stats stats;
+    stats.pages     = static_cast<unsigned>(mPages.size());
+    stats.images    = static_cast<unsigned>(mImages.size());
+    stats.uploads   = mUploads;
+    stats.sub_uploads = mSubUploads;
+    stats.repacks   = mRepacks;
+    stats.evictions = mEvictions;
+    return stats;
+}
+
+Texture* TextureAtlas::UsePage(Page& page, Device& device)
+{
+    // the device might have deleted the page texture, for example
+    // when it was not used for a while. in that case restore it
+    // from the CPU side copy.
+    auto* texture = device.FindTexture(page.name);
+    if (texture == nullptr)
+    {
+        texture = device.MakeTexture(page.name);
+        texture->SetName("TextureAtlas/" + page.name);
+        page.dirty = true;
+    }
+    if (page.dirty)
+    {
+        texture->Upload(page.texels.data(), mParams.page_size, mParams.page_size, page.format, false /* mips */);
+        page.dirty = false;
+        page.dirty_rect = URect();
+        ++mUploads;
+    }
+    else if (!page.dirty_rect.IsEmpty())
+    {
+        const auto& rect = page.dirty_rect;
+        const auto bpp   = BytesPerTexel(page.format);
+        const auto pitch = mParams.page_size * bpp;
+        const auto row_bytes = rect.GetWidth() * bpp;
+        mScratch.resize(row_bytes * rect.GetHeight());
+        for (unsigned y=0; y<rect.GetHeight(); ++y)
+        {
+            std::memcpy(&mScratch[y * row_bytes],
+                        &page.texels[(rect.GetY() + y) * pitch + rect.GetX() * bpp], row_bytes);
+        }
+        texture->UploadSubRect(mScratch.data(), rect.GetX(), rect.GetY(), rect.GetWidth(), rect.GetHeight());
+        page.dirty_rect = URect();
+        ++mSubUploads;
+    }
+    page.last_used = mFrameNumber;
+    return texture;
+}
+
+FRect TextureAtlas::GetImageRect(const Image& image) const
+{
+    const float size = mParams.page_size;
+    return FRect(image.rect.GetX() / size,
+                 image.rect.GetY() / size,
+                 image.rect.GetWidth() / size,
+                 image.rect.GetHeight() / size);
+}
+
+std::size_t TextureAtlas::FindSpace(Texture::Format format, unsigned width, unsigned height, URect* rect)
+{
+    const auto area = std::size_t(width) * std::size_t(height);
+
+    // try the existing pages first.
+    for (std::size_t i=0; i<mPages.size(); ++i)
+    {
+        if (mPages[i].format == format && Allocate(mPages[i], width, height, rect))
+            return i;
+    }
+    // try to reclaim the space used by images that have since been
+    // replaced or haven't been used recently.
+    for (std::size_t i=0; i<mPages.size(); ++i)
+    {
+        const auto& page = mPages[i];
+        if (page.format != format || page.allocated - page.live < area)
+            continue;
+        Repack(i);
+        if (Allocate(mPages[i], width, height, rect))
+            return i;
+    }
+    // create a new page.
+    const auto page_count = std::count_if(mPages.begin(), mPages.end(), [format](const auto& page) {
+        return page.format == format;
+    });
+    if (page_count < (std::ptrdiff_t)mParams.max_pages)
+    {
+        Page page;
+        page.name   = base::RandomString(10);
+        page.format = format;
+        page.texels.resize(std::size_t(mParams.page_size) * mParams.page_size * BytesPerTexel(format));
+        page.last_used = mFrameNumber;
+        mPages.push_back(std::move(page));
+        DEBUG("New texture atlas page. [format=%1, size=%2]", format, mParams.page_size);
+        if (Allocate(mPages.back(), width, height, rect))
+            return mPages.size() - 1;
+        return mPages.size();
+    }
+    // evict the least recently used page that isn't used in this frame.
+    std::size_t lru_index = mPages.size();
+    std::size_t lru_frame = std::numeric_limits<std::size_t>::max();
+    for (std::size_t i=0; i<mPages.size(); ++i)
+    {
+        const auto& page = mPages[i];
+        if (page.format != format || page.last_used == mFrameNumber)
+            continue;
+        if (page.last_used < lru_frame)
+        {
+            lru_frame = page.last_used;
+            lru_index = i;
+        }
+    }
+    if (lru_index == mPages.size())
+        return mPages.size();
+
+    ClearPage(lru_index);
+    if (Allocate(mPages[lru_index], width, height, rect))
+        return lru_index;
+    return mPages.size();
+}
+
+bool TextureAtlas::Allocate(Page& page, unsigned width, unsigned height, URect* rect)
+{
+    // simple shelf packing. prefer the shelf with the least amount of
+    // wasted height but don't put short images on tall shelves unless
+    // no new shelf can be opened.
+    const auto size = mParams.page_size;
+    Shelf* best  = nullptr;
+    Shelf* loose = nullptr;
+    for (auto& shelf : page.shelves)
+    {
+        if (shelf.height < height || size - shelf.width < width)
+            continue;
+        if (shelf.height <= height + height / 2)
+        {
+            if (!best || shelf.height < best->height)
+                best = &shelf;
+        }
+        else if (!loose || shelf.height < loose->height)
+            loose = &shelf;
+    }
+    if (!best)
+    {
+        const auto ypos = page.shelves.empty() ? 0u : page.shelves.back().ypos + page.shelves.back().height;
+        if (ypos + height <= size)
+        {
+            Shelf shelf;
+            shelf.ypos   = ypos;
+            shelf.height = height;
+            page.shelves.push_back(shelf);
+            best = &page.shelves.back();
+        }
+        else best = loose;
+    }
+    if (!best)
+        return false;
+
+    *rect = URect(best->width, best->ypos, width, height);
+    best->width += width;
+    page.allocated += std::size_t(width) * std::size_t(height);
+    return true;
+}
+
+void TextureAtlas::Repack(std::size_t page_index)
+{
+    auto& page = mPages[page_index];
+
+    std::vector<std::string> keys;
+    for (const auto& pair : mImages)
+    {
+        const auto& image = pair.second;
+        if (image.page != page_index)
+            continue;
+        keys.push_back(pair.first);
+    }
+    // drop the images that haven't been used recently, they
+    // will be packed again in case they're needed later.
+    keys.erase(std::remove_if(keys.begin(), keys.end(), [this](const std::string& key) {
+        const auto& image = mImages[key];
+        if (mFrameNumber - image.last_used <= mParams.max_idle_frames)
+            return false;
+        mImages.erase(key);
+        return true;
+    }), keys.end());
+
+    // tallest images first for better shelf utilization.
+    std::sort(keys.begin(), keys.end(), [this](const std::string& lhs, const std::string& rhs) {
+        return mImages[lhs].rect.GetHeight() > mImages[rhs].rect.GetHeight();
+    });
+
+    const auto bpp   = BytesPerTexel(page.format);
+    const auto pitch = mParams.page_size * bpp;
+    std::vector<std::uint8_t> texels(page.texels.size());
+    std::swap(texels, page.texels);
+    page.shelves.clear();
+    page.allocated = 0;
+    page.live      = 0;
+    page.dirty     = true;
+
+    const auto padding = mParams.padding;
+    for (const auto& key : keys)
+    {
+        auto& image = mImages[key];
+        const auto width  = image.rect.GetWidth();
+        const auto height = image.rect.GetHeight();
+        URect space;
+        if (!Allocate(page, width + 2 * padding, height + 2 * padding, &space))
+        {
+            mImages.erase(key);
+            continue;
+        }
+        const auto* src = &texels[image.rect.GetY() * pitch + image.rect.GetX() * bpp];
+        CopyImage(page, space, src, pitch, width, height);
+        image.rect = URect(space.GetX() + padding, space.GetY() + padding, width, height);
+        page.live += space.GetWidth() * space.GetHeight();
+    }
+    ++mRepacks;
+    DEBUG("Repacked texture atlas page. [images=%1, used=%2%]", keys.size(),
+          page.allocated * 100 / (std::size_t(mParams.page_size) * mParams.page_size));
+}
+
+void TextureAtlas::ClearPage(std::size_t page_index)
+{
+    for (auto it = mImages.begin(); it != mImages.end();)
+    {
+        if (it->second.page == page_index)
+            it = mImages.erase(it);
+        else ++it;
+    }
+    auto& page = mPages[page_index];
+    page.shelves.clear();
+    page.allocated = 0;
+    page.live      = 0;
+    ++mEvictions;
+    DEBUG("Evicted texture atlas page. [format=%1]", page.format);
+}
+
+void TextureAtlas::ReleaseImage(const std::string& key)
+{
+    auto it = mImages.find(key);
+    if (it == mImages.end())
+        return;
+    const auto& image = it->second;
+    const auto width  = image.rect.GetWidth() + 2 * mParams.padding;
+    const auto height = image.rect.GetHeight() + 2 * mParams.padding;
+    mPages[image.page].live -= std::size_t(width) * std::size_t(height);
+    mImages.erase(it);
+}
+
+void TextureAtlas::CopyImage(Page& page, const URect& rect, const std::uint8_t* src,
+                             unsigned src_pitch, unsigned src_width, unsigned src_height)
+{
+    // copy the image into the page and extend the edge texels
+    // into the padding around the image.
+    const auto bpp     = BytesPerTexel(page.format);
+    const auto pitch   = mParams.page_size * bpp;
+    const auto padding = (int)mParams.padding;
+    for (unsigned y=0; y<rect.GetHeight(); ++y)
+    {
+        const auto src_y = math::clamp(0, (int)src_height-1, (int)y - padding);
+        const auto* src_row = src + src_y * src_pitch;
+        auto* dst_row = &page.texels[(rect.GetY() + y) * pitch + rect.GetX() * bpp];
+        for (unsigned x=0; x<rect.GetWidth(); ++x)
+        {
+            const auto src_x = math::clamp(0, (int)src_width-1, (int)x - padding);
+            std::memcpy(dst_row + x * bpp, src_row + src_x * bpp, bpp);
+        }
+    }
+}
+
+} // namespace
@@ -0,0 +1,171 @@
+// Copyright (C) 2020-2021 Sami Väisänen
+// Copyright (C) 2020-2021 Ensisoft http://www.ensisoft.com
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+#pragma once
+
+#include "config.h"
+
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include <cstdint>
+#include <cstddef>
+
+#include "graphics/types.h"
+#include "graphics/texture.h"
+
+namespace gfx
+{
+    class Device;
+    class IBitmap;
+    class TextureSource;
+
+    // Runtime texture atlas for packing small textures into shared
+    // texture objects (pages) as they're being uploaded to the device.
+    // When multiple materials refer to different small images that live
+    // on the same atlas page the device doesn't need to rebind textures
+    // between draws. The texture maps adjust their texture rects so that
+    // they map to the sub-rectangle of the page where the image is.
+    //
+    // Each page keeps a CPU side copy of its contents so that the page
+    // can be restored if the device deletes the texture and so that the
+    // page can be compacted (repacked) when the space used by stale images
+    // needs to be reclaimed. When images are added only the changed area
+    // of the page is uploaded. The pages have no mips since the padding
+    // around the images would not keep the neighbouring images from
+    // bleeding in at the lower mip levels. Materials that need to wrap,
+    // scale or scroll their textures don't use the atlas at all. When no page has
+    // space for a new image the atlas first tries to repack a page, then
+    // to create a new page and finally evicts the least recently used page.
+    // If all that fails the caller is expected to fall back on using a
+    // separate texture object for the image.
+    class TextureAtlas
+    {
+    public:
+        struct Params {
+            // The width and height of each atlas page in texels.
+            // Should be a power of two so that mips can be used
+            // on all platforms.
+            unsigned page_size = 512;
+            // The maximum width/height of an image that can be packed
+            // into the atlas. Larger images always use their own textures.
+            unsigned max_image_size = 64;
+            // The maximum number of pages (per texture format).
+            unsigned max_pages = 8;
+            // The number of texels around each image filled with the
+            // image's edge texels to avoid filtering from the neighbours.
+            unsigned padding = 2;
+            // Images that haven't been used in this many frames are
+            // dropped when a page is repacked.
+            unsigned max_idle_frames = 120;
+        };
+        struct Stats {
+            // The current number of pages.
+            unsigned pages = 0;
+            // The current number of images packed in all pages.
+            unsigned images = 0;
+            // Number of full page uploads to the device.
+            unsigned uploads = 0;
+            // Number of partial page uploads (only the changed area).
+            unsigned sub_uploads = 0;
+            // Number of times a page was compacted.
+            unsigned repacks = 0;
+            // Number of times a page was cleared in order to make space.
+            unsigned evictions = 0;
+        };
+
+        TextureAtlas() = default;
+        explicit TextureAtlas(const Params& params)
+          : mParams(params)
+        {}
+        // Find the atlas page for a texture source that has previously been
+        // packed in the atlas. If check_content is true the content hash of
+        // the source is compared against the packed image and if it has
+        // changed the image is removed from the atlas. Returns the page texture
+        // and the normalized texture rectangle of the image within the page
+        // or nullptr if the source is not in the atlas.
+        Texture* FindTexture(const TextureSource& source, bool check_content, Device& device, FRect* rect);
+        // Try to pack the bitmap content of the texture source into the atlas.
+        // Returns the page texture and the normalized texture rectangle of the
+        // image within the page or nullptr if the image can't be packed, for
+        // example because it's too large. In that case the caller should use
+        // a texture object of its own for the image.
+        Texture* AddTexture(const TextureSource& source, const IBitmap& bitmap, std::size_t content_hash,
+                            Device& device, FRect* rect);
+        // Begin a new frame. The frame number is used to track when
+        // pages and images were last used.
+        void BeginFrame();
+        // Drop all pages and images. This should be called when the device
+        // textures are deleted.
+        void Clear();
+        // Get the current atlas statistics.
+        Stats GetStats() const;
+        // Get the atlas parameters.
+        const Params& GetParams() const
+        { return mParams; }
+    private:
+        struct Shelf {
+            unsigned ypos   = 0;
+            unsigned height = 0;
+            unsigned width  = 0;
+        };
+        struct Page {
+            // The name (gpu id) of the page texture object.
+            std::string name;
+            Texture::Format format = Texture::Format::RGBA;
+            // CPU side copy of the page texels.
+            std::vector<std::uint8_t> texels;
+            std::vector<Shelf> shelves;
+            // The area (in texels) allocated for images.
+            std::size_t allocated = 0;
+            // The area (in texels) of images that are still live.
+            std::size_t live = 0;
+            std::size_t last_used = 0;
+            // The area changed since the last upload.
+            URect dirty_rect;
+            // Whether the whole page needs to be uploaded.
+            bool dirty = false;
+        };
+        struct Image {
+            std::size_t page = 0;
+            // The image position within the page excluding padding.
+            URect rect;
+            std::size_t content_hash = 0;
+            std::size_t last_used = 0;
+        };
+        Texture* UsePage(Page& page, Device& device);
+        FRect GetImageRect(const Image& image) const;
+        std::size_t FindSpace(Texture::Format format, unsigned width, unsigned height, URect* rect);
+        bool Allocate(Page& page, unsigned width, unsigned height, URect* rect);
+        void Repack(std::size_t page_index);
+        void ClearPage(std::size_t page_index);
+        void ReleaseImage(const std::string& key);
+        void CopyImage(Page& page, const URect& rect, const std::uint8_t* src,
+                       unsigned src_pitch, unsigned src_width, unsigned src_height);
+    private:
+        Params mParams;
+        std::vector<Page> mPages;
+        std::unordered_map<std::string, Image> mImages;
+        std::size_t mFrameNumber = 0;
+        unsigned mUploads   = 0;
+        unsigned mSubUploads = 0;
+        // scratch buffer for partial page uploads.
+        std::vector<std::uint8_t> mScratch;
+        unsigned mRepacks   = 0;
+        unsigned mEvictions = 0;
+    };
+
+} // namespace
@@ -0,0 +1,210 @@
+// Copyright (C) 2020-2021 Sami Väisänen
+// Copyright (C) 2020-2021 Ensisoft http://www.ensisoft.com
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+#include "config.h"
+
+#include <cstring>
+#include <memory>
+
+#include "base/logging.h"
+#include "graphics/baked_texture.h"
+#include "graphics/bitmap.h"
+
+namespace {
+constexpr char Magic[4] = {'G', 'S', 'T', 'X'};
+
+std::size_t AlignOffset(std::size_t offset)
+{ return (offset + 15) & ~std::size_t(15); }
+
+unsigned GetBytesPerPixel(gfx::Texture::Format format)
+{
+    using Format = gfx::Texture::Format;
+    if (format == Format::Grayscale)
+        return 1;
+    else if (format == Format::RGB || format == Format::sRGB)
+        return 3;
+    else if (format == Format::RGBA || format == Format::sRGBA)
+        return 4;
+    return 0;
+}
+
+} // namespace
+
+namespace gfx
+{
+
+BakedTexture::BakedTexture(ResourceHandle resource)
+{
+    if (!resource)
+        return;
+    if (!Parse(resource->GetData(), resource->GetSize()))
+    {
+        ERROR("Invalid baked texture data. [file='%1']", resource->GetName());
+        mLevels.clear();
+        return;
+    }
+    mResource = resource;
+}
+
+void BakedTexture::Upload(Texture& texture) const
+{
+    ASSERT(IsValid());
+
+    const auto& base = mLevels[0];
+    texture.Upload(base.data, base.width, base.height, mFormat, false /* mips */);
+
+    // the rest of the mip chain is already precomputed.
+    for (unsigned i=1; i<mLevels.size(); ++i)
+    {
+        const auto& level = mLevels[i];
+        texture.UploadMip(i, level.data, level.width, level.height, mFormat);
+    }
+}
+
+// static
+bool BakedTexture::IsBakedTexture(const void* data, std::size_t bytes)
+{
+    if (!data || bytes < sizeof(FileHeader))
+        return false;
+    return std::memcmp(data, Magic, sizeof(Magic)) == 0;
+}
+
+bool BakedTexture::Parse(const void* data, std::size_t bytes)
+{
+    if (!IsBakedTexture(data, bytes))
+        return false;
+
+    FileHeader header;
+    std::memcpy(&header, data, sizeof(header));
+    if (header.version != Version)
+    {
+        ERROR("Unsupported baked texture version. [version=%1]", header.version);
+        return false;
+    }
+    if (header.compression != static_cast<std::uint32_t>(Compression::None))
+    {
+        ERROR("Unsupported baked texture compression. [compression=%1]", header.compression);
+        return false;
+    }
+    if (header.format > static_cast<std::uint32_t>(Texture::Format::Grayscale))
+        return false;
+
+    const auto format = static_cast<Texture::Format>(header.format);
+    const auto pixel_size = GetBytesPerPixel(format);
+    const auto table_size = sizeof(FileHeader) + sizeof(LevelHeader) * std::size_t(header.levels);
+    if (header.levels == 0 || table_size > bytes)
+        return false;
+
+    const auto* base = static_cast<const std::uint8_t*>(data);
+
+    for (std::uint32_t i=0; i<header.levels; ++i)
+    {
+        LevelHeader level;
+        std::memcpy(&level, base + sizeof(FileHeader) + sizeof(LevelHeader) * i, sizeof(level));
+        if (std::size_t(level.offset) + std::size_t(level.size) > bytes)
+            return false;
+        if (std::size_t(level.width) * std::size_t(level.height) * pixel_size != level.size)
+            return false;
+
+        Level lvl;
+        lvl.width  = level.width;
+        lvl.height = level.height;
+        lvl.data   = base + level.offset;
+        lvl.bytes  = level.size;
+        mLevels.push_back(lvl);
+    }
+    mFormat = format;
+    mFlags  = header.flags;
+    return true;
+}
+
+bool BakeTexture(const IBitmap& bitmap, bool srgb, bool premul_alpha, std::vector<char>* out)
+{
+    const auto depth = bitmap.GetDepthBits();
+    if (!(depth == 8 || depth == 24 || depth == 32) || !bitmap.IsValid())
+        return false;
+
+    std::uint32_t flags = 0;
+
+    // levels of the mipmap chain. the first level is the source image
+    // itself unless it needs premultiplication in which case it's the
+    // premultiplied copy.
+    std::vector<std::unique_ptr<IBitmap>> mips;
+    const IBitmap* level = &bitmap;
+
+    if (depth == 32 && premul_alpha)
+    {
+        const BitmapReadView<RGBA> view((const RGBA*)bitmap.GetDataPtr(), bitmap.GetWidth(), bitmap.GetHeight());
+        // this matches what TextureFileSource does on the fly.
+        mips.push_back(std::make_unique<Bitmap<RGBA>>(PremultiplyAlpha(view, true /*srgb*/)));
+        level = mips.back().get();
+        flags |= BakedTexture::Flags::PremulAlpha;
+    }
+
+    std::vector<const IBitmap*> levels;
+    levels.push_back(level);
+    while (auto next = GenerateNextMipmap(*level, srgb))
+    {
+        mips.push_back(std::move(next));
+        level = mips.back().get();
+        levels.push_back(level);
+    }
+
+    BakedTexture::FileHeader header;
+    std::memcpy(header.magic, Magic, sizeof(Magic));
+    header.version     = BakedTexture::Version;
+    header.format      = static_cast<std::uint32_t>(Texture::DepthToFormat(depth, srgb));
+    header.compression = static_cast<std::uint32_t>(BakedTexture::Compression::None);
+    header.flags       = flags;
+    header.width       = bitmap.GetWidth();
+    header.height      = bitmap.GetHeight();
+    header.levels      = static_cast<std::uint32_t>(levels.size());
+
+    std::vector<BakedTexture::LevelHeader> table;
+    std::size_t offset = AlignOffset(sizeof(header) + sizeof(BakedTexture::LevelHeader) * levels.size());
+    for (const auto* lvl : levels)
+    {
+        BakedTexture::LevelHeader entry;
+        entry.width  = lvl->GetWidth();
+        entry.height = lvl->GetHeight();
+        entry.offset = static_cast<std::uint32_t>(offset);
+        entry.size   = lvl->GetWidth() * lvl->GetHeight() * (depth / 8);
+        table.push_back(entry);
+        offset = AlignOffset(offset + entry.size);
+    }
+
+    out->clear();
+    out->resize(offset, 0);
+    std::memcpy(&(*out)[0], &header, sizeof(header));
+    std::memcpy(&(*out)[sizeof(header)], &table[0], sizeof(BakedTexture::LevelHeader) * table.size());
+    for (size_t i=0; i<levels.size(); ++i)
+    {
+        std::memcpy(&(*out)[table[i].offset], levels[i]->GetDataPtr(), table[i].size);
+    }
+    return true;
+}
+
+std::string GetBakedTextureName(const std::string& file, bool srgb, bool premul_alpha)
+{
+    std::string ret = file;
+    ret += srgb ? ".srgb" : ".lin";
+    if (premul_alpha)
+        ret += "_pma";
+    ret += ".gtx";
+    return ret;
+}
+
+} // namespace
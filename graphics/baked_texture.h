@@ -0,0 +1,140 @@
+// Copyright (C) 2020-2021 Sami Väisänen
+// Copyright (C) 2020-2021 Ensisoft http://www.ensisoft.com
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+#pragma once
+
+#include "config.h"
+
+#include <string>
+#include <vector>
+#include <cstdint>
+
+#include "graphics/texture.h"
+#include "graphics/loader.h"
+
+namespace gfx
+{
+    class IBitmap;
+
+    // Baked texture is a texture that has been pre-processed (usually
+    // at content packaging time) into a GPU ready form. The container
+    // file has a fixed size header followed by a table of mip levels
+    // and then the pixel data for each level. The pixel data has already
+    // been decoded, optionally alpha premultiplied and the complete mip
+    // chain has been generated so that at runtime the data can be uploaded
+    // to the device without any decoding or processing.
+    //
+    // Layout:
+    //   FileHeader
+    //   LevelHeader[FileHeader.levels]
+    //   level data, each level starting at a 16 byte aligned offset.
+    //
+    // All values are in little endian byte order.
+    class BakedTexture
+    {
+    public:
+        // Pixel data compression. The level data may be stored compressed
+        // in which case each level needs to be decompressed before upload.
+        // Currently, only uncompressed data is supported.
+        enum class Compression : std::uint32_t {
+            None = 0
+        };
+        enum Flags : std::uint32_t {
+            // The RGBA pixel data has been premultiplied with alpha.
+            PremulAlpha = 0x1
+        };
+        struct FileHeader {
+            char magic[4];
+            std::uint32_t version;
+            std::uint32_t format;
+            std::uint32_t compression;
+            std::uint32_t flags;
+            std::uint32_t width;
+            std::uint32_t height;
+            std::uint32_t levels;
+        };
+        struct LevelHeader {
+            std::uint32_t width;
+            std::uint32_t height;
+            std::uint32_t offset;
+            std::uint32_t size;
+        };
+        // Level of the mipmap chain.
+        struct Level {
+            unsigned width  = 0;
+            unsigned height = 0;
+            const void* data = nullptr;
+            std::size_t bytes = 0;
+        };
+        static constexpr std::uint32_t Version = 1;
+
+        // Construct an invalid baked texture.
+        BakedTexture() = default;
+        // Construct a new baked texture from the given resource data.
+        // The resource is kept alive as long as this object exists and
+        // the level data points directly to the resource data. (no copy)
+        // If the data is not a valid baked texture IsValid will be false.
+        BakedTexture(ResourceHandle resource);
+
+        // Returns true if the object was created from valid data.
+        bool IsValid() const
+        { return !mLevels.empty(); }
+        // Get the texture format of the pixel data.
+        Texture::Format GetFormat() const
+        { return mFormat; }
+        // Get the width of the base (level 0) image.
+        unsigned GetWidth() const
+        { return mLevels.empty() ? 0 : mLevels[0].width; }
+        // Get the height of the base (level 0) image.
+        unsigned GetHeight() const
+        { return mLevels.empty() ? 0 : mLevels[0].height; }
+        // Get the number of mip levels including the base level.
+        unsigned GetNumLevels() const
+        { return static_cast<unsigned>(mLevels.size()); }
+        // Get the mip level data at the given index.
+        const Level& GetLevel(unsigned index) const
+        { return mLevels[index]; }
+        // Returns true if the data has been alpha premultiplied.
+        bool IsPremultiplied() const
+        { return mFlags & Flags::PremulAlpha; }
+
+        // Upload the baked data to the given texture object.
+        void Upload(Texture& texture) const;
+
+        // Check whether the given data looks like baked texture data.
+        static bool IsBakedTexture(const void* data, std::size_t bytes);
+    private:
+        bool Parse(const void* data, std::size_t bytes);
+    private:
+        ResourceHandle mResource;
+        std::vector<Level> mLevels;
+        Texture::Format mFormat = Texture::Format::Grayscale;
+        std::uint32_t mFlags = 0;
+    };
+
+    // Bake the given bitmap into a baked texture container. The bitmap's
+    // bit depth must be 8, 24 or 32 bits. If srgb is true the RGB(A) data
+    // is considered to be sRGB encoded and the mips are computed in linear
+    // space accordingly. If premul_alpha is true the RGBA data is alpha
+    // premultiplied before the mips are computed.
+    // Returns false if the data could not be baked.
+    bool BakeTexture(const IBitmap& bitmap, bool srgb, bool premul_alpha, std::vector<char>* out);
+
+    // Map the name of a texture image file (e.g. a .png) to the name of
+    // the baked texture file with the given processing options.
+    std::string GetBakedTextureName(const std::string& file, bool srgb, bool premul_alpha);
+
+} // namespace
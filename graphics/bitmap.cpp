@@ -16,22 +16,54 @@
 
 #include "config.h"
 
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#  include <emmintrin.h>
+#  define GFX_BITMAP_SIMD_SSE2
+// AVX2 kernels are compiled separately for the AVX2 target and
+// selected at runtime when the CPU supports AVX2.
+#  if defined(_MSC_VER) && !defined(__clang__)
+#    include <immintrin.h>
+#    include <intrin.h>
+#    define GFX_BITMAP_SIMD_AVX2
+#    define GFX_TARGET_AVX2
+#  elif (defined(__GNUC__) || defined(__clang__)) && !defined(__EMSCRIPTEN__)
+#    include <immintrin.h>
+#    define GFX_BITMAP_SIMD_AVX2
+#    define GFX_TARGET_AVX2 __attribute__((target("avx2")))
+#  endif
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+#  include <arm_neon.h>
+#  define GFX_BITMAP_SIMD_NEON
+#endif
+
 #include "warnpush.h"
 #  include <boost/math/special_functions/prime.hpp>
 #  include <stb/stb_image_write.h>
 #include "warnpop.h"
 
 #include <algorithm>
+#include <atomic>
+#include <filesystem>
 #include <fstream>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include <cstdint>
+#include <cstdio>
 #include <cmath>
 
 #include "base/hash.h"
 #include "base/math.h"
+#include "base/logging.h"
+#include "base/utility.h"
 #include "data/writer.h"
 #include "data/reader.h"
 #include "graphics/bitmap.h"
 
 namespace {
+using u8  = std::uint8_t;
+using u16 = std::uint16_t;
+
 void PremultiplyPixel_lRGB(const gfx::RGBA& src, gfx::RGBA* dst)
 {
     gfx::fRGBA norm;
@@ -49,37 +81,597 @@ void PremultiplyPixel_sRGB(const gfx::RGBA& src, gfx::RGBA* dst)
     *dst = gfx::Pixel_to_uints(norm);
 }
 
-template<typename T_u8, typename T_float>
-std::unique_ptr<gfx::Bitmap<T_u8>> ConvertToLinear(const gfx::IBitmapReadView& src)
+// Lookup tables for converting between sRGB and linear values.
+// The linear values used for filtering are stored with 14 bits of
+// precision so that a sum of 4 values still fits in 16 bits. This is
+// enough to keep the sRGB -> linear -> sRGB round trip exact and the
+// result within +-1 of the floating point conversion.
+constexpr unsigned LinearBits = 14;
+constexpr unsigned LinearMax  = (1u << LinearBits) - 1;
+
+struct sRGB_LUT {
+    // sRGB to linear with 8 bits. Matches the floating point
+    // conversion with truncation exactly.
+    u8 to_linear8[256];
+    // sRGB to linear with 14 bits.
+    u16 to_linear14[256];
+    // linear with 14 bits to sRGB.
+    u8 from_linear14[LinearMax + 1];
+
+    sRGB_LUT()
+    {
+        for (unsigned i=0; i<256; ++i)
+        {
+            const auto linear = gfx::sRGB_decode(i / 255.0f);
+            to_linear8[i]  = (u8)(linear * 255);
+            to_linear14[i] = (u16)(linear * LinearMax + 0.5f);
+        }
+        for (unsigned i=0; i<=LinearMax; ++i)
+        {
+            const auto srgb = gfx::sRGB_encode(i / (float)LinearMax);
+            from_linear14[i] = (u8)math::clamp(0.0f, 255.0f, srgb * 255.0f + 0.5f);
+        }
+    }
+};
+const sRGB_LUT& GetSRGB_LUT()
+{
+    static const sRGB_LUT lut;
+    return lut;
+}
+
+// 2x2 box filter kernels. Each kernel computes a range of pixels in one
+// destination row from the two source rows. The average of each channel
+// is computed with integers and rounded, (a + b + c + d + 2) / 4, so that
+// the SIMD and scalar kernels produce identical results.
+// The SIMD kernels return the number of destination pixels processed and
+// the rest is then processed with the scalar kernel.
+using BoxFilterRow8  = unsigned (*)(const u8* row0, const u8* row1, u8* dst, unsigned count);
+using BoxFilterRow16 = unsigned (*)(const u16* row0, const u16* row1, u16* dst, unsigned count);
+
+// Scalar box filter for any number of channels. The horizontal neighbour
+// is found "next" values after the current pixel which lets the single
+// column bitmaps sample the same column twice.
+template<unsigned Channels, typename T>
+void BoxFilterRow(const T* row0, const T* row1, T* dst, unsigned begin, unsigned end, unsigned next)
+{
+    for (unsigned i=begin; i<end; ++i)
+    {
+        const auto* src0 = row0 + i * Channels * 2;
+        const auto* src1 = row1 + i * Channels * 2;
+        for (unsigned c=0; c<Channels; ++c)
+        {
+            const unsigned sum = src0[c] + src0[c + next] + src1[c] + src1[c + next];
+            dst[i * Channels + c] = (T)((sum + 2) >> 2);
+        }
+    }
+}
+
+#if defined(GFX_BITMAP_SIMD_SSE2)
+unsigned BoxFilterRow_A8_SSE2(const u8* row0, const u8* row1, u8* dst, unsigned count)
+{
+    const __m128i mask = _mm_set1_epi16(0xff);
+    const __m128i two  = _mm_set1_epi16(2);
+    unsigned i = 0;
+    for (; i + 8 <= count; i += 8)
+    {
+        const __m128i r0 = _mm_loadu_si128((const __m128i*)(row0 + i * 2));
+        const __m128i r1 = _mm_loadu_si128((const __m128i*)(row1 + i * 2));
+        // split into even and odd columns in 16 bits.
+        __m128i sum = _mm_add_epi16(_mm_and_si128(r0, mask), _mm_srli_epi16(r0, 8));
+        sum = _mm_add_epi16(sum, _mm_and_si128(r1, mask));
+        sum = _mm_add_epi16(sum, _mm_srli_epi16(r1, 8));
+        sum = _mm_srli_epi16(_mm_add_epi16(sum, two), 2);
+        _mm_storel_epi64((__m128i*)(dst + i), _mm_packus_epi16(sum, sum));
+    }
+    return i;
+}
+unsigned BoxFilterRow_RGB_SSE2(const u8* row0, const u8* row1, u8* dst, unsigned count)
+{
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i two  = _mm_set1_epi16(2);
+    const __m128i mask = _mm_set_epi16(0, 0, 0, 0, 0, -1, -1, -1);
+    // sum of the pixel pair whose channels start at lane 0
+    // of a vector of 16 bit vertical sums.
+    auto pair = [mask](__m128i v) {
+        return _mm_and_si128(_mm_add_epi16(v, _mm_srli_si128(v, 6)), mask);
+    };
+    unsigned i = 0;
+    // each round consumes 8 source pixels (24 bytes) and writes 4
+    // destination pixels (12 bytes) but the stores write 14 bytes
+    // so there must be room for one more pixel after.
+    for (; i + 5 <= count; i += 4)
+    {
+        const u8* src0 = row0 + i * 6;
+        const u8* src1 = row1 + i * 6;
+        const __m128i a0 = _mm_loadu_si128((const __m128i*)(src0 + 0));
+        const __m128i a1 = _mm_loadu_si128((const __m128i*)(src1 + 0));
+        const __m128i b0 = _mm_loadu_si128((const __m128i*)(src0 + 8));
+        const __m128i b1 = _mm_loadu_si128((const __m128i*)(src1 + 8));
+        // vertical sums s0 ... s23 of the channel values.
+        const __m128i s0  = _mm_add_epi16(_mm_unpacklo_epi8(a0, zero), _mm_unpacklo_epi8(a1, zero));
+        const __m128i s8  = _mm_add_epi16(_mm_unpackhi_epi8(a0, zero), _mm_unpackhi_epi8(a1, zero));
+        const __m128i s16 = _mm_add_epi16(_mm_unpackhi_epi8(b0, zero), _mm_unpackhi_epi8(b1, zero));
+        const __m128i s6  = _mm_or_si128(_mm_srli_si128(s0, 12), _mm_slli_si128(s8, 4));
+        const __m128i s12 = _mm_or_si128(_mm_srli_si128(s8, 8), _mm_slli_si128(s16, 8));
+        const __m128i s18 = _mm_srli_si128(s16, 4);
+        __m128i lo = _mm_or_si128(pair(s0), _mm_slli_si128(pair(s6), 6));
+        __m128i hi = _mm_or_si128(pair(s12), _mm_slli_si128(pair(s18), 6));
+        lo = _mm_srli_epi16(_mm_add_epi16(lo, two), 2);
+        hi = _mm_srli_epi16(_mm_add_epi16(hi, two), 2);
+        const __m128i ret = _mm_packus_epi16(lo, hi);
+        _mm_storel_epi64((__m128i*)(dst + i * 3 + 0), ret);
+        _mm_storel_epi64((__m128i*)(dst + i * 3 + 6), _mm_srli_si128(ret, 8));
+    }
+    return i;
+}
+unsigned BoxFilterRow_RGBA_SSE2(const u8* row0, const u8* row1, u8* dst, unsigned count)
+{
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i two  = _mm_set1_epi16(2);
+    unsigned i = 0;
+    for (; i + 2 <= count; i += 2)
+    {
+        const __m128i r0 = _mm_loadu_si128((const __m128i*)(row0 + i * 8));
+        const __m128i r1 = _mm_loadu_si128((const __m128i*)(row1 + i * 8));
+        // vertical sums of the pixels 0, 1 and 2, 3
+        const __m128i lo = _mm_add_epi16(_mm_unpacklo_epi8(r0, zero), _mm_unpacklo_epi8(r1, zero));
+        const __m128i hi = _mm_add_epi16(_mm_unpackhi_epi8(r0, zero), _mm_unpackhi_epi8(r1, zero));
+        // horizontal sums of pixels 0 + 1 and 2 + 3
+        __m128i sum = _mm_add_epi16(_mm_unpacklo_epi64(lo, hi), _mm_unpackhi_epi64(lo, hi));
+        sum = _mm_srli_epi16(_mm_add_epi16(sum, two), 2);
+        _mm_storel_epi64((__m128i*)(dst + i * 4), _mm_packus_epi16(sum, sum));
+    }
+    return i;
+}
+unsigned BoxFilterRow_RGBA16_SSE2(const u16* row0, const u16* row1, u16* dst, unsigned count)
+{
+    const __m128i two = _mm_set1_epi16(2);
+    unsigned i = 0;
+    for (; i + 2 <= count; i += 2)
+    {
+        // the values are at most 14 bits so the sum of 4 fits in 16 bits.
+        const __m128i a = _mm_add_epi16(_mm_loadu_si128((const __m128i*)(row0 + i * 8 + 0)),
+                                        _mm_loadu_si128((const __m128i*)(row1 + i * 8 + 0)));
+        const __m128i b = _mm_add_epi16(_mm_loadu_si128((const __m128i*)(row0 + i * 8 + 8)),
+                                        _mm_loadu_si128((const __m128i*)(row1 + i * 8 + 8)));
+        __m128i sum = _mm_add_epi16(_mm_unpacklo_epi64(a, b), _mm_unpackhi_epi64(a, b));
+        sum = _mm_srli_epi16(_mm_add_epi16(sum, two), 2);
+        _mm_storeu_si128((__m128i*)(dst + i * 4), sum);
+    }
+    return i;
+}
+#endif
+
+#if defined(GFX_BITMAP_SIMD_AVX2)
+GFX_TARGET_AVX2
+unsigned BoxFilterRow_A8_AVX2(const u8* row0, const u8* row1, u8* dst, unsigned count)
+{
+    const __m256i mask = _mm256_set1_epi16(0xff);
+    const __m256i two  = _mm256_set1_epi16(2);
+    unsigned i = 0;
+    for (; i + 16 <= count; i += 16)
+    {
+        const __m256i r0 = _mm256_loadu_si256((const __m256i*)(row0 + i * 2));
+        const __m256i r1 = _mm256_loadu_si256((const __m256i*)(row1 + i * 2));
+        __m256i sum = _mm256_add_epi16(_mm256_and_si256(r0, mask), _mm256_srli_epi16(r0, 8));
+        sum = _mm256_add_epi16(sum, _mm256_and_si256(r1, mask));
+        sum = _mm256_add_epi16(sum, _mm256_srli_epi16(r1, 8));
+        sum = _mm256_srli_epi16(_mm256_add_epi16(sum, two), 2);
+        // pack works within the 128 bit lanes so gather the low
+        // halves of both lanes together.
+        const __m256i ret = _mm256_permute4x64_epi64(_mm256_packus_epi16(sum, sum), 0x08);
+        _mm_storeu_si128((__m128i*)(dst + i), _mm256_castsi256_si128(ret));
+    }
+    return i + BoxFilterRow_A8_SSE2(row0 + i * 2, row1 + i * 2, dst + i, count - i);
+}
+GFX_TARGET_AVX2
+unsigned BoxFilterRow_RGBA_AVX2(const u8* row0, const u8* row1, u8* dst, unsigned count)
+{
+    const __m256i zero = _mm256_setzero_si256();
+    const __m256i two  = _mm256_set1_epi16(2);
+    unsigned i = 0;
+    for (; i + 4 <= count; i += 4)
+    {
+        const __m256i r0 = _mm256_loadu_si256((const __m256i*)(row0 + i * 8));
+        const __m256i r1 = _mm256_loadu_si256((const __m256i*)(row1 + i * 8));
+        const __m256i lo = _mm256_add_epi16(_mm256_unpacklo_epi8(r0, zero), _mm256_unpacklo_epi8(r1, zero));
+        const __m256i hi = _mm256_add_epi16(_mm256_unpackhi_epi8(r0, zero), _mm256_unpackhi_epi8(r1, zero));
+        __m256i sum = _mm256_add_epi16(_mm256_unpacklo_epi64(lo, hi), _mm256_unpackhi_epi64(lo, hi));
+        sum = _mm256_srli_epi16(_mm256_add_epi16(sum, two), 2);
+        const __m256i ret = _mm256_permute4x64_epi64(_mm256_packus_epi16(sum, sum), 0x08);
+        _mm_storeu_si128((__m128i*)(dst + i * 4), _mm256_castsi256_si128(ret));
+    }
+    return i + BoxFilterRow_RGBA_SSE2(row0 + i * 8, row1 + i * 8, dst + i * 4, count - i);
+}
+GFX_TARGET_AVX2
+unsigned BoxFilterRow_RGBA16_AVX2(const u16* row0, const u16* row1, u16* dst, unsigned count)
+{
+    const __m256i two = _mm256_set1_epi16(2);
+    unsigned i = 0;
+    for (; i + 4 <= count; i += 4)
+    {
+        const __m256i a = _mm256_add_epi16(_mm256_loadu_si256((const __m256i*)(row0 + i * 8 + 0)),
+                                           _mm256_loadu_si256((const __m256i*)(row1 + i * 8 + 0)));
+        const __m256i b = _mm256_add_epi16(_mm256_loadu_si256((const __m256i*)(row0 + i * 8 + 16)),
+                                           _mm256_loadu_si256((const __m256i*)(row1 + i * 8 + 16)));
+        __m256i sum = _mm256_add_epi16(_mm256_unpacklo_epi64(a, b), _mm256_unpackhi_epi64(a, b));
+        sum = _mm256_srli_epi16(_mm256_add_epi16(sum, two), 2);
+        // unpack works within the 128 bit lanes which leaves the
+        // pixels in 0, 2, 1, 3 order.
+        _mm256_storeu_si256((__m256i*)(dst + i * 4), _mm256_permute4x64_epi64(sum, 0xd8));
+    }
+    return i + BoxFilterRow_RGBA16_SSE2(row0 + i * 8, row1 + i * 8, dst + i * 4, count - i);
+}
+#endif
+
+#if defined(GFX_BITMAP_SIMD_NEON)
+unsigned BoxFilterRow_A8_NEON(const u8* row0, const u8* row1, u8* dst, unsigned count)
+{
+    unsigned i = 0;
+    for (; i + 8 <= count; i += 8)
+    {
+        // pairwise add the adjacent columns into 16 bits.
+        const uint16x8_t sum = vaddq_u16(vpaddlq_u8(vld1q_u8(row0 + i * 2)),
+                                         vpaddlq_u8(vld1q_u8(row1 + i * 2)));
+        vst1_u8(dst + i, vrshrn_n_u16(sum, 2));
+    }
+    return i;
+}
+unsigned BoxFilterRow_RGB_NEON(const u8* row0, const u8* row1, u8* dst, unsigned count)
+{
+    unsigned i = 0;
+    for (; i + 8 <= count; i += 8)
+    {
+        const uint8x16x3_t r0 = vld3q_u8(row0 + i * 6);
+        const uint8x16x3_t r1 = vld3q_u8(row1 + i * 6);
+        uint8x8x3_t ret;
+        for (int c=0; c<3; ++c)
+            ret.val[c] = vrshrn_n_u16(vaddq_u16(vpaddlq_u8(r0.val[c]), vpaddlq_u8(r1.val[c])), 2);
+        vst3_u8(dst + i * 3, ret);
+    }
+    return i;
+}
+unsigned BoxFilterRow_RGBA_NEON(const u8* row0, const u8* row1, u8* dst, unsigned count)
+{
+    unsigned i = 0;
+    for (; i + 8 <= count; i += 8)
+    {
+        const uint8x16x4_t r0 = vld4q_u8(row0 + i * 8);
+        const uint8x16x4_t r1 = vld4q_u8(row1 + i * 8);
+        uint8x8x4_t ret;
+        for (int c=0; c<4; ++c)
+            ret.val[c] = vrshrn_n_u16(vaddq_u16(vpaddlq_u8(r0.val[c]), vpaddlq_u8(r1.val[c])), 2);
+        vst4_u8(dst + i * 4, ret);
+    }
+    return i;
+}
+unsigned BoxFilterRow_RGBA16_NEON(const u16* row0, const u16* row1, u16* dst, unsigned count)
+{
+    unsigned i = 0;
+    for (; i + 4 <= count; i += 4)
+    {
+        const uint16x8x4_t r0 = vld4q_u16(row0 + i * 8);
+        const uint16x8x4_t r1 = vld4q_u16(row1 + i * 8);
+        uint16x4x4_t ret;
+        for (int c=0; c<4; ++c)
+            ret.val[c] = vrshrn_n_u32(vaddq_u32(vpaddlq_u16(r0.val[c]), vpaddlq_u16(r1.val[c])), 2);
+        vst4_u16(dst + i * 4, ret);
+    }
+    return i;
+}
+#endif
+
+// Noise layer evaluation. The values that only depend on the column or
+// the row are computed once per layer and then each pixel only needs to
+// hash and interpolate the 4 lattice values. This computes exactly the
+// same floating point operations as math::NoiseGenerator::GetSample.
+struct NoiseLayer {
+    std::uint32_t prime0 = 0;
+    std::uint32_t prime1 = 0;
+    std::uint32_t prime2 = 0;
+    float amplitude = 0.0f;
+    float period    = 0.0f;
+    // the lattice points to the left and right of each column
+    // and the interpolation weight of each column.
+    std::vector<float> x0;
+    std::vector<float> x1;
+    std::vector<float> wx;
+};
+struct NoiseRow {
+    // the lattice points above and below the row (multiplied by 57)
+    // and the interpolation weight of the row.
+    float y0 = 0.0f;
+    float y1 = 0.0f;
+    float wy = 0.0f;
+};
+
+// Find the lattice points around the normalized coordinate and the
+// (cosine) interpolation weight.
+inline void GetNoiseLattice(float value, float period, float* v0, float* v1, float* weight)
+{
+    const float t0 = int(value / period) * period;
+    const float t  = (value - t0) / period;
+    *v0 = t0;
+    *v1 = t0 + period;
+    *weight = -std::cos(math::Pi * t) * 0.5 + 0.5;
+}
+
+inline float NoiseRandom(const NoiseLayer& layer, float x)
+{
+    std::uint32_t bits = 0;
+    std::memcpy(&bits, &x, sizeof(x));
+    const std::uint32_t mask = (~(std::uint32_t)0) >> 1;
+    const std::uint32_t val  = (bits << 13) ^ bits;
+    return ((val * (val * val * layer.prime0 + layer.prime1) + layer.prime2) & mask) / (float)mask;
+}
+
+// Add the layer's noise values times the amplitude to the pixels in the row.
+// The SIMD kernels return the number of pixels processed and the rest is
+// then processed with the scalar kernel.
+using NoiseRowFunc = unsigned (*)(const NoiseLayer& layer, const NoiseRow& row, float* pixels, unsigned count);
+
+void AddNoiseRow(const NoiseLayer& layer, const NoiseRow& row, float* pixels, unsigned begin, unsigned end)
+{
+    for (unsigned i=begin; i<end; ++i)
+    {
+        const float s0 = NoiseRandom(layer, layer.x0[i] + row.y0);
+        const float s1 = NoiseRandom(layer, layer.x1[i] + row.y0);
+        const float s2 = NoiseRandom(layer, layer.x0[i] + row.y1);
+        const float s3 = NoiseRandom(layer, layer.x1[i] + row.y1);
+        const float wx = layer.wx[i];
+        const float bot = (1.0f - wx) * s0 + wx * s1;
+        const float top = (1.0f - wx) * s2 + wx * s3;
+        const float sample = (1.0f - row.wy) * bot + row.wy * top;
+        pixels[i] += sample * layer.amplitude;
+    }
+}
+
+#if defined(GFX_BITMAP_SIMD_SSE2)
+inline __m128i Mul32_SSE2(__m128i a, __m128i b)
+{
+    // SSE2 only has 32x32 -> 64 bit multiply for the even lanes.
+    const __m128i even = _mm_mul_epu32(a, b);
+    const __m128i odd  = _mm_mul_epu32(_mm_srli_epi64(a, 32), _mm_srli_epi64(b, 32));
+    return _mm_unpacklo_epi32(_mm_shuffle_epi32(even, _MM_SHUFFLE(0, 0, 2, 0)),
+                              _mm_shuffle_epi32(odd, _MM_SHUFFLE(0, 0, 2, 0)));
+}
+inline __m128 NoiseRandom_SSE2(__m128 x, __m128i p0, __m128i p1, __m128i p2)
+{
+    const __m128i mask = _mm_set1_epi32(0x7fffffff);
+    const __m128i bits = _mm_castps_si128(x);
+    const __m128i val  = _mm_xor_si128(_mm_slli_epi32(bits, 13), bits);
+    __m128i ret = Mul32_SSE2(Mul32_SSE2(val, val), p0);
+    ret = Mul32_SSE2(val, _mm_add_epi32(ret, p1));
+    ret = _mm_and_si128(_mm_add_epi32(ret, p2), mask);
+    // the value fits in 31 bits so signed conversion is fine.
+    return _mm_div_ps(_mm_cvtepi32_ps(ret), _mm_set1_ps((float)0x7fffffff));
+}
+unsigned AddNoiseRow_SSE2(const NoiseLayer& layer, const NoiseRow& row, float* pixels, unsigned count)
+{
+    const __m128i p0  = _mm_set1_epi32((int)layer.prime0);
+    const __m128i p1  = _mm_set1_epi32((int)layer.prime1);
+    const __m128i p2  = _mm_set1_epi32((int)layer.prime2);
+    const __m128 y0   = _mm_set1_ps(row.y0);
+    const __m128 y1   = _mm_set1_ps(row.y1);
+    const __m128 wy   = _mm_set1_ps(row.wy);
+    const __m128 one  = _mm_set1_ps(1.0f);
+    const __m128 amp  = _mm_set1_ps(layer.amplitude);
+    unsigned i = 0;
+    for (; i + 4 <= count; i += 4)
+    {
+        const __m128 x0 = _mm_loadu_ps(&layer.x0[i]);
+        const __m128 x1 = _mm_loadu_ps(&layer.x1[i]);
+        const __m128 wx = _mm_loadu_ps(&layer.wx[i]);
+        const __m128 s0 = NoiseRandom_SSE2(_mm_add_ps(x0, y0), p0, p1, p2);
+        const __m128 s1 = NoiseRandom_SSE2(_mm_add_ps(x1, y0), p0, p1, p2);
+        const __m128 s2 = NoiseRandom_SSE2(_mm_add_ps(x0, y1), p0, p1, p2);
+        const __m128 s3 = NoiseRandom_SSE2(_mm_add_ps(x1, y1), p0, p1, p2);
+        const __m128 wx1 = _mm_sub_ps(one, wx);
+        const __m128 bot = _mm_add_ps(_mm_mul_ps(wx1, s0), _mm_mul_ps(wx, s1));
+        const __m128 top = _mm_add_ps(_mm_mul_ps(wx1, s2), _mm_mul_ps(wx, s3));
+        const __m128 sample = _mm_add_ps(_mm_mul_ps(_mm_sub_ps(one, wy), bot), _mm_mul_ps(wy, top));
+        _mm_storeu_ps(pixels + i, _mm_add_ps(_mm_loadu_ps(pixels + i), _mm_mul_ps(sample, amp)));
+    }
+    return i;
+}
+#endif
+
+#if defined(GFX_BITMAP_SIMD_AVX2)
+GFX_TARGET_AVX2
+inline __m256 NoiseRandom_AVX2(__m256 x, __m256i p0, __m256i p1, __m256i p2)
+{
+    const __m256i mask = _mm256_set1_epi32(0x7fffffff);
+    const __m256i bits = _mm256_castps_si256(x);
+    const __m256i val  = _mm256_xor_si256(_mm256_slli_epi32(bits, 13), bits);
+    __m256i ret = _mm256_mullo_epi32(_mm256_mullo_epi32(val, val), p0);
+    ret = _mm256_mullo_epi32(val, _mm256_add_epi32(ret, p1));
+    ret = _mm256_and_si256(_mm256_add_epi32(ret, p2), mask);
+    return _mm256_div_ps(_mm256_cvtepi32_ps(ret), _mm256_set1_ps((float)0x7fffffff));
+}
+GFX_TARGET_AVX2
+unsigned AddNoiseRow_AVX2(const NoiseLayer& layer, const NoiseRow& row, float* pixels, unsigned count)
+{
+    const __m256i p0  = _mm256_set1_epi32((int)layer.prime0);
+    const __m256i p1  = _mm256_set1_epi32((int)layer.prime1);
+    const __m256i p2  = _mm256_set1_epi32((int)layer.prime2);
+    const __m256 y0   = _mm256_set1_ps(row.y0);
+    const __m256 y1   = _mm256_set1_ps(row.y1);
+    const __m256 wy   = _mm256_set1_ps(row.wy);
+    const __m256 one  = _mm256_set1_ps(1.0f);
+    const __m256 amp  = _mm256_set1_ps(layer.amplitude);
+    unsigned i = 0;
+    for (; i + 8 <= count; i += 8)
+    {
+        // no FMA here, the result must be the same as with the scalar code.
+        const __m256 x0 = _mm256_loadu_ps(&layer.x0[i]);
+        const __m256 x1 = _mm256_loadu_ps(&layer.x1[i]);
+        const __m256 wx = _mm256_loadu_ps(&layer.wx[i]);
+        const __m256 s0 = NoiseRandom_AVX2(_mm256_add_ps(x0, y0), p0, p1, p2);
+        const __m256 s1 = NoiseRandom_AVX2(_mm256_add_ps(x1, y0), p0, p1, p2);
+        const __m256 s2 = NoiseRandom_AVX2(_mm256_add_ps(x0, y1), p0, p1, p2);
+        const __m256 s3 = NoiseRandom_AVX2(_mm256_add_ps(x1, y1), p0, p1, p2);
+        const __m256 wx1 = _mm256_sub_ps(one, wx);
+        const __m256 bot = _mm256_add_ps(_mm256_mul_ps(wx1, s0), _mm256_mul_ps(wx, s1));
+        const __m256 top = _mm256_add_ps(_mm256_mul_ps(wx1, s2), _mm256_mul_ps(wx, s3));
+        const __m256 sample = _mm256_add_ps(_mm256_mul_ps(_mm256_sub_ps(one, wy), bot), _mm256_mul_ps(wy, top));
+        _mm256_storeu_ps(pixels + i, _mm256_add_ps(_mm256_loadu_ps(pixels + i), _mm256_mul_ps(sample, amp)));
+    }
+    return i;
+}
+#endif
+
+#if defined(GFX_BITMAP_SIMD_NEON)
+inline float32x4_t NoiseRandom_NEON(float32x4_t x, uint32x4_t p0, uint32x4_t p1, uint32x4_t p2)
+{
+    const uint32x4_t mask = vdupq_n_u32(0x7fffffff);
+    const uint32x4_t bits = vreinterpretq_u32_f32(x);
+    const uint32x4_t val  = veorq_u32(vshlq_n_u32(bits, 13), bits);
+    uint32x4_t ret = vmulq_u32(vmulq_u32(val, val), p0);
+    ret = vmulq_u32(val, vaddq_u32(ret, p1));
+    ret = vandq_u32(vaddq_u32(ret, p2), mask);
+    return vdivq_f32(vcvtq_f32_u32(ret), vdupq_n_f32((float)0x7fffffff));
+}
+unsigned AddNoiseRow_NEON(const NoiseLayer& layer, const NoiseRow& row, float* pixels, unsigned count)
+{
+    const uint32x4_t p0  = vdupq_n_u32(layer.prime0);
+    const uint32x4_t p1  = vdupq_n_u32(layer.prime1);
+    const uint32x4_t p2  = vdupq_n_u32(layer.prime2);
+    const float32x4_t y0  = vdupq_n_f32(row.y0);
+    const float32x4_t y1  = vdupq_n_f32(row.y1);
+    const float32x4_t wy  = vdupq_n_f32(row.wy);
+    const float32x4_t one = vdupq_n_f32(1.0f);
+    const float32x4_t amp = vdupq_n_f32(layer.amplitude);
+    unsigned i = 0;
+    for (; i + 4 <= count; i += 4)
+    {
+        // no fused multiply-add here, the result must be the same as with the scalar code.
+        const float32x4_t x0 = vld1q_f32(&layer.x0[i]);
+        const float32x4_t x1 = vld1q_f32(&layer.x1[i]);
+        const float32x4_t wx = vld1q_f32(&layer.wx[i]);
+        const float32x4_t s0 = NoiseRandom_NEON(vaddq_f32(x0, y0), p0, p1, p2);
+        const float32x4_t s1 = NoiseRandom_NEON(vaddq_f32(x1, y0), p0, p1, p2);
+        const float32x4_t s2 = NoiseRandom_NEON(vaddq_f32(x0, y1), p0, p1, p2);
+        const float32x4_t s3 = NoiseRandom_NEON(vaddq_f32(x1, y1), p0, p1, p2);
+        const float32x4_t wx1 = vsubq_f32(one, wx);
+        const float32x4_t bot = vaddq_f32(vmulq_f32(wx1, s0), vmulq_f32(wx, s1));
+        const float32x4_t top = vaddq_f32(vmulq_f32(wx1, s2), vmulq_f32(wx, s3));
+        const float32x4_t sample = vaddq_f32(vmulq_f32(vsubq_f32(one, wy), bot), vmulq_f32(wy, top));
+        vst1q_f32(pixels + i, vaddq_f32(vld1q_f32(pixels + i), vmulq_f32(sample, amp)));
+    }
+    return i;
+}
+#endif
+
+unsigned BoxFilterRow_None(const u8*, const u8*, u8*, unsigned)
+{ return 0; }
+unsigned BoxFilterRow_None(const u16*, const u16*, u16*, unsigned)
+{ return 0; }
+unsigned AddNoiseRow_None(const NoiseLayer&, const NoiseRow&, float*, unsigned)
+{ return 0; }
+
+struct BitmapKernels {
+    BoxFilterRow8  a8     = &BoxFilterRow_None;
+    BoxFilterRow8  rgb    = &BoxFilterRow_None;
+    BoxFilterRow8  rgba   = &BoxFilterRow_None;
+    BoxFilterRow16 rgba16 = &BoxFilterRow_None;
+    NoiseRowFunc   noise  = &AddNoiseRow_None;
+};
+
+#if defined(GFX_BITMAP_SIMD_AVX2)
+bool HasAVX2()
+{
+#  if defined(_MSC_VER) && !defined(__clang__)
+    int info[4];
+    __cpuid(info, 0);
+    if (info[0] < 7)
+        return false;
+    __cpuid(info, 1);
+    // check that the OS saves the YMM registers.
+    const bool osxsave = (info[2] & (1 << 27)) != 0;
+    const bool avx     = (info[2] & (1 << 28)) != 0;
+    if (!osxsave || !avx || (_xgetbv(0) & 0x6) != 0x6)
+        return false;
+    __cpuidex(info, 7, 0);
+    return (info[1] & (1 << 5)) != 0;
+#  else
+    __builtin_cpu_init();
+    return __builtin_cpu_supports("avx2");
+#  endif
+}
+#endif
+
+BitmapKernels SelectBitmapKernels()
+{
+    BitmapKernels kernels;
+#if defined(GFX_BITMAP_SIMD_SSE2)
+    kernels.a8     = &BoxFilterRow_A8_SSE2;
+    kernels.rgb    = &BoxFilterRow_RGB_SSE2;
+    kernels.rgba   = &BoxFilterRow_RGBA_SSE2;
+    kernels.rgba16 = &BoxFilterRow_RGBA16_SSE2;
+    kernels.noise  = &AddNoiseRow_SSE2;
+#endif
+#if defined(GFX_BITMAP_SIMD_AVX2)
+    if (HasAVX2())
+    {
+        kernels.a8     = &BoxFilterRow_A8_AVX2;
+        kernels.rgba   = &BoxFilterRow_RGBA_AVX2;
+        kernels.rgba16 = &BoxFilterRow_RGBA16_AVX2;
+        kernels.noise  = &AddNoiseRow_AVX2;
+    }
+#endif
+#if defined(GFX_BITMAP_SIMD_NEON)
+    kernels.a8     = &BoxFilterRow_A8_NEON;
+    kernels.rgb    = &BoxFilterRow_RGB_NEON;
+    kernels.rgba   = &BoxFilterRow_RGBA_NEON;
+    kernels.rgba16 = &BoxFilterRow_RGBA16_NEON;
+    kernels.noise  = &AddNoiseRow_NEON;
+#endif
+    return kernels;
+}
+
+#if defined(GFX_BITMAP_SIMD_SSE2) || defined(GFX_BITMAP_SIMD_NEON)
+bool EnableBitmapSIMD = true;
+#else
+bool EnableBitmapSIMD = false;
+#endif
+
+const BitmapKernels& GetBitmapKernels()
+{
+    static const BitmapKernels scalar;
+    static const BitmapKernels simd = SelectBitmapKernels();
+    return EnableBitmapSIMD ? simd : scalar;
+}
+
+template<typename Pixel, unsigned Channels>
+std::unique_ptr<gfx::Bitmap<Pixel>> ConvertToLinear(const gfx::IBitmapReadView& src)
 {
     ASSERT(src.IsValid());
 
     const auto width  = src.GetWidth();
     const auto height = src.GetHeight();
+    const auto& lut = GetSRGB_LUT();
 
-    using Bitmap = gfx::Bitmap<T_u8>;
-
-    auto ret = std::make_unique<Bitmap>(width, height);
+    auto ret = std::make_unique<gfx::Bitmap<Pixel>>(width, height);
     auto dst = ret->GetWriteView();
 
-    for (unsigned row=0; row<height; ++row)
+    const auto* in = (const u8*)src.GetReadPtr();
+    auto* out = (u8*)dst->GetWritePtr();
+    for (size_t i=0; i<(size_t)width*height; ++i)
     {
-        for (unsigned col=0; col<width; ++col)
-        {
-            T_u8 value;
-            T_float norm;
-            src.ReadPixel(row, col, &value);
-            norm  = gfx::Pixel_to_floats(value);
-            norm  = gfx::sRGB_decode(norm);
-            value = gfx::Pixel_to_uints(norm);
-            dst->WritePixel(row, col, value);
-        }
+        // alpha is not sRGB encoded.
+        out[0] = lut.to_linear8[in[0]];
+        out[1] = lut.to_linear8[in[1]];
+        out[2] = lut.to_linear8[in[2]];
+        if constexpr (Channels == 4)
+            out[3] = in[3];
+        in  += Channels;
+        out += Channels;
     }
     return ret;
 }
 
-template<typename T_u8, typename T_float, bool support_srgb, bool alpha_channel>
-std::unique_ptr<gfx::Bitmap<T_u8>> BoxFilter(const gfx::IBitmapReadView& src, bool srgb, bool premul_alpha)
+template<typename Pixel, unsigned Channels>
+std::unique_ptr<gfx::Bitmap<Pixel>> BoxFilter(const gfx::IBitmapReadView& src, BoxFilterRow8 kernel)
 {
     ASSERT(src.IsValid());
 
@@ -90,79 +682,222 @@ std::unique_ptr<gfx::Bitmap<T_u8>> BoxFilter(const gfx::IBitmapReadView& src, bo
 
     const auto dst_width  = std::max(1u, src_width / 2);
     const auto dst_height = std::max(1u, src_height / 2);
+    // a single row or column is filtered with itself.
+    const auto next_row = src_height > 1 ? src_width * Channels : 0u;
+    const auto next_col = src_width > 1 ? Channels : 0u;
+
+    auto ret = std::make_unique<gfx::Bitmap<Pixel>>(dst_width, dst_height);
+    auto dst = ret->GetWriteView();
+
+    const auto* in = (const u8*)src.GetReadPtr();
+    auto* out = (u8*)dst->GetWritePtr();
+    for (unsigned row=0; row<dst_height; ++row)
+    {
+        const auto* row0 = in + (size_t)row * 2 * src_width * Channels;
+        const auto* row1 = row0 + next_row;
+        auto* dst_row = out + (size_t)row * dst_width * Channels;
+        const auto done = next_col ? kernel(row0, row1, dst_row, dst_width) : 0u;
+        BoxFilterRow<Channels>(row0, row1, dst_row, done, dst_width, next_col);
+    }
+    return ret;
+}
+
+// Box filter sRGB encoded RGB(A) bitmap. The color channels are converted
+// to linear values before averaging and then back to sRGB. The alpha
+// channel is linear. RGB and RGBA are both filtered as RGBA with 16 bits
+// per channel.
+template<typename Pixel, unsigned Channels>
+std::unique_ptr<gfx::Bitmap<Pixel>> BoxFilter_sRGB(const gfx::IBitmapReadView& src, BoxFilterRow16 kernel)
+{
+    ASSERT(src.IsValid());
 
-    const auto src_height_max = src_height & ~0x1;
-    const auto src_width_max  = src_width & ~0x1;
+    const auto src_width  = src.GetWidth();
+    const auto src_height = src.GetHeight();
+    if (src_width == 1 && src_height == 1)
+        return nullptr;
 
-    using Bitmap = gfx::Bitmap<T_u8>;
+    const auto dst_width  = std::max(1u, src_width / 2);
+    const auto dst_height = std::max(1u, src_height / 2);
+    const auto& lut = GetSRGB_LUT();
 
-    auto ret = std::make_unique<Bitmap>(dst_width, dst_height);
+    auto ret = std::make_unique<gfx::Bitmap<Pixel>>(dst_width, dst_height);
     auto dst = ret->GetWriteView();
 
-    for (unsigned dst_row=0, src_row=0; src_row<src_height_max; src_row+=2, dst_row++)
-    {
-        for (unsigned dst_col=0, src_col=0; src_col<src_width_max; src_col+=2, dst_col++)
+    // decode one source row into linear RGBA.
+    auto decode = [&lut, src_width](const u8* in, u16* out, unsigned count) {
+        for (unsigned col=0; col<count; ++col)
         {
-            // read 2x2 pixels from the source image
-            T_u8 values[4];
-            src.ReadPixel(std::min(src_row+0, src_height-1), std::min(src_col+0, src_width-1), &values[0]);
-            src.ReadPixel(std::min(src_row+0, src_height-1), std::min(src_col+1, src_width-1), &values[1]);
-            src.ReadPixel(std::min(src_row+1, src_height-1), std::min(src_col+0, src_width-1), &values[2]);
-            src.ReadPixel(std::min(src_row+1, src_height-1), std::min(src_col+1, src_width-1), &values[3]);
-
-            // normalize the values for better precision. alternative would
-            // be to use bit shift (right shift by two) on the integer type
-            // but that would lose some precision.
-            T_float values_norm[4];
-            values_norm[0] = gfx::Pixel_to_floats(values[0]);
-            values_norm[1] = gfx::Pixel_to_floats(values[1]);
-            values_norm[2] = gfx::Pixel_to_floats(values[2]);
-            values_norm[3] = gfx::Pixel_to_floats(values[3]);
-
-            // if we're dealing with sRGB color space then the values need first
-            // be converted into linear before averaging. this is only supported
-            // for RGBA and RGB formats.
-            if constexpr (support_srgb)
-            {
-                if (srgb)
-                {
-                    values_norm[0] = gfx::sRGB_decode(values_norm[0]);
-                    values_norm[1] = gfx::sRGB_decode(values_norm[1]);
-                    values_norm[2] = gfx::sRGB_decode(values_norm[2]);
-                    values_norm[3] = gfx::sRGB_decode(values_norm[3]);
-                }
-            }
+            const auto* px = in + std::min(col, src_width - 1) * Channels;
+            out[0] = lut.to_linear14[px[0]];
+            out[1] = lut.to_linear14[px[1]];
+            out[2] = lut.to_linear14[px[2]];
+            out[3] = Channels == 4 ? px[3] : 0;
+            out += 4;
+        }
+    };
 
-            // premultiply alpha into RGB
-            if constexpr (alpha_channel)
-            {
-                if (premul_alpha)
-                {
-                    for (auto& rgba : values_norm)
-                    {
-                        rgba = gfx::RGBA_premul_alpha(rgba);
-                    }
-                }
-            }
+    std::vector<u16> linear0(dst_width * 2 * 4);
+    std::vector<u16> linear1(dst_width * 2 * 4);
+    std::vector<u16> average(dst_width * 4);
 
-            // compute the average of the original 4 pixels.
-            T_float value = values_norm[0] * 0.25f +
-                            values_norm[1] * 0.25f +
-                            values_norm[2] * 0.25f +
-                            values_norm[3] * 0.25f;
-            // encode linear in sRGB if needed.
-            if constexpr (support_srgb)
-            {
-                if (srgb)
-                    value = gfx::sRGB_encode(value);
-            }
+    const auto* in = (const u8*)src.GetReadPtr();
+    auto* out = (u8*)dst->GetWritePtr();
+    for (unsigned row=0; row<dst_height; ++row)
+    {
+        const auto src_row0 = row * 2;
+        const auto src_row1 = std::min(row * 2 + 1, src_height - 1);
+        decode(in + (size_t)src_row0 * src_width * Channels, &linear0[0], dst_width * 2);
+        decode(in + (size_t)src_row1 * src_width * Channels, &linear1[0], dst_width * 2);
 
-            // write the new pixel value out.
-            dst->WritePixel(dst_row, dst_col, gfx::Pixel_to_uints(value));
+        const auto done = kernel(&linear0[0], &linear1[0], &average[0], dst_width);
+        BoxFilterRow<4>(&linear0[0], &linear1[0], &average[0], done, dst_width, 4);
+
+        auto* dst_row = out + (size_t)row * dst_width * Channels;
+        for (unsigned col=0; col<dst_width; ++col)
+        {
+            const auto* px = &average[col * 4];
+            dst_row[0] = lut.from_linear14[px[0]];
+            dst_row[1] = lut.from_linear14[px[1]];
+            dst_row[2] = lut.from_linear14[px[2]];
+            if constexpr (Channels == 4)
+                dst_row[3] = (u8)px[3];
+            dst_row += Channels;
         }
     }
     return ret;
 }
+
+// Run the function over the range [0, count) in batches on worker threads.
+// The calling thread also processes batches. When the work is too small
+// to be worth spreading over threads everything is done on the calling
+// thread.
+template<typename Function>
+void ParallelFor(unsigned count, unsigned batch, Function function)
+{
+    unsigned num_threads = 1;
+#if !defined(__EMSCRIPTEN__) || defined(__EMSCRIPTEN_PTHREADS__)
+    num_threads = std::min(std::max(1u, std::thread::hardware_concurrency()),
+                           (count + batch - 1) / batch);
+#endif
+    if (num_threads <= 1)
+    {
+        function(0u, count);
+        return;
+    }
+
+    std::atomic<unsigned> next(0);
+    auto worker = [&next, &function, count, batch]() {
+        for (;;)
+        {
+            const auto begin = next.fetch_add(batch);
+            if (begin >= count)
+                break;
+            function(begin, std::min(begin + batch, count));
+        }
+    };
+    std::vector<std::thread> threads;
+    for (unsigned i=1; i<num_threads; ++i)
+        threads.emplace_back(worker);
+    worker();
+    for (auto& thread : threads)
+        thread.join();
+}
+
+// Cached bitmaps are stored on disk with a small header followed by the
+// raw pixel data.
+struct CachedBitmapHeader {
+    char magic[4] = {'G', 'S', 'B', 'C'};
+    std::uint32_t version = 1;
+    std::uint32_t width   = 0;
+    std::uint32_t height  = 0;
+    std::uint32_t depth   = 0;
+    std::uint32_t padding = 0;
+    std::uint64_t hash    = 0;
+};
+
+std::mutex gCacheMutex;
+std::string gCacheDirectory;
+
+std::string GetCachedBitmapFile(const char* prefix, std::size_t hash)
+{
+    std::lock_guard<std::mutex> lock(gCacheMutex);
+    if (gCacheDirectory.empty())
+        return "";
+    char name[64];
+    std::snprintf(name, sizeof(name), "%s-%016llx.bin", prefix, (unsigned long long)hash);
+    return base::JoinPath(gCacheDirectory, name);
+}
+
+std::unique_ptr<gfx::AlphaMask> LoadCachedBitmap(const std::string& file, std::size_t hash, unsigned width, unsigned height)
+{
+    auto in = base::OpenBinaryInputStream(file);
+    if (!in.is_open())
+        return nullptr;
+
+    const CachedBitmapHeader expected;
+    CachedBitmapHeader header;
+    in.read((char*)&header, sizeof(header));
+    if (in.gcount() != sizeof(header) ||
+        std::memcmp(header.magic, expected.magic, sizeof(header.magic)) ||
+        header.version != expected.version ||
+        header.width   != width ||
+        header.height  != height ||
+        header.depth   != 8 ||
+        header.hash    != hash)
+    {
+        WARN("Ignoring invalid cached bitmap file. [file='%1']", file);
+        return nullptr;
+    }
+    auto ret = std::make_unique<gfx::AlphaMask>(width, height);
+    const auto bytes = (std::streamsize)width * height;
+    in.read((char*)ret->GetDataPtr(), bytes);
+    if (in.gcount() != bytes)
+    {
+        WARN("Ignoring truncated cached bitmap file. [file='%1']", file);
+        return nullptr;
+    }
+    DEBUG("Loaded cached bitmap. [file='%1']", file);
+    return ret;
+}
+
+void StoreCachedBitmap(const std::string& file, std::size_t hash, const gfx::AlphaMask& bitmap)
+{
+    std::error_code error;
+    const auto& path = std::filesystem::u8path(file);
+    std::filesystem::create_directories(path.parent_path(), error);
+
+    // write into a temporary file first and then rename it so that
+    // nobody will ever see a partially written file.
+    const auto& temp = file + "." + base::RandomString(6);
+    {
+        auto out = base::OpenBinaryOutputStream(temp);
+        if (!out.is_open())
+        {
+            WARN("Failed to open cached bitmap file for writing. [file='%1']", temp);
+            return;
+        }
+        CachedBitmapHeader header;
+        header.width  = bitmap.GetWidth();
+        header.height = bitmap.GetHeight();
+        header.depth  = 8;
+        header.hash   = hash;
+        out.write((const char*)&header, sizeof(header));
+        out.write((const char*)bitmap.GetDataPtr(), (std::streamsize)bitmap.GetWidth() * bitmap.GetHeight());
+        if (out.fail())
+        {
+            WARN("Failed to write cached bitmap file. [file='%1']", temp);
+            out.close();
+            std::filesystem::remove(std::filesystem::u8path(temp), error);
+            return;
+        }
+    }
+    std::filesystem::rename(std::filesystem::u8path(temp), path, error);
+    if (error)
+    {
+        WARN("Failed to rename cached bitmap file. [file='%1', error='%2']", file, error.message());
+        std::filesystem::remove(std::filesystem::u8path(temp), error);
+    }
+}
 } // namespace
 
 namespace gfx
@@ -632,13 +1367,17 @@ void WritePNG(const IBitmap& bmp, const std::string& filename)
 
 std::unique_ptr<IBitmap> GenerateNextMipmap(const IBitmapReadView& src, bool srgb)
 {
-    const auto premul_alpha = false;
+    const auto& kernels = GetBitmapKernels();
     if (src.GetDepthBits() == 32) {
-       return ::BoxFilter<RGBA, fRGBA, true, true>(src, srgb, premul_alpha);
+        if (srgb)
+            return ::BoxFilter_sRGB<RGBA, 4>(src, kernels.rgba16);
+        return ::BoxFilter<RGBA, 4>(src, kernels.rgba);
     } else if (src.GetDepthBits() == 24) {
-        return ::BoxFilter<RGB, fRGB, true, false> (src, srgb, false);
+        if (srgb)
+            return ::BoxFilter_sRGB<RGB, 3>(src, kernels.rgba16);
+        return ::BoxFilter<RGB, 3>(src, kernels.rgb);
     } else if (src.GetDepthBits() == 8)
-        return ::BoxFilter<Grayscale, fGrayscale, false, false>(src, false, false);
+        return ::BoxFilter<Grayscale, 1>(src, kernels.a8);
     return nullptr;
 }
 std::unique_ptr<IBitmap> GenerateNextMipmap(const IBitmap& src, bool srgb)
@@ -650,9 +1389,9 @@ std::unique_ptr<IBitmap> GenerateNextMipmap(const IBitmap& src, bool srgb)
 std::unique_ptr<IBitmap> ConvertToLinear(const IBitmapReadView& src)
 {
     if (src.GetDepthBits() == 32)
-        return ::ConvertToLinear<RGBA, fRGBA>(src);
+        return ::ConvertToLinear<RGBA, 4>(src);
     else if (src.GetDepthBits() == 24)
-        return ::ConvertToLinear<RGB, fRGB>(src);
+        return ::ConvertToLinear<RGB, 3>(src);
     return nullptr;
 }
 std::unique_ptr<IBitmap> ConvertToLinear(const IBitmap& src)
@@ -661,6 +1400,28 @@ std::unique_ptr<IBitmap> ConvertToLinear(const IBitmap& src)
     return ConvertToLinear(*view);
 }
 
+void SetBitmapCacheDirectory(const std::string& dir)
+{
+    std::lock_guard<std::mutex> lock(gCacheMutex);
+    gCacheDirectory = dir;
+}
+std::string GetBitmapCacheDirectory()
+{
+    std::lock_guard<std::mutex> lock(gCacheMutex);
+    return gCacheDirectory;
+}
+
+void EnableBitmapSIMD(bool on_off)
+{
+#if defined(GFX_BITMAP_SIMD_SSE2) || defined(GFX_BITMAP_SIMD_NEON)
+    ::EnableBitmapSIMD = on_off;
+#endif
+}
+bool IsBitmapSIMDEnabled()
+{
+    return ::EnableBitmapSIMD;
+}
+
 void PremultiplyAlpha(const BitmapWriteView<RGBA>& dst,
                       const BitmapReadView<RGBA>& src, bool srgb)
 {
@@ -740,27 +1501,68 @@ bool NoiseBitmapGenerator::FromJson(const data::Reader& data)
 
 std::unique_ptr<IBitmap> NoiseBitmapGenerator::Generate() const
 {
+    const auto hash = GetHash();
+    const auto& cache_file = GetCachedBitmapFile("noise", hash);
+    if (!cache_file.empty())
+    {
+        if (auto ret = LoadCachedBitmap(cache_file, hash, mWidth, mHeight))
+            return ret;
+    }
+
     auto ret = std::make_unique<AlphaMask>();
     ret->Resize(mWidth, mHeight);
+    if (!mWidth || !mHeight)
+        return ret;
+
     const float w = mWidth;
     const float h = mHeight;
-    for (unsigned y = 0; y < mHeight; ++y)
+
+    // compute the per layer and per column values up front.
+    std::vector<NoiseLayer> layers;
+    for (const auto& layer : mLayers)
     {
-        for (unsigned x = 0; x < mWidth; ++x)
+        NoiseLayer noise;
+        noise.prime0    = layer.prime0;
+        noise.prime1    = layer.prime1;
+        noise.prime2    = layer.prime2;
+        noise.amplitude = math::clamp(0.0f, 255.0f, layer.amplitude);
+        noise.period    = 1.0f / layer.frequency;
+        noise.x0.resize(mWidth);
+        noise.x1.resize(mWidth);
+        noise.wx.resize(mWidth);
+        for (unsigned x=0; x<mWidth; ++x)
         {
-            float pixel = 0.0f;
-            for (const auto& layer : mLayers)
+            GetNoiseLattice(x / w, noise.period, &noise.x0[x], &noise.x1[x], &noise.wx[x]);
+        }
+        layers.push_back(std::move(noise));
+    }
+
+    const auto kernel = GetBitmapKernels().noise;
+    auto* pixels = (u8*)ret->GetDataPtr();
+
+    ParallelFor(mHeight, 16, [&layers, kernel, pixels, w = mWidth, h](unsigned begin, unsigned end) {
+        std::vector<float> values(w);
+        for (unsigned y=begin; y<end; ++y)
+        {
+            std::fill(values.begin(), values.end(), 0.0f);
+            for (const auto& layer : layers)
+            {
+                NoiseRow row;
+                GetNoiseLattice(y / h, layer.period, &row.y0, &row.y1, &row.wy);
+                row.y0 = row.y0 * 57;
+                row.y1 = row.y1 * 57;
+                const auto done = kernel(layer, row, &values[0], w);
+                AddNoiseRow(layer, row, &values[0], done, w);
+            }
+            for (unsigned x=0; x<w; ++x)
             {
-                const math::NoiseGenerator gen(layer.frequency, layer.prime0, layer.prime1, layer.prime2);
-                const auto amplitude = math::clamp(0.0f, 255.0f, layer.amplitude);
-                const auto sample = gen.GetSample(x / w, y / h);
-                pixel += (sample * amplitude);
+                pixels[y * w + x] = math::clamp(0u, 255u, (unsigned)values[x]);
             }
-            Grayscale px;
-            px.r = math::clamp(0u, 255u, (unsigned) pixel);
-            ret->SetPixel(y, x, px);
         }
-    }
+    });
+
+    if (!cache_file.empty())
+        StoreCachedBitmap(cache_file, hash, *ret);
     return ret;
 }
  size_t NoiseBitmapGenerator::GetHash() const
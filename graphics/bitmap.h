@@ -463,6 +463,18 @@ namespace gfx
     };
 
 
+    namespace detail {
+        // Check whether the pixel compare functor compares the pixels
+        // for bitwise equality which allows for comparing the pixels
+        // as raw bytes. The functor indicates this with a BitwiseCompare
+        // flag.
+        template<typename CompareFunc, typename = void>
+        struct IsBitwiseCompare : std::false_type {};
+        template<typename CompareFunc>
+        struct IsBitwiseCompare<CompareFunc, std::void_t<decltype(CompareFunc::BitwiseCompare)>>
+          : std::bool_constant<CompareFunc::BitwiseCompare> {};
+    } // namespace
+
     template<typename Pixel>
     void FillBitmap(const BitmapWriteView<Pixel>& dst,
                     const IRect& dst_rect, const Pixel& value)
@@ -471,13 +483,17 @@ namespace gfx
         const auto dst_height = dst.GetHeight();
         const auto dst_rect_safe = IRect(0, 0, dst_width, dst_height);
         const auto rect = Intersect(dst_rect_safe, dst_rect);
-        for (unsigned y=0; y<rect.GetHeight(); ++y)
+        if (rect.IsEmpty())
+            return;
+        // fill the first row and then copy it over the rest of the rows.
+        auto* pixels = static_cast<Pixel*>(dst.GetWritePtr());
+        const auto& top_left = rect.GetPosition();
+        const auto width = rect.GetWidth();
+        auto* first = &pixels[top_left.GetY() * dst_width + top_left.GetX()];
+        std::fill_n(first, width, value);
+        for (unsigned y=1; y<rect.GetHeight(); ++y)
         {
-            for (unsigned x=0; x<rect.GetWidth(); ++x)
-            {
-                const auto point = rect.MapToGlobal(x, y);
-                dst.WritePixel(point, value);
-            }
+            std::memcpy(first + y * dst_width, first, width * sizeof(Pixel));
         }
     }
 
@@ -520,16 +536,21 @@ namespace gfx
         const auto src_rect_safe = Intersect(IRect(0, 0, src_width, src_height), src_rect);
         const auto dst_rect = IRect(dst_pos, src_rect_safe.GetSize());
         const auto cpy_rect = Intersect(IRect(0, 0, dst_width, dst_height), dst_rect);
-
+        if (cpy_rect.IsEmpty())
+            return;
+
+        // copy the pixels one row at a time. use memmove since the source
+        // and destination could be the same bitmap.
+        const auto* src_pixels = static_cast<const Pixel*>(src.GetReadPtr());
+        auto* dst_pixels = static_cast<Pixel*>(dst.GetWritePtr());
+        const auto width = cpy_rect.GetWidth();
         for (unsigned y=0; y<cpy_rect.GetHeight(); ++y)
         {
-            for (unsigned x=0; x<cpy_rect.GetWidth(); ++x)
-            {
-                const auto& dst_point = cpy_rect.MapToGlobal(x, y);
-                const auto& src_point = src_rect_safe.MapToGlobal(dst_rect.MapToLocal(dst_point));
-                const auto& src_pixel = src.template ReadPixel<Pixel>(src_point);
-                dst.WritePixel(dst_point, src_pixel);
-            }
+            const auto& dst_point = cpy_rect.MapToGlobal(0, y);
+            const auto& src_point = src_rect_safe.MapToGlobal(dst_rect.MapToLocal(dst_point));
+            std::memmove(&dst_pixels[dst_point.GetY() * dst_width + dst_point.GetX()],
+                         &src_pixels[src_point.GetY() * src_width + src_point.GetX()],
+                         width * sizeof(Pixel));
         }
     }
 
@@ -598,6 +619,22 @@ namespace gfx
 
         const auto width  = std::min(dst_rect_safe.GetWidth(), src_rect_safe.GetWidth());
         const auto height = std::min(dst_rect_safe.GetHeight(), dst_rect_safe.GetHeight());
+        if constexpr (detail::IsBitwiseCompare<CompareFunc>::value)
+        {
+            // compare the pixels one row at a time.
+            const auto* src_pixels = static_cast<const Pixel*>(src.GetReadPtr());
+            const auto* dst_pixels = static_cast<const Pixel*>(dst.GetReadPtr());
+            for (unsigned row=0; row<height; ++row)
+            {
+                const auto& dst_point = dst_rect_safe.MapToGlobal(0, row);
+                const auto& src_point = src_rect_safe.MapToGlobal(0, row);
+                if (std::memcmp(&dst_pixels[dst_point.GetY() * dst_width + dst_point.GetX()],
+                                &src_pixels[src_point.GetY() * src_width + src_point.GetX()],
+                                width * sizeof(Pixel)))
+                    return false;
+            }
+            return true;
+        }
         for (unsigned row=0; row<height; ++row)
         {
             for (unsigned col=0; col<width; ++col)
@@ -698,6 +735,9 @@ namespace gfx
 
         // pixel to pixel
         struct Pixel2Pixel {
+            // the pixel types have no padding so the pixels
+            // can be compared as bytes.
+            static constexpr bool BitwiseCompare = true;
             bool operator()(const Pixel& lhs, const Pixel& rhs) const
             { return lhs == rhs; }
         };
@@ -1137,11 +1177,36 @@ namespace gfx
     void WritePPM(const IBitmap& bmp, const std::string& filename);
     void WritePNG(const IBitmap& bmp, const std::string& filename);
 
+    // Generate the next mipmap level by filtering the source bitmap with
+    // a 2x2 box filter. Returns nullptr if the source is already 1x1 pixel
+    // or the format is not supported. When srgb is true the RGB channels
+    // are averaged in linear space and the result is within +-1 of the
+    // exact floating point conversion. Otherwise the result is the rounded
+    // average of the channel values.
     std::unique_ptr<IBitmap> GenerateNextMipmap(const IBitmapReadView& src, bool srgb);
     std::unique_ptr<IBitmap> GenerateNextMipmap(const IBitmap& src, bool srgb);
+    // Convert a sRGB encoded RGB(A) bitmap into linear. Alpha is unchanged.
     std::unique_ptr<IBitmap> ConvertToLinear(const IBitmapReadView& src);
     std::unique_ptr<IBitmap> ConvertToLinear(const IBitmap& src);
 
+    // Set the directory for caching procedurally generated bitmaps on disk.
+    // When set the bitmap generators store the generated bitmaps in this
+    // directory keyed by the generator's content hash and load them from
+    // there instead of generating them again when the generator parameters
+    // have not changed. An empty string (the default) disables the cache.
+    void SetBitmapCacheDirectory(const std::string& dir);
+    std::string GetBitmapCacheDirectory();
+
+    // Enable/disable the SIMD implementation of the bitmap kernels used
+    // for mipmap and noise generation. The best implementation (SSE2/AVX2/NEON) is
+    // selected at runtime based on the CPU. When disabled or when no SIMD
+    // implementation is available the scalar code path is used. Both paths
+    // produce the same results. Mostly useful for testing and benchmarking.
+    // On by default.
+    void EnableBitmapSIMD(bool on_off);
+    // Returns true if a SIMD implementation is available and enabled.
+    bool IsBitmapSIMDEnabled();
+
     void PremultiplyAlpha(const BitmapWriteView<RGBA>& dst,
                           const BitmapReadView<RGBA>& src, bool srgb);
     Bitmap<RGBA> PremultiplyAlpha(const BitmapReadView<RGBA>& src, bool srgb);
@@ -1238,6 +1303,10 @@ namespace gfx
         { mWidth = width; }
         virtual void IntoJson(data::Writer& data) const override;
         virtual bool FromJson(const data::Reader& data) override;
+        // Generate the noise bitmap. The rows are generated in parallel
+        // on worker threads. If the bitmap cache is enabled the result is
+        // stored in the cache and subsequent calls with the same parameters
+        // load the bitmap from the cache.
         virtual std::unique_ptr<IBitmap> Generate() const override;
         virtual std::size_t GetHash() const override;
     private:
@@ -227,6 +227,10 @@ namespace gfx
         virtual void DeleteGeometries() = 0;
         virtual void DeleteTextures() = 0;
         virtual void DeleteFramebuffers() = 0;
+        // Delete a single texture or framebuffer identified by its name.
+        // If no such resource exists then nothing is done.
+        virtual void DeleteTexture(const std::string& name) = 0;
+        virtual void DeleteFramebuffer(const std::string& name) = 0;
         // Set the render buffer used for the next Draw, Clear and Read commands.
         // If the fbo is nullptr then set the frame buffer to the default fbo 
         // that is the rendering surface of the context.
@@ -248,6 +252,16 @@ namespace gfx
         // currently at frame N+max_num_idle_frames then the texture is deleted.
         virtual void CleanGarbage(size_t max_num_idle_frames, unsigned flags) = 0;
 
+        // Set the maximum amount of memory (in bytes) that can be used
+        // for textures. The memory use is estimated based on the texture
+        // dimensions, format and mips. When a texture upload would exceed
+        // the budget the least recently used textures that are not used
+        // in the current frame are deleted first. Transient textures are
+        // deleted before other textures and textures that belong to a
+        // group are only deleted together with the whole group.
+        // Zero means no budget, i.e. unlimited, which is the default.
+        virtual void SetTextureMemoryBudget(std::size_t bytes) = 0;
+
         // Prepare the device for the next frame.
         virtual void BeginFrame() = 0;
         // End rendering a frame. If display is true then this will call
@@ -271,9 +285,51 @@ namespace gfx
             std::size_t static_vbo_mem_alloc  = 0;
             std::size_t streaming_vbo_mem_use = 0;
             std::size_t streaming_vbo_mem_alloc = 0;
+            // the current (estimated) texture memory use in bytes.
+            std::size_t texture_mem_use = 0;
+            // the current texture memory budget in bytes or 0 for no budget.
+            std::size_t texture_mem_budget = 0;
+            // the total number of textures deleted in order to
+            // stay within the texture memory budget.
+            std::size_t num_textures_evicted = 0;
+            // the total number of texture memory bytes released by
+            // deleting textures in order to stay within the budget.
+            std::size_t texture_mem_evicted = 0;
+            // the total number of program objects created (i.e. compiled
+            // and linked) on the device.
+            std::size_t num_programs_created = 0;
         };
         virtual void GetResourceStats(ResourceStats* stats) const = 0;
 
+        // Counters for the work submitted to the device during a frame.
+        struct FrameStats {
+            // the number of draw calls (primitive draw commands).
+            unsigned draw_calls = 0;
+            // the number of vertices drawn by the draw calls.
+            std::size_t vertices = 0;
+            // the number of times the current program was changed.
+            unsigned program_switches = 0;
+            // the number of times a texture was bound to a texture unit.
+            unsigned texture_binds = 0;
+            // the number of texture (and mip level) uploads.
+            unsigned texture_uploads = 0;
+            // the number of bytes uploaded in texture uploads.
+            std::size_t texture_upload_bytes = 0;
+            // the number of vertex buffer uploads.
+            unsigned buffer_uploads = 0;
+            // the number of bytes uploaded in vertex buffer uploads.
+            std::size_t buffer_upload_bytes = 0;
+            // the number of times the current framebuffer was changed.
+            unsigned fbo_switches = 0;
+            // the number of uniform values set on programs.
+            unsigned uniform_sets = 0;
+        };
+        // Get the counters for the last completed frame, i.e. the work that
+        // was submitted since the previous call to EndFrame up to the latest
+        // call to EndFrame. Work done outside BeginFrame/EndFrame, for example
+        // when preparing resources, is accounted to the next frame.
+        virtual void GetFrameStats(FrameStats* stats) const = 0;
+
         struct DeviceCaps {
             unsigned num_texture_units = 0;
             unsigned max_fbo_width = 0;
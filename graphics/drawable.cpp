@@ -16,6 +16,14 @@
 
 #include "config.h"
 
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#  include <emmintrin.h>
+#  define GFX_PARTICLE_SIMD_SSE2
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+#  include <arm_neon.h>
+#  define GFX_PARTICLE_SIMD_NEON
+#endif
+
 #include <functional> // for hash
 #include <cmath>
 #include <cstdio>
@@ -29,6 +37,7 @@
 #include "graphics/device.h"
 #include "graphics/shader.h"
 #include "graphics/geometry.h"
+#include "graphics/material.h"
 #include "graphics/resource.h"
 #include "graphics/transform.h"
 
@@ -66,6 +75,45 @@ std::string NameAspectRatio(float width, float height, RoundFunc Round, const ch
     return ret;
 }
 
+// The maximum distance in pixels between a curve and its tessellation
+// that is accepted when choosing the level of detail for curved shapes.
+constexpr float MaxCurveScreenError = 0.5f;
+// The number of levels of detail for curved shapes. Each level has
+// half the number of slices of the previous level.
+constexpr unsigned NumCurveLodLevels = 5;
+
+// Compute the level of detail for tessellating a curve with the given
+// radius in pixels. Level 0 is the full detail which is 100 slices
+// for a full circle.
+unsigned ComputeCurveLod(float radius)
+{
+    // unknown size, use full detail.
+    if (radius <= 0.0f)
+        return 0;
+    if (radius <= MaxCurveScreenError)
+        return NumCurveLodLevels - 1;
+    // a chord that spans an angle a deviates from the arc at most
+    // r * (1 - cos(a/2)). solve for the number of slices needed
+    // for the full circle.
+    const auto max_angle = 2.0f * std::acos(1.0f - MaxCurveScreenError / radius);
+    const auto slices = 2.0f * math::Pi / max_angle;
+    unsigned lod = 0;
+    while (lod + 1 < NumCurveLodLevels && (100u >> (lod + 1)) >= slices)
+        ++lod;
+    return lod;
+}
+unsigned GetLodSlices(unsigned max_slices, unsigned lod, unsigned min_slices)
+{ return std::max(max_slices >> lod, min_slices); }
+
+// Get the geometry name suffix for the level of detail. The full
+// detail level has no suffix.
+std::string GetLodName(unsigned lod)
+{
+    if (lod == 0)
+        return "";
+    return "LOD" + std::to_string(lod);
+}
+
 gfx::Shader* MakeVertexArrayShader(gfx::Device& device)
 {
     auto* shader = device.FindShader("vertex-array-shader");
@@ -111,6 +159,520 @@ void main()
     shader->CompileSource(src);
     return shader;
 }
+
+using ParticleClass = gfx::KinematicsParticleEngineClass;
+
+gfx::Shader* MakeParticleShader(gfx::Device& device, ParticleClass::CoordinateSpace space)
+{
+    // this shader doesn't actually write to vTexCoord because when
+    // particle (GL_POINTS) rasterization is done the fragment shader
+    // must use gl_PointCoord instead.
+    constexpr auto* local_src = R"(
+#version 100
+attribute vec2 aPosition;
+attribute vec4 aData;
+
+uniform mat4 kProjectionMatrix;
+uniform mat4 kModelViewMatrix;
+
+varying vec2  vTexCoord;
+varying float vParticleRandomValue;
+varying float vParticleAlpha;
+varying float vParticleTime;
+
+void main()
+{
+    vec4 vertex  = vec4(aPosition.x, aPosition.y, 0.0, 1.0);
+    gl_PointSize = aData.x;
+    vParticleRandomValue = aData.y;
+    vParticleAlpha       = aData.z;
+    vParticleTime        = aData.w;
+    gl_Position  = kProjectionMatrix * kModelViewMatrix * vertex;
+}
+    )";
+
+    constexpr auto* global_src = R"(
+#version 100
+attribute vec2 aPosition;
+attribute vec4 aData;
+
+uniform mat4 kProjectionMatrix;
+uniform mat4 kViewMatrix;
+
+varying vec2 vTexCoord;
+varying float vParticleRandomValue;
+varying float vParticleAlpha;
+varying float vParticleTime;
+
+void main()
+{
+  vec4 vertex = vec4(aPosition.x, aPosition.y, 0.0, 1.0);
+  gl_PointSize = aData.x;
+  vParticleRandomValue = aData.y;
+  vParticleAlpha       = aData.z;
+  vParticleTime        = aData.w;
+  gl_Position  = kProjectionMatrix * kViewMatrix * vertex;
+}
+    )";
+
+    const auto* shader_name = space == ParticleClass::CoordinateSpace::Local
+            ? "LocalParticleShader" : "GlobalParticleShader";
+    const auto* shader_src = space == ParticleClass::CoordinateSpace::Local
+            ? local_src : global_src;
+
+    gfx::Shader* shader = device.FindShader(shader_name);
+    if (!shader)
+    {
+        shader = device.MakeShader(shader_name);
+        shader->SetName(shader_name);
+        shader->CompileSource(shader_src);
+    }
+    return shader;
+}
+
+const gfx::VertexLayout& GetParticleVertexLayout()
+{
+    using ParticleVertex = ParticleClass::ParticleVertex;
+    static const gfx::VertexLayout layout(sizeof(ParticleVertex), {
+        {"aPosition", 0, 2, 0, offsetof(ParticleVertex, aPosition)},
+        {"aData",     0, 4, 0, offsetof(ParticleVertex, aData)}
+    });
+    return layout;
+}
+
+gfx::Shader* MakeAnalyticParticleShader(gfx::Device& device, ParticleClass::CoordinateSpace space)
+{
+    // Compute the particle state from the initial particle state and
+    // the current simulation time. This must produce the same results
+    // as the CPU simulation (UpdateParticle) in the cases where the
+    // analytic simulation can be used.
+    constexpr auto* src = R"(
+attribute vec2  aPosition;
+attribute vec2  aDirection;
+attribute vec4  aData;
+attribute vec4  aTime;
+attribute float aPeriod;
+
+uniform mat4 kProjectionMatrix;
+#ifdef GLOBAL_SPACE
+uniform mat4 kViewMatrix;
+#else
+uniform mat4 kModelViewMatrix;
+#endif
+// the current simulation time since the particles were spawned.
+uniform float kTime;
+uniform vec2  kGravity;
+uniform vec2  kSimulationSize;
+// 0.0 = no boundary, 1.0 = wrap, 2.0 = clamp
+uniform float kBoundaryPolicy;
+uniform float kPixelScale;
+
+varying vec2  vTexCoord;
+varying float vParticleRandomValue;
+varying float vParticleAlpha;
+varying float vParticleTime;
+
+void main()
+{
+    // time since the particle was (last) born.
+    float t = kTime - aTime.z;
+    if (aPeriod > 0.0 && t >= 0.0)
+        t = mod(t, aPeriod);
+
+    vec2 position = aPosition + aDirection * t + 0.5 * kGravity * t * t;
+    if (kBoundaryPolicy == 1.0)
+        position = mod(position, kSimulationSize);
+    else if (kBoundaryPolicy == 2.0)
+        position = clamp(position, vec2(0.0), kSimulationSize);
+
+    vec4 vertex = vec4(position / kSimulationSize, 0.0, 1.0);
+    vParticleRandomValue = aData.y;
+    vParticleAlpha       = min(aData.z + aTime.y * t, 1.0);
+    vParticleTime        = t / aData.w;
+#ifdef GLOBAL_SPACE
+    gl_Position  = kProjectionMatrix * kViewMatrix * vertex;
+#else
+    gl_Position  = kProjectionMatrix * kModelViewMatrix * vertex;
+#endif
+    gl_PointSize = (aData.x + aTime.x * t) * kPixelScale;
+
+    // particle is not yet born or is already dead. move the vertex
+    // outside the clip volume so that it doesn't produce any fragments.
+    if (t < 0.0 || t >= aTime.w)
+    {
+        gl_Position  = vec4(2.0, 2.0, 2.0, 1.0);
+        gl_PointSize = 0.0;
+    }
+}
+    )";
+
+    const auto* shader_name = space == ParticleClass::CoordinateSpace::Local
+            ? "LocalAnalyticParticleShader" : "GlobalAnalyticParticleShader";
+
+    gfx::Shader* shader = device.FindShader(shader_name);
+    if (!shader)
+    {
+        std::string source = "#version 100\n";
+        if (space == ParticleClass::CoordinateSpace::Global)
+            source += "#define GLOBAL_SPACE\n";
+        source += src;
+
+        shader = device.MakeShader(shader_name);
+        shader->SetName(shader_name);
+        shader->CompileSource(source);
+    }
+    return shader;
+}
+
+const gfx::VertexLayout& GetAnalyticParticleVertexLayout()
+{
+    using ParticleVertex = ParticleClass::AnalyticParticleVertex;
+    static const gfx::VertexLayout layout(sizeof(ParticleVertex), {
+        {"aPosition",  0, 2, 0, offsetof(ParticleVertex, aPosition)},
+        {"aDirection", 0, 2, 0, offsetof(ParticleVertex, aDirection)},
+        {"aData",      0, 4, 0, offsetof(ParticleVertex, aData)},
+        {"aTime",      0, 4, 0, offsetof(ParticleVertex, aTime)},
+        {"aPeriod",    0, 1, 0, offsetof(ParticleVertex, aPeriod)}
+    });
+    return layout;
+}
+
+// The maximum number of particles for the analytic simulation with
+// continuous spawning, i.e. the particle rate times the lifetime.
+constexpr auto MaxAnalyticParticles = 1u << 16;
+// The analytic particle time values for particles that never die.
+constexpr auto AnalyticNeverDies = 1.0e9f;
+
+// Get the number of particles needed for the analytic simulation
+// with continuous spawning.
+double GetNumContinuousAnalyticParticles(const ParticleClass::Params& params)
+{
+    return std::ceil(double(params.num_particles) * double(params.max_lifetime));
+}
+
+// Compute the time it takes for a particle that starts at pos moving
+// with velocity to exit the [0, max] range.
+float ComputeExitTime(float pos, float velocity, float max)
+{
+    if (pos < 0.0f || pos > max)
+        return 0.0f;
+    if (velocity > 0.0f)
+        return (max - pos) / velocity;
+    else if (velocity < 0.0f)
+        return pos / -velocity;
+    return AnalyticNeverDies;
+}
+
+
+#if defined(GFX_PARTICLE_SIMD_SSE2) || defined(GFX_PARTICLE_SIMD_NEON)
+bool EnableParticleSIMD = true;
+#else
+bool EnableParticleSIMD = false;
+#endif
+
+// Reflect the particle's direction vector at the simulation boundary
+// when the particle is at the boundary.
+void ReflectParticle(const ParticleClass::Params& params, glm::vec2& position, glm::vec2& direction)
+{
+    glm::vec2 n;
+    if (position.x <= 0.0f)
+        n = glm::vec2(1.0f, 0.0f);
+    else if (position.x >= params.max_xpos)
+        n = glm::vec2(-1.0f, 0.0f);
+    else if (position.y <= 0.0f)
+        n = glm::vec2(0, 1.0f);
+    else if (position.y >= params.max_ypos)
+        n = glm::vec2(0, -1.0f);
+    else return;
+    // compute new direction vector given the normal vector of the boundary
+    // and then bake the velocity in the new direction
+    const auto& d = glm::normalize(direction);
+    const float v = glm::length(direction);
+    direction = (d - 2 * glm::dot(d, n) * n) * v;
+
+    // clamp the position in order to eliminate the situation
+    // where the object has moved beyond the boundaries of the simulation
+    // and is stuck there alternating it's direction vector
+    position.x = math::clamp(0.0f, params.max_xpos, position.x);
+    position.y = math::clamp(0.0f, params.max_ypos, position.y);
+}
+
+// Update a single particle. Returns false if the particle died.
+bool UpdateParticle(const ParticleClass::Params& params, ParticleClass::Particle& p, float dt)
+{
+    using Motion = ParticleClass::Motion;
+    using BoundaryPolicy = ParticleClass::BoundaryPolicy;
+    using CoordinateSpace = ParticleClass::CoordinateSpace;
+
+    p.time += dt;
+    if (p.time > p.time_scale * params.max_lifetime)
+        return false;
+
+    const auto p0 = p.position;
+
+    // update change in position
+    if (params.motion == Motion::Linear)
+        p.position += (p.direction * dt);
+    else if (params.motion == Motion::Projectile)
+    {
+        p.position += (p.direction * dt);
+        p.direction += (dt * params.gravity);
+    }
+
+    const auto& p1 = p.position;
+    const auto& dp = p1 - p0;
+    const auto  dd = glm::length(dp);
+
+    // Update particle size with respect to time and distance
+    p.pointsize += (dt * params.rate_of_change_in_size_wrt_time * p.time_scale);
+    p.pointsize += (dd * params.rate_of_change_in_size_wrt_dist);
+    if (p.pointsize <= 0.0f)
+        return false;
+
+    // update particle alpha value with respect to time and distance.
+    p.alpha += (dt * params.rate_of_change_in_alpha_wrt_time * p.time_scale);
+    p.alpha += (dt * params.rate_of_change_in_alpha_wrt_dist);
+    if (p.alpha <= 0.0f)
+        return false;
+    p.alpha = math::clamp(0.0f, 1.0f, p.alpha);
+
+    // accumulate distance approximation
+    p.distance += dd;
+
+    // todo:
+    if (params.coordinate_space == CoordinateSpace::Global)
+        return true;
+
+    // boundary conditions.
+    if (params.boundary == BoundaryPolicy::Wrap)
+    {
+        p.position.x = math::wrap(0.0f, params.max_xpos, p.position.x);
+        p.position.y = math::wrap(0.0f, params.max_ypos, p.position.y);
+    }
+    else if (params.boundary == BoundaryPolicy::Clamp)
+    {
+        p.position.x = math::clamp(0.0f, params.max_xpos, p.position.x);
+        p.position.y = math::clamp(0.0f, params.max_ypos, p.position.y);
+    }
+    else if (params.boundary == BoundaryPolicy::Kill)
+    {
+        if (p.position.x < 0.0f || p.position.x > params.max_xpos)
+            return false;
+        else if (p.position.y < 0.0f || p.position.y > params.max_ypos)
+            return false;
+    }
+    else if (params.boundary == BoundaryPolicy::Reflect)
+    {
+        ReflectParticle(params, p.position, p.direction);
+    }
+    return true;
+}
+
+// Thin wrappers over the 4 wide float SIMD operations that are needed
+// for the particle update so that the same update kernel can be used
+// for both SSE2 and NEON.
+#if defined(GFX_PARTICLE_SIMD_SSE2)
+using float4 = __m128;
+using mask4  = __m128;
+inline float4 Load(const float* ptr)
+{ return _mm_loadu_ps(ptr); }
+inline void Store(float* ptr, float4 value)
+{ _mm_storeu_ps(ptr, value); }
+inline float4 Splat(float value)
+{ return _mm_set1_ps(value); }
+inline float4 Add(float4 a, float4 b)
+{ return _mm_add_ps(a, b); }
+inline float4 Sub(float4 a, float4 b)
+{ return _mm_sub_ps(a, b); }
+inline float4 Mul(float4 a, float4 b)
+{ return _mm_mul_ps(a, b); }
+inline float4 Sqrt(float4 a)
+{ return _mm_sqrt_ps(a); }
+inline mask4 Less(float4 a, float4 b)
+{ return _mm_cmplt_ps(a, b); }
+inline mask4 LessEqual(float4 a, float4 b)
+{ return _mm_cmple_ps(a, b); }
+inline mask4 Greater(float4 a, float4 b)
+{ return _mm_cmpgt_ps(a, b); }
+inline mask4 GreaterEqual(float4 a, float4 b)
+{ return _mm_cmpge_ps(a, b); }
+inline mask4 Or(mask4 a, mask4 b)
+{ return _mm_or_ps(a, b); }
+// Select a where the mask is set, otherwise b.
+inline float4 Select(mask4 mask, float4 a, float4 b)
+{ return _mm_or_ps(_mm_and_ps(mask, a), _mm_andnot_ps(mask, b)); }
+// Get the mask lanes as bits, lane 0 in bit 0.
+inline unsigned GetBits(mask4 mask)
+{ return (unsigned)_mm_movemask_ps(mask); }
+#elif defined(GFX_PARTICLE_SIMD_NEON)
+using float4 = float32x4_t;
+using mask4  = uint32x4_t;
+inline float4 Load(const float* ptr)
+{ return vld1q_f32(ptr); }
+inline void Store(float* ptr, float4 value)
+{ vst1q_f32(ptr, value); }
+inline float4 Splat(float value)
+{ return vdupq_n_f32(value); }
+inline float4 Add(float4 a, float4 b)
+{ return vaddq_f32(a, b); }
+inline float4 Sub(float4 a, float4 b)
+{ return vsubq_f32(a, b); }
+inline float4 Mul(float4 a, float4 b)
+{ return vmulq_f32(a, b); }
+inline float4 Sqrt(float4 a)
+{ return vsqrtq_f32(a); }
+inline mask4 Less(float4 a, float4 b)
+{ return vcltq_f32(a, b); }
+inline mask4 LessEqual(float4 a, float4 b)
+{ return vcleq_f32(a, b); }
+inline mask4 Greater(float4 a, float4 b)
+{ return vcgtq_f32(a, b); }
+inline mask4 GreaterEqual(float4 a, float4 b)
+{ return vcgeq_f32(a, b); }
+inline mask4 Or(mask4 a, mask4 b)
+{ return vorrq_u32(a, b); }
+inline float4 Select(mask4 mask, float4 a, float4 b)
+{ return vbslq_f32(mask, a, b); }
+inline unsigned GetBits(mask4 mask)
+{
+    std::uint32_t lanes[4];
+    vst1q_u32(lanes, mask);
+    return (lanes[0] & 1) | ((lanes[1] & 1) << 1) | ((lanes[2] & 1) << 2) | ((lanes[3] & 1) << 3);
+}
+#endif
+
+#if defined(GFX_PARTICLE_SIMD_SSE2) || defined(GFX_PARTICLE_SIMD_NEON)
+// Update the particles 4 at a time. This is the vectorized version of
+// UpdateParticle and performs exactly the same floating point operations
+// in the same order so that the results are identical. Returns the number
+// of particles processed which is a multiple of 4. The remaining tail
+// must be processed with the scalar UpdateParticle.
+std::size_t UpdateParticlesSIMD(const ParticleClass::Params& params, ParticleClass::ParticleArray& particles,
+                                std::uint8_t* alive, float dt)
+{
+    using Motion = ParticleClass::Motion;
+    using BoundaryPolicy = ParticleClass::BoundaryPolicy;
+    using CoordinateSpace = ParticleClass::CoordinateSpace;
+
+    const auto count = particles.size() & ~std::size_t(3);
+    const auto projectile = params.motion == Motion::Projectile;
+    const auto boundary   = params.coordinate_space == CoordinateSpace::Local;
+
+    const auto zero = Splat(0.0f);
+    const auto one  = Splat(1.0f);
+    const auto time_step = Splat(dt);
+    const auto max_lifetime = Splat(params.max_lifetime);
+    const auto max_xpos = Splat(params.max_xpos);
+    const auto max_ypos = Splat(params.max_ypos);
+    // the scalar code evaluates these as (dt * rate) * time_scale
+    // so precomputing the first product doesn't change the result.
+    const auto gravity_x = Splat(dt * params.gravity.x);
+    const auto gravity_y = Splat(dt * params.gravity.y);
+    const auto size_wrt_time  = Splat(dt * params.rate_of_change_in_size_wrt_time);
+    const auto size_wrt_dist  = Splat(params.rate_of_change_in_size_wrt_dist);
+    const auto alpha_wrt_time = Splat(dt * params.rate_of_change_in_alpha_wrt_time);
+    const auto alpha_wrt_dist = Splat(dt * params.rate_of_change_in_alpha_wrt_dist);
+
+    float* position_x  = particles.position_x.data();
+    float* position_y  = particles.position_y.data();
+    float* direction_x = particles.direction_x.data();
+    float* direction_y = particles.direction_y.data();
+    float* pointsize   = particles.pointsize.data();
+    float* time        = particles.time.data();
+    float* distance    = particles.distance.data();
+    float* alpha       = particles.alpha.data();
+    const float* time_scale = particles.time_scale.data();
+
+    for (std::size_t i=0; i<count; i+=4)
+    {
+        const auto t  = Add(Load(time + i), time_step);
+        const auto ts = Load(time_scale + i);
+        auto dead = Greater(t, Mul(ts, max_lifetime));
+
+        const auto x0 = Load(position_x + i);
+        const auto y0 = Load(position_y + i);
+        auto dx = Load(direction_x + i);
+        auto dy = Load(direction_y + i);
+        auto x1 = Add(x0, Mul(dx, time_step));
+        auto y1 = Add(y0, Mul(dy, time_step));
+        if (projectile)
+        {
+            dx = Add(dx, gravity_x);
+            dy = Add(dy, gravity_y);
+        }
+        const auto dpx = Sub(x1, x0);
+        const auto dpy = Sub(y1, y0);
+        const auto dd  = Sqrt(Add(Mul(dpx, dpx), Mul(dpy, dpy)));
+
+        auto size = Load(pointsize + i);
+        size = Add(size, Mul(size_wrt_time, ts));
+        size = Add(size, Mul(dd, size_wrt_dist));
+        dead = Or(dead, LessEqual(size, zero));
+
+        auto a = Load(alpha + i);
+        a = Add(a, Mul(alpha_wrt_time, ts));
+        a = Add(a, alpha_wrt_dist);
+        dead = Or(dead, LessEqual(a, zero));
+        a = Select(Less(a, zero), zero, Select(Greater(a, one), one, a));
+
+        const auto dist = Add(Load(distance + i), dd);
+
+        unsigned reflect = 0;
+        if (boundary && params.boundary == BoundaryPolicy::Wrap)
+        {
+            x1 = Select(Greater(x1, max_xpos), zero, Select(Less(x1, zero), max_xpos, x1));
+            y1 = Select(Greater(y1, max_ypos), zero, Select(Less(y1, zero), max_ypos, y1));
+        }
+        else if (boundary && params.boundary == BoundaryPolicy::Clamp)
+        {
+            x1 = Select(Less(x1, zero), zero, Select(Greater(x1, max_xpos), max_xpos, x1));
+            y1 = Select(Less(y1, zero), zero, Select(Greater(y1, max_ypos), max_ypos, y1));
+        }
+        else if (boundary && params.boundary == BoundaryPolicy::Kill)
+        {
+            dead = Or(dead, Or(Less(x1, zero), Greater(x1, max_xpos)));
+            dead = Or(dead, Or(Less(y1, zero), Greater(y1, max_ypos)));
+        }
+        else if (boundary && params.boundary == BoundaryPolicy::Reflect)
+        {
+            reflect = GetBits(Or(Or(LessEqual(x1, zero), GreaterEqual(x1, max_xpos)),
+                                 Or(LessEqual(y1, zero), GreaterEqual(y1, max_ypos))));
+        }
+
+        Store(time + i, t);
+        Store(position_x + i, x1);
+        Store(position_y + i, y1);
+        Store(direction_x + i, dx);
+        Store(direction_y + i, dy);
+        Store(pointsize + i, size);
+        Store(alpha + i, a);
+        Store(distance + i, dist);
+
+        const auto dead_bits = GetBits(dead);
+        for (unsigned lane=0; lane<4; ++lane)
+            alive[i + lane] = (dead_bits & (1u << lane)) ? 0 : 1;
+
+        // reflecting particles at the boundary is rare enough that
+        // it's simply done with the scalar code.
+        reflect &= ~dead_bits;
+        for (unsigned lane=0; reflect && lane<4; ++lane)
+        {
+            if (!(reflect & (1u << lane)))
+                continue;
+            const auto index = i + lane;
+            glm::vec2 pos(position_x[index], position_y[index]);
+            glm::vec2 dir(direction_x[index], direction_y[index]);
+            ReflectParticle(params, pos, dir);
+            position_x[index]  = pos.x;
+            position_y[index]  = pos.y;
+            direction_x[index] = dir.x;
+            direction_y[index] = dir.y;
+        }
+    }
+    return count;
+}
+#endif
+
 } // namespace
 
 namespace gfx {
@@ -232,8 +794,9 @@ Geometry* CapsuleGeometry::Generate(const Environment& env, Style style, Device&
     if (style == Style::Points)
         return nullptr;
 
-    // todo LOD information
-    const auto slices = 50;
+    // the end caps have a radius of quarter of the shorter side.
+    const auto lod = ComputeCurveLod(std::min(env.screen_size.x, env.screen_size.y) * 0.25f);
+    const auto slices = GetLodSlices(50, lod, 3);
     const auto radius = 0.25f;
     const auto max_slice = style == Style::Solid ? slices + 1 : slices;
     const auto angle_increment = math::Pi / slices;
@@ -260,6 +823,7 @@ Geometry* CapsuleGeometry::Generate(const Environment& env, Style style, Device&
         name = "Capsule";
     else BUG("???");
     name += NameAspectRatio(rect_width, rect_height, HalfRound, "%1.1f:%1.1f");
+    name += GetLodName(lod);
 
     Geometry* geom = device.FindGeometry(name);
     if (!geom)
@@ -398,12 +962,12 @@ Geometry* SemiCircleGeometry::Generate(const Environment& env, Style style, Devi
     if (style == Style::Points)
         return nullptr;
 
-    // todo: we could use some information here about the
-    // eventual transform on the screen and use that to compute
-    // some kind of "LOD" value for figuring out how many slices we should have.
-    const auto slices = 50;
-    const auto* name = style == Style::Outline   ? "SemiCircleOutline" :
-                       (style == Style::Wireframe ? "SemiCircleWireframe" : "SemiCircle");
+    // use the size of the shape on the screen to figure out
+    // how many slices are needed.
+    const auto lod = ComputeCurveLod(std::max(env.screen_size.x, env.screen_size.y) * 0.5f);
+    const auto slices = GetLodSlices(50, lod, 3);
+    const auto& name = std::string(style == Style::Outline   ? "SemiCircleOutline" :
+                                  (style == Style::Wireframe ? "SemiCircleWireframe" : "SemiCircle")) + GetLodName(lod);
 
     Geometry* geom = device.FindGeometry(name);
     if (!geom)
@@ -472,12 +1036,12 @@ Geometry* CircleGeometry::Generate(const Environment& env, Style style, Device&
     if (style == Style::Points)
         return nullptr;
 
-    // todo: we could use some information here about the
-    // eventual transform on the screen and use that to compute
-    // some kind of "LOD" value for figuring out how many slices we should have.
-    const auto slices = 100;
-    const auto* name = style == Style::Outline   ? "CircleOutline" :
-                      (style == Style::Wireframe ? "CircleWireframe" : "Circle");
+    // use the size of the shape on the screen to figure out
+    // how many slices are needed.
+    const auto lod = ComputeCurveLod(std::max(env.screen_size.x, env.screen_size.y) * 0.5f);
+    const auto slices = GetLodSlices(100, lod, 6);
+    const auto& name = std::string(style == Style::Outline   ? "CircleOutline" :
+                                  (style == Style::Wireframe ? "CircleWireframe" : "Circle")) + GetLodName(lod);
 
     Geometry* geom = device.FindGeometry(name);
     if (!geom)
@@ -774,8 +1338,9 @@ Geometry* SectorClass::Upload(const Environment& environment, Style style, Devic
     if (style == Style::Points)
         return nullptr;
 
-    const auto* name = style == Style::Outline   ? "SectorOutline"   :
-                      (style == Style::Wireframe ? "SectorWireframe" : "Sector");
+    const auto lod = ComputeCurveLod(std::max(environment.screen_size.x, environment.screen_size.y) * 0.5f);
+    const auto& name = std::string(style == Style::Outline   ? "SectorOutline"   :
+                                  (style == Style::Wireframe ? "SectorWireframe" : "Sector")) + GetLodName(lod);
     Geometry* geom = device.FindGeometry(name);
     if (!geom)
     {
@@ -791,7 +1356,7 @@ Geometry* SectorClass::Upload(const Environment& environment, Style style, Devic
         {
             vs.push_back(center);
         }
-        const auto slices    = 100 * mPercentage;
+        const auto slices    = std::max(GetLodSlices(100, lod, 6) * mPercentage, 1.0f);
         const auto angle_max = math::Pi * 2.0 * mPercentage;
         const auto angle_inc = angle_max / slices;
         const auto max_slice = style == Style::Wireframe ? slices : slices + 1;
@@ -886,7 +1451,9 @@ Geometry* RoundRectangleClass::Upload(const Drawable::Environment& env, Drawable
         w = h / (rect_width/rect_height);
     else h = w / (rect_height/rect_width);
 
-    const auto slices    = 20;
+    // the corner radius is relative to the shorter side.
+    const auto lod = ComputeCurveLod(std::min(env.screen_size.x, env.screen_size.y) * mRadius);
+    const auto slices    = GetLodSlices(20, lod, 2);
     const auto increment = (float)(math::Pi * 0.5  / slices); // each corner is a quarter circle, i.e. half pi rad
 
     Geometry* geom = nullptr;
@@ -914,6 +1481,7 @@ Geometry* RoundRectangleClass::Upload(const Drawable::Environment& env, Drawable
     // for the generated geometry so that we can keep some of these
     // around and not have to regenerate the geometry all the time.
     name += NameAspectRatio(rect_width, rect_height, Truncate, "%d:%d");
+    name += GetLodName(lod);
 
     if (style == Style::Outline)
     {
@@ -1549,6 +2117,13 @@ Geometry* Cursor::Upload(const Environment& env, Device& device) const
 
 std::string KinematicsParticleEngineClass::GetProgramId() const
 {
+    if (IsAnalytic())
+    {
+        if (mParams.coordinate_space == CoordinateSpace::Local)
+            return "local-analytic-particle-program";
+        else if (mParams.coordinate_space == CoordinateSpace::Global)
+            return "global-analytic-particle-program";
+    }
     if (mParams.coordinate_space == CoordinateSpace::Local)
         return "local-particle-program";
     else if (mParams.coordinate_space == CoordinateSpace::Global)
@@ -1559,79 +2134,60 @@ std::string KinematicsParticleEngineClass::GetProgramId() const
 
 Shader* KinematicsParticleEngineClass::GetShader(Device& device) const
 {
-    // this shader doesn't actually write to vTexCoord because when
-    // particle (GL_POINTS) rasterization is done the fragment shader
-    // must use gl_PointCoord instead.
-    constexpr auto* local_src = R"(
-#version 100
-attribute vec2 aPosition;
-attribute vec4 aData;
-
-uniform mat4 kProjectionMatrix;
-uniform mat4 kModelViewMatrix;
-
-varying vec2  vTexCoord;
-varying float vParticleRandomValue;
-varying float vParticleAlpha;
-varying float vParticleTime;
-
-void main()
-{
-    vec4 vertex  = vec4(aPosition.x, aPosition.y, 0.0, 1.0);
-    gl_PointSize = aData.x;
-    vParticleRandomValue = aData.y;
-    vParticleAlpha       = aData.z;
-    vParticleTime        = aData.w;
-    gl_Position  = kProjectionMatrix * kModelViewMatrix * vertex;
+    if (IsAnalytic())
+        return MakeAnalyticParticleShader(device, mParams.coordinate_space);
+    return MakeParticleShader(device, mParams.coordinate_space);
 }
-    )";
-
-    constexpr auto* global_src = R"(
-#version 100
-attribute vec2 aPosition;
-attribute vec4 aData;
 
-uniform mat4 kProjectionMatrix;
-uniform mat4 kViewMatrix;
-
-varying vec2 vTexCoord;
-varying float vParticleRandomValue;
-varying float vParticleAlpha;
-varying float vParticleTime;
-
-void main()
+Geometry* KinematicsParticleEngineClass::Upload(const Drawable::Environment& env, const InstanceState& state, Device& device) const
 {
-  vec4 vertex = vec4(aPosition.x, aPosition.y, 0.0, 1.0);
-  gl_PointSize = aData.x;
-  vParticleRandomValue = aData.y;
-  vParticleAlpha       = aData.z;
-  vParticleTime        = aData.w;
-  gl_Position  = kProjectionMatrix * kViewMatrix * vertex;
-}
-    )";
-
-    const auto* shader_name = mParams.coordinate_space == CoordinateSpace::Local
-            ? "LocalParticleShader" : "GlobalParticleShader";
-    const auto* shader_src = mParams.coordinate_space == CoordinateSpace::Local
-            ? local_src : global_src;
-
-    Shader* shader = device.FindShader(shader_name);
-    if (!shader)
+    if (IsAnalytic())
     {
-        shader = device.MakeShader(shader_name);
-        shader->SetName(shader_name);
-        shader->CompileSource(shader_src);
+        // nothing to draw before the particles are spawned or
+        // after the simulation has ended.
+        if (state.analytic.empty() || state.time < state.delay || state.time >= mParams.max_time)
+            return nullptr;
+
+        // the initial particle attributes only need to be uploaded
+        // once after the simulation has been (re)started.
+        Geometry* geom = device.FindGeometry(state.analytic_geometry);
+        if (!geom)
+        {
+            geom = device.MakeGeometry(state.analytic_geometry);
+        }
+        if (geom->GetDataHash() != state.analytic_hash)
+        {
+            geom->Upload(state.analytic.data(), state.analytic.size() * sizeof(AnalyticParticleVertex), Geometry::Usage::Static);
+            geom->SetVertexLayout(GetAnalyticParticleVertexLayout());
+            geom->SetDataHash(state.analytic_hash);
+            geom->ClearDraws();
+            geom->AddDrawCmd(Geometry::DrawType::Points);
+        }
+        return geom;
     }
-    return shader;
-}
 
-Geometry* KinematicsParticleEngineClass::Upload(const Drawable::Environment& env, const InstanceState& state, Device& device) const
-{
     Geometry* geom = device.FindGeometry("particle-buffer");
     if (!geom)
     {
         geom = device.MakeGeometry("particle-buffer");
     }
+    // the vertex scratch space is shared by all the particle engines
+    // drawn on this thread so that uploading doesn't allocate every frame.
+    static thread_local std::vector<ParticleVertex> verts;
+    verts.clear();
+    AppendVertices(env, state, nullptr, &verts);
+
+    geom->Upload(verts.data(), verts.size() * sizeof(ParticleVertex), Geometry::Usage::Stream);
+    geom->SetVertexLayout(GetParticleVertexLayout());
+    geom->ClearDraws();
+    geom->AddDrawCmd(Geometry::DrawType::Points);
+    return geom;
+}
+
+void KinematicsParticleEngineClass::AppendVertices(const Environment& env, const InstanceState& state,
+                                                   const glm::mat4* model_to_world,
+                                                   std::vector<ParticleVertex>* vertices) const
+{
     // the point rasterization doesn't support non-uniform
     // sizes for the points, i.e. they're always square
     // so therefore we must choose one of the pixel ratio values
@@ -1639,48 +2195,69 @@ Geometry* KinematicsParticleEngineClass::Upload(const Drawable::Environment& env
     // based sizes
     const auto pixel_scaler = std::min(env.pixel_ratio.x, env.pixel_ratio.y);
 
-    struct ParticleVertex {
-        Vec2 aPosition;
-        Vec4 aData;
-    };
-    static const VertexLayout layout(sizeof(ParticleVertex), {
-        {"aPosition", 0, 2, 0, offsetof(ParticleVertex, aPosition)},
-        {"aData",     0, 4, 0, offsetof(ParticleVertex, aData)}
-    });
+    // particles in the global space are already in the world space.
+    if (mParams.coordinate_space == CoordinateSpace::Global)
+        model_to_world = nullptr;
+
+    const auto& particles = state.particles;
+    const auto offset = vertices->size();
 
-    std::vector<ParticleVertex> verts;
-    for (const auto& p : state.particles)
+    vertices->resize(offset + particles.size());
+    for (size_t i=0; i<particles.size(); ++i)
     {
         // When using local coordinate space the max x/y should
         // be the extents of the simulation in which case the
         // particle x,y become normalized on the [0.0f, 1.0f] range.
         // when using global coordinate space max x/y should be 1.0f
         // and particle coordinates are left in the global space
-        ParticleVertex v;
-        v.aPosition.x = p.position.x / mParams.max_xpos;
-        v.aPosition.y = p.position.y / mParams.max_ypos;
+        auto& v = (*vertices)[offset + i];
+        v.aPosition.x = particles.position_x[i] / mParams.max_xpos;
+        v.aPosition.y = particles.position_y[i] / mParams.max_ypos;
+        if (model_to_world)
+        {
+            const auto& world = (*model_to_world) * glm::vec4(v.aPosition.x, v.aPosition.y, 0.0f, 1.0f);
+            v.aPosition.x = world.x;
+            v.aPosition.y = world.y;
+        }
         // copy the per particle data into the data vector for the fragment shader.
-        v.aData.x = p.pointsize >= 0.0f ? p.pointsize * pixel_scaler : 0.0f;
+        const auto pointsize = particles.pointsize[i];
+        v.aData.x = pointsize >= 0.0f ? pointsize * pixel_scaler : 0.0f;
         // abusing texcoord here to provide per particle random value.
         // we can use this to simulate particle rotation for example
         // (if the material supports it)
-        v.aData.y = p.randomizer;
+        v.aData.y = particles.randomizer[i];
         // Use the particle data to pass the per particle alpha.
-        v.aData.z = p.alpha;
+        v.aData.z = particles.alpha[i];
         // use the particle data to pass the per particle time.
-        v.aData.w = p.time / (p.time_scale * mParams.max_lifetime);
-        verts.push_back(v);
+        v.aData.w = particles.time[i] / (particles.time_scale[i] * mParams.max_lifetime);
     }
-
-    geom->SetVertexBuffer(std::move(verts), Geometry::Usage::Stream);
-    geom->SetVertexLayout(layout);
-    geom->ClearDraws();
-    geom->AddDrawCmd(Geometry::DrawType::Points);
-    return geom;
 }
 
-void KinematicsParticleEngineClass::ApplyDynamicState(const Environment& env, Program& program) const
+void KinematicsParticleEngineClass::ApplyDynamicState(const Environment& env, const InstanceState& state, Program& program) const
 {
+    if (IsAnalytic())
+    {
+        // the boundary conditions only apply in the local coordinate space.
+        // the kill boundary is already baked into the particle time of death.
+        float boundary = 0.0f;
+        if (mParams.coordinate_space == CoordinateSpace::Local)
+        {
+            if (mParams.boundary == BoundaryPolicy::Wrap)
+                boundary = 1.0f;
+            else if (mParams.boundary == BoundaryPolicy::Clamp)
+                boundary = 2.0f;
+        }
+        const auto gravity = mParams.motion == Motion::Projectile
+                             ? mParams.gravity : glm::vec2(0.0f, 0.0f);
+        // see AppendVertices about the point size scaling.
+        const auto pixel_scaler = std::min(env.pixel_ratio.x, env.pixel_ratio.y);
+        program.SetUniform("kTime", state.time - state.delay);
+        program.SetUniform("kGravity", gravity.x, gravity.y);
+        program.SetUniform("kSimulationSize", mParams.max_xpos, mParams.max_ypos);
+        program.SetUniform("kBoundaryPolicy", boundary);
+        program.SetUniform("kPixelScale", pixel_scaler);
+    }
+
     if (mParams.coordinate_space == CoordinateSpace::Global)
     {
         // when the coordinate space is global the particles are spawn directly
@@ -1735,6 +2312,14 @@ void KinematicsParticleEngineClass::Update(const Environment& env, InstanceState
         return;
     }
 
+    // the particle state is computed in the vertex shader based on
+    // the simulation time.
+    if (IsAnalytic())
+    {
+        state.time += dt;
+        return;
+    }
+
     if (state.time < state.delay)
     {
         if (state.time + dt > state.delay)
@@ -1748,15 +2333,7 @@ void KinematicsParticleEngineClass::Update(const Environment& env, InstanceState
 
 
     // update each particle
-    for (size_t i=0; i<state.particles.size();)
-    {
-        if (UpdateParticle(env, state, i, dt))
-        {
-            ++i;
-            continue;
-        }
-        KillParticle(state, i);
-    }
+    UpdateParticles(state, dt);
 
     // Spawn new particles if needed.
     if (mParams.mode == SpawnPolicy::Maintain)
@@ -1796,9 +2373,41 @@ bool KinematicsParticleEngineClass::IsAlive(const InstanceState& state) const
         mParams.mode == SpawnPolicy::Maintain)
         return true;
 
+    if (IsAnalytic())
+        return state.time - state.delay < state.analytic_end_time;
+
     return !state.particles.empty();
 }
 
+bool KinematicsParticleEngineClass::IsAnalytic() const
+{
+    if (mParams.simulation != Simulation::Analytic)
+        return false;
+
+    // the boundary conditions only apply in the local coordinate space.
+    const auto local = mParams.coordinate_space == CoordinateSpace::Local;
+    if (local && mParams.boundary == BoundaryPolicy::Reflect)
+        return false;
+
+    if (mParams.motion == Motion::Projectile)
+    {
+        // the projectile path isn't monotonic so the clamping can't be
+        // done at the end and the exit time would need solving quadratics.
+        if (local && (mParams.boundary == BoundaryPolicy::Clamp ||
+                      mParams.boundary == BoundaryPolicy::Kill))
+            return false;
+        // the distance travelled along the curved path isn't simple.
+        if (mParams.rate_of_change_in_size_wrt_dist != 0.0f)
+            return false;
+    }
+    if (mParams.mode == SpawnPolicy::Continuous)
+    {
+        if (GetNumContinuousAnalyticParticles(mParams) > MaxAnalyticParticles)
+            return false;
+    }
+    return true;
+}
+
 // ParticleEngine implementation. Restart the simulation
 // with the previous parameters.
 void KinematicsParticleEngineClass::Restart(const Environment& env, InstanceState& state) const
@@ -1807,6 +2416,13 @@ void KinematicsParticleEngineClass::Restart(const Environment& env, InstanceStat
     state.delay = mParams.delay;
     state.time  = 0.0f;
     state.hatching = 0.0f;
+    state.analytic.clear();
+    state.analytic_end_time = 0.0f;
+    if (IsAnalytic())
+    {
+        InitAnalyticParticles(env, state);
+        return;
+    }
     // if the spawn policy is continuous the num particles
     // is a rate of particles per second. in order to avoid
     // a massive initial burst of particles skip the init here
@@ -1828,6 +2444,7 @@ void KinematicsParticleEngineClass::IntoJson(data::Writer& data) const
     data.Write("coordinate_space", mParams.coordinate_space);
     data.Write("motion", mParams.motion);
     data.Write("mode", mParams.mode);
+    data.Write("simulation", mParams.simulation);
     data.Write("boundary", mParams.boundary);
     data.Write("delay", mParams.delay);
     data.Write("min_time", mParams.min_time);
@@ -1878,6 +2495,7 @@ std::optional<KinematicsParticleEngineClass> KinematicsParticleEngineClass::From
     data.Read("coordinate_space",             &ret.mParams.coordinate_space);
     data.Read("motion",                       &ret.mParams.motion);
     data.Read("mode",                         &ret.mParams.mode);
+    data.Read("simulation",                   &ret.mParams.simulation);
     data.Read("boundary",                     &ret.mParams.boundary);
     data.Read("delay",                        &ret.mParams.delay);
     data.Read("min_time",                     &ret.mParams.min_time);
@@ -2125,99 +2743,280 @@ void KinematicsParticleEngineClass::InitParticles(const Environment& env, Instan
         }
     } else BUG("Unhandled particle system coordinate space.");
 }
-void KinematicsParticleEngineClass::KillParticle(InstanceState& state, size_t i) const
+void KinematicsParticleEngineClass::InitAnalyticParticles(const Environment& env, InstanceState& state) const
 {
-    const auto last = state.particles.size() - 1;
-    std::swap(state.particles[i], state.particles[last]);
-    state.particles.pop_back();
-}
-
-bool KinematicsParticleEngineClass::UpdateParticle(const Environment& env, InstanceState& state, size_t i, float dt) const
-{
-    auto& p = state.particles[i];
-
-    p.time += dt;
-    if (p.time > p.time_scale * mParams.max_lifetime)
-        return false;
-
-    const auto p0 = p.position;
-
-    // update change in position
-    if (mParams.motion == Motion::Linear)
-        p.position += (p.direction * dt);
-    else if (mParams.motion == Motion::Projectile)
+    // with continuous spawning the particles are born at a fixed rate
+    // and once every particle has been born the first particle is born
+    // again. The period is long enough for any particle to die before
+    // it's born again.
+    auto count = size_t(mParams.num_particles);
+    auto birth_interval = 0.0f;
+    auto period = 0.0f;
+    if (mParams.mode == SpawnPolicy::Continuous)
     {
-        p.position += (p.direction * dt);
-        p.direction += (dt * mParams.gravity);
+        count = size_t(GetNumContinuousAnalyticParticles(mParams));
+        birth_interval = 1.0f / mParams.num_particles;
+        period = count * birth_interval;
     }
 
-    const auto& p1 = p.position;
-    const auto& dp = p1 - p0;
-    const auto  dd = glm::length(dp);
+    // use the normal particle initialization for the initial particle
+    // state and then work out the rest of the particle's life from that.
+    InitParticles(env, state, count);
 
-    // Update particle size with respect to time and distance
-    p.pointsize += (dt * mParams.rate_of_change_in_size_wrt_time * p.time_scale);
-    p.pointsize += (dd * mParams.rate_of_change_in_size_wrt_dist);
-    if (p.pointsize <= 0.0f)
-        return false;
-
-    // update particle alpha value with respect to time and distance.
-    p.alpha += (dt * mParams.rate_of_change_in_alpha_wrt_time * p.time_scale);
-    p.alpha += (dt * mParams.rate_of_change_in_alpha_wrt_dist);
-    if (p.alpha <= 0.0f)
-        return false;
-    p.alpha = math::clamp(0.0f, 1.0f, p.alpha);
-
-    // accumulate distance approximation
-    p.distance += dd;
+    const auto& particles = state.particles;
+    const auto local = mParams.coordinate_space == CoordinateSpace::Local;
+    const auto kill  = local && mParams.boundary == BoundaryPolicy::Kill;
 
-    // todo:
-    if (mParams.coordinate_space == CoordinateSpace::Global)
-        return true;
+    state.analytic.resize(particles.size());
+    state.analytic_end_time = 0.0f;
+    for (size_t i=0; i<particles.size(); ++i)
+    {
+        const auto time_scale = particles.time_scale[i];
+        const auto velocity = glm::vec2(particles.direction_x[i], particles.direction_y[i]);
+        const auto position = glm::vec2(particles.position_x[i], particles.position_y[i]);
+        // with linear motion the distance travelled is simply speed * time.
+        const auto speed = glm::length(velocity);
+        const auto size_rate  = mParams.rate_of_change_in_size_wrt_time * time_scale +
+                                mParams.rate_of_change_in_size_wrt_dist * speed;
+        const auto alpha_rate = mParams.rate_of_change_in_alpha_wrt_time * time_scale +
+                                mParams.rate_of_change_in_alpha_wrt_dist;
+        const auto lifetime = std::min(time_scale * mParams.max_lifetime, AnalyticNeverDies);
+
+        // the particle dies at the end of its lifetime or when
+        // the size or the alpha reaches 0 or when it crosses the
+        // boundary, whichever comes first.
+        auto death = lifetime;
+        if (size_rate < 0.0f)
+            death = std::min(death, particles.pointsize[i] / -size_rate);
+        if (alpha_rate < 0.0f)
+            death = std::min(death, particles.alpha[i] / -alpha_rate);
+        if (kill)
+        {
+            death = std::min(death, ComputeExitTime(position.x, velocity.x, mParams.max_xpos));
+            death = std::min(death, ComputeExitTime(position.y, velocity.y, mParams.max_ypos));
+        }
+        const auto birth = i * birth_interval;
+
+        auto& v = state.analytic[i];
+        v.aPosition  = Vec2 { position.x, position.y };
+        v.aDirection = Vec2 { velocity.x, velocity.y };
+        v.aData      = Vec4 { particles.pointsize[i], particles.randomizer[i], particles.alpha[i], lifetime };
+        v.aTime      = Vec4 { size_rate, alpha_rate, birth, death };
+        if (mParams.mode == SpawnPolicy::Continuous)
+            v.aPeriod = period;
+        else if (mParams.mode == SpawnPolicy::Maintain && death < AnalyticNeverDies)
+            v.aPeriod = death;
+        else v.aPeriod = 0.0f;
+
+        state.analytic_end_time = std::max(state.analytic_end_time, birth + death);
+    }
+    state.particles.clear();
 
-    // boundary conditions.
-    if (mParams.boundary == BoundaryPolicy::Wrap)
+    // the geometry is keyed by the class and the particle data so that
+    // instances with the same particles share the same device buffer.
+    // geometries that are no longer drawn are cleaned up by the device.
+    std::size_t hash = 0;
+    for (const auto& v : state.analytic)
+        hash = base::hash_combine(hash, v);
+    state.analytic_hash = hash;
+    state.analytic_geometry = "analytic-particles/" + mId + "/" + std::to_string(hash);
+}
+
+void KinematicsParticleEngineClass::UpdateParticles(InstanceState& state, float dt) const
+{
+    auto& particles = state.particles;
+    auto& alive = state.alive;
+    const auto count = particles.size();
+    alive.resize(count);
+
+    size_t i = 0;
+#if defined(GFX_PARTICLE_SIMD_SSE2) || defined(GFX_PARTICLE_SIMD_NEON)
+    if (EnableParticleSIMD)
+        i = UpdateParticlesSIMD(mParams, particles, alive.data(), dt);
+#endif
+    for (; i<count; ++i)
     {
-        p.position.x = math::wrap(0.0f, mParams.max_xpos, p.position.x);
-        p.position.y = math::wrap(0.0f, mParams.max_ypos, p.position.y);
+        auto p = particles.GetParticle(i);
+        alive[i] = UpdateParticle(mParams, p, dt);
+        particles.SetParticle(i, p);
     }
-    else if (mParams.boundary == BoundaryPolicy::Clamp)
+
+    // remove the dead particles by swapping with the last particle.
+    // this results in the same particle order as killing each particle
+    // immediately when updating them one by one.
+    size_t num_alive = count;
+    for (i=0; i<num_alive;)
     {
-        p.position.x = math::clamp(0.0f, mParams.max_xpos, p.position.x);
-        p.position.y = math::clamp(0.0f, mParams.max_ypos, p.position.y);
+        if (alive[i])
+        {
+            ++i;
+            continue;
+        }
+        --num_alive;
+        particles.Swap(i, num_alive);
+        std::swap(alive[i], alive[num_alive]);
     }
-    else if (mParams.boundary == BoundaryPolicy::Kill)
+    particles.resize(num_alive);
+}
+
+// static
+void KinematicsParticleEngineClass::EnableSIMD(bool on_off)
+{
+#if defined(GFX_PARTICLE_SIMD_SSE2) || defined(GFX_PARTICLE_SIMD_NEON)
+    EnableParticleSIMD = on_off;
+#endif
+}
+// static
+bool KinematicsParticleEngineClass::IsSIMDEnabled()
+{
+    return EnableParticleSIMD;
+}
+
+void KinematicsParticleEngineClass::ParticleArray::clear()
+{
+    position_x.clear();
+    position_y.clear();
+    direction_x.clear();
+    direction_y.clear();
+    pointsize.clear();
+    time.clear();
+    time_scale.clear();
+    distance.clear();
+    randomizer.clear();
+    alpha.clear();
+}
+void KinematicsParticleEngineClass::ParticleArray::resize(std::size_t count)
+{
+    position_x.resize(count);
+    position_y.resize(count);
+    direction_x.resize(count);
+    direction_y.resize(count);
+    pointsize.resize(count);
+    time.resize(count);
+    time_scale.resize(count);
+    distance.resize(count);
+    randomizer.resize(count);
+    alpha.resize(count);
+}
+void KinematicsParticleEngineClass::ParticleArray::push_back(const Particle& p)
+{
+    position_x.push_back(p.position.x);
+    position_y.push_back(p.position.y);
+    direction_x.push_back(p.direction.x);
+    direction_y.push_back(p.direction.y);
+    pointsize.push_back(p.pointsize);
+    time.push_back(p.time);
+    time_scale.push_back(p.time_scale);
+    distance.push_back(p.distance);
+    randomizer.push_back(p.randomizer);
+    alpha.push_back(p.alpha);
+}
+KinematicsParticleEngineClass::Particle KinematicsParticleEngineClass::ParticleArray::GetParticle(std::size_t index) const
+{
+    Particle p;
+    p.position.x  = position_x[index];
+    p.position.y  = position_y[index];
+    p.direction.x = direction_x[index];
+    p.direction.y = direction_y[index];
+    p.pointsize   = pointsize[index];
+    p.time        = time[index];
+    p.time_scale  = time_scale[index];
+    p.distance    = distance[index];
+    p.randomizer  = randomizer[index];
+    p.alpha       = alpha[index];
+    return p;
+}
+void KinematicsParticleEngineClass::ParticleArray::SetParticle(std::size_t index, const Particle& p)
+{
+    position_x[index]  = p.position.x;
+    position_y[index]  = p.position.y;
+    direction_x[index] = p.direction.x;
+    direction_y[index] = p.direction.y;
+    pointsize[index]   = p.pointsize;
+    time[index]        = p.time;
+    time_scale[index]  = p.time_scale;
+    distance[index]    = p.distance;
+    randomizer[index]  = p.randomizer;
+    alpha[index]       = p.alpha;
+}
+void KinematicsParticleEngineClass::ParticleArray::Swap(std::size_t a, std::size_t b)
+{
+    std::swap(position_x[a], position_x[b]);
+    std::swap(position_y[a], position_y[b]);
+    std::swap(direction_x[a], direction_x[b]);
+    std::swap(direction_y[a], direction_y[b]);
+    std::swap(pointsize[a], pointsize[b]);
+    std::swap(time[a], time[b]);
+    std::swap(time_scale[a], time_scale[b]);
+    std::swap(distance[a], distance[b]);
+    std::swap(randomizer[a], randomizer[b]);
+    std::swap(alpha[a], alpha[b]);
+}
+
+void ParticleBatch::ApplyDynamicState(const Environment& env, Program& program, RasterState& raster) const
+{
+    raster.line_width = 1.0;
+    raster.culling    = Culling::None;
+    // the particle vertices are already in the world space so only
+    // the view transformation is needed.
+    program.SetUniform("kProjectionMatrix",
+        *(const Program::Matrix4x4*)glm::value_ptr(*env.proj_matrix));
+    program.SetUniform("kViewMatrix",
+        *(const Program::Matrix4x4*)glm::value_ptr(*env.view_matrix));
+}
+Shader* ParticleBatch::GetShader(Device& device) const
+{
+    return MakeParticleShader(device, KinematicsParticleEngineClass::CoordinateSpace::Global);
+}
+Geometry* ParticleBatch::Upload(const Environment& env, Device& device) const
+{
+    Geometry* geom = device.FindGeometry("particle-batch-buffer");
+    if (!geom)
     {
-        if (p.position.x < 0.0f || p.position.x > mParams.max_xpos)
-            return false;
-        else if (p.position.y < 0.0f || p.position.y > mParams.max_ypos)
-            return false;
+        geom = device.MakeGeometry("particle-batch-buffer");
     }
-    else if (mParams.boundary == BoundaryPolicy::Reflect)
-    {
-        glm::vec2 n;
-        if (p.position.x <= 0.0f)
-            n = glm::vec2(1.0f, 0.0f);
-        else if (p.position.x >= mParams.max_xpos)
-            n = glm::vec2(-1.0f, 0.0f);
-        else if (p.position.y <= 0.0f)
-            n = glm::vec2(0, 1.0f);
-        else if (p.position.y >= mParams.max_ypos)
-            n = glm::vec2(0, -1.0f);
-        else return true;
-        // compute new direction vector given the normal vector of the boundary
-        // and then bake the velocity in the new direction
-        const auto& d = glm::normalize(p.direction);
-        const float v = glm::length(p.direction);
-        p.direction = (d - 2 * glm::dot(d, n) * n) * v;
-
-        // clamp the position in order to eliminate the situation
-        // where the object has moved beyond the boundaries of the simulation
-        // and is stuck there alternating it's direction vector
-        p.position.x = math::clamp(0.0f, mParams.max_xpos, p.position.x);
-        p.position.y = math::clamp(0.0f, mParams.max_ypos, p.position.y);
+    // the vertex vector is kept around so that once it has grown
+    // big enough there are no more allocations.
+    mVertices.clear();
+    for (const auto& engine : mEngines)
+    {
+        engine.engine->AppendVertices(env, &engine.model_to_world, &mVertices);
     }
-    return true;
+    using ParticleVertex = KinematicsParticleEngineClass::ParticleVertex;
+    geom->Upload(mVertices.data(), mVertices.size() * sizeof(ParticleVertex), Geometry::Usage::Stream);
+    geom->SetVertexLayout(GetParticleVertexLayout());
+    geom->ClearDraws();
+    geom->AddDrawCmd(Geometry::DrawType::Points);
+    return geom;
+}
+Drawable::Style ParticleBatch::GetStyle() const
+{
+    return Style::Points;
+}
+// static
+bool ParticleBatch::CanCombine(const Drawable& a, const Material& a_material,
+                               const Drawable& b, const Material& b_material)
+{
+    // analytic particles are evaluated in the vertex shader
+    // from their own static buffer and can't be batched.
+    const auto* a_engine = dynamic_cast<const KinematicsParticleEngine*>(&a);
+    const auto* b_engine = dynamic_cast<const KinematicsParticleEngine*>(&b);
+    if (!a_engine || !b_engine || a_engine->IsAnalytic() || b_engine->IsAnalytic())
+        return false;
+    if (a.GetStyle() != b.GetStyle())
+        return false;
+    if (&a_material == &b_material)
+        return true;
+
+    const auto* a_inst = dynamic_cast<const MaterialClassInst*>(&a_material);
+    const auto* b_inst = dynamic_cast<const MaterialClassInst*>(&b_material);
+    if (!a_inst || !b_inst)
+        return false;
+    return a_inst->HasSameState(*b_inst);
+}
+std::string ParticleBatch::GetProgramId() const
+{
+    return "global-particle-program";
 }
 
 void TileBatch::ApplyDynamicState(const Environment& env, Program& program, RasterState& raster) const
@@ -2303,6 +3102,83 @@ std::string TileBatch::GetProgramId() const
     return "tile-batch-program";
 }
 
+void TextBatch::ApplyDynamicState(const Environment& env, Program& program, RasterState& raster) const
+{
+    program.SetUniform("kProjectionMatrix",
+        *(const Program::Matrix4x4*)glm::value_ptr(*env.proj_matrix));
+    program.SetUniform("kModelViewMatrix",
+        *(const Program::Matrix4x4*)glm::value_ptr(*env.view_matrix * *env.model_matrix));
+}
+Shader* TextBatch::GetShader(Device& device) const
+{
+    return MakeVertexArrayShader(device);
+}
+Geometry* TextBatch::Upload(const Environment& env, Device& device) const
+{
+    size_t hash = 0;
+    hash = base::hash_combine(hash, mText.GetHash());
+    hash = base::hash_combine(hash, mAtlas->GetLayoutVersion());
+    if (hash != mVertexHash)
+    {
+        mVertices.clear();
+
+        std::vector<GlyphAtlas::GlyphQuad> quads;
+        unsigned width  = 0;
+        unsigned height = 0;
+        if (mAtlas->Layout(mText, &quads, &width, &height) && width && height)
+        {
+            for (const auto& quad : quads)
+            {
+                const float x0 = quad.x / width;
+                const float y0 = quad.y / height;
+                const float x1 = (quad.x + quad.width) / width;
+                const float y1 = (quad.y + quad.height) / height;
+                const auto& tex = quad.texture_rect;
+                const float u0 = tex.GetX();
+                const float v0 = tex.GetY();
+                const float u1 = tex.GetX() + tex.GetWidth();
+                const float v1 = tex.GetY() + tex.GetHeight();
+
+                const Vertex top_left  {{x0, -y0}, {u0, v0}};
+                const Vertex top_right {{x1, -y0}, {u1, v0}};
+                const Vertex bot_left  {{x0, -y1}, {u0, v1}};
+                const Vertex bot_right {{x1, -y1}, {u1, v1}};
+                mVertices.push_back(top_left);
+                mVertices.push_back(bot_left);
+                mVertices.push_back(bot_right);
+                mVertices.push_back(top_left);
+                mVertices.push_back(bot_right);
+                mVertices.push_back(top_right);
+            }
+        }
+        // the layout itself might have evicted pages from the atlas
+        // so the hash is computed again with the current layout version.
+        hash = 0;
+        hash = base::hash_combine(hash, mText.GetHash());
+        hash = base::hash_combine(hash, mAtlas->GetLayoutVersion());
+        mVertexHash = hash;
+    }
+    if (mVertices.empty())
+        return nullptr;
+
+    Geometry* geom = device.FindGeometry("text-buffer");
+    if (!geom)
+        geom = device.MakeGeometry("text-buffer");
+
+    geom->SetVertexBuffer(mVertices, Geometry::Usage::Stream);
+    geom->ClearDraws();
+    geom->AddDrawCmd(Geometry::DrawType::Triangles);
+    return geom;
+}
+Drawable::Style TextBatch::GetStyle() const
+{
+    return Style::Solid;
+}
+std::string TextBatch::GetProgramId() const
+{
+    return "generic-vertex-program";
+}
+
 std::unique_ptr<Drawable> CreateDrawableInstance(const std::shared_ptr<const DrawableClass>& klass)
 {
     // factory function based on type switching.
@@ -25,6 +25,7 @@
 #include "warnpop.h"
 
 #include <algorithm>
+#include <cstdint>
 #include <string>
 #include <vector>
 #include <limits>
@@ -39,6 +40,7 @@
 #include "graphics/geometry.h"
 #include "graphics/device.h"
 #include "graphics/program.h"
+#include "graphics/text.h"
 
 namespace gfx
 {
@@ -46,6 +48,7 @@ namespace gfx
     class Shader;
     class Geometry;
     class Program;
+    class Material;
 
     // DrawableClass defines a new type of drawable.
      class DrawableClass
@@ -104,6 +107,11 @@ namespace gfx
              // the current model matrix that will be used to transform the
              // vertices from the local space to the world space.
              const glm::mat4* model_matrix = nullptr;
+             // the approximate size of the shape (i.e. the model space unit
+             // box) on the render surface in pixels after projection.
+             // used to select the level of detail for curved shapes.
+             // zero if unknown in which case the full detail is used.
+             glm::vec2 screen_size = {0.0f, 0.0f};
          };
 
         virtual ~DrawableClass() = default;
@@ -968,6 +976,25 @@ namespace gfx
             Sector
         };
 
+        // Control how the particle state is computed.
+        enum class Simulation {
+            // Particles are simulated on the CPU. Every particle is updated
+            // on every update and the particle vertices are uploaded to the
+            // device on every frame.
+            CPU,
+            // The particle state is evaluated in the vertex shader as a closed
+            // form function of the initial particle state and the simulation
+            // time. The initial particle attributes are uploaded only once and
+            // the CPU only needs to keep track of the simulation time.
+            // Particles that die are respawned with the same initial attributes,
+            // i.e. there's no randomness after the particles have been created.
+            // When the parameters can't be evaluated analytically (reflecting
+            // boundary, projectile motion with clamping or killing boundary or
+            // size changing with distance, continuous spawning with unlimited
+            // particle lifetime) the CPU simulation is used instead.
+            Analytic
+        };
+
         // initial engine configuration params
         struct Params {
             Direction direction = Direction::Sector;
@@ -981,6 +1008,8 @@ namespace gfx
             Motion motion = Motion::Linear;
             // when to spawn particles.
             SpawnPolicy mode = SpawnPolicy::Maintain;
+            // how to compute the particle state.
+            Simulation simulation = Simulation::CPU;
             // What happens to a particle at the simulation boundary
             BoundaryPolicy boundary = BoundaryPolicy::Clamp;
             // delay until the particles are spawned after start.
@@ -1035,17 +1064,83 @@ namespace gfx
             glm::vec2 gravity = {0.0f, 0.3f};
         };
 
+        // Container for the simulation particles. The particle data is
+        // kept in structure of arrays layout, i.e. each particle attribute
+        // is in its own contiguous array, so that the simulation can update
+        // several particles at once using SIMD instructions.
+        struct ParticleArray {
+            std::vector<float> position_x;
+            std::vector<float> position_y;
+            std::vector<float> direction_x;
+            std::vector<float> direction_y;
+            std::vector<float> pointsize;
+            std::vector<float> time;
+            std::vector<float> time_scale;
+            std::vector<float> distance;
+            std::vector<float> randomizer;
+            std::vector<float> alpha;
+
+            std::size_t size() const
+            { return time.size(); }
+            bool empty() const
+            { return time.empty(); }
+            void clear();
+            void resize(std::size_t count);
+            void push_back(const Particle& p);
+            // Get a copy of the particle at the given index.
+            Particle GetParticle(std::size_t index) const;
+            // Overwrite the particle at the given index.
+            void SetParticle(std::size_t index, const Particle& p);
+            // Swap the particles at the given indices.
+            void Swap(std::size_t a, std::size_t b);
+        };
+
+        // Per particle vertex data uploaded to the device.
+        struct ParticleVertex {
+            Vec2 aPosition;
+            Vec4 aData;
+        };
+        // Per particle vertex data for the analytic simulation. These are
+        // the initial particle attributes from which the vertex shader
+        // computes the current particle state.
+        struct AnalyticParticleVertex {
+            // initial position in simulation space.
+            Vec2 aPosition;
+            // initial direction times velocity.
+            Vec2 aDirection;
+            // x = initial point size, y = random value,
+            // z = initial alpha, w = lifetime
+            Vec4 aData;
+            // x = change in size wrt time, y = change in alpha wrt time
+            // z = time of birth, w = time of death (relative to birth)
+            Vec4 aTime;
+            // the period after which the particle is born again or 0.0f
+            // if the particle is never born again.
+            float aPeriod = 0.0f;
+        };
+
         // State of any instance of KinematicsParticleEngine.
         struct InstanceState {
             // the simulation particles.
-            std::vector<Particle> particles;
+            ParticleArray particles;
+            // per particle alive flags. scratch space for the update.
+            std::vector<std::uint8_t> alive;
             // delay until the particles are first initially emitted.
             float delay = 0.0f;
             // simulation time.
             float time = 0.0f;
             // fractional count of new particles being hatched.
             float hatching = 0.0f;
-
+            // the initial particle attributes for the analytic simulation.
+            std::vector<AnalyticParticleVertex> analytic;
+            // analytic simulation time after which no particle is alive
+            // anymore unless the particles are born again.
+            float analytic_end_time = 0.0f;
+            // the hash of the analytic particle attributes.
+            std::size_t analytic_hash = 0;
+            // the name of the device geometry for the analytic particles.
+            // derived from the class ID and the particle attributes.
+            std::string analytic_geometry;
         };
 
         KinematicsParticleEngineClass()
@@ -1068,10 +1163,22 @@ namespace gfx
 
         std::string GetProgramId() const;
 
-        void ApplyDynamicState(const Environment& env, Program& program) const;
+        void ApplyDynamicState(const Environment& env, const InstanceState& state, Program& program) const;
         void Update(const Environment& env, InstanceState& state, float dt) const;
+        // Compute the vertices for the particles in the given state and
+        // append them to the vertex vector. If model_to_world is not null
+        // the particles simulated in the local coordinate space are
+        // transformed to the world space, i.e. the vertices can then be
+        // drawn with the global particle program.
+        void AppendVertices(const Environment& env, const InstanceState& state,
+                            const glm::mat4* model_to_world,
+                            std::vector<ParticleVertex>* vertices) const;
         void Restart(const Environment& env, InstanceState& state) const;
         bool IsAlive(const InstanceState& state) const;
+        // Returns true if the particles are evaluated analytically on
+        // the GPU, i.e. the simulation is set to analytic and the current
+        // params can be evaluated analytically.
+        bool IsAnalytic() const;
 
         // Get the params.
         const Params& GetParams() const
@@ -1087,10 +1194,20 @@ namespace gfx
         virtual bool LoadFromJson(const data::Reader& data) override;
         // Load from JSON
         static std::optional<KinematicsParticleEngineClass> FromJson(const data::Reader& data);
+
+        // Enable/disable the vectorized (SIMD) particle update. When
+        // disabled or when no SIMD implementation is available for the
+        // target the particles are updated with the scalar code path.
+        // Both paths produce the same results. Mostly useful for testing
+        // and benchmarking. On by default.
+        static void EnableSIMD(bool on_off);
+        // Returns true if the SIMD particle update is available
+        // on this target and currently enabled.
+        static bool IsSIMDEnabled();
     private:
         void InitParticles(const Environment& env, InstanceState& state, size_t num) const;
-        void KillParticle(InstanceState& state, size_t i) const;
-        bool UpdateParticle(const Environment& env, InstanceState& state, size_t i, float dt) const;
+        void InitAnalyticParticles(const Environment& env, InstanceState& state) const;
+        void UpdateParticles(InstanceState& state, float dt) const;
     private:
         Params mParams;
     };
@@ -1119,7 +1236,7 @@ namespace gfx
         {
             state.line_width = 1.0;
             state.culling    = Culling::None;
-            mClass->ApplyDynamicState(env, program);
+            mClass->ApplyDynamicState(env, mState, program);
         }
         // Drawable implementation. Compile the shader.
         virtual Shader* GetShader(Device& device) const override
@@ -1155,9 +1272,20 @@ namespace gfx
             return mClass->GetProgramId();
         }
 
-        // Get the current number of alive particles.
+        // Get the current number of alive particles. When the particles
+        // are evaluated analytically this is the number of particles
+        // that have been created for the simulation.
         size_t GetNumParticlesAlive() const
-        { return mState.particles.size(); }
+        { return mClass->IsAnalytic() ? mState.analytic.size() : mState.particles.size(); }
+        // Returns true if the particles are evaluated analytically on the GPU.
+        // Such particles can't be combined with other particles into a batch.
+        bool IsAnalytic() const
+        { return mClass->IsAnalytic(); }
+        // Append the particle vertices to the vertex vector.
+        // See KinematicsParticleEngineClass::AppendVertices.
+        void AppendVertices(const Environment& env, const glm::mat4* model_to_world,
+                            std::vector<KinematicsParticleEngineClass::ParticleVertex>* vertices) const
+        { mClass->AppendVertices(env, mState, model_to_world, vertices); }
 
     private:
         // this is the "class" object for this particle engine type.
@@ -1202,6 +1330,87 @@ namespace gfx
         float mTileHeight = 0.0f;
     };
 
+    // Draw text using glyphs from a shared glyph atlas. Each glyph is
+    // drawn as a quad that maps to the glyph in the atlas texture.
+    // The quads are only recomputed when the text changes or when the
+    // atlas has evicted glyphs, so changing the text doesn't require
+    // rasterizing or uploading a new texture. The text is mapped into
+    // the model space (unit rectangle) based on the text buffer dimensions.
+    // Use together with GlyphAtlasMaterial using the same atlas.
+    class TextBatch : public Drawable
+    {
+    public:
+        TextBatch(std::shared_ptr<GlyphAtlas> atlas, const TextBuffer& text)
+          : mAtlas(atlas)
+          , mText(text)
+        {}
+        TextBatch(std::shared_ptr<GlyphAtlas> atlas, TextBuffer&& text)
+          : mAtlas(atlas)
+          , mText(std::move(text))
+        {}
+
+        virtual void ApplyDynamicState(const Environment& env, Program& program, RasterState& raster) const override;
+        virtual Shader* GetShader(Device& device) const override;
+        virtual Geometry* Upload(const Environment& env, Device& device) const override;
+        virtual Style GetStyle() const override;
+        virtual std::string GetProgramId() const override;
+
+        void SetText(const TextBuffer& text)
+        { mText = text; }
+        void SetText(TextBuffer&& text)
+        { mText = std::move(text); }
+        const TextBuffer& GetText() const
+        { return mText; }
+    private:
+        std::shared_ptr<GlyphAtlas> mAtlas;
+        TextBuffer mText;
+        // the glyph quad vertices computed from the current
+        // text and the atlas layout identified by the hash.
+        mutable std::vector<Vertex> mVertices;
+        mutable std::size_t mVertexHash = 0;
+    };
+
+    // ParticleBatch combines the particles of several particle engine
+    // instances into a single vertex buffer upload and a single draw.
+    // The particles of the engines simulated in the local coordinate
+    // space are transformed into the world space on the CPU so engines
+    // with different model transformations can be drawn together.
+    // The batch (and its vertex storage) is meant to be reused from frame
+    // to frame in order to avoid allocating memory on every frame.
+    class ParticleBatch : public Drawable
+    {
+    public:
+        virtual void ApplyDynamicState(const Environment& env, Program& program, RasterState& raster) const override;
+        virtual Shader* GetShader(Device& device) const override;
+        virtual Geometry* Upload(const Environment& env, Device& device) const override;
+        virtual Style GetStyle() const override;
+        virtual std::string GetProgramId() const override;
+
+        // Add a particle engine to the batch. The engine object must
+        // remain valid until the batch has been drawn.
+        void AddEngine(const KinematicsParticleEngine* engine, const glm::mat4& model_to_world)
+        { mEngines.push_back({engine, model_to_world}); }
+        // Remove all the engines from the batch.
+        void Clear()
+        { mEngines.clear(); }
+
+        // Check whether the draws of the two drawables can be combined
+        // into the same batch. Both must be non-analytic particle engines
+        // with the same style and since the batch is drawn with a single
+        // material their materials must render identically.
+        static bool CanCombine(const Drawable& a, const Material& a_material,
+                               const Drawable& b, const Material& b_material);
+        std::size_t GetNumEngines() const
+        { return mEngines.size(); }
+    private:
+        struct Engine {
+            const KinematicsParticleEngine* engine = nullptr;
+            glm::mat4 model_to_world;
+        };
+        std::vector<Engine> mEngines;
+        mutable std::vector<KinematicsParticleEngineClass::ParticleVertex> mVertices;
+    };
+
     std::unique_ptr<Drawable> CreateDrawableInstance(const std::shared_ptr<const DrawableClass>& klass);
 
 } // namespace
@@ -113,6 +113,21 @@ void DrawTextRect(Painter& painter,
     {
         buff.ComputeTextMetrics(&raster_width, &raster_height);
     }
+    else if (auto atlas = GlyphAtlas::Get(font, font_size_px))
+    {
+        // draw the text with glyphs from the shared glyph atlas. this
+        // avoids rasterizing and uploading a new texture every time the
+        // text content changes. (for example some frame counter text)
+        GlyphAtlasMaterial material(atlas);
+        material.SetColor(color);
+        material.SetPointSampling(true);
+
+        Transform t;
+        t.Resize(raster_width, raster_height);
+        t.MoveTo(rect);
+        painter.Draw(TextBatch(atlas, std::move(buff)), t, material);
+        return;
+    }
 
     TextMaterial material(std::move(buff));
     material.SetColor(color);
@@ -47,6 +47,13 @@ namespace gfx
         // Try to create the framebuffer. Returns true if successful or false to indicate an error
         // i.e. the implementation failed to support the requested format.
         virtual bool Create(const Config& conf) = 0;
+        // Set a texture to be used as the color buffer instead of the
+        // texture that the framebuffer would otherwise create itself.
+        // This lets the rendered image be sampled through the device
+        // texture (and thus through materials) by its name. The texture
+        // must already have storage that matches the framebuffer size
+        // and this must be called before Create.
+        virtual void SetColorTarget(Texture* texture) = 0;
         // Resolve the framebuffer color buffer contents into a texture that can be
         // used to sample the rendered image.
         virtual void Resolve(Texture** color) const = 0;
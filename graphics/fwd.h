@@ -25,6 +25,7 @@ namespace gfx
     class MaterialClass;
     class Drawable;
     class DrawableClass;
+    class ParticleBatch;
     class Transform;
     class Device;
     class IBitmap;
@@ -35,5 +36,6 @@ namespace gfx
     class Loader;
     class Resource;
     class Framebuffer;
+    class TextureAtlas;
 
 } // namespace
\ No newline at end of file
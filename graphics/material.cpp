@@ -35,6 +35,8 @@
 #include "graphics/program.h"
 #include "graphics/resource.h"
 #include "graphics/loader.h"
+#include "graphics/baked_texture.h"
+#include "graphics/atlas.h"
 
 //                  == Notes about shaders ==
 // 1. Shaders are specific to a device within compatibility constraints
@@ -162,6 +164,139 @@ namespace {
         }
         return code;
     }
+    gfx::Shader* MakeTextShader(gfx::Device& device)
+    {
+constexpr auto* src = R"(
+#version 100
+precision highp float;
+uniform sampler2D kTexture;
+uniform vec4 kColor;
+uniform float kTime;
+varying vec2 vTexCoord;
+void main() {
+   float alpha = texture2D(kTexture, vTexCoord).a;
+   gl_FragColor = vec4(kColor.r, kColor.g, kColor.b, kColor.a * alpha);
+}
+        )";
+        auto* shader = device.MakeShader("text-shader");
+        shader->CompileSource(src);
+        shader->SetName("TextShader");
+        return shader;
+    }
+
+    // Find the texture object for the texture source and (re)upload the
+    // texture content if the texture doesn't exist yet or when the content
+    // has changed. If the source's texture is packed into the texture atlas
+    // the returned texture is the atlas page, the rect is set to the
+    // sub-rectangle of the page and the atlas flag is set. Otherwise the
+    // rect remains unmodified.
+    gfx::Texture* BindTextureSource(const gfx::TextureSource& source,
+                                    const gfx::TextureMap::BindingState& state,
+                                    gfx::Device& device, gfx::FRect* rect, bool* atlas)
+    {
+        const auto& name = source.GetGpuId();
+        auto* texture = device.FindTexture(name);
+        // textures packed in the atlas never have their own texture object.
+        if (!texture && state.atlas)
+        {
+            if (auto* page = state.atlas->FindTexture(source, state.dynamic_content, device, rect))
+            {
+                *atlas = true;
+                return page;
+            }
+        }
+
+        bool needs_upload = false;
+        size_t content_hash = 0;
+
+        const bool srgb_texture = source.GetColorSpace() == gfx::TextureSource::ColorSpace::sRGB;
+
+        // check for changes.
+        if (texture && state.dynamic_content) {
+            content_hash = source.GetContentHash();
+            needs_upload = content_hash != texture->GetContentHash();
+        }
+        // upload if doesn't exist already or the content has changed.
+        if (texture && !needs_upload)
+            return texture;
+
+        std::shared_ptr<gfx::IBitmap> bitmap;
+        if (!texture && state.atlas && !source.HasBakedData())
+        {
+            bitmap = source.GetData();
+            if (!bitmap)
+                return nullptr;
+            if (!content_hash)
+                content_hash = source.GetContentHash();
+            if (auto* page = state.atlas->AddTexture(source, *bitmap, content_hash, device, rect))
+            {
+                *atlas = true;
+                return page;
+            }
+        }
+
+        if (!texture)
+            texture = device.MakeTexture(name);
+
+        texture->SetName(source.GetName());
+        texture->SetGroup(state.group_tag);
+        if (bitmap || !source.UploadBaked(*texture))
+        {
+            if (!bitmap)
+                bitmap = source.GetData();
+            if (!bitmap)
+                return nullptr;
+            const auto width  = bitmap->GetWidth();
+            const auto height = bitmap->GetHeight();
+            const auto format = gfx::Texture::DepthToFormat(bitmap->GetDepthBits(), srgb_texture);
+            texture->Upload(bitmap->GetDataPtr(), width, height, format);
+        }
+        if (!content_hash)
+            content_hash = source.GetContentHash();
+        texture->SetContentHash(content_hash);
+        return texture;
+    }
+
+    // The texture atlas pages have no mips, pick the closest filter
+    // that doesn't sample the mips.
+    gfx::Texture::MinFilter GetAtlasMinFilter(gfx::Texture::MinFilter filter)
+    {
+        using MinFilter = gfx::Texture::MinFilter;
+        if (filter == MinFilter::Nearest || filter == MinFilter::Mipmap)
+            return MinFilter::Nearest;
+        return MinFilter::Linear;
+    }
+
+    // Check whether a built-in material can sample its textures out of
+    // the texture atlas. The image is clamped to its rect in the atlas
+    // page so a material that wraps, scales, scrolls or rotates its
+    // texture coordinates would need the shader to wrap them which
+    // creates seams. Such materials keep using textures of their own.
+    bool CanUseTextureAtlas(gfx::Texture::Wrapping wrap_x, gfx::Texture::Wrapping wrap_y,
+                            const glm::vec2& scale, const glm::vec3& velocity, float rotation,
+                            const gfx::MaterialClass::UniformMap& uniforms)
+    {
+        if (wrap_x != gfx::Texture::Wrapping::Clamp || wrap_y != gfx::Texture::Wrapping::Clamp)
+            return false;
+        if (scale != glm::vec2(1.0f, 1.0f) || velocity != glm::vec3(0.0f, 0.0f, 0.0f) || rotation != 0.0f)
+            return false;
+        for (const char* name : {"kTextureScale", "kTextureVelocityXY", "kTextureVelocityZ", "kTextureRotation"})
+        {
+            if (uniforms.find(name) != uniforms.end())
+                return false;
+        }
+        return true;
+    }
+
+    // Map a texture rect in the source texture's coordinates to the
+    // coordinates of the (atlas) texture where the source is located.
+    gfx::FRect MapTextureRect(const gfx::FRect& rect, const gfx::FRect& location)
+    {
+        return gfx::FRect(location.GetX() + rect.GetX() * location.GetWidth(),
+                          location.GetY() + rect.GetY() * location.GetHeight(),
+                          rect.GetWidth() * location.GetWidth(),
+                          rect.GetHeight() * location.GetHeight());
+    }
 } // namespace
 
 namespace gfx
@@ -198,6 +333,37 @@ std::shared_ptr<IBitmap> detail::TextureFileSource::GetData() const
     ERROR("Failed to load texture. [file='%1']", mFile);
     return nullptr;
 }
+bool detail::TextureFileSource::UploadBaked(Texture& texture) const
+{
+    if (mBakedFile.empty())
+        return false;
+
+    const BakedTexture baked(gfx::LoadResource(mBakedFile));
+    if (!baked.IsValid())
+    {
+        WARN("Failed to load baked texture. Falling back to image file. [file='%1']", mBakedFile);
+        return false;
+    }
+    // the baked data must have been processed the same way as the
+    // data from GetData would be, otherwise use the image file.
+    const auto format = baked.GetFormat();
+    const bool srgb = mColorSpace == ColorSpace::sRGB;
+    bool mismatch = false;
+    if (format == Texture::Format::RGB || format == Texture::Format::RGBA)
+        mismatch = srgb;
+    else if (format == Texture::Format::sRGB || format == Texture::Format::sRGBA)
+        mismatch = !srgb;
+    if (format == Texture::Format::RGBA || format == Texture::Format::sRGBA)
+        mismatch = mismatch || baked.IsPremultiplied() != TestFlag(Flags::PremulAlpha);
+    if (mismatch)
+    {
+        WARN("Baked texture doesn't match texture settings. Falling back to image file. [file='%1']", mBakedFile);
+        return false;
+    }
+    DEBUG("Loading baked texture file. [file='%1']", mBakedFile);
+    baked.Upload(texture);
+    return true;
+}
 void detail::TextureFileSource::IntoJson(data::Writer& data) const
 {
     data.Write("id",   mId);
@@ -205,11 +371,14 @@ void detail::TextureFileSource::IntoJson(data::Writer& data) const
     data.Write("name", mName);
     data.Write("flags", mFlags);
     data.Write("colorspace", mColorSpace);
+    if (!mBakedFile.empty())
+        data.Write("baked_file", mBakedFile);
 }
 bool detail::TextureFileSource::FromJson(const data::Reader& data)
 {
     data.Read("id",   &mId);
     data.Read("file", &mFile);
+    data.Read("baked_file", &mBakedFile);
     data.Read("name", &mName);
     data.Read("flags", &mFlags);
     data.Read("colorspace", &mColorSpace);
@@ -476,43 +645,14 @@ bool SpriteMap::BindTextures(const BindingState& state, Device& device, BoundSta
     for (unsigned i=0; i<2; ++i)
     {
         const auto& sprite  = mSprites[frame_index[i]];
-        const auto& source  = sprite.source;
-        const auto& name    = source->GetGpuId();
-        auto* texture = device.FindTexture(name);
-
-        bool needs_upload = false;
-        bool srgb_texture = false;
-        size_t content_hash = 0;
-
-        if (source->GetColorSpace() == TextureSource::ColorSpace::sRGB)
-            srgb_texture = true;
-
-        // check for changes.
-        if (texture && state.dynamic_content) {
-            content_hash = source->GetContentHash();
-            needs_upload = content_hash != texture->GetContentHash();
-        }
-        if (!texture || needs_upload)
-        {
-            if (!texture)
-                texture = device.MakeTexture(name);
-
-            auto bitmap = source->GetData();
-            if (!bitmap)
-                return false;
-            const auto width  = bitmap->GetWidth();
-            const auto height = bitmap->GetHeight();
-            const auto format = Texture::DepthToFormat(bitmap->GetDepthBits(), srgb_texture);
-            texture->SetName(source->GetName());
-            texture->SetGroup(state.group_tag);
-            texture->Upload(bitmap->GetDataPtr(), width, height, format);
-
-            if (!content_hash)
-                content_hash = source->GetContentHash();
-            texture->SetContentHash(content_hash);
-        }
+        FRect location(0.0f, 0.0f, 1.0f, 1.0f);
+        bool atlas = false;
+        auto* texture = BindTextureSource(*sprite.source, state, device, &location, &atlas);
+        if (!texture)
+            return false;
         result.textures[i]      = texture;
-        result.rects[i]         = sprite.rect;
+        result.rects[i]         = MapTextureRect(sprite.rect, location);
+        result.atlas[i]         = atlas;
         result.sampler_names[i] = mSamplerName[i];
         result.rect_names[i]    = mRectUniformName[i];
     }
@@ -616,42 +756,14 @@ bool TextureMap2D::BindTextures(const BindingState& state, Device& device, Bound
     if (!mSource)
         return false;
 
-    const auto& source  = mSource;
-    const auto& name    = mSource->GetGpuId();
-    auto* texture = device.FindTexture(name);
-
-    bool needs_upload = false;
-    bool srgb_texture = false;
-    size_t content_hash = 0;
-
-    if (mSource->GetColorSpace() == TextureSource::ColorSpace::sRGB)
-        srgb_texture = true;
-
-    // check for changes.
-    if (texture && state.dynamic_content) {
-        content_hash = source->GetContentHash();
-        needs_upload = content_hash != texture->GetContentHash();
-    }
-    // upload if doesn't exist already or the content has changed.
-    if (!texture || needs_upload)
-    {
-        if (!texture)
-            texture = device.MakeTexture(name);
-
-        auto bitmap = source->GetData();
-        if (!bitmap)
-            return false;
-        const auto width  = bitmap->GetWidth();
-        const auto height = bitmap->GetHeight();
-        const auto format = Texture::DepthToFormat(bitmap->GetDepthBits(), srgb_texture);
-        texture->SetName(mSource->GetName());
-        texture->Upload(bitmap->GetDataPtr(), width, height, format);
-        if (!content_hash)
-            content_hash = source->GetContentHash();
-        texture->SetContentHash(content_hash);
-    }
+    FRect location(0.0f, 0.0f, 1.0f, 1.0f);
+    bool atlas = false;
+    auto* texture = BindTextureSource(*mSource, state, device, &location, &atlas);
+    if (!texture)
+        return false;
     result.textures[0] = texture;
-    result.rects[0]    = mRect;
+    result.rects[0]    = MapTextureRect(mRect, location);
+    result.atlas[0]    = atlas;
     result.blend_coefficient = 0;
     result.sampler_names[0]  = mSamplerName;
     result.rect_names[0]     = mRectUniformName;
@@ -1204,6 +1316,8 @@ void SpriteClass::ApplyDynamicState(const State& state, Device& device, Program&
     ts.dynamic_content = state.editing_mode || !mStatic;
     ts.current_time    = state.material_time;
     ts.group_tag       = mClassId;
+    ts.atlas           = CanUseTextureAtlas(mWrapX, mWrapY, mTextureScale, mTextureVelocity, mTextureRotation,
+                                            state.uniforms) ? state.atlas : nullptr;
 
     TextureMap::BoundState binds;
     if (!mSprite.BindTextures(ts, device,  binds))
@@ -1216,7 +1330,7 @@ void SpriteClass::ApplyDynamicState(const State& state, Device& device, Program&
     {
         auto* texture = binds.textures[i];
         // set texture properties *before* setting it to the program.
-        texture->SetFilter(mMinFilter);
+        texture->SetFilter(binds.atlas[i] ? GetAtlasMinFilter(mMinFilter) : mMinFilter);
         texture->SetFilter(mMagFilter);
         texture->SetWrapX(mWrapX);
         texture->SetWrapY(mWrapY);
@@ -1611,13 +1725,15 @@ void TextureMap2DClass::ApplyDynamicState(const State& state, Device& device, Pr
     TextureMap::BindingState ts;
     ts.dynamic_content = state.editing_mode || !mStatic;
     ts.current_time    = 0.0;
+    ts.atlas           = CanUseTextureAtlas(mWrapX, mWrapY, mTextureScale, mTextureVelocity, mTextureRotation,
+                                            state.uniforms) ? state.atlas : nullptr;
 
     TextureMap::BoundState binds;
     if (!mTexture.BindTextures(ts, device, binds))
         return;
 
     auto* texture = binds.textures[0];
-    texture->SetFilter(mMinFilter);
+    texture->SetFilter(binds.atlas[0] ? GetAtlasMinFilter(mMinFilter) : mMinFilter);
     texture->SetFilter(mMagFilter);
     texture->SetWrapX(mWrapX);
     texture->SetWrapY(mWrapY);
@@ -2246,6 +2362,27 @@ CustomMaterialClass& CustomMaterialClass::operator=(const CustomMaterialClass& o
     return *this;
 }
 
+bool MaterialClassInst::HasSameState(const MaterialClassInst& other) const
+{
+    if (mRuntime != other.mRuntime)
+        return false;
+    if (mUniforms.size() != other.mUniforms.size())
+        return false;
+    // the uniform values don't all have an equality operator
+    // so compare them by their hash values instead.
+    for (const auto& uniform : mUniforms)
+    {
+        const auto* other_uniform = base::SafeFind(other.mUniforms, uniform.first);
+        if (!other_uniform || other_uniform->index() != uniform.second.index())
+            return false;
+        if (base::hash_combine(0, *other_uniform) != base::hash_combine(0, uniform.second))
+            return false;
+    }
+    if (mClass == other.mClass)
+        return true;
+    return mClass->GetHash() == other.mClass->GetHash();
+}
+
 void MaterialClassInst::ApplyDynamicState(const Environment& env, Device& device, Program& program, RasterState& raster) const
 {
     MaterialClass::State state;
@@ -2253,6 +2390,7 @@ void MaterialClassInst::ApplyDynamicState(const Environment& env, Device& device
     state.render_points = env.render_points;
     state.material_time = mRuntime;
     state.uniforms      = mUniforms;
+    state.atlas         = env.atlas;
     mClass->ApplyDynamicState(state, device, program);
 
     const auto surface = mClass->GetSurfaceType();
@@ -2333,24 +2471,7 @@ void TextMaterial::ApplyDynamicState(const Environment& env, Device& device, Pro
 void TextMaterial::ApplyStaticState(gfx::Device& device, gfx::Program& program) const
 {}
 Shader* TextMaterial::GetShader(const Environment& env, Device& device) const
-{
-constexpr auto* src = R"(
-#version 100
-precision highp float;
-uniform sampler2D kTexture;
-uniform vec4 kColor;
-uniform float kTime;
-varying vec2 vTexCoord;
-void main() {
-   float alpha = texture2D(kTexture, vTexCoord).a;
-   gl_FragColor = vec4(kColor.r, kColor.g, kColor.b, kColor.a * alpha);
-}
-        )";
-    auto* shader = device.MakeShader("text-shader");
-    shader->CompileSource(src);
-    shader->SetName("TextShader");
-    return shader;
-}
+{ return MakeTextShader(device); }
 std::string TextMaterial::GetProgramId() const
 { return "text-shader"; }
 std::string TextMaterial::GetClassId() const
@@ -2368,6 +2489,71 @@ void TextMaterial::ResetUniforms()
 void TextMaterial::SetUniforms(const UniformMap& uniforms)
 {}
 
+GlyphAtlasMaterial::GlyphAtlasMaterial(std::shared_ptr<GlyphAtlas> atlas)
+  : mAtlas(atlas)
+{}
+void GlyphAtlasMaterial::ApplyDynamicState(const Environment& env, Device& device, Program& program, RasterState& raster) const
+{
+    raster.blending = RasterState::Blending::Transparent;
+
+    const auto& name = "GlyphAtlas/" + mAtlas->GetFontName() + "/" + std::to_string(mAtlas->GetFontSize());
+    auto* texture = device.FindTexture(name);
+    if (!texture)
+    {
+        texture = device.MakeTexture(name);
+        texture->SetName(name);
+        texture->SetWrapX(Texture::Wrapping::Clamp);
+        texture->SetWrapY(Texture::Wrapping::Clamp);
+    }
+    // the glyphs are packed tightly so the atlas can't have mips.
+    // the glyphs are padded so that linear filtering doesn't bleed.
+    // the texture is shared so the filtering is set on every use.
+    if (mPointSampling)
+    {
+        texture->SetFilter(Texture::MagFilter::Nearest);
+        texture->SetFilter(Texture::MinFilter::Nearest);
+    }
+    else
+    {
+        texture->SetFilter(Texture::MagFilter::Linear);
+        texture->SetFilter(Texture::MinFilter::Linear);
+    }
+    // the atlas content changes only when new glyphs are rasterized
+    // which is rare after the commonly used glyphs have been cached.
+    // the content version is never 0 for a valid atlas.
+    const auto version = mAtlas->GetContentVersion();
+    if (texture->GetContentHash() != version)
+    {
+        const auto& bitmap = mAtlas->GetBitmap();
+        const bool mips = false;
+        texture->Upload(bitmap.GetDataPtr(), bitmap.GetWidth(), bitmap.GetHeight(),
+                        gfx::Texture::Format::Grayscale, mips);
+        texture->SetContentHash(version);
+    }
+    program.SetTexture("kTexture", 0, *texture);
+    program.SetUniform("kColor", mColor);
+}
+void GlyphAtlasMaterial::ApplyStaticState(gfx::Device& device, gfx::Program& program) const
+{}
+Shader* GlyphAtlasMaterial::GetShader(const Environment& env, Device& device) const
+{ return MakeTextShader(device); }
+std::string GlyphAtlasMaterial::GetProgramId() const
+{ return "text-shader"; }
+std::string GlyphAtlasMaterial::GetClassId() const
+{ return {}; }
+void GlyphAtlasMaterial::Update(float dt)
+{}
+void GlyphAtlasMaterial::SetRuntime(float runtime)
+{}
+void GlyphAtlasMaterial::SetUniform(const std::string& name, const Uniform& value)
+{}
+void GlyphAtlasMaterial::SetUniform(const std::string& name, Uniform&& value)
+{}
+void GlyphAtlasMaterial::ResetUniforms()
+{}
+void GlyphAtlasMaterial::SetUniforms(const UniformMap& uniforms)
+{}
+
 
 GradientClass CreateMaterialClassFromColor(const Color4f& top_left,
                                            const Color4f& top_right,
@@ -48,6 +48,7 @@ namespace gfx
 {
     class Device;
     class Shader;
+    class TextureAtlas;
 
     // Interface for acquiring texture data. Possible implementations
     // might load the data from a file or generate it on the fly.
@@ -97,6 +98,16 @@ namespace gfx
         // error this function should return empty shared pointer.
         // The returned bitmap can be potentially immutably shared.
         virtual std::shared_ptr<IBitmap> GetData() const = 0;
+        // Try to upload the texture content into the given texture object
+        // directly from a pre-processed (baked) GPU ready representation
+        // of the content without going through GetData. Returns false
+        // if no such data is available and GetData should be used instead.
+        virtual bool UploadBaked(Texture& texture) const
+        { return false; }
+        // Check whether the texture source has pre-processed (baked)
+        // content available for UploadBaked.
+        virtual bool HasBakedData() const
+        { return false; }
         // Create a similar clone of this texture source but
         // with unique id.
         virtual std::unique_ptr<TextureSource> Clone() const = 0;
@@ -162,6 +173,7 @@ namespace gfx
                 hash = base::hash_combine(hash, mName);
                 hash = base::hash_combine(hash, mFlags);
                 hash = base::hash_combine(hash, mColorSpace);
+                hash = base::hash_combine(hash, mBakedFile);
                 return hash;
             }
             virtual std::size_t GetContentHash() const override
@@ -169,6 +181,9 @@ namespace gfx
             virtual void SetName(const std::string& name) override
             { mName = name; }
             virtual std::shared_ptr<IBitmap> GetData() const override;
+            virtual bool UploadBaked(Texture& texture) const override;
+            virtual bool HasBakedData() const override
+            { return !mBakedFile.empty(); }
             virtual std::unique_ptr<TextureSource> Clone() const override
             {
                 auto ret = std::make_unique<TextureFileSource>(*this);
@@ -188,15 +203,22 @@ namespace gfx
                                        TestFlag(Flags::AllowPacking));
                 packer->SetTextureFlag(this, TexturePacker::TextureFlags::AllowedToResize,
                                        TestFlag(Flags::AllowResizing));
+                packer->SetTextureFlag(this, TexturePacker::TextureFlags::ColorSpace_sRGB,
+                                       mColorSpace == ColorSpace::sRGB);
+                packer->SetTextureFlag(this, TexturePacker::TextureFlags::PremulAlpha,
+                                       TestFlag(Flags::PremulAlpha));
             }
             virtual void FinishPacking(const TexturePacker* packer) override
             {
                 mFile = packer->GetPackedTextureId(this);
+                mBakedFile = packer->GetBakedTextureId(this);
             }
             void SetFileName(const std::string& file)
             { mFile = file; }
             const std::string& GetFilename() const
             { return mFile; }
+            const std::string& GetBakedFilename() const
+            { return mBakedFile; }
             bool TestFlag(Flags flag) const
             { return mFlags.test(flag); }
             void SetFlag(Flags flag, bool on_off)
@@ -206,6 +228,9 @@ namespace gfx
         private:
             std::string mId;
             std::string mFile;
+            // URI of the baked (pre-processed) texture file if any.
+            // This is only set when the content has been packaged.
+            std::string mBakedFile;
             std::string mName;
             base::bitflag<Flags> mFlags;
             ColorSpace mColorSpace = ColorSpace::Linear; // default to liaear now for compatibility
@@ -498,6 +523,12 @@ namespace gfx
             bool dynamic_content = false;
             double current_time  = 0.0f;
             std::string group_tag;
+            // The texture atlas for packing small textures into shared
+            // textures or nullptr if every texture source should use
+            // a texture object of its own. When textures are packed into
+            // the atlas the bound texture rects are adjusted to map into
+            // the atlas page.
+            TextureAtlas* atlas = nullptr;
         };
         // The result of binding textures.
         struct BoundState {
@@ -505,6 +536,9 @@ namespace gfx
             Texture* textures[2] = {nullptr, nullptr};
             // The texture rects for the textures.
             FRect rects[2];
+            // Whether the texture is a texture atlas page. The atlas
+            // pages have no mips.
+            bool atlas[2] = {false, false};
             // If multiple textures are used when cycling through a series of
             // textures (i.e. a sprite) the blend coefficient defines the
             // current weight between the textures[0] and textures[1] based
@@ -805,6 +839,8 @@ namespace gfx
             // The instance uniforms will take precedence over the uniforms
             // set in the class whenever they're set.
             std::unordered_map<std::string, Uniform> uniforms;
+            // The texture atlas to use (if any) for small textures.
+            TextureAtlas* atlas = nullptr;
         };
 
         virtual ~MaterialClass() = default;
@@ -1461,6 +1497,8 @@ namespace gfx
             // in case it has been modified and should be re-uploaded.
             bool editing_mode  = false;
             bool render_points = false;
+            // The texture atlas to use (if any) for small textures.
+            TextureAtlas* atlas = nullptr;
         };
         struct RasterState {
             using Blending = Device::State::BlendOp;
@@ -1538,6 +1576,13 @@ namespace gfx
 
         double GetRuntime() const
         { return mRuntime; }
+        const UniformMap& GetUniforms() const
+        { return mUniforms; }
+
+        // Check whether this material instance renders identically to
+        // the other material instance, i.e. both are instances of the
+        // same material class with the same runtime and instance uniforms.
+        bool HasSameState(const MaterialClassInst& other) const;
 
         // Get the material class object instance.
         const MaterialClass& GetClass() const
@@ -1590,6 +1635,39 @@ namespace gfx
         Color4f mColor = Color::White;
         bool mPointSampling = true;
     };
+
+    // Material for shading text drawn with a TextBatch drawable using
+    // glyphs from a shared glyph atlas. The atlas texture is shared by
+    // all materials using the same atlas and is only uploaded when the
+    // atlas contents have changed.
+    class GlyphAtlasMaterial : public gfx::Material
+    {
+    public:
+        GlyphAtlasMaterial(std::shared_ptr<GlyphAtlas> atlas);
+        virtual void ApplyDynamicState(const Environment& env, Device& device, Program& program, RasterState& raster) const override;
+        virtual void ApplyStaticState(Device& device, Program& program) const override;
+        virtual Shader* GetShader(const Environment& env, Device& device) const override;
+        virtual std::string GetProgramId() const override;
+        virtual std::string GetClassId() const override;
+        virtual void Update(float dt) override;
+        virtual void SetRuntime(float runtime) override;
+        virtual void SetUniform(const std::string& name, const Uniform& value) override;
+        virtual void SetUniform(const std::string& name, Uniform&& value) override;
+        virtual void ResetUniforms()  override;
+        virtual void SetUniforms(const UniformMap& uniforms) override;
+        void SetColor(const Color4f& color)
+        { mColor = color; }
+        // Set point sampling to true in order to sample the glyphs with
+        // nearest filtering. This keeps the glyphs (especially bitmap/pixel
+        // fonts) crisp when the text is drawn at its rasterized size.
+        // See TextMaterial::SetPointSampling. The default is true.
+        void SetPointSampling(bool on_off)
+        { mPointSampling = on_off; }
+    private:
+        std::shared_ptr<GlyphAtlas> mAtlas;
+        Color4f mColor = Color::White;
+        bool mPointSampling = true;
+    };
     // Create gradient material based on 4 colors
     GradientClass CreateMaterialClassFromColor(const Color4f& top_left,
                                                const Color4f& top_right,
@@ -32,6 +32,8 @@
 #include <sstream>
 #include <map>
 #include <unordered_map>
+#include <unordered_set>
+#include <algorithm>
 
 #include "base/assert.h"
 #include "base/logging.h"
@@ -269,6 +271,7 @@ struct OpenGLFunctions
     PFNGLCLEARPROC                   glClear;
     PFNGLCLEARSTENCILPROC            glClearStencil;
     PFNGLBLENDFUNCPROC               glBlendFunc;
+    PFNGLBLENDFUNCSEPARATEPROC       glBlendFuncSeparate;
     PFNGLDEPTHFUNCPROC               glDepthFunc;
     PFNGLVIEWPORTPROC                glViewport;
     PFNGLDRAWARRAYSPROC              glDrawArrays;
@@ -299,6 +302,7 @@ struct OpenGLFunctions
     PFNGLACTIVETEXTUREPROC           glActiveTexture;
     PFNGLGENERATEMIPMAPPROC          glGenerateMipmap;
     PFNGLTEXIMAGE2DPROC              glTexImage2D;
+    PFNGLTEXSUBIMAGE2DPROC           glTexSubImage2D;
     PFNGLTEXPARAMETERIPROC           glTexParameteri;
     PFNGLPIXELSTOREIPROC             glPixelStorei;
     PFNGLENABLEPROC                  glEnable;
@@ -361,6 +365,7 @@ public:
         RESOLVE(glClearStencil);
         RESOLVE(glClearDepthf);
         RESOLVE(glBlendFunc);
+        RESOLVE(glBlendFuncSeparate);
         RESOLVE(glViewport);
         RESOLVE(glDrawArrays);
         RESOLVE(glGetAttribLocation);
@@ -390,6 +395,7 @@ public:
         RESOLVE(glActiveTexture);
         RESOLVE(glGenerateMipmap);
         RESOLVE(glTexImage2D);
+        RESOLVE(glTexSubImage2D);
         RESOLVE(glTexParameteri);
         RESOLVE(glPixelStorei);
         RESOLVE(glEnable);
@@ -583,6 +589,7 @@ public:
         auto* ret    = program.get();
         mPrograms[name] = std::move(program);
         ret->SetFrameStamp(mFrameNumber);
+        mNumProgramsCreated++;
         return ret;
     }
 
@@ -608,7 +615,11 @@ public:
         auto it = mTextures.find(name);
         if (it == std::end(mTextures))
             return nullptr;
-        return it->second.get();
+        // the caller is likely to hold on to the texture pointer
+        // until the draw, so it must not be evicted during this frame.
+        auto* impl = static_cast<TextureImpl*>(it->second.get());
+        impl->SetLookupStamp(mFrameNumber);
+        return impl;
     }
 
     virtual Texture* MakeTexture(const std::string& name) override
@@ -623,6 +634,7 @@ public:
         // that is not used will get immediately cleaned away when the current
         // device frame number exceeds the maximum number of idle frames.
         ret->SetFrameStamp(mFrameNumber);
+        ret->SetLookupStamp(mFrameNumber);
         return ret;
     }
     virtual Framebuffer* FindFramebuffer(const std::string& name) override
@@ -636,6 +648,9 @@ public:
     {
         auto fbo = std::make_unique<FramebufferImpl>(name, mGL, *this);
         auto* ret = fbo.get();
+        auto it = mFBOs.find(name);
+        if (it != mFBOs.end() && it->second.get() == mFramebuffer)
+            mFramebuffer = nullptr;
         mFBOs[name] = std::move(fbo);
         return ret;
     }
@@ -643,10 +658,13 @@ public:
     virtual void DeleteShaders() override
     {
         mShaders.clear();
+        mCurrentProgram = 0;
     }
     virtual void DeletePrograms() override
     {
         mPrograms.clear();
+        // a new program could get the same name as a deleted one.
+        mCurrentProgram = 0;
     }
     virtual void DeleteGeometries() override
     {
@@ -668,10 +686,37 @@ public:
     virtual void DeleteFramebuffers() override
     {
         mFBOs.clear();
+        mFramebuffer = nullptr;
+    }
+    virtual void DeleteTexture(const std::string& name) override
+    {
+        auto it = mTextures.find(name);
+        if (it == mTextures.end())
+            return;
+
+        for (auto& unit : mTextureUnits)
+        {
+            if (unit.texture == it->second.get())
+                unit.texture = nullptr;
+        }
+        mTextures.erase(it);
+    }
+    virtual void DeleteFramebuffer(const std::string& name) override
+    {
+        auto it = mFBOs.find(name);
+        if (it == mFBOs.end())
+            return;
+
+        if (it->second.get() == mFramebuffer)
+            mFramebuffer = nullptr;
+        mFBOs.erase(it);
     }
 
     virtual void SetFramebuffer(const Framebuffer* fbo) override
     {
+        if (fbo != mFramebuffer)
+            mFrameStats.fbo_switches++;
+
         if (fbo)
         {
             const auto* impl = static_cast<const FramebufferImpl*>(fbo);
@@ -681,6 +726,7 @@ public:
         {
             GL_CALL(glBindFramebuffer(GL_FRAMEBUFFER, 0));
         }
+        mFramebuffer = fbo;
     }
 
     virtual void Draw(const Program& program, const Geometry& geometry, const State& state) override
@@ -692,6 +738,11 @@ public:
 
         // start using this program
         GL_CALL(glUseProgram(myprog->GetName()));
+        if (mCurrentProgram != myprog->GetName())
+        {
+            mCurrentProgram = myprog->GetName();
+            mFrameStats.program_switches++;
+        }
 
         // IMPORTANT !
         // the program doesn't set the uniforms directly but instead of compares the uniform
@@ -735,6 +786,7 @@ public:
                 GL_CALL(glUniformMatrix4fv(location, 1, GL_FALSE /*transpose*/, (const float*)&ptr->s));
             else BUG("Unhandled shader program uniform type.");
         }
+        mFrameStats.uniform_sets += myprog->GetNumUniformsSet();
 
         TRACE_LEAVE(SetUniforms);
         // clear pending uniform state after everything has been set.
@@ -780,6 +832,11 @@ public:
                 GL_CALL(glEnable(GL_BLEND));
                 if (state.premulalpha)
                     GL_CALL(glBlendFunc(GL_ONE, GL_ONE_MINUS_SRC_ALPHA));
+                // when rendering into an offscreen color buffer accumulate the
+                // alpha channel as coverage so that the result is a correct
+                // premultiplied image that can be composited later.
+                else if (mFramebuffer)
+                    GL_CALL(glBlendFuncSeparate(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA, GL_ONE, GL_ONE_MINUS_SRC_ALPHA));
                 else GL_CALL(glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA));
                 break;
             case State::BlendOp::Additive:
@@ -981,6 +1038,7 @@ public:
             {
                 // set the texture unit to the sampler
                 GL_CALL(glUniform1i(sampler.location, unit));
+                mFrameStats.uniform_sets++;
                 continue;
             }
 
@@ -1010,7 +1068,10 @@ public:
 
             // bind the 2D texture.
             if (mTextureUnits[unit].texture != texture)
+            {
                 GL_CALL(glBindTexture(GL_TEXTURE_2D, texture_handle));
+                mFrameStats.texture_binds++;
+            }
             // set texture parameters, wrapping and min/mag filters.
             if (mTextureUnits[unit].wrap_x != texture_wrap_x)
                 GL_CALL(glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, texture_wrap_x));
@@ -1023,6 +1084,7 @@ public:
 
             // set the texture unit to the sampler
             GL_CALL(glUniform1i(sampler.location, unit));
+            mFrameStats.uniform_sets++;
 
             // store current binding and the sampler state.
             mTextureUnits[unit].texture    = texture;
@@ -1080,6 +1142,9 @@ public:
             else if (type == Geometry::DrawType::LineLoop)
                 GL_CALL(glDrawArrays(GL_LINE_LOOP, offset, count));
             else BUG("Unknown draw primitive type.");
+
+            mFrameStats.draw_calls++;
+            mFrameStats.vertices += count;
         }
         TRACE_LEAVE(DrawGeometry);
     }
@@ -1093,7 +1158,11 @@ public:
                 auto* impl = static_cast<ProgImpl*>(it->second.get());
                 const auto last_used_frame_number = impl->GetFrameStamp();
                 if (mFrameNumber - last_used_frame_number >= max_num_idle_frames)
+                {
+                    if (impl->GetName() == mCurrentProgram)
+                        mCurrentProgram = 0;
                     it = mPrograms.erase(it);
+                }
                 else ++it;
             }
         }
@@ -1126,7 +1195,9 @@ public:
                 const auto this_last_used  = impl->GetFrameStamp();
                 const auto last_used = std::max(group_last_used, this_last_used);
                 const auto is_expired = mFrameNumber - last_used >= max_num_idle_frames;
-                if (is_expired)
+                // a texture that is the color buffer of a framebuffer lives
+                // as long as the framebuffer, see IsFramebufferTexture.
+                if (is_expired && !IsFramebufferTexture(impl))
                 {
                     size_t unit = 0;
                     for (unit = 0; unit < mTextureUnits.size(); ++unit)
@@ -1156,6 +1227,13 @@ public:
         }
     }
 
+    virtual void SetTextureMemoryBudget(std::size_t bytes) override
+    {
+        mTextureMemBudget = bytes;
+        if (mTextureMemBudget)
+            EvictTextures(0, nullptr);
+    }
+
     virtual void BeginFrame() override
     {
         for (auto& pair : mPrograms)
@@ -1181,6 +1259,8 @@ public:
     virtual void EndFrame(bool display) override
     {
         mFrameNumber++;
+        mLastFrameStats = mFrameStats;
+        mFrameStats = FrameStats();
         if (display)
             mContext->Display();
 
@@ -1252,6 +1332,15 @@ public:
                 stats->streaming_vbo_mem_use   += buffer.offset;
             }
         }
+        stats->texture_mem_use      = mTextureMemUse;
+        stats->texture_mem_budget   = mTextureMemBudget;
+        stats->num_textures_evicted = mNumTexturesEvicted;
+        stats->texture_mem_evicted  = mTextureMemEvicted;
+        stats->num_programs_created = mNumProgramsCreated;
+    }
+    virtual void GetFrameStats(FrameStats* stats) const override
+    {
+        *stats = mLastFrameStats;
     }
     virtual void GetDeviceCaps(DeviceCaps* caps) const override
     {
@@ -1369,6 +1458,8 @@ public:
         ASSERT(offset + bytes <= buffer.capacity);
         GL_CALL(glBindBuffer(GL_ARRAY_BUFFER, buffer.name));
         GL_CALL(glBufferSubData(GL_ARRAY_BUFFER, offset, bytes, data));
+        mFrameStats.buffer_uploads++;
+        mFrameStats.buffer_upload_bytes += bytes;
 
         if (buffer.usage == Geometry::Usage::Static)
         {
@@ -1424,6 +1515,124 @@ private:
     }
 private:
     class TextureImpl;
+
+    // Release texture memory by deleting the least recently used textures
+    // until the given number of new bytes fits within the texture memory budget.
+    void EvictTextures(std::size_t bytes, const TextureImpl* uploading)
+    {
+        if (!mTextureMemBudget || mTextureMemUse + bytes <= mTextureMemBudget)
+            return;
+
+        // textures that have been set on a program sampler could
+        // still be used by a draw that hasn't happened yet in this
+        // frame so they must not be deleted.
+        std::unordered_set<const TextureImpl*> pinned;
+        for (const auto& pair : mPrograms)
+        {
+            const auto* impl = static_cast<const ProgImpl*>(pair.second.get());
+            for (size_t i=0; i<impl->GetNumSamplersSet(); ++i)
+                pinned.insert(impl->GetSamplerSetting(i).texture);
+        }
+        // textures attached to a framebuffer are pinned for as long as
+        // the framebuffer exists.
+        for (const auto& pair : mFBOs)
+        {
+            const auto* impl = static_cast<const FramebufferImpl*>(pair.second.get());
+            if (const auto* texture = impl->GetClientColor())
+                pinned.insert(texture);
+        }
+
+        // the textures in a group are evicted together, see CleanGarbage.
+        // textures without a group are evicted individually.
+        struct Candidate {
+            std::vector<std::string> textures;
+            std::size_t last_used = 0;
+            std::size_t bytes = 0;
+            bool transient = true;
+            bool locked = false;
+        };
+        std::unordered_map<std::string, Candidate> candidates;
+        for (const auto& pair : mTextures)
+        {
+            const auto* impl  = static_cast<const TextureImpl*>(pair.second.get());
+            const auto& group = impl->GetGroup();
+            auto& candidate = candidates[group.empty() ? "#" + pair.first : group];
+            candidate.textures.push_back(pair.first);
+            candidate.last_used = std::max(candidate.last_used, impl->GetFrameStamp());
+            candidate.bytes    += impl->GetByteSize();
+            candidate.transient = candidate.transient && impl->IsTransient();
+            if (impl == uploading || pinned.count(impl) || impl->GetLookupStamp() == mFrameNumber)
+                candidate.locked = true;
+        }
+
+        std::vector<const Candidate*> lru;
+        for (const auto& pair : candidates)
+        {
+            const auto& candidate = pair.second;
+            // never evict anything that is being used for the current frame.
+            if (candidate.locked || candidate.last_used >= mFrameNumber)
+                continue;
+            lru.push_back(&candidate);
+        }
+        // transient textures are cheap to recreate so they go first,
+        // then the least recently used textures.
+        std::sort(lru.begin(), lru.end(), [](const Candidate* lhs, const Candidate* rhs) {
+            if (lhs->transient != rhs->transient)
+                return lhs->transient;
+            return lhs->last_used < rhs->last_used;
+        });
+
+        for (const auto* candidate : lru)
+        {
+            if (mTextureMemUse + bytes <= mTextureMemBudget)
+                break;
+            for (const auto& name : candidate->textures)
+            {
+                auto it = mTextures.find(name);
+                const auto* impl = static_cast<const TextureImpl*>(it->second.get());
+                for (auto& unit : mTextureUnits)
+                {
+                    if (unit.texture == impl)
+                        unit.texture = nullptr;
+                }
+                DEBUG("Evicting texture. [name='%1', bytes=%2, last_used=%3]", impl->GetName(),
+                      impl->GetByteSize(), impl->GetFrameStamp());
+                mTextureMemEvicted += impl->GetByteSize();
+                mNumTexturesEvicted++;
+                mTextures.erase(it);
+            }
+        }
+        if (mTextureMemUse + bytes > mTextureMemBudget)
+        {
+            WARN("Texture memory budget exceeded. [budget=%1, use=%2, request=%3]",
+                 mTextureMemBudget, mTextureMemUse, bytes);
+        }
+    }
+
+    // Check whether the texture is the color buffer of some framebuffer.
+    // Deleting such a texture would leave the framebuffer with a dangling
+    // color attachment, so the texture must outlive the framebuffer.
+    bool IsFramebufferTexture(const TextureImpl* texture) const
+    {
+        for (const auto& pair : mFBOs)
+        {
+            const auto* impl = static_cast<const FramebufferImpl*>(pair.second.get());
+            if (impl->GetClientColor() == texture)
+                return true;
+        }
+        return false;
+    }
+
+    static std::size_t GetTextureByteSize(unsigned xres, unsigned yres, Texture::Format format)
+    {
+        std::size_t bytes = std::size_t(xres) * std::size_t(yres);
+        if (format == Texture::Format::sRGB || format == Texture::Format::RGB)
+            bytes *= 3;
+        else if (format == Texture::Format::sRGBA || format == Texture::Format::RGBA)
+            bytes *= 4;
+        return bytes;
+    }
+
     // cached texture unit state. used to omit texture unit
     // state changes when not needed.
     struct TextureUnit {
@@ -1458,6 +1667,7 @@ private:
                 if (!mTransient)
                     DEBUG("Deleted texture object. [name='%1', handle=%2]", mName, mHandle);
             }
+            mDevice.mTextureMemUse -= mBytes;
         }
 
         virtual void Upload(const void* bytes, unsigned xres, unsigned yres, Format format, bool mips) override
@@ -1525,6 +1735,12 @@ private:
                 }
             }
 
+            // the full mip chain takes roughly 1/3 more memory than the base level.
+            const auto base_bytes = GetTextureByteSize(xres, yres, format);
+            const auto new_bytes  = mips ? base_bytes + base_bytes / 3 : base_bytes;
+            if (new_bytes > mBytes)
+                mDevice.EvictTextures(new_bytes - mBytes, this);
+
             GL_CALL(glActiveTexture(GL_TEXTURE0));
 
             // trash the last texture unit in the hopes that it would not
@@ -1566,6 +1782,11 @@ private:
             #endif
             }
 
+            mDevice.mTextureMemUse -= mBytes;
+            mDevice.mTextureMemUse += new_bytes;
+            mDevice.mFrameStats.texture_uploads++;
+            mDevice.mFrameStats.texture_upload_bytes += bytes ? base_bytes : 0;
+            mBytes  = new_bytes;
             mWidth  = xres;
             mHeight = yres;
             mFormat = format;
@@ -1577,6 +1798,132 @@ private:
             mDevice.mTextureUnits[last].mag_filter = GL_NONE;
         }
 
+        virtual void UploadMip(unsigned level, const void* bytes, unsigned xres, unsigned yres, Format format) override
+        {
+            ASSERT(mHandle);
+            ASSERT(level > 0);
+            ASSERT(format == mFormat);
+
+        #if defined(WEBGL)
+            // WebGL only supports mips with POT textures.
+            if (!base::IsPowerOfTwo(mWidth) || !base::IsPowerOfTwo(mHeight))
+                return;
+        #endif
+
+            GLenum type = 0;
+            std::unique_ptr<IBitmap> linear;
+            if (format == Format::sRGB && !mDevice.mExtensions.EXT_sRGB)
+            {
+                BitmapReadView<RGB> view((const RGB*) bytes, xres, yres);
+                linear = ConvertToLinear(view);
+                bytes = linear->GetDataPtr();
+                type  = GL_RGB;
+            }
+            else if (format == Format::sRGBA && !mDevice.mExtensions.EXT_sRGB)
+            {
+                BitmapReadView<RGBA> view((const RGBA*) bytes, xres, yres);
+                linear = ConvertToLinear(view);
+                bytes = linear->GetDataPtr();
+                type  = GL_RGBA;
+            }
+            else if (format == Format::sRGB)
+                type = GL_SRGB_EXT;
+            else if (format == Format::sRGBA)
+                type = GL_SRGB_ALPHA_EXT;
+            else if (format == Format::RGB)
+                type = GL_RGB;
+            else if (format == Format::RGBA)
+                type = GL_RGBA;
+            else if (format == Format::Grayscale)
+                type = GL_ALPHA;
+            else BUG("Unknown texture format.");
+
+            // the base level upload has trashed the last texture unit
+            // and left this texture bound there. make sure that's still
+            // the case since the texture units might have been used in between.
+            const auto last = mDevice.mTextureUnits.size() - 1;
+            const auto unit = GL_TEXTURE0 + last;
+            GL_CALL(glActiveTexture(unit));
+            GL_CALL(glBindTexture(GL_TEXTURE_2D, mHandle));
+            GL_CALL(glTexImage2D(GL_TEXTURE_2D,
+                level,
+                type,
+                xres,
+                yres,
+                0, // border must be 0
+                type,
+                GL_UNSIGNED_BYTE,
+                bytes));
+            mHasMips = true;
+            const auto level_bytes = GetTextureByteSize(xres, yres, format);
+            mDevice.mTextureMemUse += level_bytes;
+            mDevice.mFrameStats.texture_uploads++;
+            mDevice.mFrameStats.texture_upload_bytes += level_bytes;
+            mBytes += level_bytes;
+            mDevice.mTextureUnits[last].texture = this;
+            mDevice.mTextureUnits[last].wrap_x  = GL_NONE;
+            mDevice.mTextureUnits[last].wrap_y  = GL_NONE;
+            mDevice.mTextureUnits[last].min_filter = GL_NONE;
+            mDevice.mTextureUnits[last].mag_filter = GL_NONE;
+        }
+
+        virtual void UploadSubRect(const void* bytes, unsigned xpos, unsigned ypos, unsigned width, unsigned height) override
+        {
+            ASSERT(mHandle);
+            ASSERT(!mHasMips);
+            ASSERT(xpos + width <= mWidth && ypos + height <= mHeight);
+
+            GLenum type = 0;
+            std::unique_ptr<IBitmap> linear;
+            if (mFormat == Format::sRGB && !mDevice.mExtensions.EXT_sRGB)
+            {
+                BitmapReadView<RGB> view((const RGB*) bytes, width, height);
+                linear = ConvertToLinear(view);
+                bytes = linear->GetDataPtr();
+                type  = GL_RGB;
+            }
+            else if (mFormat == Format::sRGBA && !mDevice.mExtensions.EXT_sRGB)
+            {
+                BitmapReadView<RGBA> view((const RGBA*) bytes, width, height);
+                linear = ConvertToLinear(view);
+                bytes = linear->GetDataPtr();
+                type  = GL_RGBA;
+            }
+            else if (mFormat == Format::sRGB)
+                type = GL_SRGB_EXT;
+            else if (mFormat == Format::sRGBA)
+                type = GL_SRGB_ALPHA_EXT;
+            else if (mFormat == Format::RGB)
+                type = GL_RGB;
+            else if (mFormat == Format::RGBA)
+                type = GL_RGBA;
+            else if (mFormat == Format::Grayscale)
+                type = GL_ALPHA;
+            else BUG("Unknown texture format.");
+
+            // trash the last texture unit the same way as Upload does.
+            const auto last = mDevice.mTextureUnits.size() - 1;
+            const auto unit = GL_TEXTURE0 + last;
+            GL_CALL(glActiveTexture(unit));
+            GL_CALL(glBindTexture(GL_TEXTURE_2D, mHandle));
+            GL_CALL(glTexSubImage2D(GL_TEXTURE_2D,
+                0, // mip level
+                xpos,
+                ypos,
+                width,
+                height,
+                type,
+                GL_UNSIGNED_BYTE,
+                bytes));
+            mDevice.mFrameStats.texture_uploads++;
+            mDevice.mFrameStats.texture_upload_bytes += GetTextureByteSize(width, height, mFormat);
+            mDevice.mTextureUnits[last].texture = this;
+            mDevice.mTextureUnits[last].wrap_x  = GL_NONE;
+            mDevice.mTextureUnits[last].wrap_y  = GL_NONE;
+            mDevice.mTextureUnits[last].min_filter = GL_NONE;
+            mDevice.mTextureUnits[last].mag_filter = GL_NONE;
+        }
+
         // refer actual state setting to the point when
         // the texture is actually used in a program's sampler
         virtual void SetFilter(MinFilter filter) override
@@ -1624,10 +1971,16 @@ private:
         { mFrameNumber = frame_number; }
         std::size_t GetFrameStamp() const
         { return mFrameNumber; }
+        void SetLookupStamp(size_t frame_number)
+        { mLookupFrameNumber = frame_number; }
+        std::size_t GetLookupStamp() const
+        { return mLookupFrameNumber; }
         const std::string& GetName() const
         { return mName; }
         const std::string& GetGroup() const
         { return mGroup; }
+        std::size_t GetByteSize() const
+        { return mBytes; }
     private:
         void GenerateMips(const void* bytes, unsigned xres, unsigned yres, Format format)
         {
@@ -1681,7 +2034,10 @@ private:
         unsigned mHeight = 0;
         Format mFormat = Texture::Format::Grayscale;
         mutable std::size_t mFrameNumber = 0;
+        std::size_t mLookupFrameNumber = 0;
         std::size_t mHash = 0;
+        // estimated number of bytes used by the texture data.
+        std::size_t mBytes = 0;
         std::string mName;
         std::string mGroup;
         bool mTransient = false;
@@ -2347,16 +2703,25 @@ private:
                 GLint mCurrentFBO = 0;
             } binder(mGL);
 
-            mColor = std::make_unique<TextureImpl>(mGL, mDevice);
-            mColor->Upload(nullptr, xres, yres, Texture::Format::RGBA, false /*mips*/);
-            mColor->SetName("FBO/" + mName + "/color0");
+            TextureImpl* color = mClientColor;
+            if (color)
+            {
+                ASSERT(color->GetWidth() == xres && color->GetHeight() == yres);
+            }
+            else
+            {
+                mColor = std::make_unique<TextureImpl>(mGL, mDevice);
+                mColor->Upload(nullptr, xres, yres, Texture::Format::RGBA, false /*mips*/);
+                mColor->SetName("FBO/" + mName + "/color0");
+                color = mColor.get();
+            }
 
             GL_CALL(glGenFramebuffers(1, &mHandle));
             GL_CALL(glBindFramebuffer(GL_FRAMEBUFFER, mHandle));
 
             if (conf.format == Format::ColorRGBA8)
             {
-                GL_CALL(glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, mColor->GetHandle(), 0));
+                GL_CALL(glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, color->GetHandle(), 0));
             }
             else if (conf.format == Format::ColorRGBA8_Depth16)
             {
@@ -2364,7 +2729,7 @@ private:
                 GL_CALL(glBindRenderbuffer(GL_RENDERBUFFER, mDepthBuffer));
                 GL_CALL(glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT16, xres, yres));
                 GL_CALL(glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, mDepthBuffer));
-                GL_CALL(glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, mColor->GetHandle(), 0));
+                GL_CALL(glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, color->GetHandle(), 0));
             }
             else if (conf.format == Format::ColorRGBA8_Depth24_Stencil8)
             {
@@ -2380,7 +2745,7 @@ private:
                     GL_CALL(glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH24_STENCIL8_OES, xres, yres));
                     GL_CALL(glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, mDepthBuffer));
                     GL_CALL(glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_STENCIL_ATTACHMENT, GL_RENDERBUFFER, mDepthBuffer));
-                    GL_CALL(glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, mColor->GetHandle(), 0));
+                    GL_CALL(glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, color->GetHandle(), 0));
                 }
                 else
                 {
@@ -2392,7 +2757,7 @@ private:
                     GL_CALL(glBindRenderbuffer(GL_RENDERBUFFER, mDepthBuffer));
                     GL_CALL(glRenderbufferStorage(GL_RENDERBUFFER, WEBGL_DEPTH_STENCIL, xres, yres));
                     GL_CALL(glFramebufferRenderbuffer(GL_FRAMEBUFFER, WEBGL_DEPTH_STENCIL_ATTACHMENT, GL_RENDERBUFFER, mDepthBuffer));
-                    GL_CALL(glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, mColor->GetHandle(), 0));
+                    GL_CALL(glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, color->GetHandle(), 0));
                 }
             }
             // possible FBO *error* statuses are: INCOMPLETE_ATTACHMENT, INCOMPLETE_DIMENSIONS and INCOMPLETE_MISSING_ATTACHMENT
@@ -2408,8 +2773,18 @@ private:
             mConfig = conf;
             return ret == GL_FRAMEBUFFER_COMPLETE;
         }
+        virtual void SetColorTarget(Texture* texture) override
+        {
+            ASSERT(mHandle == 0);
+            mClientColor = static_cast<TextureImpl*>(texture);
+        }
         virtual void Resolve(Texture** color) const override
         {
+            if (mClientColor)
+            {
+                *color = mClientColor;
+                return;
+            }
             ASSERT(mColor);
             *color = mColor.get();
         }
@@ -2422,11 +2797,15 @@ private:
 
         GLuint GetHandle() const
         { return mHandle; }
+        const TextureImpl* GetClientColor() const
+        { return mClientColor; }
     private:
         const std::string mName;
         const OpenGLFunctions& mGL;
         OpenGLES2GraphicsDevice& mDevice;
         std::unique_ptr<TextureImpl> mColor;
+        // client provided color buffer texture if any.
+        TextureImpl* mClientColor = nullptr;
         GLuint mHandle = 0;
         // this is either only depth or packed depth+stencil
         GLuint mDepthBuffer = 0;
@@ -2438,6 +2817,8 @@ private:
     std::map<std::string, std::unique_ptr<Program>> mPrograms;
     std::map<std::string, std::unique_ptr<Texture>> mTextures;
     std::map<std::string, std::unique_ptr<Framebuffer>> mFBOs;
+    // the currently bound framebuffer if any.
+    const Framebuffer* mFramebuffer = nullptr;
     std::shared_ptr<Context> mContextImpl;
     Context* mContext = nullptr;
     std::size_t mFrameNumber = 0;
@@ -2459,6 +2840,18 @@ private:
         bool EXT_sRGB = false;
         bool OES_packed_depth_stencil = false;
     } mExtensions;
+    // texture memory accounting.
+    std::size_t mTextureMemUse = 0;
+    std::size_t mTextureMemBudget = 0;
+    std::size_t mTextureMemEvicted = 0;
+    std::size_t mNumTexturesEvicted = 0;
+    // total number of programs created.
+    std::size_t mNumProgramsCreated = 0;
+    // the counters for the current and the last completed frame.
+    FrameStats mFrameStats;
+    FrameStats mLastFrameStats;
+    // the program that was used in the latest draw.
+    GLuint mCurrentProgram = 0;
 };
 
 namespace detail {
@@ -58,7 +58,13 @@ namespace gfx
             // Texture flags allow resizing.
             AllowedToResize,
             // Texture flags allow packing/combining.
-            AllowedToPack
+            AllowedToPack,
+            // Texture content is sRGB encoded. Used when baking
+            // the texture data in order to compute the mips correctly.
+            ColorSpace_sRGB,
+            // Texture alpha should be premultiplied. Used when baking
+            // the texture data.
+            PremulAlpha
         };
         // Set the texture flags that impact how the texture can be packed
         virtual void SetTextureFlag(ObjectHandle instance, TextureFlags flag, bool on_off) = 0;
@@ -68,6 +74,10 @@ namespace gfx
         // resources after packing.
         virtual std::string GetPackedTextureId(ObjectHandle instance) const = 0;
         virtual gfx::FRect  GetPackedTextureBox(ObjectHandle instance) const = 0;
+        // Get the URI of the baked (GPU ready, pre-processed) texture data
+        // for the texture object. If no baked data was produced then an
+        // empty string is returned.
+        virtual std::string GetBakedTextureId(ObjectHandle instance) const = 0;
     protected:
         ~TexturePacker() = default;
     };
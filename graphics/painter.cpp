@@ -52,6 +52,10 @@ public:
     {
         mEditingMode = on_off;
     }
+    virtual void SetTextureAtlas(TextureAtlas* atlas) override
+    {
+        mAtlas = atlas;
+    }
     virtual void SetPixelRatio(const glm::vec2& ratio) override
     {
         mPixelRatio = ratio;
@@ -84,6 +88,18 @@ public:
     {
         return mViewMatrix;
     }
+    virtual const glm::mat4& GetProjectionMatrix() const override
+    {
+        return mProjection;
+    }
+    virtual IRect GetViewport() const override
+    {
+        return mViewport;
+    }
+    virtual USize GetSurfaceSize() const override
+    {
+        return USize(mSurfacesize);
+    }
     virtual void Clear(const Color4f& color) override
     {
         mDevice->ClearColor(color);
@@ -102,12 +118,14 @@ public:
         drawable_env.proj_matrix  = &mProjection;
         drawable_env.view_matrix  = &mViewMatrix;
         drawable_env.model_matrix = &kModelMatrix;
+        drawable_env.screen_size  = ComputeScreenSize(kModelMatrix);
         Geometry* geom = drawable.Upload(drawable_env, *mDevice);
         if (geom == nullptr)
             return;
 
         Material::Environment material_env;
         material_env.editing_mode  = mEditingMode;
+        material_env.atlas         = mAtlas;
         material_env.render_points = style == Drawable::Style::Points;
         Program* prog = GetProgram(drawable, material, drawable_env, material_env);
         if (prog == nullptr)
@@ -175,12 +193,14 @@ public:
             drawable_env.view_matrix  = &mViewMatrix;
             drawable_env.proj_matrix  = &mProjection;
             drawable_env.model_matrix = mask.transform;
+            drawable_env.screen_size  = ComputeScreenSize(*mask.transform);
             Geometry* geom = mask.drawable->Upload(drawable_env, *mDevice);
             if (geom == nullptr)
                 continue;
 
             Material::Environment material_env;
             material_env.editing_mode  = mEditingMode;
+            material_env.atlas         = mAtlas;
             material_env.render_points = mask.drawable->GetStyle() == Drawable::Style::Points;
             Program* prog = GetProgram(*mask.drawable, mask_material, drawable_env,material_env);
             if (prog == nullptr)
@@ -211,12 +231,14 @@ public:
             drawable_env.view_matrix  = &mViewMatrix;
             drawable_env.proj_matrix  = &mProjection;
             drawable_env.model_matrix = draw.transform;
+            drawable_env.screen_size  = ComputeScreenSize(*draw.transform);
             Geometry* geom = draw.drawable->Upload(drawable_env, *mDevice);
             if (geom == nullptr)
                 continue;
 
             Material::Environment material_env;
             material_env.editing_mode  = mEditingMode;
+            material_env.atlas         = mAtlas;
             material_env.render_points = draw.drawable->GetStyle() == Drawable::Style::Points;
             Program* prog = GetProgram(*draw.drawable, *draw.material, drawable_env, material_env);
             if (prog == nullptr)
@@ -245,12 +267,14 @@ public:
             drawable_env.proj_matrix  = &mProjection;
             drawable_env.view_matrix  = &mViewMatrix;
             drawable_env.model_matrix = draw.transform;
+            drawable_env.screen_size  = ComputeScreenSize(*draw.transform);
             Geometry* geom = draw.drawable->Upload(drawable_env, *mDevice);
             if (geom == nullptr)
                 continue;
 
             Material::Environment material_env;
             material_env.editing_mode  = mEditingMode;
+            material_env.atlas         = mAtlas;
             material_env.render_points = draw.drawable->GetStyle() == Drawable::Style::Points;
             Program* program = GetProgram(*draw.drawable, *draw.material, drawable_env, material_env);
             if (program == nullptr)
@@ -275,6 +299,21 @@ public:
         }
     }
 
+    virtual bool PrepareProgram(const Drawable& drawable, const Material& material) override
+    {
+        Drawable::Environment drawable_env;
+        drawable_env.editing_mode = mEditingMode;
+        drawable_env.pixel_ratio  = mPixelRatio;
+        drawable_env.proj_matrix  = &mProjection;
+        drawable_env.view_matrix  = &mViewMatrix;
+
+        Material::Environment material_env;
+        material_env.editing_mode  = mEditingMode;
+        material_env.atlas         = mAtlas;
+        material_env.render_points = drawable.GetStyle() == Drawable::Style::Points;
+        return GetProgram(drawable, material, drawable_env, material_env) != nullptr;
+    }
+
 private:
     Program* GetProgram(const Drawable& drawable,
                         const Material& material,
@@ -307,6 +346,22 @@ private:
         return nullptr;
     }
 
+    // Compute the approximate size of the model space unit box on the
+    // rendering surface in pixels.
+    glm::vec2 ComputeScreenSize(const glm::mat4& model) const
+    {
+        if (mViewport.IsEmpty())
+            return glm::vec2(0.0f, 0.0f);
+        // the NDC range is 2 units across the viewport.
+        const auto half_width  = mViewport.GetWidth() * 0.5f;
+        const auto half_height = mViewport.GetHeight() * 0.5f;
+        const auto& mvp = mProjection * mViewMatrix * model;
+        const auto& x = mvp * glm::vec4(1.0f, 0.0f, 0.0f, 0.0f);
+        const auto& y = mvp * glm::vec4(0.0f, 1.0f, 0.0f, 0.0f);
+        return glm::vec2(glm::length(glm::vec2(x.x * half_width, x.y * half_height)),
+                         glm::length(glm::vec2(y.x * half_width, y.y * half_height)));
+    }
+
     IRect MapToDevice(const IRect& rect) const
     {
         if (rect.IsEmpty())
@@ -323,6 +378,7 @@ private:
     Device* mDevice = nullptr;
 private:
     bool mEditingMode = false;
+    TextureAtlas* mAtlas = nullptr;
     // Expected Size of the rendering surface.
     ISize mSurfacesize;
     // the viewport setting for mapping the NDC coordinates
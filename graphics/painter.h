@@ -36,6 +36,7 @@ namespace gfx
     class Drawable;
     class Material;
     class Transform;
+    class TextureAtlas;
 
     // Painter class implements some algorithms for
     // drawing different types of objects on the screen.
@@ -48,6 +49,10 @@ namespace gfx
         // modifications and possibly regenerated/reuploaded to the device.
         // The default is false.
         virtual void SetEditingMode(bool on_off) = 0;
+        // Set the texture atlas to be used for packing small textures
+        // into shared textures or nullptr to disable packing.
+        // The atlas must outlive the painter. The default is nullptr.
+        virtual void SetTextureAtlas(TextureAtlas* atlas) = 0;
         // Set the ratio of rendering surface pixels to game units.
         virtual void SetPixelRatio(const glm::vec2& ratio) = 0;
         // Set the size of the target rendering surface. (The surface that
@@ -81,6 +86,12 @@ namespace gfx
         virtual void SetViewMatrix(const glm::mat4& view) = 0;
         // Get the current view matrix if any.
         virtual const glm::mat4& GetViewMatrix() const = 0;
+        // Get the current projection matrix.
+        virtual const glm::mat4& GetProjectionMatrix() const = 0;
+        // Get the current render target/device view port.
+        virtual IRect GetViewport() const = 0;
+        // Get the current size of the target rendering surface.
+        virtual USize GetSurfaceSize() const = 0;
 
         // Clear the render target with the given clear color.
         // You probably want to do this as the first step before
@@ -112,6 +123,14 @@ namespace gfx
         // todo:
         virtual void Draw(const std::vector<DrawShape>& shapes) = 0;
 
+        // Compile and link the device program that is needed for drawing
+        // the given drawable with the given material without drawing anything.
+        // This lets the caller build the programs ahead of time (for example
+        // when loading a scene) instead of stalling the frame where the
+        // combination is drawn for the first time.
+        // Returns true if the program is available, otherwise false.
+        virtual bool PrepareProgram(const Drawable& drawable, const Material& material) = 0;
+
         // Create new painter implementation using the given graphics device.
         static std::unique_ptr<Painter> Create(std::shared_ptr<Device> device);
         static std::unique_ptr<Painter> Create(Device* device);
@@ -27,6 +27,7 @@
 #include <functional>
 #include <stdexcept>
 #include <map>
+#include <sstream>
 
 #include "base/logging.h"
 #include "base/utility.h"
@@ -74,6 +75,12 @@ struct FontLibrary {
         //DEBUG("Done with FreeType");
     }
 };
+FontLibrary& GetFontLibrary()
+{
+    static FontLibrary freetype;
+    return freetype;
+}
+
 // FreeType 2 uses size objects to model all information related to a given character
 // size for a given face. For example, a size object holds the value of certain metrics
 // like the ascender or text height, expressed in 1/64th of a pixel, for a character
@@ -81,6 +88,13 @@ struct FontLibrary {
 // https://www.freetype.org/freetype2/docs/tutorial/step1.html
 const auto EFFIN_MAGIC_SCALE = 64;
 
+// padding in pixels between glyphs in the glyph atlas in order
+// to avoid sampling neighbouring glyphs when filtering.
+const unsigned GLYPH_PADDING = 1;
+// size of the solid block of pixels reserved for drawing
+// underlines at the top left corner of the glyph atlas.
+const unsigned UNDERLINE_BLOCK = 4;
+
 using gfx::Bitmap;
 using gfx::Grayscale;
 
@@ -392,7 +406,7 @@ void TextBuffer::SetBufferSize(unsigned int width, unsigned int height)
 
 std::shared_ptr<AlphaMask> TextBuffer::Rasterize() const
 {
-    static FontLibrary freetype;
+    auto& freetype = GetFontLibrary();
 
     std::vector<TextComposite> blocks;
     std::shared_ptr<const Resource> fontbuff;
@@ -600,4 +614,426 @@ std::optional<TextBuffer> TextBuffer::FromJson(const data::Reader& data)
     return buffer;
 }
 
+struct GlyphAtlas::Font {
+    // the font data buffer must outlive the face.
+    ResourceHandle buffer;
+    FT_Face face = nullptr;
+    hb_font_t* hb_font = nullptr;
+   ~Font()
+    {
+        if (hb_font)
+            hb_font_destroy(hb_font);
+        if (face)
+            FT_Done_Face(face);
+    }
+};
+
+GlyphAtlas::GlyphAtlas(const std::string& font, unsigned font_size)
+  : mFontName(font)
+  , mFontSize(font_size)
+  , mBitmap(AtlasSize, AtlasSize)
+{
+    auto& freetype = GetFontLibrary();
+
+    auto buffer = gfx::LoadResource(font);
+    if (!buffer)
+    {
+        ERROR("Failed to load font file. [file='%1']", font);
+        return;
+    }
+    auto ret = std::make_unique<Font>();
+    ret->buffer = buffer;
+    if (FT_New_Memory_Face(freetype.library, (const FT_Byte*)buffer->GetData(),
+                           buffer->GetSize(), 0, &ret->face))
+    {
+        ERROR("Failed to load font file. [file='%1']", font);
+        return;
+    }
+    if (FT_Select_Charmap(ret->face, FT_ENCODING_UNICODE))
+    {
+        ERROR("Font doesn't support Unicode. [file='%1']", font);
+        return;
+    }
+    if (FT_Set_Pixel_Sizes(ret->face, 0, font_size))
+    {
+        ERROR("Font doesn't support pixel size. [file='%1', size=%2]", font, font_size);
+        return;
+    }
+    ret->hb_font = hb_ft_font_create(ret->face, nullptr);
+    mFont = std::move(ret);
+
+    // make the pages big enough to fit several glyphs each.
+    mPageSize = 256;
+    while (mPageSize < font_size * 2 && mPageSize < AtlasSize)
+        mPageSize *= 2;
+
+    const auto pages = AtlasSize / mPageSize;
+    for (unsigned y=0; y<pages; ++y)
+    {
+        for (unsigned x=0; x<pages; ++x)
+        {
+            Page page;
+            page.x = x * mPageSize;
+            page.y = y * mPageSize;
+            mPages.push_back(std::move(page));
+        }
+    }
+    for (unsigned i=0; i<mPages.size(); ++i)
+        ClearPage(i);
+
+    DEBUG("Created new glyph atlas. [font='%1', size=%2, pages=%3]", font, font_size, mPages.size());
+}
+
+GlyphAtlas::~GlyphAtlas() = default;
+
+bool GlyphAtlas::Layout(const TextBuffer& text, std::vector<GlyphQuad>* quads, unsigned* width, unsigned* height)
+{
+    if (!mFont)
+        return false;
+
+    // start a new layout round. any page used during this round
+    // will not be evicted until the layout is done.
+    ++mLayoutRound;
+
+    FT_Face face = mFont->face;
+
+    // see RasterizeLine for the underline computation.
+    const int underline_position  = face->underline_position / EFFIN_MAGIC_SCALE;
+    const int underline_thickness = 2;
+    // the texture rects are kept in atlas pixels until the layout is
+    // done since the atlas can grow while the glyphs are being laid out.
+    const FRect underline_rect(1, 1, UNDERLINE_BLOCK-2, UNDERLINE_BLOCK-2);
+
+    struct Line {
+        std::vector<GlyphQuad> glyphs;
+        int width = 0;
+    };
+    struct Block {
+        std::vector<Line> lines;
+        int width  = 0;
+        int height = 0;
+    };
+    std::vector<Block> blocks;
+
+    hb_buffer_t* hb_buff = hb_buffer_create();
+    auto buff_raii = base::MakeUniqueHandle(hb_buff, hb_buffer_destroy);
+
+    const auto halign = text.GetHorizontalAligment();
+    const auto valign = text.GetVerticalAlignment();
+
+    for (size_t i=0; i<text.GetNumTexts(); ++i)
+    {
+        const auto& blob = text.GetText(i);
+        if (blob.font != mFontName || blob.fontsize != mFontSize)
+        {
+            WARN("Text font doesn't match glyph atlas font. [font='%1', size=%2]", blob.font, blob.fontsize);
+            continue;
+        }
+        const int line_height = (face->size->metrics.height / EFFIN_MAGIC_SCALE) * blob.lineheight;
+
+        Block block;
+        // see CompositeTextBlock for the baseline position.
+        int baseline = line_height * 0.75;
+
+        std::stringstream ss(blob.text);
+        std::string str;
+        while (std::getline(ss, str))
+        {
+            Line line;
+            if (!str.empty())
+            {
+                hb_buffer_reset(hb_buff);
+                hb_buffer_add_utf8(hb_buff, str.c_str(), -1, 0, -1);
+                hb_buffer_set_direction(hb_buff, HB_DIRECTION_LTR);
+                hb_buffer_set_script(hb_buff, HB_SCRIPT_LATIN);
+                hb_buffer_set_language(hb_buff, hb_language_from_string("en", -1));
+                hb_shape(mFont->hb_font, hb_buff, nullptr, 0);
+
+                const auto glyph_count = hb_buffer_get_length(hb_buff);
+                const hb_glyph_info_t* glyph_info = hb_buffer_get_glyph_infos(hb_buff, nullptr);
+                const hb_glyph_position_t* glyph_pos = hb_buffer_get_glyph_positions(hb_buff, nullptr);
+
+                int pen_x = 0;
+                int pen_y = 0;
+                for (unsigned g=0; g<glyph_count; ++g)
+                {
+                    const auto* glyph = FindGlyph(glyph_info[g].codepoint);
+                    if (!glyph)
+                        return false;
+
+                    const int xa = glyph_pos[g].x_advance / EFFIN_MAGIC_SCALE;
+                    const int ya = glyph_pos[g].y_advance / EFFIN_MAGIC_SCALE;
+                    const int xo = glyph_pos[g].x_offset / EFFIN_MAGIC_SCALE;
+                    const int yo = glyph_pos[g].y_offset / EFFIN_MAGIC_SCALE;
+
+                    // glyph top left corner relative to the baseline with y growing up.
+                    const int x = pen_x + glyph->bearing_x + xo;
+                    const int y = pen_y + glyph->bearing_y + yo;
+                    if (glyph->width && glyph->height)
+                    {
+                        GlyphQuad quad;
+                        quad.x      = x;
+                        quad.y      = baseline - y;
+                        quad.width  = glyph->width;
+                        quad.height = glyph->height;
+                        quad.texture_rect = FRect(glyph->x, glyph->y, glyph->width, glyph->height);
+                        line.glyphs.push_back(quad);
+                    }
+                    line.width = x + glyph->width;
+
+                    pen_x += xa;
+                    pen_y += ya;
+                }
+                if (blob.underline)
+                {
+                    GlyphQuad quad;
+                    quad.x      = 0;
+                    quad.y      = baseline + underline_position;
+                    quad.width  = line.width;
+                    quad.height = underline_thickness;
+                    quad.texture_rect = underline_rect;
+                    line.glyphs.push_back(quad);
+                    mPages[0].last_use = mLayoutRound;
+                }
+            }
+            block.width = std::max(block.width, line.width);
+            block.lines.push_back(std::move(line));
+            baseline += line_height;
+        }
+        block.height = block.lines.size() * line_height;
+        blocks.push_back(std::move(block));
+    }
+
+    int text_width_px  = 0;
+    int text_height_px = 0;
+    for (const auto& block : blocks)
+    {
+        text_width_px   = std::max(block.width, text_width_px);
+        text_height_px += block.height;
+    }
+    const int image_width_px  = text.GetBufferWidth()  ? (int)text.GetBufferWidth()  : text_width_px;
+    const int image_height_px = text.GetBufferHeight() ? (int)text.GetBufferHeight() : text_height_px;
+
+    int block_ypos = 0;
+    if (valign == TextBuffer::VerticalAlignment::AlignCenter)
+        block_ypos = (image_height_px - text_height_px) / 2;
+    else if (valign == TextBuffer::VerticalAlignment::AlignBottom)
+        block_ypos = image_height_px - text_height_px;
+
+    quads->clear();
+    for (const auto& block : blocks)
+    {
+        const int block_xpos = AlignLine(block.width, image_width_px, halign);
+        for (const auto& line : block.lines)
+        {
+            const int line_xpos = AlignLine(line.width, block.width, halign);
+            for (auto quad : line.glyphs)
+            {
+                const auto& tex = quad.texture_rect;
+                quad.x += block_xpos + line_xpos;
+                quad.y += block_ypos;
+                quad.texture_rect = MapRect(tex.GetX(), tex.GetY(), tex.GetWidth(), tex.GetHeight());
+                quads->push_back(quad);
+            }
+        }
+        block_ypos += block.height;
+    }
+    *width  = image_width_px;
+    *height = image_height_px;
+    return true;
+}
+
+// static
+std::shared_ptr<GlyphAtlas> GlyphAtlas::Get(const std::string& font, unsigned font_size)
+{
+    // the atlases are kept around for the lifetime of the program.
+    // the number of different font and size combinations is expected
+    // to be small. failed atlases are kept as nullptrs in order to
+    // avoid trying to load the font again and again.
+    static std::unordered_map<std::string, std::shared_ptr<GlyphAtlas>> atlases;
+
+    const auto& key = font + "/" + std::to_string(font_size);
+    auto it = atlases.find(key);
+    if (it != atlases.end())
+        return it->second;
+
+    auto atlas = std::make_shared<GlyphAtlas>(font, font_size);
+    if (!atlas->IsValid())
+        atlas.reset();
+    atlases[key] = atlas;
+    return atlas;
+}
+
+const GlyphAtlas::Glyph* GlyphAtlas::FindGlyph(unsigned index)
+{
+    auto it = mGlyphs.find(index);
+    if (it != mGlyphs.end())
+    {
+        const auto& glyph = it->second;
+        if (glyph.width && glyph.height)
+            mPages[glyph.page].last_use = mLayoutRound;
+        return &glyph;
+    }
+
+    FT_Face face = mFont->face;
+    if (FT_Load_Glyph(face, index, FT_LOAD_DEFAULT) ||
+        FT_Render_Glyph(face->glyph, FT_RENDER_MODE_NORMAL))
+    {
+        ERROR("Failed to rasterize glyph. [font='%1', glyph=%2]", mFontName, index);
+        return nullptr;
+    }
+    FT_GlyphSlot slot = face->glyph;
+
+    Glyph glyph;
+    glyph.width     = slot->bitmap.width;
+    glyph.height    = slot->bitmap.rows;
+    glyph.bearing_x = slot->bitmap_left;
+    glyph.bearing_y = slot->bitmap_top;
+
+    // glyphs without any pixels (such as space) only have metrics.
+    if (glyph.width && glyph.height)
+    {
+        unsigned page = 0;
+        for (page=0; page<mPages.size(); ++page)
+        {
+            if (PackGlyph(mPages[page], glyph.width, glyph.height, &glyph.x, &glyph.y))
+                break;
+        }
+        if (page == mPages.size())
+        {
+            // evict the least recently used page that is not
+            // used by the current layout.
+            unsigned victim = mPages.size();
+            for (unsigned i=0; i<mPages.size(); ++i)
+            {
+                if (mPages[i].last_use == mLayoutRound)
+                    continue;
+                if (victim == mPages.size() || mPages[i].last_use < mPages[victim].last_use)
+                    victim = i;
+            }
+            if (victim == mPages.size())
+            {
+                // all the pages are used by the current layout. grow the
+                // atlas in order to make space for new pages.
+                if (!GrowAtlas())
+                {
+                    WARN("Glyph atlas is full. [font='%1', size=%2]", mFontName, mFontSize);
+                    return nullptr;
+                }
+                victim = page;
+            }
+            else
+            {
+                ClearPage(victim);
+                ++mStats.pages_evicted;
+                ++mLayoutVersion;
+            }
+            if (!PackGlyph(mPages[victim], glyph.width, glyph.height, &glyph.x, &glyph.y))
+            {
+                WARN("Glyph doesn't fit in glyph atlas page. [font='%1', glyph=%2]", mFontName, index);
+                return nullptr;
+            }
+            page = victim;
+        }
+        const AlphaMask bmp(reinterpret_cast<const Grayscale*>(slot->bitmap.buffer),
+                            slot->bitmap.width,
+                            slot->bitmap.rows,
+                            slot->bitmap.pitch);
+        mBitmap.Copy(glyph.x, glyph.y, bmp);
+        glyph.page = page;
+        mPages[page].glyphs.push_back(index);
+        mPages[page].last_use = mLayoutRound;
+        ++mContentVersion;
+    }
+    ++mStats.glyphs_rasterized;
+    it = mGlyphs.insert(std::make_pair(index, glyph)).first;
+    return &it->second;
+}
+
+bool GlyphAtlas::PackGlyph(Page& page, unsigned width, unsigned height, unsigned* x, unsigned* y)
+{
+    width  += GLYPH_PADDING;
+    height += GLYPH_PADDING;
+    if (width > mPageSize || height > mPageSize)
+        return false;
+
+    // start a new shelf if the current shelf is full.
+    if (page.cursor_x + width > mPageSize)
+    {
+        page.cursor_x = 0;
+        page.cursor_y += page.shelf_height;
+        page.shelf_height = 0;
+    }
+    if (page.cursor_y + height > mPageSize)
+        return false;
+
+    *x = page.x + page.cursor_x;
+    *y = page.y + page.cursor_y;
+    page.cursor_x += width;
+    page.shelf_height = std::max(page.shelf_height, height);
+    return true;
+}
+
+void GlyphAtlas::ClearPage(unsigned index)
+{
+    auto& page = mPages[index];
+    for (auto glyph : page.glyphs)
+        mGlyphs.erase(glyph);
+
+    page.glyphs.clear();
+    page.cursor_x = 0;
+    page.cursor_y = 0;
+    page.shelf_height = 0;
+    mBitmap.Fill(URect(page.x, page.y, mPageSize, mPageSize), Grayscale(0));
+
+    // the first page always has the solid block for underlines.
+    if (index == 0)
+    {
+        unsigned x, y;
+        PackGlyph(page, UNDERLINE_BLOCK, UNDERLINE_BLOCK, &x, &y);
+        mBitmap.Fill(URect(x, y, UNDERLINE_BLOCK, UNDERLINE_BLOCK), Grayscale(0xff));
+    }
+    ++mContentVersion;
+}
+
+bool GlyphAtlas::GrowAtlas()
+{
+    const auto size = mBitmap.GetWidth();
+    if (size * 2 > MaxAtlasSize)
+        return false;
+
+    AlphaMask bitmap(size * 2, size * 2);
+    bitmap.Copy(0, 0, mBitmap);
+    mBitmap = std::move(bitmap);
+
+    // add new pages for the new area of the bitmap. the existing
+    // pages keep their positions and their glyphs.
+    const auto pages = size * 2 / mPageSize;
+    for (unsigned y=0; y<pages; ++y)
+    {
+        for (unsigned x=0; x<pages; ++x)
+        {
+            if (x * mPageSize < size && y * mPageSize < size)
+                continue;
+            Page page;
+            page.x = x * mPageSize;
+            page.y = y * mPageSize;
+            mPages.push_back(std::move(page));
+            ClearPage(mPages.size()-1);
+        }
+    }
+    // the normalized texture coordinates of all glyphs have changed.
+    ++mLayoutVersion;
+    ++mStats.atlas_grown;
+    DEBUG("Grew glyph atlas. [font='%1', size=%2, atlas=%3, pages=%4]", mFontName, mFontSize,
+          mBitmap.GetWidth(), mPages.size());
+    return true;
+}
+
+FRect GlyphAtlas::MapRect(unsigned x, unsigned y, unsigned width, unsigned height) const
+{
+    const float size = mBitmap.GetWidth();
+    return FRect(x / size, y / size, width / size, height / size);
+}
+
 }  //namespace
@@ -22,6 +22,7 @@
 #include <vector>
 #include <memory>
 #include <optional>
+#include <unordered_map>
 
 #include "base/assert.h"
 #include "base/utility.h"
@@ -178,4 +179,133 @@ namespace gfx
         std::vector<Text> mText;
     };
 
+    // Glyph atlas caches the rasterized glyphs of one particular font
+    // at one particular pixel size in a single alpha mask bitmap that
+    // can be used as a texture. Instead of rasterizing a whole string
+    // of text into a bitmap (like TextBuffer does) the text is laid out
+    // as a series of glyph quads that refer to the glyphs in the atlas.
+    // This means that when the text content changes only the quads need
+    // to be recomputed as long as the glyphs are already in the atlas.
+    //
+    // The atlas bitmap is divided into fixed size pages and the glyphs
+    // are packed into the pages on "shelves". When the atlas runs out of
+    // space the least recently used page is evicted and the glyphs on it
+    // are rasterized again when they're needed the next time. If all the
+    // pages are needed by the text being laid out the atlas bitmap is
+    // grown (up to MaxAtlasSize) in order to make room for more pages.
+    class GlyphAtlas
+    {
+    public:
+        // A laid out glyph quad. The position and size are in pixels
+        // relative to the top left corner of the text buffer with
+        // y growing down. The texture rect is in normalized texture
+        // coordinates in the atlas bitmap.
+        struct GlyphQuad {
+            float x = 0.0f;
+            float y = 0.0f;
+            float width  = 0.0f;
+            float height = 0.0f;
+            FRect texture_rect;
+        };
+        struct Stats {
+            // number of glyphs rasterized into the atlas.
+            unsigned glyphs_rasterized = 0;
+            // number of pages evicted in order to make space for new glyphs.
+            unsigned pages_evicted = 0;
+            // number of times the atlas bitmap has been grown.
+            unsigned atlas_grown = 0;
+        };
+        // The initial dimension (width and height) of the atlas bitmap in pixels.
+        static constexpr unsigned AtlasSize = 1024;
+        // The maximum dimension of the atlas bitmap in pixels.
+        static constexpr unsigned MaxAtlasSize = 4096;
+
+        GlyphAtlas(const std::string& font, unsigned font_size);
+        GlyphAtlas(const GlyphAtlas&) = delete;
+       ~GlyphAtlas();
+
+        // Layout the contents of the text buffer using glyphs in the atlas
+        // and rasterize any glyphs that are not yet in the atlas. The layout
+        // follows the same rules as TextBuffer::Rasterize, i.e. the quads are
+        // aligned inside the text buffer dimensions. If the buffer has no
+        // dimensions the dimensions of the text itself are used instead.
+        // The resulting layout dimensions are returned in width and height.
+        // Only the text blocks that use the atlas font and font size
+        // are laid out. Returns false if the text could not be laid out.
+        bool Layout(const TextBuffer& text, std::vector<GlyphQuad>* quads,
+                    unsigned* width, unsigned* height);
+
+        // Get the atlas bitmap with the rasterized glyphs.
+        const AlphaMask& GetBitmap() const
+        { return mBitmap; }
+        // Get the version of the bitmap content. The version changes
+        // whenever the bitmap content changes and the bitmap needs to
+        // be uploaded to the device again.
+        std::size_t GetContentVersion() const
+        { return mContentVersion; }
+        // Get the version of the atlas layout. The version changes whenever
+        // a page is evicted from the atlas or the atlas is grown which means
+        // that any previously computed glyph quads are no longer valid and
+        // need to be recomputed.
+        std::size_t GetLayoutVersion() const
+        { return mLayoutVersion; }
+        // Get the atlas font name.
+        const std::string& GetFontName() const
+        { return mFontName; }
+        // Get the atlas font size in pixels.
+        unsigned GetFontSize() const
+        { return mFontSize; }
+        // Get the atlas statistics.
+        const Stats& GetStats() const
+        { return mStats; }
+        // Returns true if the font was loaded successfully.
+        bool IsValid() const
+        { return !!mFont; }
+
+        // Get a shared glyph atlas for the given font and font size.
+        // Returns nullptr if the font could not be loaded.
+        static std::shared_ptr<GlyphAtlas> Get(const std::string& font, unsigned font_size);
+    private:
+        struct Glyph {
+            unsigned page = 0;
+            // glyph box inside the atlas bitmap in pixels.
+            unsigned x = 0;
+            unsigned y = 0;
+            unsigned width  = 0;
+            unsigned height = 0;
+            int bearing_x = 0;
+            int bearing_y = 0;
+        };
+        struct Page {
+            unsigned x = 0;
+            unsigned y = 0;
+            // the current packing position and the
+            // height of the current shelf.
+            unsigned cursor_x = 0;
+            unsigned cursor_y = 0;
+            unsigned shelf_height = 0;
+            // the layout round when the page was last used.
+            std::size_t last_use = 0;
+            std::vector<unsigned> glyphs;
+        };
+        const Glyph* FindGlyph(unsigned index);
+        bool PackGlyph(Page& page, unsigned width, unsigned height, unsigned* x, unsigned* y);
+        void ClearPage(unsigned index);
+        bool GrowAtlas();
+        FRect MapRect(unsigned x, unsigned y, unsigned width, unsigned height) const;
+    private:
+        struct Font;
+        const std::string mFontName;
+        const unsigned mFontSize = 0;
+        std::unique_ptr<Font> mFont;
+        AlphaMask mBitmap;
+        unsigned mPageSize = 0;
+        std::vector<Page> mPages;
+        std::unordered_map<unsigned, Glyph> mGlyphs;
+        std::size_t mContentVersion = 0;
+        std::size_t mLayoutVersion  = 0;
+        std::size_t mLayoutRound = 0;
+        Stats mStats;
+    };
+
 } // namespace
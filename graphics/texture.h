@@ -127,6 +127,17 @@ namespace gfx
         // If mips is false (no mipmap generation) the texture minification filter
         // must be set to not use any mips either.
         virtual void Upload(const void* bytes, unsigned xres, unsigned yres, Format format, bool mips=true) = 0;
+        // Upload a precomputed mipmap level from the given CPU side buffer.
+        // The base level (level 0) must have been uploaded with Upload first
+        // and the format must match the format of the base level.
+        // This is used for uploading pre-baked texture data with a complete
+        // mip chain instead of generating the mips at runtime.
+        virtual void UploadMip(unsigned level, const void* bytes, unsigned xres, unsigned yres, Format format) = 0;
+        // Upload new contents for a sub-rectangle of the base level from the
+        // given CPU side buffer. The data must be tightly packed and have the
+        // same format as the texture. The texture must have been uploaded
+        // without mips first since the mips are not updated.
+        virtual void UploadSubRect(const void* bytes, unsigned xpos, unsigned ypos, unsigned width, unsigned height) = 0;
         // Get the texture width. Initially 0 until Upload is called
         // and new texture contents are uploaded.
         virtual unsigned GetWidth() const = 0;
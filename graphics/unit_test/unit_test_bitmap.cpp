@@ -17,16 +17,364 @@
 #include "config.h"
 
 #include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
 #include <iostream>
 
 #include "base/utility.h"
 #include "base/format.h"
 #include "base/test_minimal.h"
 #include "base/test_float.h"
+#include "base/test_help.h"
 #include "data/json.h"
 #include "graphics/color4f.h"
 #include "graphics/bitmap.h"
 
+template<typename Pixel>
+gfx::Bitmap<Pixel> MakeRandomBitmap(unsigned width, unsigned height)
+{
+    gfx::Bitmap<Pixel> bmp(width, height);
+    auto* bytes = (std::uint8_t*)bmp.GetDataPtr();
+    for (size_t i=0; i<width*height*sizeof(Pixel); ++i)
+        bytes[i] = std::rand() & 0xff;
+    return bmp;
+}
+
+template<typename Pixel>
+void unit_test_mipmap_kernels(bool srgb)
+{
+    constexpr unsigned channels = sizeof(Pixel);
+
+    struct TestCase {
+        unsigned width;
+        unsigned height;
+    } cases[] = {
+        {2, 2}, {1, 7}, {7, 1}, {3, 5}, {17, 9}, {64, 33}, {129, 70}, {300, 256}
+    };
+    for (const auto& test : cases)
+    {
+        const auto& src = MakeRandomBitmap<Pixel>(test.width, test.height);
+
+        gfx::EnableBitmapSIMD(false);
+        const auto scalar = gfx::GenerateNextMipmap(src, srgb);
+        gfx::EnableBitmapSIMD(true);
+        const auto simd = gfx::GenerateNextMipmap(src, srgb);
+
+        const auto width  = std::max(1u, test.width / 2);
+        const auto height = std::max(1u, test.height / 2);
+        TEST_REQUIRE(scalar && simd);
+        TEST_REQUIRE(scalar->GetWidth() == width);
+        TEST_REQUIRE(scalar->GetHeight() == height);
+        TEST_REQUIRE(simd->GetWidth() == width);
+        TEST_REQUIRE(simd->GetHeight() == height);
+        // the SIMD and scalar paths must produce identical results.
+        TEST_REQUIRE(!std::memcmp(scalar->GetDataPtr(), simd->GetDataPtr(), width * height * channels));
+
+        // check against the reference computed with floats.
+        const auto* src_bytes = (const std::uint8_t*)src.GetDataPtr();
+        const auto* dst_bytes = (const std::uint8_t*)simd->GetDataPtr();
+        for (unsigned row=0; row<height; ++row)
+        {
+            for (unsigned col=0; col<width; ++col)
+            {
+                const unsigned rows[2] = {row*2, std::min(row*2+1, test.height-1)};
+                const unsigned cols[2] = {col*2, std::min(col*2+1, test.width-1)};
+                for (unsigned c=0; c<channels; ++c)
+                {
+                    const auto is_color = srgb && c < 3;
+                    float sum = 0.0f;
+                    for (unsigned r : rows)
+                    {
+                        for (unsigned s : cols)
+                        {
+                            const auto value = src_bytes[(r * test.width + s) * channels + c] / 255.0f;
+                            sum += is_color ? gfx::sRGB_decode(value) : value;
+                        }
+                    }
+                    const auto average = sum * 0.25f;
+                    const auto expected = (is_color ? gfx::sRGB_encode(average) : average) * 255.0f;
+                    const int actual = dst_bytes[(row * width + col) * channels + c];
+                    if (is_color)
+                        TEST_REQUIRE(std::abs(actual - std::round(expected)) <= 1.0f);
+                    else TEST_REQUIRE(actual == (int)std::floor(expected + 0.5f) ||
+                                      actual == (int)std::floor(expected + 0.5f + 1e-4f));
+                }
+            }
+        }
+    }
+    TEST_REQUIRE(gfx::GenerateNextMipmap(MakeRandomBitmap<Pixel>(1, 1), srgb) == nullptr);
+
+    // uniform color must not change when filtered.
+    for (unsigned i=0; i<256; ++i)
+    {
+        gfx::Bitmap<Pixel> src(8, 8);
+        std::memset((void*)src.GetDataPtr(), i, 8 * 8 * channels);
+        const auto mip = gfx::GenerateNextMipmap(src, srgb);
+        const auto* bytes = (const std::uint8_t*)mip->GetDataPtr();
+        for (unsigned j=0; j<4*4*channels; ++j)
+            TEST_REQUIRE(bytes[j] == i);
+    }
+}
+
+template<typename Pixel>
+void unit_test_convert_to_linear()
+{
+    constexpr unsigned channels = sizeof(Pixel);
+
+    const auto& src = MakeRandomBitmap<Pixel>(67, 31);
+    const auto& ret = gfx::ConvertToLinear(src);
+    TEST_REQUIRE(ret->GetWidth() == 67);
+    TEST_REQUIRE(ret->GetHeight() == 31);
+    const auto* src_bytes = (const std::uint8_t*)src.GetDataPtr();
+    const auto* dst_bytes = (const std::uint8_t*)ret->GetDataPtr();
+    for (unsigned i=0; i<67*31*channels; ++i)
+    {
+        // alpha is not sRGB encoded.
+        if (i % channels == 3)
+            TEST_REQUIRE(dst_bytes[i] == src_bytes[i]);
+        else TEST_REQUIRE(dst_bytes[i] == (std::uint8_t)(gfx::sRGB_decode(src_bytes[i] / 255.0f) * 255));
+    }
+}
+
+template<typename Pixel>
+void unit_test_copy_fill_compare()
+{
+    const auto& src = MakeRandomBitmap<Pixel>(37, 23);
+    const Pixel fill = MakeRandomBitmap<Pixel>(1, 1).GetPixel(0, 0);
+
+    const gfx::IPoint positions[] = {
+        {0, 0}, {5, 3}, {-10, -4}, {20, 10}, {-40, 0}, {50, 50}
+    };
+    for (const auto& pos : positions)
+    {
+        auto dst = MakeRandomBitmap<Pixel>(40, 30);
+        auto ref = dst;
+        dst.Copy(pos.GetX(), pos.GetY(), src);
+        for (int y=0; y<(int)src.GetHeight(); ++y)
+        {
+            for (int x=0; x<(int)src.GetWidth(); ++x)
+            {
+                const auto dx = pos.GetX() + x;
+                const auto dy = pos.GetY() + y;
+                if (dx >= 0 && dy >= 0 && dx < 40 && dy < 30)
+                    ref.SetPixel(dy, dx, src.GetPixel(y, x));
+            }
+        }
+        TEST_REQUIRE(dst == ref);
+
+        const gfx::IRect rect(pos, 11, 7);
+        dst.Fill(rect, fill);
+        for (int y=0; y<7; ++y)
+        {
+            for (int x=0; x<11; ++x)
+            {
+                const auto dx = pos.GetX() + x;
+                const auto dy = pos.GetY() + y;
+                if (dx >= 0 && dy >= 0 && dx < 40 && dy < 30)
+                    ref.SetPixel(dy, dx, fill);
+            }
+        }
+        TEST_REQUIRE(dst == ref);
+
+        // change a single pixel and check that the comparison finds it.
+        const auto px = ref.GetPixel(29, 39);
+        ref.SetPixel(29, 39, Pixel(px == fill ? src.GetPixel(0, 0) : fill));
+        if (ref.GetPixel(29, 39) != px)
+        {
+            TEST_REQUIRE(dst != ref);
+            TEST_REQUIRE(Compare(dst, gfx::URect(0, 0, 39, 30), ref));
+            TEST_REQUIRE(!Compare(dst, gfx::URect(20, 20, 20, 10), ref));
+        }
+    }
+}
+
+// the original noise bitmap generation algorithm.
+gfx::AlphaMask GenerateReferenceNoise(const gfx::NoiseBitmapGenerator& gen)
+{
+    gfx::AlphaMask ret;
+    ret.Resize(gen.GetWidth(), gen.GetHeight());
+    const float w = gen.GetWidth();
+    const float h = gen.GetHeight();
+    for (unsigned y = 0; y < gen.GetHeight(); ++y)
+    {
+        for (unsigned x = 0; x < gen.GetWidth(); ++x)
+        {
+            float pixel = 0.0f;
+            for (size_t i=0; i<gen.GetNumLayers(); ++i)
+            {
+                const auto& layer = gen.GetLayer(i);
+                const math::NoiseGenerator noise(layer.frequency, layer.prime0, layer.prime1, layer.prime2);
+                const auto amplitude = math::clamp(0.0f, 255.0f, layer.amplitude);
+                const auto sample = noise.GetSample(x / w, y / h);
+                pixel += (sample * amplitude);
+            }
+            gfx::Grayscale px;
+            px.r = math::clamp(0u, 255u, (unsigned) pixel);
+            ret.SetPixel(y, x, px);
+        }
+    }
+    return ret;
+}
+
+gfx::NoiseBitmapGenerator MakeTestNoiseGenerator(unsigned width, unsigned height)
+{
+    gfx::NoiseBitmapGenerator gen;
+    gen.SetWidth(width);
+    gen.SetHeight(height);
+    gen.AddLayer({2399, 23346353, 458912449, 4.0f, 200.0f});
+    gen.AddLayer({2963, 29297533, 458913047, 8.0f, 64.0f});
+    gen.AddLayer({5689, 88124567, 458912471, 128.0f, 4.0});
+    return gen;
+}
+
+void unit_test_noise_generator()
+{
+    struct TestCase {
+        unsigned width;
+        unsigned height;
+    } cases[] = {
+        {1, 1}, {3, 5}, {67, 33}, {256, 256}, {300, 129}
+    };
+
+    for (const auto& test : cases)
+    {
+        const auto& gen = MakeTestNoiseGenerator(test.width, test.height);
+        const auto& expected = GenerateReferenceNoise(gen);
+
+        gfx::EnableBitmapSIMD(false);
+        const auto scalar = gen.Generate();
+        gfx::EnableBitmapSIMD(true);
+        const auto simd = gen.Generate();
+        TEST_REQUIRE(scalar->GetWidth() == test.width);
+        TEST_REQUIRE(scalar->GetHeight() == test.height);
+        TEST_REQUIRE(simd->GetWidth() == test.width);
+        TEST_REQUIRE(simd->GetHeight() == test.height);
+        TEST_REQUIRE(*static_cast<const gfx::AlphaMask*>(scalar.get()) == expected);
+        TEST_REQUIRE(*static_cast<const gfx::AlphaMask*>(simd.get()) == expected);
+    }
+
+    // no layers.
+    {
+        gfx::NoiseBitmapGenerator gen(64, 32);
+        const auto bmp = gen.Generate();
+        TEST_REQUIRE(bmp->GetWidth() == 64);
+        TEST_REQUIRE(bmp->GetHeight() == 32);
+        TEST_REQUIRE(static_cast<const gfx::AlphaMask*>(bmp.get())->Compare(gfx::Grayscale(0)));
+    }
+}
+
+void unit_test_noise_generator_cache()
+{
+    std::filesystem::remove_all("bitmap-cache");
+    gfx::SetBitmapCacheDirectory("bitmap-cache");
+    TEST_REQUIRE(gfx::GetBitmapCacheDirectory() == "bitmap-cache");
+
+    auto gen = MakeTestNoiseGenerator(64, 64);
+    const auto& expected = GenerateReferenceNoise(gen);
+
+    // count the files in the cache directory.
+    auto count_files = []() {
+        unsigned count = 0;
+        for (const auto& entry : std::filesystem::directory_iterator("bitmap-cache"))
+        {
+            if (entry.is_regular_file())
+                ++count;
+        }
+        return count;
+    };
+
+    // generate and store in the cache.
+    {
+        const auto bmp = gen.Generate();
+        TEST_REQUIRE(*static_cast<const gfx::AlphaMask*>(bmp.get()) == expected);
+        TEST_REQUIRE(count_files() == 1);
+    }
+
+    // overwrite the cached data with garbage to see that it's used.
+    const auto path = std::filesystem::directory_iterator("bitmap-cache")->path();
+    {
+        std::fstream io(path, std::ios::in | std::ios::out | std::ios::binary);
+        io.seekp(0, std::ios::end);
+        const auto size = (size_t)io.tellp();
+        TEST_REQUIRE(size > 64 * 64);
+        io.seekp(size - 64 * 64);
+        const std::vector<char> zeros(64 * 64, 0);
+        io.write(&zeros[0], zeros.size());
+    }
+    {
+        const auto bmp = gen.Generate();
+        TEST_REQUIRE(static_cast<const gfx::AlphaMask*>(bmp.get())->Compare(gfx::Grayscale(0)));
+    }
+
+    // different parameters are generated again.
+    gen.GetLayer(0).amplitude = 100.0f;
+    {
+        const auto bmp = gen.Generate();
+        TEST_REQUIRE(*static_cast<const gfx::AlphaMask*>(bmp.get()) == GenerateReferenceNoise(gen));
+        TEST_REQUIRE(count_files() == 2);
+    }
+
+    // truncated file is ignored and the bitmap is generated again.
+    gen = MakeTestNoiseGenerator(64, 64);
+    std::filesystem::resize_file(path, 100);
+    {
+        const auto bmp = gen.Generate();
+        TEST_REQUIRE(*static_cast<const gfx::AlphaMask*>(bmp.get()) == expected);
+        TEST_REQUIRE(count_files() == 2);
+    }
+
+    gfx::SetBitmapCacheDirectory("");
+    std::filesystem::remove_all("bitmap-cache");
+}
+
+void perf_test_bitmap_kernels()
+{
+    const auto& rgba = MakeRandomBitmap<gfx::RGBA>(1024, 1024);
+    const auto& rgb  = MakeRandomBitmap<gfx::RGB>(1024, 1024);
+    const auto& a8   = MakeRandomBitmap<gfx::Grayscale>(1024, 1024);
+
+    for (int i=0; i<2; ++i)
+    {
+        const bool simd = i == 1;
+        gfx::EnableBitmapSIMD(simd);
+        const std::string suffix = simd ? (gfx::IsBitmapSIMDEnabled() ? " (SIMD)" : " (SIMD not available)") : " (scalar)";
+
+        auto test = base::TimedTest(100, [&rgba]() { gfx::GenerateNextMipmap(rgba, false); });
+        base::PrintTestTimes(("Mipmap RGBA 1024x1024" + suffix).c_str(), test);
+        test = base::TimedTest(100, [&rgba]() { gfx::GenerateNextMipmap(rgba, true); });
+        base::PrintTestTimes(("Mipmap sRGBA 1024x1024" + suffix).c_str(), test);
+        test = base::TimedTest(100, [&rgb]() { gfx::GenerateNextMipmap(rgb, false); });
+        base::PrintTestTimes(("Mipmap RGB 1024x1024" + suffix).c_str(), test);
+        test = base::TimedTest(100, [&rgb]() { gfx::GenerateNextMipmap(rgb, true); });
+        base::PrintTestTimes(("Mipmap sRGB 1024x1024" + suffix).c_str(), test);
+        test = base::TimedTest(100, [&a8]() { gfx::GenerateNextMipmap(a8, false); });
+        base::PrintTestTimes(("Mipmap A8 1024x1024" + suffix).c_str(), test);
+    }
+
+    const auto& noise = MakeTestNoiseGenerator(1024, 1024);
+    auto test = base::TimedTest(1, [&noise]() { GenerateReferenceNoise(noise); });
+    base::PrintTestTimes("Noise 1024x1024 (reference)", test);
+    gfx::EnableBitmapSIMD(false);
+    test = base::TimedTest(10, [&noise]() { noise.Generate(); });
+    base::PrintTestTimes("Noise 1024x1024 (scalar)", test);
+    gfx::EnableBitmapSIMD(true);
+    test = base::TimedTest(10, [&noise]() { noise.Generate(); });
+    base::PrintTestTimes("Noise 1024x1024 (SIMD)", test);
+
+    test = base::TimedTest(100, [&rgba]() { gfx::ConvertToLinear(rgba); });
+    base::PrintTestTimes("ConvertToLinear RGBA 1024x1024", test);
+
+    gfx::Bitmap<gfx::RGBA> dst(1024, 1024);
+    test = base::TimedTest(100, [&rgba, &dst]() { dst.Copy(0, 0, rgba); });
+    base::PrintTestTimes("Copy RGBA 1024x1024", test);
+    test = base::TimedTest(100, [&dst]() { dst.Fill(gfx::RGBA(gfx::Color::Red, 0xff)); });
+    base::PrintTestTimes("Fill RGBA 1024x1024", test);
+    test = base::TimedTest(100, [&rgba, &dst]() { dst.Copy(0, 0, rgba); TEST_REQUIRE(dst == rgba); });
+    base::PrintTestTimes("Copy + compare RGBA 1024x1024", test);
+}
+
 int test_main(int argc, char* argv[])
 {
     // test empty bitmap for "emptiness"
@@ -421,5 +769,28 @@ int test_main(int argc, char* argv[])
         TEST_REQUIRE(other.GetLayer(0).frequency == real::float32(4.0f));
         TEST_REQUIRE(other.GetLayer(0).amplitude == real::float32(200.0f));
     }
+
+    unit_test_mipmap_kernels<gfx::Grayscale>(false);
+    unit_test_mipmap_kernels<gfx::RGB>(false);
+    unit_test_mipmap_kernels<gfx::RGB>(true);
+    unit_test_mipmap_kernels<gfx::RGBA>(false);
+    unit_test_mipmap_kernels<gfx::RGBA>(true);
+    unit_test_convert_to_linear<gfx::RGB>();
+    unit_test_convert_to_linear<gfx::RGBA>();
+    unit_test_copy_fill_compare<gfx::Grayscale>();
+    unit_test_copy_fill_compare<gfx::RGB>();
+    unit_test_copy_fill_compare<gfx::RGBA>();
+    unit_test_noise_generator();
+    unit_test_noise_generator_cache();
+
+    bool perf_test = false;
+    for (int i=1; i<argc; ++i)
+    {
+        if (!std::strcmp("--perftest", argv[i]))
+            perf_test = true;
+        else std::printf("Unrecognized cmdline param: '%s'\n", argv[i]);
+    }
+    if (perf_test)
+        perf_test_bitmap_kernels();
     return 0;
-}
\ No newline at end of file
+}
@@ -30,6 +30,9 @@
 #include "graphics/shader.h"
 #include "graphics/geometry.h"
 #include "graphics/framebuffer.h"
+#include "graphics/drawable.h"
+#include "graphics/material.h"
+#include "graphics/painter.h"
 
 // We need this to create the rendering context.
 #include "wdk/opengl/context.h"
@@ -1283,6 +1286,34 @@ void main() {
         TEST_REQUIRE(dev->FindTexture("foo") == nullptr);
     }
 
+    // texture that is the color buffer of a framebuffer is not cleaned
+    // while the framebuffer exists.
+    {
+        auto* texture = dev->MakeTexture("foo");
+        texture->Upload(nullptr, 10, 10, gfx::Texture::Format::RGBA, false);
+
+        gfx::Framebuffer::Config conf;
+        conf.format = gfx::Framebuffer::Format::ColorRGBA8;
+        conf.width  = 10;
+        conf.height = 10;
+        auto* fbo = dev->MakeFramebuffer("fbo");
+        fbo->SetColorTarget(texture);
+        TEST_REQUIRE(fbo->Create(conf));
+
+        for (int i=0; i<3; ++i)
+        {
+            dev->BeginFrame();
+            dev->EndFrame();
+            dev->CleanGarbage(2, gfx::Device::GCFlags::Textures);
+        }
+        TEST_REQUIRE(dev->FindTexture("foo"));
+
+        dev->DeleteFramebuffer("fbo");
+        dev->BeginFrame();
+        dev->EndFrame();
+        dev->CleanGarbage(2, gfx::Device::GCFlags::Textures);
+        TEST_REQUIRE(dev->FindTexture("foo") == nullptr);
+    }
 }
 
 void unit_test_render_dynamic()
@@ -1384,6 +1415,158 @@ void main() {
     }
 }
 
+void unit_test_texture_memory_budget()
+{
+    auto dev = gfx::Device::Create(std::make_shared<TestContext>(10, 10));
+
+    const gfx::RGBA pixels[4 * 4] = {};
+    const auto texture_bytes = sizeof(pixels);
+
+    // byte accounting
+    {
+        auto* foo = dev->MakeTexture("foo");
+        foo->Upload(pixels, 4, 4, gfx::Texture::Format::RGBA, false);
+
+        gfx::Device::ResourceStats stats;
+        dev->GetResourceStats(&stats);
+        TEST_REQUIRE(stats.texture_mem_use == texture_bytes);
+        TEST_REQUIRE(stats.texture_mem_budget == 0);
+
+        // re-upload doesn't change the accounting.
+        foo->Upload(pixels, 4, 4, gfx::Texture::Format::RGBA, false);
+        dev->GetResourceStats(&stats);
+        TEST_REQUIRE(stats.texture_mem_use == texture_bytes);
+
+        dev->DeleteTextures();
+        dev->GetResourceStats(&stats);
+        TEST_REQUIRE(stats.texture_mem_use == 0);
+    }
+
+    // least recently used texture is evicted first.
+    {
+        dev->SetTextureMemoryBudget(texture_bytes * 2);
+
+        dev->BeginFrame();
+        dev->MakeTexture("foo")->Upload(pixels, 4, 4, gfx::Texture::Format::RGBA, false);
+        dev->EndFrame();
+
+        dev->BeginFrame();
+        dev->MakeTexture("bar")->Upload(pixels, 4, 4, gfx::Texture::Format::RGBA, false);
+        dev->EndFrame();
+
+        dev->BeginFrame();
+        dev->MakeTexture("meh")->Upload(pixels, 4, 4, gfx::Texture::Format::RGBA, false);
+        dev->EndFrame();
+
+        TEST_REQUIRE(dev->FindTexture("foo") == nullptr);
+        TEST_REQUIRE(dev->FindTexture("bar"));
+        TEST_REQUIRE(dev->FindTexture("meh"));
+
+        gfx::Device::ResourceStats stats;
+        dev->GetResourceStats(&stats);
+        TEST_REQUIRE(stats.texture_mem_use == texture_bytes * 2);
+        TEST_REQUIRE(stats.num_textures_evicted == 1);
+        TEST_REQUIRE(stats.texture_mem_evicted == texture_bytes);
+        dev->DeleteTextures();
+    }
+
+    // transient textures are evicted before other textures.
+    {
+        dev->BeginFrame();
+        dev->MakeTexture("foo")->Upload(pixels, 4, 4, gfx::Texture::Format::RGBA, false);
+        dev->EndFrame();
+
+        dev->BeginFrame();
+        auto* bar = dev->MakeTexture("bar");
+        bar->SetTransient(true);
+        bar->Upload(pixels, 4, 4, gfx::Texture::Format::RGBA, false);
+        dev->EndFrame();
+
+        dev->BeginFrame();
+        dev->MakeTexture("meh")->Upload(pixels, 4, 4, gfx::Texture::Format::RGBA, false);
+        dev->EndFrame();
+
+        TEST_REQUIRE(dev->FindTexture("foo"));
+        TEST_REQUIRE(dev->FindTexture("bar") == nullptr);
+        TEST_REQUIRE(dev->FindTexture("meh"));
+        dev->DeleteTextures();
+    }
+
+    // grouped textures are evicted together.
+    {
+        dev->SetTextureMemoryBudget(texture_bytes * 3);
+
+        dev->BeginFrame();
+        auto* foo = dev->MakeTexture("foo");
+        foo->SetGroup("group");
+        foo->Upload(pixels, 4, 4, gfx::Texture::Format::RGBA, false);
+        auto* bar = dev->MakeTexture("bar");
+        bar->SetGroup("group");
+        bar->Upload(pixels, 4, 4, gfx::Texture::Format::RGBA, false);
+        dev->EndFrame();
+
+        dev->BeginFrame();
+        dev->MakeTexture("meh")->Upload(pixels, 4, 4, gfx::Texture::Format::RGBA, false);
+        dev->EndFrame();
+
+        dev->BeginFrame();
+        dev->MakeTexture("huh")->Upload(pixels, 4, 4, gfx::Texture::Format::RGBA, false);
+        dev->EndFrame();
+
+        TEST_REQUIRE(dev->FindTexture("foo") == nullptr);
+        TEST_REQUIRE(dev->FindTexture("bar") == nullptr);
+        TEST_REQUIRE(dev->FindTexture("meh"));
+        TEST_REQUIRE(dev->FindTexture("huh"));
+        dev->DeleteTextures();
+    }
+
+    // textures used in the current frame are not evicted.
+    {
+        dev->SetTextureMemoryBudget(texture_bytes);
+
+        dev->BeginFrame();
+        dev->MakeTexture("foo")->Upload(pixels, 4, 4, gfx::Texture::Format::RGBA, false);
+        dev->MakeTexture("bar")->Upload(pixels, 4, 4, gfx::Texture::Format::RGBA, false);
+        dev->EndFrame();
+
+        TEST_REQUIRE(dev->FindTexture("foo"));
+        TEST_REQUIRE(dev->FindTexture("bar"));
+        dev->DeleteTextures();
+    }
+
+    // textures attached to a framebuffer are not evicted.
+    {
+        dev->SetTextureMemoryBudget(texture_bytes * 2);
+
+        dev->BeginFrame();
+        auto* foo = dev->MakeTexture("foo");
+        foo->Upload(nullptr, 4, 4, gfx::Texture::Format::RGBA, false);
+        gfx::Framebuffer::Config conf;
+        conf.format = gfx::Framebuffer::Format::ColorRGBA8;
+        conf.width  = 4;
+        conf.height = 4;
+        auto* fbo = dev->MakeFramebuffer("fbo");
+        fbo->SetColorTarget(foo);
+        TEST_REQUIRE(fbo->Create(conf));
+        dev->EndFrame();
+
+        dev->BeginFrame();
+        dev->MakeTexture("bar")->Upload(pixels, 4, 4, gfx::Texture::Format::RGBA, false);
+        dev->EndFrame();
+
+        dev->BeginFrame();
+        dev->MakeTexture("meh")->Upload(pixels, 4, 4, gfx::Texture::Format::RGBA, false);
+        dev->EndFrame();
+
+        TEST_REQUIRE(dev->FindTexture("foo"));
+        TEST_REQUIRE(dev->FindTexture("bar") == nullptr);
+        TEST_REQUIRE(dev->FindTexture("meh"));
+
+        dev->DeleteFramebuffers();
+        dev->DeleteTextures();
+    }
+}
+
 void unit_test_buffer_allocation()
 {
     auto dev = gfx::Device::Create(std::make_shared<TestContext>(10, 10));
@@ -1905,6 +2088,182 @@ void main() {
 
 }
 
+void unit_test_frame_stats()
+{
+    auto dev = gfx::Device::Create(std::make_shared<TestContext>(10, 10));
+
+    gfx::Device::FrameStats stats;
+    dev->GetFrameStats(&stats);
+    TEST_REQUIRE(stats.draw_calls == 0);
+
+    // resources prepared outside of a frame are accounted to the next frame.
+    auto* geom = dev->MakeGeometry("geom");
+    const gfx::Vertex verts[] = {
+      { {-1,  1}, {0, 1} },
+      { {-1, -1}, {0, 0} },
+      { { 1, -1}, {1, 0} },
+
+      { {-1,  1}, {0, 1} },
+      { { 1, -1}, {1, 0} },
+      { { 1,  1}, {1, 1} }
+    };
+    geom->SetVertexBuffer(verts, 6);
+    geom->AddDrawCmd(gfx::Geometry::DrawType::Triangles);
+
+    gfx::Bitmap<gfx::RGBA> data(4, 4);
+    data.Fill(gfx::Color::Red);
+    auto* texture = dev->MakeTexture("tex");
+    texture->Upload(data.GetDataPtr(), 4, 4, gfx::Texture::Format::RGBA, false /*mips*/);
+
+    const char* fssrc =
+            R"(#version 100
+precision mediump float;
+uniform vec4 kColor;
+uniform sampler2D kTexture;
+varying vec2 vTexCoord;
+void main() {
+  gl_FragColor = kColor * texture2D(kTexture, vTexCoord);
+})";
+    const char* vssrc =
+            R"(#version 100
+attribute vec2 aPosition;
+attribute vec2 aTexCoord;
+varying vec2 vTexCoord;
+void main() {
+  gl_Position = vec4(aPosition.xy, 1.0, 1.0);
+  vTexCoord = aTexCoord;
+})";
+    auto* program = MakeTestProgram(*dev, vssrc, fssrc, "prog");
+
+    gfx::Device::State state;
+    state.blending     = gfx::Device::State::BlendOp::None;
+    state.bWriteColor  = true;
+    state.viewport     = gfx::IRect(0, 0, 10, 10);
+    state.stencil_func = gfx::Device::State::StencilFunc::Disabled;
+
+    // first frame, draw twice with the same uniform value.
+    dev->BeginFrame();
+    program->SetUniform("kColor", gfx::Color4f(gfx::Color::White));
+    program->SetTexture("kTexture", 0, *texture);
+    dev->Draw(*program, *geom, state);
+    program->SetUniform("kColor", gfx::Color4f(gfx::Color::White));
+    program->SetTexture("kTexture", 0, *texture);
+    dev->Draw(*program, *geom, state);
+
+    // the frame isn't complete yet.
+    dev->GetFrameStats(&stats);
+    TEST_REQUIRE(stats.draw_calls == 0);
+    dev->EndFrame();
+
+    dev->GetFrameStats(&stats);
+    TEST_REQUIRE(stats.draw_calls == 2);
+    TEST_REQUIRE(stats.vertices == 12);
+    TEST_REQUIRE(stats.program_switches == 1);
+    TEST_REQUIRE(stats.buffer_uploads == 1);
+    TEST_REQUIRE(stats.buffer_upload_bytes == sizeof(verts));
+    TEST_REQUIRE(stats.texture_uploads == 1);
+    TEST_REQUIRE(stats.texture_upload_bytes == 4 * 4 * 4);
+    TEST_REQUIRE(stats.texture_binds <= 1);
+    // kColor once (the second set is redundant) and the sampler per draw.
+    TEST_REQUIRE(stats.uniform_sets == 3);
+    TEST_REQUIRE(stats.fbo_switches == 0);
+
+    // second frame, nothing has changed.
+    dev->BeginFrame();
+    program->SetUniform("kColor", gfx::Color4f(gfx::Color::White));
+    program->SetTexture("kTexture", 0, *texture);
+    dev->Draw(*program, *geom, state);
+    dev->EndFrame();
+
+    dev->GetFrameStats(&stats);
+    TEST_REQUIRE(stats.draw_calls == 1);
+    TEST_REQUIRE(stats.vertices == 6);
+    TEST_REQUIRE(stats.program_switches == 0);
+    TEST_REQUIRE(stats.buffer_uploads == 0);
+    TEST_REQUIRE(stats.buffer_upload_bytes == 0);
+    TEST_REQUIRE(stats.texture_uploads == 0);
+    TEST_REQUIRE(stats.texture_binds == 0);
+    TEST_REQUIRE(stats.uniform_sets == 1);
+
+    // render into a framebuffer and back to the default framebuffer.
+    gfx::Framebuffer::Config conf;
+    conf.format = gfx::Framebuffer::Format::ColorRGBA8;
+    conf.width  = 10;
+    conf.height = 10;
+    auto* fbo = dev->MakeFramebuffer("fbo");
+    TEST_REQUIRE(fbo->Create(conf));
+
+    dev->BeginFrame();
+    dev->SetFramebuffer(fbo);
+    program->SetTexture("kTexture", 0, *texture);
+    dev->Draw(*program, *geom, state);
+    dev->SetFramebuffer(fbo);
+    program->SetTexture("kTexture", 0, *texture);
+    dev->Draw(*program, *geom, state);
+    dev->SetFramebuffer(nullptr);
+    dev->EndFrame();
+
+    dev->GetFrameStats(&stats);
+    TEST_REQUIRE(stats.draw_calls == 2);
+    TEST_REQUIRE(stats.fbo_switches == 2);
+    TEST_REQUIRE(stats.program_switches == 0);
+
+    // deleting the programs must not leave a stale current program behind.
+    // a new program could get the same name as the deleted one and must
+    // still be taken into use.
+    dev->DeletePrograms();
+    dev->DeleteShaders();
+    program = MakeTestProgram(*dev, vssrc, fssrc, "prog");
+
+    dev->BeginFrame();
+    program->SetUniform("kColor", gfx::Color4f(gfx::Color::White));
+    program->SetTexture("kTexture", 0, *texture);
+    dev->Draw(*program, *geom, state);
+    dev->EndFrame();
+
+    dev->GetFrameStats(&stats);
+    TEST_REQUIRE(stats.draw_calls == 1);
+    TEST_REQUIRE(stats.program_switches == 1);
+    TEST_REQUIRE(stats.uniform_sets == 2);
+
+    {
+        gfx::RgbaBitmap expected;
+        expected.Resize(10, 10);
+        expected.Fill(gfx::Color::Red);
+        const auto& bmp = dev->ReadColorBuffer(10, 10);
+        TEST_REQUIRE(bmp == expected);
+    }
+}
+
+void unit_test_analytic_particle_program()
+{
+    auto dev = gfx::Device::Create(std::make_shared<TestContext>(10, 10));
+    auto painter = gfx::Painter::Create(dev.get());
+
+    using ParticleClass = gfx::KinematicsParticleEngineClass;
+    const ParticleClass::CoordinateSpace spaces[] = {
+        ParticleClass::CoordinateSpace::Local,
+        ParticleClass::CoordinateSpace::Global
+    };
+    // the analytic particle vertex shader must compile and link
+    // with the material shader in both coordinate spaces.
+    for (auto space : spaces)
+    {
+        ParticleClass::Params params;
+        params.simulation       = ParticleClass::Simulation::Analytic;
+        params.motion           = ParticleClass::Motion::Linear;
+        params.mode             = ParticleClass::SpawnPolicy::Once;
+        params.coordinate_space = space;
+        params.max_lifetime     = 1.0f;
+        gfx::KinematicsParticleEngine engine(params);
+        TEST_REQUIRE(engine.IsAnalytic());
+
+        auto* shader = engine.GetShader(*dev);
+        TEST_REQUIRE(shader && shader->IsValid());
+        TEST_REQUIRE(painter->PrepareProgram(engine, gfx::CreateMaterialFromColor(gfx::Color::White)));
+    }
+}
+
 int test_main(int argc, char* argv[])
 {
     unit_test_device();
@@ -1925,9 +2284,12 @@ int test_main(int argc, char* argv[])
     unit_test_uniform_sampler_optimize_bug();
     unit_test_render_dynamic();
     unit_test_clean_textures();
+    unit_test_texture_memory_budget();
     unit_test_buffer_allocation();
     unit_test_max_texture_units_single_texture();
     unit_test_max_texture_units_many_textures();
+    unit_test_frame_stats();
+    unit_test_analytic_particle_program();
     // bugs
     unit_test_empty_draw_lost_uniform_bug();
     unit_test_repeated_uniform_bug();
@@ -16,10 +16,21 @@
 
 #include "config.h"
 
+#include "warnpush.h"
+#  include <glm/mat4x4.hpp>
+#include "warnpop.h"
+
+#include <cstring>
+#include <vector>
+
 #include "base/test_minimal.h"
 #include "base/test_float.h"
+#include "base/test_help.h"
+#include "base/utility.h"
 #include "data/json.h"
 #include "graphics/drawable.h"
+#include "graphics/material.h"
+#include "graphics/transform.h"
 
 bool operator==(const gfx::Vertex& lhs, const gfx::Vertex& rhs)
 {
@@ -262,6 +273,7 @@ void unit_test_particle_engine_data()
     params.motion   = gfx::KinematicsParticleEngineClass::Motion::Projectile;
     params.mode     = gfx::KinematicsParticleEngineClass::SpawnPolicy::Continuous;
     params.boundary = gfx::KinematicsParticleEngineClass::BoundaryPolicy::Kill;
+    params.simulation = gfx::KinematicsParticleEngineClass::Simulation::Analytic;
     params.num_particles = 500.0f;
     params.min_lifetime  = 2.0f;
     params.max_lifetime  = 5.0f;
@@ -299,6 +311,7 @@ void unit_test_particle_engine_data()
         TEST_REQUIRE(p.motion                           == gfx::KinematicsParticleEngineClass::Motion::Projectile);
         TEST_REQUIRE(p.mode                             == gfx::KinematicsParticleEngineClass::SpawnPolicy::Continuous);
         TEST_REQUIRE(p.boundary                         == gfx::KinematicsParticleEngineClass::BoundaryPolicy::Kill);
+        TEST_REQUIRE(p.simulation                       == gfx::KinematicsParticleEngineClass::Simulation::Analytic);
         TEST_REQUIRE(p.num_particles                    == real::float32(500.0f));
         TEST_REQUIRE(p.min_lifetime                     == real::float32(2.0f));
         TEST_REQUIRE(p.max_lifetime                     == real::float32(5.0f));
@@ -349,10 +362,596 @@ void unit_test_particle_engine_data()
 }
 
 
+using ParticleClass = gfx::KinematicsParticleEngineClass;
+
+// Reference particle update with the particles stored in an array of
+// structures and killed one by one while updating. The optimized
+// particle update must produce exactly the same results.
+bool UpdateReferenceParticle(const ParticleClass::Params& params, ParticleClass::Particle& p, float dt)
+{
+    p.time += dt;
+    if (p.time > p.time_scale * params.max_lifetime)
+        return false;
+
+    const auto p0 = p.position;
+    if (params.motion == ParticleClass::Motion::Linear)
+        p.position += (p.direction * dt);
+    else if (params.motion == ParticleClass::Motion::Projectile)
+    {
+        p.position += (p.direction * dt);
+        p.direction += (dt * params.gravity);
+    }
+    const auto& p1 = p.position;
+    const auto& dp = p1 - p0;
+    const auto  dd = glm::length(dp);
+
+    p.pointsize += (dt * params.rate_of_change_in_size_wrt_time * p.time_scale);
+    p.pointsize += (dd * params.rate_of_change_in_size_wrt_dist);
+    if (p.pointsize <= 0.0f)
+        return false;
+
+    p.alpha += (dt * params.rate_of_change_in_alpha_wrt_time * p.time_scale);
+    p.alpha += (dt * params.rate_of_change_in_alpha_wrt_dist);
+    if (p.alpha <= 0.0f)
+        return false;
+    p.alpha = math::clamp(0.0f, 1.0f, p.alpha);
+
+    p.distance += dd;
+
+    if (params.coordinate_space == ParticleClass::CoordinateSpace::Global)
+        return true;
+
+    if (params.boundary == ParticleClass::BoundaryPolicy::Wrap)
+    {
+        p.position.x = math::wrap(0.0f, params.max_xpos, p.position.x);
+        p.position.y = math::wrap(0.0f, params.max_ypos, p.position.y);
+    }
+    else if (params.boundary == ParticleClass::BoundaryPolicy::Clamp)
+    {
+        p.position.x = math::clamp(0.0f, params.max_xpos, p.position.x);
+        p.position.y = math::clamp(0.0f, params.max_ypos, p.position.y);
+    }
+    else if (params.boundary == ParticleClass::BoundaryPolicy::Kill)
+    {
+        if (p.position.x < 0.0f || p.position.x > params.max_xpos)
+            return false;
+        else if (p.position.y < 0.0f || p.position.y > params.max_ypos)
+            return false;
+    }
+    else if (params.boundary == ParticleClass::BoundaryPolicy::Reflect)
+    {
+        glm::vec2 n;
+        if (p.position.x <= 0.0f)
+            n = glm::vec2(1.0f, 0.0f);
+        else if (p.position.x >= params.max_xpos)
+            n = glm::vec2(-1.0f, 0.0f);
+        else if (p.position.y <= 0.0f)
+            n = glm::vec2(0, 1.0f);
+        else if (p.position.y >= params.max_ypos)
+            n = glm::vec2(0, -1.0f);
+        else return true;
+        const auto& d = glm::normalize(p.direction);
+        const float v = glm::length(p.direction);
+        p.direction = (d - 2 * glm::dot(d, n) * n) * v;
+        p.position.x = math::clamp(0.0f, params.max_xpos, p.position.x);
+        p.position.y = math::clamp(0.0f, params.max_ypos, p.position.y);
+    }
+    return true;
+}
+void UpdateReferenceParticles(const ParticleClass::Params& params, std::vector<ParticleClass::Particle>& particles, float dt)
+{
+    for (size_t i=0; i<particles.size();)
+    {
+        if (UpdateReferenceParticle(params, particles[i], dt))
+        {
+            ++i;
+            continue;
+        }
+        std::swap(particles[i], particles.back());
+        particles.pop_back();
+    }
+}
+
+bool BitEquals(float lhs, float rhs)
+{ return std::memcmp(&lhs, &rhs, sizeof(float)) == 0; }
+
+bool operator==(const ParticleClass::Particle& lhs, const ParticleClass::Particle& rhs)
+{
+    return BitEquals(lhs.position.x, rhs.position.x) &&
+           BitEquals(lhs.position.y, rhs.position.y) &&
+           BitEquals(lhs.direction.x, rhs.direction.x) &&
+           BitEquals(lhs.direction.y, rhs.direction.y) &&
+           BitEquals(lhs.pointsize, rhs.pointsize) &&
+           BitEquals(lhs.time, rhs.time) &&
+           BitEquals(lhs.time_scale, rhs.time_scale) &&
+           BitEquals(lhs.distance, rhs.distance) &&
+           BitEquals(lhs.randomizer, rhs.randomizer) &&
+           BitEquals(lhs.alpha, rhs.alpha);
+}
+
+ParticleClass::Params MakeTestParticleParams()
+{
+    ParticleClass::Params params;
+    params.mode          = ParticleClass::SpawnPolicy::Once;
+    // not a multiple of SIMD width on purpose.
+    params.num_particles = 1023.0f;
+    params.min_lifetime  = 1.0f;
+    params.max_lifetime  = 4.0f;
+    params.max_xpos      = 10.0f;
+    params.max_ypos      = 10.0f;
+    params.init_rect_xpos   = 0.25f;
+    params.init_rect_ypos   = 0.25f;
+    params.init_rect_width  = 0.5f;
+    params.init_rect_height = 0.5f;
+    params.min_velocity = 1.0f;
+    params.max_velocity = 8.0f;
+    params.min_point_size = 1.0f;
+    params.max_point_size = 10.0f;
+    params.min_alpha = 0.1f;
+    params.max_alpha = 1.0f;
+    params.rate_of_change_in_size_wrt_time  = -2.0f;
+    params.rate_of_change_in_size_wrt_dist  = 0.5f;
+    params.rate_of_change_in_alpha_wrt_time = -0.5f;
+    params.rate_of_change_in_alpha_wrt_dist = 0.25f;
+    params.gravity = glm::vec2{0.5f, 4.0f};
+    return params;
+}
+
+void unit_test_particle_engine_update()
+{
+    const glm::mat4 matrix(1.0f);
+    gfx::Drawable::Environment env;
+    env.model_matrix = &matrix;
+    env.view_matrix  = &matrix;
+    env.proj_matrix  = &matrix;
+
+    const ParticleClass::Motion motions[] = {
+        ParticleClass::Motion::Linear,
+        ParticleClass::Motion::Projectile
+    };
+    const ParticleClass::BoundaryPolicy boundaries[] = {
+        ParticleClass::BoundaryPolicy::Clamp,
+        ParticleClass::BoundaryPolicy::Wrap,
+        ParticleClass::BoundaryPolicy::Kill,
+        ParticleClass::BoundaryPolicy::Reflect
+    };
+    const ParticleClass::CoordinateSpace spaces[] = {
+        ParticleClass::CoordinateSpace::Local,
+        ParticleClass::CoordinateSpace::Global
+    };
+
+    for (auto motion : motions)
+    {
+        for (auto boundary : boundaries)
+        {
+            for (auto space : spaces)
+            {
+                auto params = MakeTestParticleParams();
+                params.motion   = motion;
+                params.boundary = boundary;
+                params.coordinate_space = space;
+                ParticleClass klass(params);
+
+                ParticleClass::InstanceState init;
+                klass.Restart(env, init);
+                TEST_REQUIRE(init.particles.size() == 1023);
+
+                std::vector<ParticleClass::Particle> reference;
+                for (size_t i=0; i<init.particles.size(); ++i)
+                    reference.push_back(init.particles.GetParticle(i));
+
+                ParticleClass::InstanceState simd = init;
+                ParticleClass::InstanceState scalar = init;
+                for (unsigned step=0; step<300; ++step)
+                {
+                    const float dt = 1.0f / 60.0f;
+                    UpdateReferenceParticles(params, reference, dt);
+
+                    ParticleClass::EnableSIMD(true);
+                    klass.Update(env, simd, dt);
+                    ParticleClass::EnableSIMD(false);
+                    klass.Update(env, scalar, dt);
+
+                    TEST_REQUIRE(simd.particles.size() == reference.size());
+                    TEST_REQUIRE(scalar.particles.size() == reference.size());
+                    for (size_t i=0; i<reference.size(); ++i)
+                    {
+                        TEST_REQUIRE(simd.particles.GetParticle(i) == reference[i]);
+                        TEST_REQUIRE(scalar.particles.GetParticle(i) == reference[i]);
+                    }
+                }
+                // make sure that killing particles was exercised.
+                TEST_REQUIRE(reference.size() < 1023);
+            }
+        }
+    }
+    ParticleClass::EnableSIMD(true);
+}
+
+// Evaluate the analytic particle the same way as the vertex shader does.
+struct AnalyticParticle {
+    glm::vec2 position;
+    float pointsize = 0.0f;
+    float alpha = 0.0f;
+    bool alive = false;
+};
+AnalyticParticle EvaluateAnalyticParticle(const ParticleClass::Params& params,
+                                          const ParticleClass::AnalyticParticleVertex& v, float time)
+{
+    float t = time - v.aTime.z;
+    if (v.aPeriod > 0.0f && t >= 0.0f)
+        t = std::fmod(t, v.aPeriod);
+
+    const auto gravity = params.motion == ParticleClass::Motion::Projectile
+                         ? params.gravity : glm::vec2(0.0f, 0.0f);
+    glm::vec2 position = glm::vec2(v.aPosition.x, v.aPosition.y) +
+                         glm::vec2(v.aDirection.x, v.aDirection.y) * t + 0.5f * gravity * t * t;
+    if (params.coordinate_space == ParticleClass::CoordinateSpace::Local &&
+        params.boundary == ParticleClass::BoundaryPolicy::Clamp)
+    {
+        position.x = math::clamp(0.0f, params.max_xpos, position.x);
+        position.y = math::clamp(0.0f, params.max_ypos, position.y);
+    }
+    AnalyticParticle ret;
+    ret.position  = position;
+    ret.pointsize = v.aData.x + v.aTime.x * t;
+    ret.alpha     = std::min(v.aData.z + v.aTime.y * t, 1.0f);
+    ret.alive     = t >= 0.0f && t < v.aTime.w;
+    return ret;
+}
+
+void unit_test_particle_engine_analytic()
+{
+    const glm::mat4 matrix(1.0f);
+    gfx::Drawable::Environment env;
+    env.model_matrix = &matrix;
+    env.view_matrix  = &matrix;
+    env.proj_matrix  = &matrix;
+
+    // parameters that can't be evaluated analytically.
+    {
+        auto params = MakeTestParticleParams();
+        TEST_REQUIRE(!ParticleClass(params).IsAnalytic());
+        params.simulation = ParticleClass::Simulation::Analytic;
+        params.motion     = ParticleClass::Motion::Linear;
+        params.boundary   = ParticleClass::BoundaryPolicy::Clamp;
+        TEST_REQUIRE(ParticleClass(params).IsAnalytic());
+        params.boundary = ParticleClass::BoundaryPolicy::Reflect;
+        TEST_REQUIRE(!ParticleClass(params).IsAnalytic());
+        params.coordinate_space = ParticleClass::CoordinateSpace::Global;
+        TEST_REQUIRE(ParticleClass(params).IsAnalytic());
+        params.coordinate_space = ParticleClass::CoordinateSpace::Local;
+        params.motion   = ParticleClass::Motion::Projectile;
+        params.boundary = ParticleClass::BoundaryPolicy::Wrap;
+        TEST_REQUIRE(!ParticleClass(params).IsAnalytic());
+        params.rate_of_change_in_size_wrt_dist = 0.0f;
+        TEST_REQUIRE(ParticleClass(params).IsAnalytic());
+        params.boundary = ParticleClass::BoundaryPolicy::Kill;
+        TEST_REQUIRE(!ParticleClass(params).IsAnalytic());
+        params.boundary = ParticleClass::BoundaryPolicy::Wrap;
+        params.mode = ParticleClass::SpawnPolicy::Continuous;
+        TEST_REQUIRE(ParticleClass(params).IsAnalytic());
+        params.max_lifetime = std::numeric_limits<float>::max();
+        TEST_REQUIRE(!ParticleClass(params).IsAnalytic());
+    }
+
+    // the analytic particles match the CPU simulation.
+    const ParticleClass::BoundaryPolicy boundaries[] = {
+        ParticleClass::BoundaryPolicy::Clamp,
+        ParticleClass::BoundaryPolicy::Kill
+    };
+    const ParticleClass::CoordinateSpace spaces[] = {
+        ParticleClass::CoordinateSpace::Local,
+        ParticleClass::CoordinateSpace::Global
+    };
+    for (auto boundary : boundaries)
+    {
+        for (auto space : spaces)
+        {
+            auto params = MakeTestParticleParams();
+            params.simulation = ParticleClass::Simulation::Analytic;
+            params.motion     = ParticleClass::Motion::Linear;
+            params.boundary   = boundary;
+            params.coordinate_space = space;
+            ParticleClass klass(params);
+            TEST_REQUIRE(klass.IsAnalytic());
+
+            ParticleClass::InstanceState state;
+            klass.Restart(env, state);
+            TEST_REQUIRE(state.particles.empty());
+            TEST_REQUIRE(state.analytic.size() == 1023);
+
+            std::vector<ParticleClass::Particle> reference;
+            std::vector<bool> alive;
+            for (const auto& v : state.analytic)
+            {
+                ParticleClass::Particle p;
+                p.position   = glm::vec2(v.aPosition.x, v.aPosition.y);
+                p.direction  = glm::vec2(v.aDirection.x, v.aDirection.y);
+                p.pointsize  = v.aData.x;
+                p.randomizer = v.aData.y;
+                p.alpha      = v.aData.z;
+                p.time_scale = v.aData.w / params.max_lifetime;
+                reference.push_back(p);
+                alive.push_back(true);
+            }
+
+            const float dt = 1.0f / 60.0f;
+            for (unsigned step=0; step<300; ++step)
+            {
+                klass.Update(env, state, dt);
+                TEST_REQUIRE(state.particles.empty());
+
+                for (size_t i=0; i<reference.size(); ++i)
+                {
+                    if (alive[i])
+                        alive[i] = UpdateReferenceParticle(params, reference[i], dt);
+
+                    const auto& analytic = EvaluateAnalyticParticle(params, state.analytic[i], state.time);
+                    // the CPU simulation only checks the death conditions once
+                    // per step so skip the steps right around the time of death.
+                    if (std::abs(state.time - state.analytic[i].aTime.w) <= 2.0f * dt)
+                        continue;
+                    TEST_REQUIRE(analytic.alive == alive[i]);
+                    if (!alive[i])
+                        continue;
+                    TEST_REQUIRE(std::abs(analytic.position.x - reference[i].position.x) < 0.001f);
+                    TEST_REQUIRE(std::abs(analytic.position.y - reference[i].position.y) < 0.001f);
+                    TEST_REQUIRE(std::abs(analytic.pointsize - reference[i].pointsize) < 0.001f);
+                    TEST_REQUIRE(std::abs(analytic.alpha - reference[i].alpha) < 0.001f);
+                }
+            }
+            // make sure that killing particles was exercised.
+            TEST_REQUIRE(std::count(alive.begin(), alive.end(), true) < 1023);
+        }
+    }
+
+    // particles spawned once end when every particle has died.
+    {
+        auto params = MakeTestParticleParams();
+        params.simulation = ParticleClass::Simulation::Analytic;
+        params.motion     = ParticleClass::Motion::Linear;
+        ParticleClass klass(params);
+
+        ParticleClass::InstanceState state;
+        klass.Restart(env, state);
+        TEST_REQUIRE(state.analytic_end_time > 0.0f);
+        TEST_REQUIRE(state.analytic_end_time <= params.max_lifetime);
+        TEST_REQUIRE(klass.IsAlive(state));
+        klass.Update(env, state, state.analytic_end_time + 0.1f);
+        TEST_REQUIRE(!klass.IsAlive(state));
+    }
+
+    // the particle geometry is keyed by the class and the particle data.
+    {
+        auto params = MakeTestParticleParams();
+        params.simulation = ParticleClass::Simulation::Analytic;
+        params.motion     = ParticleClass::Motion::Linear;
+        ParticleClass klass(params);
+
+        ParticleClass::InstanceState state;
+        klass.Restart(env, state);
+        TEST_REQUIRE(base::StartsWith(state.analytic_geometry, "analytic-particles/" + klass.GetId() + "/"));
+
+        // a copy of the instance shares the same geometry.
+        ParticleClass::InstanceState copy = state;
+        TEST_REQUIRE(copy.analytic_geometry == state.analytic_geometry);
+
+        // new particle data uses another geometry.
+        klass.Restart(env, copy);
+        TEST_REQUIRE(copy.analytic_geometry != state.analytic_geometry);
+        TEST_REQUIRE(copy.analytic_hash != state.analytic_hash);
+    }
+
+    // maintained particles are born again when they die.
+    {
+        auto params = MakeTestParticleParams();
+        params.simulation = ParticleClass::Simulation::Analytic;
+        params.motion     = ParticleClass::Motion::Linear;
+        params.mode       = ParticleClass::SpawnPolicy::Maintain;
+        ParticleClass klass(params);
+
+        ParticleClass::InstanceState state;
+        klass.Restart(env, state);
+        for (const auto& v : state.analytic)
+        {
+            if (v.aTime.w <= 0.0f)
+                continue;
+            TEST_REQUIRE(real::equals(v.aPeriod, v.aTime.w));
+            const auto& first  = EvaluateAnalyticParticle(params, v, v.aTime.w * 0.5f);
+            const auto& second = EvaluateAnalyticParticle(params, v, v.aTime.w * 1.5f);
+            TEST_REQUIRE(first.alive && second.alive);
+            TEST_REQUIRE(std::abs(first.position.x - second.position.x) < 0.001f);
+            TEST_REQUIRE(std::abs(first.position.y - second.position.y) < 0.001f);
+        }
+        klass.Update(env, state, 100.0f);
+        TEST_REQUIRE(klass.IsAlive(state));
+    }
+
+    // continuously spawned particles are born at a fixed rate.
+    {
+        auto params = MakeTestParticleParams();
+        params.simulation    = ParticleClass::Simulation::Analytic;
+        params.motion        = ParticleClass::Motion::Linear;
+        params.mode          = ParticleClass::SpawnPolicy::Continuous;
+        params.num_particles = 10.0f;
+        ParticleClass klass(params);
+
+        ParticleClass::InstanceState state;
+        klass.Restart(env, state);
+        // 10 particles per second with 4s max lifetime.
+        TEST_REQUIRE(state.analytic.size() == 40);
+        for (size_t i=0; i<state.analytic.size(); ++i)
+        {
+            const auto& v = state.analytic[i];
+            TEST_REQUIRE(real::equals(v.aTime.z, i * 0.1f));
+            TEST_REQUIRE(real::equals(v.aPeriod, 4.0f));
+            TEST_REQUIRE(v.aTime.w <= v.aPeriod);
+        }
+        TEST_REQUIRE(!EvaluateAnalyticParticle(params, state.analytic[20], 1.0f).alive);
+    }
+}
+
+void unit_test_particle_engine_vertices()
+{
+    const glm::mat4 identity(1.0f);
+    gfx::Drawable::Environment env;
+    env.model_matrix = &identity;
+    env.view_matrix  = &identity;
+    env.proj_matrix  = &identity;
+    env.pixel_ratio  = glm::vec2(2.0f, 3.0f);
+
+    gfx::Transform transform;
+    transform.Resize(10.0f, 20.0f);
+    transform.MoveTo(100.0f, 200.0f);
+    const auto& model_to_world = transform.GetAsMatrix();
+
+    auto params = MakeTestParticleParams();
+    params.num_particles = 10.0f;
+
+    // local coordinate space particles are transformed to the world space.
+    {
+        params.coordinate_space = ParticleClass::CoordinateSpace::Local;
+        gfx::KinematicsParticleEngine engine(params);
+        engine.Restart(env);
+
+        std::vector<ParticleClass::ParticleVertex> local;
+        std::vector<ParticleClass::ParticleVertex> world;
+        engine.AppendVertices(env, nullptr, &local);
+        engine.AppendVertices(env, &model_to_world, &world);
+        TEST_REQUIRE(local.size() == 10);
+        TEST_REQUIRE(world.size() == 10);
+        for (size_t i=0; i<local.size(); ++i)
+        {
+            TEST_REQUIRE(real::equals(world[i].aPosition.x, local[i].aPosition.x * 10.0f + 100.0f));
+            TEST_REQUIRE(real::equals(world[i].aPosition.y, local[i].aPosition.y * 20.0f + 200.0f));
+            TEST_REQUIRE(real::equals(world[i].aData.x, local[i].aData.x));
+            TEST_REQUIRE(real::equals(world[i].aData.z, local[i].aData.z));
+        }
+        // appending keeps the previous vertices.
+        engine.AppendVertices(env, nullptr, &world);
+        TEST_REQUIRE(world.size() == 20);
+    }
+
+    // global coordinate space particles are already in the world space.
+    {
+        params.coordinate_space = ParticleClass::CoordinateSpace::Global;
+        params.max_xpos = 1.0f;
+        params.max_ypos = 1.0f;
+        gfx::KinematicsParticleEngine engine(params);
+        engine.Restart(env);
+
+        std::vector<ParticleClass::ParticleVertex> local;
+        std::vector<ParticleClass::ParticleVertex> world;
+        engine.AppendVertices(env, nullptr, &local);
+        engine.AppendVertices(env, &model_to_world, &world);
+        TEST_REQUIRE(local.size() == 10);
+        TEST_REQUIRE(world.size() == 10);
+        for (size_t i=0; i<local.size(); ++i)
+        {
+            TEST_REQUIRE(real::equals(world[i].aPosition.x, local[i].aPosition.x));
+            TEST_REQUIRE(real::equals(world[i].aPosition.y, local[i].aPosition.y));
+            // point size is scaled with the smaller pixel ratio.
+            TEST_REQUIRE(world[i].aData.x >= 2.0f * params.min_point_size);
+        }
+    }
+}
+
+void unit_test_particle_batch_combine()
+{
+    auto params = MakeTestParticleParams();
+    gfx::KinematicsParticleEngine a(params);
+    gfx::KinematicsParticleEngine b(params);
+    gfx::Rectangle rect;
+
+    auto color = std::make_shared<gfx::ColorClass>(gfx::CreateMaterialClassFromColor(gfx::Color::Red));
+    gfx::MaterialClassInst red_a(color);
+    gfx::MaterialClassInst red_b(color);
+    TEST_REQUIRE(gfx::ParticleBatch::CanCombine(a, red_a, b, red_b));
+    TEST_REQUIRE(gfx::ParticleBatch::CanCombine(a, red_a, b, red_a));
+
+    // same class but different instance parameters.
+    red_b.SetUniform("kBaseColor", gfx::Color4f(gfx::Color::Green));
+    TEST_REQUIRE(!gfx::ParticleBatch::CanCombine(a, red_a, b, red_b));
+    red_a.SetUniform("kBaseColor", gfx::Color4f(gfx::Color::Green));
+    TEST_REQUIRE(gfx::ParticleBatch::CanCombine(a, red_a, b, red_b));
+
+    // same class but different runtime.
+    red_b.SetRuntime(1.0f);
+    TEST_REQUIRE(!gfx::ParticleBatch::CanCombine(a, red_a, b, red_b));
+    red_b.SetRuntime(0.0f);
+
+    // different material class.
+    gfx::MaterialClassInst green(gfx::CreateMaterialClassFromColor(gfx::Color::Green));
+    TEST_REQUIRE(!gfx::ParticleBatch::CanCombine(a, red_a, b, green));
+
+    // not a particle engine.
+    TEST_REQUIRE(!gfx::ParticleBatch::CanCombine(a, red_a, rect, red_a));
+
+    // analytic particles can't be batched.
+    params.simulation = ParticleClass::Simulation::Analytic;
+    params.motion     = ParticleClass::Motion::Linear;
+    params.boundary   = ParticleClass::BoundaryPolicy::Clamp;
+    gfx::KinematicsParticleEngine analytic(params);
+    TEST_REQUIRE(analytic.IsAnalytic());
+    TEST_REQUIRE(!gfx::ParticleBatch::CanCombine(a, red_a, analytic, red_a));
+}
+
+void perf_test_particle_engine_update()
+{
+    const glm::mat4 matrix(1.0f);
+    gfx::Drawable::Environment env;
+    env.model_matrix = &matrix;
+    env.view_matrix  = &matrix;
+    env.proj_matrix  = &matrix;
+
+    auto params = MakeTestParticleParams();
+    params.mode          = ParticleClass::SpawnPolicy::Maintain;
+    params.motion        = ParticleClass::Motion::Projectile;
+    params.boundary      = ParticleClass::BoundaryPolicy::Wrap;
+    params.num_particles = 100000.0f;
+    params.min_lifetime  = 1000.0f;
+    params.max_lifetime  = 1000.0f;
+    params.rate_of_change_in_size_wrt_time  = 0.0f;
+    params.rate_of_change_in_alpha_wrt_time = 0.0f;
+    ParticleClass klass(params);
+
+    ParticleClass::InstanceState state;
+    klass.Restart(env, state);
+
+    ParticleClass::EnableSIMD(false);
+    const auto& scalar = base::TimedTest(1000, [&klass, &env, &state]() {
+        klass.Update(env, state, 1.0f/60.0f);
+    });
+    base::PrintTestTimes("Particle update (scalar)", scalar);
+
+    ParticleClass::EnableSIMD(true);
+    const auto& simd = base::TimedTest(1000, [&klass, &env, &state]() {
+        klass.Update(env, state, 1.0f/60.0f);
+    });
+    base::PrintTestTimes(ParticleClass::IsSIMDEnabled()
+                         ? "Particle update (SIMD)"
+                         : "Particle update (SIMD not available)", simd);
+}
+
 int test_main(int argc, char* argv[])
 {
     unit_test_polygon_data();
     unit_test_polygon_vertex_operations();
     unit_test_particle_engine_data();
+    unit_test_particle_engine_update();
+    unit_test_particle_engine_analytic();
+    unit_test_particle_engine_vertices();
+    unit_test_particle_batch_combine();
+
+    bool perf_test = false;
+    for (int i=1; i<argc; ++i)
+    {
+        if (!std::strcmp("--perftest", argv[i]))
+            perf_test = true;
+        else std::printf("Unrecognized cmdline param: '%s'\n", argv[i]);
+    }
+    if (perf_test)
+        perf_test_particle_engine_update();
     return 0;
-}
\ No newline at end of file
+}
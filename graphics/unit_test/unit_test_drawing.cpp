@@ -38,6 +38,7 @@
 #include "graphics/geometry.h"
 #include "graphics/painter.h"
 #include "graphics/transform.h"
+#include "graphics/atlas.h"
 
 class TestShader : public gfx::Shader
 {
@@ -84,6 +85,17 @@ public:
         mWidth  = xres;
         mHeight = yres;
         mFormat = format;
+        mMips   = mips;
+        ++mUploads;
+    }
+    virtual void UploadMip(unsigned level, const void* bytes, unsigned xres, unsigned yres, Format format) override
+    {}
+    virtual void UploadSubRect(const void* bytes, unsigned xpos, unsigned ypos, unsigned width, unsigned height) override
+    {
+        TEST_REQUIRE(!mMips);
+        TEST_REQUIRE(xpos + width <= mWidth && ypos + height <= mHeight);
+        mSubRect = gfx::URect(xpos, ypos, width, height);
+        ++mSubUploads;
     }
     virtual unsigned GetWidth() const override
     { return mWidth; }
@@ -101,9 +113,21 @@ public:
     {}
     virtual void SetGroup(const std::string&) override
     {}
+    bool HasMips() const
+    { return mMips; }
+    unsigned GetNumUploads() const
+    { return mUploads; }
+    unsigned GetNumSubUploads() const
+    { return mSubUploads; }
+    gfx::URect GetLastSubRect() const
+    { return mSubRect; }
 private:
     unsigned mWidth  = 0;
     unsigned mHeight = 0;
+    unsigned mUploads = 0;
+    unsigned mSubUploads = 0;
+    gfx::URect mSubRect;
+    bool mMips = false;
     Format mFormat  = Format::Grayscale;
     Wrapping mWrapX = Wrapping::Repeat;
     Wrapping mWrapY = Wrapping::Repeat;
@@ -408,6 +432,10 @@ public:
     {}
     virtual void DeleteFramebuffers() override
     {}
+    virtual void DeleteTexture(const std::string& name) override
+    { mTextureIndexMap.erase(name); }
+    virtual void DeleteFramebuffer(const std::string& name) override
+    {}
     virtual void SetFramebuffer(const gfx::Framebuffer* fbo) override
     {
 
@@ -437,9 +465,15 @@ public:
         bitmap.Fill(gfx::Color::DarkGreen);
         return bitmap;
     }
+    virtual void SetTextureMemoryBudget(std::size_t bytes) override
+    {}
     virtual void GetResourceStats(ResourceStats* stats) const override
     {
 
+    }
+    virtual void GetFrameStats(FrameStats* stats) const override
+    {
+
     }
     virtual void GetDeviceCaps(DeviceCaps* caps) const override
     {
@@ -1724,6 +1758,68 @@ void unit_test_particles()
 // a rect and a circle can both use the same vertex shader
 // and when with a single material only a single program
 // needs to be created.
+void unit_test_curve_lod()
+{
+    TestDevice device;
+
+    const glm::mat4 model(1.0f);
+    gfx::Drawable::Environment env;
+    env.model_matrix = &model;
+
+    // unknown size on the screen uses full detail.
+    auto* full = (TestGeometry*)gfx::Circle().Upload(env, device);
+    TEST_REQUIRE(full);
+    TEST_REQUIRE(full == device.FindGeometry("Circle"));
+    TEST_REQUIRE(full->Count<gfx::Vertex>() == 1 + 101);
+
+    // big shape on the screen uses full detail too.
+    env.screen_size = glm::vec2(1000.0f, 1000.0f);
+    TEST_REQUIRE(gfx::Circle().Upload(env, device) == full);
+
+    // tiny shape uses the lowest level of detail.
+    env.screen_size = glm::vec2(4.0f, 4.0f);
+    auto* tiny = (TestGeometry*)gfx::Circle().Upload(env, device);
+    TEST_REQUIRE(tiny && tiny != full);
+    TEST_REQUIRE(tiny->Count<gfx::Vertex>() == 1 + 7);
+
+    // radius of 50 pixels needs 23 slices for 0.5px error -> 25 slices.
+    env.screen_size = glm::vec2(100.0f, 80.0f);
+    auto* medium = (TestGeometry*)gfx::Circle().Upload(env, device);
+    TEST_REQUIRE(medium && medium != full && medium != tiny);
+    TEST_REQUIRE(medium->Count<gfx::Vertex>() == 1 + 26);
+
+    // each level of detail is cached.
+    TEST_REQUIRE(gfx::Circle().Upload(env, device) == medium);
+    env.screen_size = glm::vec2(3.0f, 3.0f);
+    TEST_REQUIRE(gfx::Circle().Upload(env, device) == tiny);
+
+    // the other curved shapes.
+    {
+        env.screen_size = glm::vec2(0.0f, 0.0f);
+        auto* a = (TestGeometry*)gfx::SemiCircle().Upload(env, device);
+        env.screen_size = glm::vec2(4.0f, 4.0f);
+        auto* b = (TestGeometry*)gfx::SemiCircle().Upload(env, device);
+        TEST_REQUIRE(a->Count<gfx::Vertex>() == 1 + 51);
+        TEST_REQUIRE(b->Count<gfx::Vertex>() == 1 + 4);
+    }
+    {
+        env.screen_size = glm::vec2(0.0f, 0.0f);
+        auto* a = (TestGeometry*)gfx::RoundRectangle().Upload(env, device);
+        env.screen_size = glm::vec2(4.0f, 4.0f);
+        auto* b = (TestGeometry*)gfx::RoundRectangle().Upload(env, device);
+        TEST_REQUIRE(a != b);
+        TEST_REQUIRE(a->Count<gfx::Vertex>() > b->Count<gfx::Vertex>());
+    }
+    {
+        env.screen_size = glm::vec2(0.0f, 0.0f);
+        auto* a = (TestGeometry*)gfx::Capsule().Upload(env, device);
+        env.screen_size = glm::vec2(8.0f, 4.0f);
+        auto* b = (TestGeometry*)gfx::Capsule().Upload(env, device);
+        TEST_REQUIRE(a != b);
+        TEST_REQUIRE(a->Count<gfx::Vertex>() > b->Count<gfx::Vertex>());
+    }
+}
+
 void unit_test_painter_shape_material_pairing()
 {
     TestDevice device;
@@ -1785,6 +1881,205 @@ void unit_test_packed_texture_bug()
     }
 }
 
+void unit_test_texture_atlas()
+{
+    gfx::TextureAtlas::Params params;
+    params.page_size      = 64;
+    params.max_image_size = 16;
+    params.max_pages      = 1;
+    params.padding        = 1;
+
+    // small textures share the same atlas page.
+    {
+        TestDevice device;
+        TestProgram program;
+        gfx::TextureAtlas atlas(params);
+
+        gfx::RgbaBitmap bitmap;
+        bitmap.Resize(8, 8);
+        bitmap.Fill(gfx::Color::Red);
+
+        gfx::TextureMap2DClass material0;
+        material0.SetTexture(gfx::CreateTextureFromBitmap(bitmap));
+        bitmap.Fill(gfx::Color::Green);
+        gfx::TextureMap2DClass material1;
+        material1.SetTexture(gfx::CreateTextureFromBitmap(bitmap), gfx::FRect(0.5f, 0.0f, 0.5f, 1.0f));
+
+        gfx::MaterialClass::State env;
+        env.atlas = &atlas;
+        material0.ApplyDynamicState(env, device, program);
+        TEST_REQUIRE(device.GetNumTextures() == 1);
+        TEST_REQUIRE(device.GetTexture(0).GetWidth() == 64);
+        TEST_REQUIRE(device.GetTexture(0).GetHeight() == 64);
+        TEST_REQUIRE(device.GetTexture(0).GetFormat() == gfx::Texture::Format::RGBA);
+        TEST_REQUIRE(program.GetTextureBinding(0).texture == &device.GetTexture(0));
+
+        glm::vec4 box0;
+        glm::ivec2 wrap;
+        TEST_REQUIRE(program.GetUniform("kTextureBox", &box0));
+        TEST_REQUIRE(program.GetUniform("kTextureWrap", &wrap));
+        TEST_REQUIRE(box0 == glm::vec4(1.0f/64.0f, 1.0f/64.0f, 8.0f/64.0f, 8.0f/64.0f));
+        TEST_REQUIRE(wrap != glm::ivec2(0, 0));
+
+        program.Clear();
+        material1.ApplyDynamicState(env, device, program);
+        TEST_REQUIRE(device.GetNumTextures() == 1);
+        TEST_REQUIRE(program.GetTextureBinding(0).texture == &device.GetTexture(0));
+
+        glm::vec4 box1;
+        TEST_REQUIRE(program.GetUniform("kTextureBox", &box1));
+        TEST_REQUIRE(box1 == glm::vec4(11.0f/64.0f + 4.0f/64.0f, 1.0f/64.0f, 4.0f/64.0f, 8.0f/64.0f));
+
+        // same texture, no new images. the page was uploaded once without
+        // mips and the second image only uploaded its own area.
+        program.Clear();
+        material0.ApplyDynamicState(env, device, program);
+        TEST_REQUIRE(atlas.GetStats().images == 2);
+        TEST_REQUIRE(atlas.GetStats().pages == 1);
+        TEST_REQUIRE(atlas.GetStats().uploads == 1);
+        TEST_REQUIRE(atlas.GetStats().sub_uploads == 1);
+        TEST_REQUIRE(device.GetTexture(0).GetNumUploads() == 1);
+        TEST_REQUIRE(device.GetTexture(0).GetNumSubUploads() == 1);
+        const auto sub_rect = device.GetTexture(0).GetLastSubRect();
+        TEST_REQUIRE(sub_rect.GetX() == 10 && sub_rect.GetY() == 0);
+        TEST_REQUIRE(sub_rect.GetWidth() == 10 && sub_rect.GetHeight() == 10);
+        TEST_REQUIRE(device.GetTexture(0).HasMips() == false);
+        TEST_REQUIRE(device.GetTexture(0).GetMinFilter() == gfx::Texture::MinFilter::Linear);
+
+        // materials that would need the shader to wrap or move the
+        // texture coordinates don't use the atlas.
+        {
+            gfx::TextureMap2DClass wrapped;
+            wrapped.SetTexture(gfx::CreateTextureFromBitmap(bitmap));
+            wrapped.SetTextureWrapX(gfx::TextureMap2DClass::TextureWrapping::Repeat);
+            gfx::TextureMap2DClass scaled;
+            scaled.SetTexture(gfx::CreateTextureFromBitmap(bitmap));
+            scaled.SetTextureScaleX(2.0f);
+            gfx::TextureMap2DClass scrolling;
+            scrolling.SetTexture(gfx::CreateTextureFromBitmap(bitmap));
+            scrolling.SetTextureVelocity(glm::vec2(1.0f, 0.0f), 0.0f);
+
+            TestDevice other;
+            program.Clear();
+            wrapped.ApplyDynamicState(env, other, program);
+            scaled.ApplyDynamicState(env, other, program);
+            scrolling.ApplyDynamicState(env, other, program);
+            TEST_REQUIRE(other.GetNumTextures() == 3);
+            TEST_REQUIRE(other.GetTexture(0).GetWidth() == 8);
+            TEST_REQUIRE(other.GetTexture(0).HasMips());
+            TEST_REQUIRE(atlas.GetStats().images == 2);
+        }
+
+        // large texture uses its own texture object.
+        bitmap.Resize(32, 32);
+        gfx::TextureMap2DClass material2;
+        material2.SetTexture(gfx::CreateTextureFromBitmap(bitmap));
+        program.Clear();
+        material2.ApplyDynamicState(env, device, program);
+        TEST_REQUIRE(device.GetNumTextures() == 2);
+        TEST_REQUIRE(device.GetTexture(1).GetWidth() == 32);
+        TEST_REQUIRE(program.GetTextureBinding(0).texture == &device.GetTexture(1));
+        TEST_REQUIRE(program.GetUniform("kTextureWrap", &wrap));
+        TEST_REQUIRE(wrap == glm::ivec2(0, 0));
+        TEST_REQUIRE(atlas.GetStats().images == 2);
+    }
+
+    // different formats go into different pages.
+    {
+        TestDevice device;
+        TestProgram program;
+        gfx::TextureAtlas atlas(params);
+
+        const gfx::RgbaBitmap rgba(4, 4);
+        const gfx::GrayscaleBitmap alpha(4, 4);
+        gfx::SpriteClass sprite;
+        sprite.AddTexture(gfx::CreateTextureFromBitmap(rgba));
+        sprite.AddTexture(gfx::CreateTextureFromBitmap(alpha));
+        sprite.SetFps(1.0f);
+
+        gfx::MaterialClass::State env;
+        env.atlas = &atlas;
+        sprite.ApplyDynamicState(env, device, program);
+        TEST_REQUIRE(device.GetNumTextures() == 2);
+        TEST_REQUIRE(atlas.GetStats().pages == 2);
+        TEST_REQUIRE(program.GetTextureBinding(0).texture->GetFormat() == gfx::Texture::Format::RGBA);
+        TEST_REQUIRE(program.GetTextureBinding(1).texture->GetFormat() == gfx::Texture::Format::Grayscale);
+    }
+
+    params.page_size = 32;
+    params.max_image_size = 14;
+
+    // repack the page when images have changed.
+    {
+        TestDevice device;
+        gfx::TextureAtlas atlas(params);
+
+        gfx::RgbaBitmap bitmap(14, 14);
+        std::vector<std::unique_ptr<gfx::detail::TextureBitmapBufferSource>> sources;
+        for (int i=0; i<5; ++i)
+        {
+            sources.push_back(gfx::CreateTextureFromBitmap(bitmap));
+        }
+        gfx::FRect rect;
+        for (int i=0; i<4; ++i)
+        {
+            const auto& source = *sources[i];
+            TEST_REQUIRE(atlas.AddTexture(source, *source.GetData(), source.GetContentHash(), device, &rect));
+        }
+        TEST_REQUIRE(atlas.GetStats().images == 4);
+        TEST_REQUIRE(atlas.AddTexture(*sources[4], *sources[4]->GetData(), 0, device, &rect) == nullptr);
+
+        // change the content of the first image.
+        sources[0]->SetBitmap(gfx::RgbaBitmap(10, 10));
+        TEST_REQUIRE(atlas.FindTexture(*sources[0], false, device, &rect));
+        TEST_REQUIRE(atlas.FindTexture(*sources[0], true, device, &rect) == nullptr);
+        TEST_REQUIRE(atlas.GetStats().images == 3);
+
+        TEST_REQUIRE(atlas.AddTexture(*sources[4], *sources[4]->GetData(), 0, device, &rect));
+        TEST_REQUIRE(atlas.GetStats().images == 4);
+        TEST_REQUIRE(atlas.GetStats().repacks == 1);
+        TEST_REQUIRE(atlas.GetStats().evictions == 0);
+        for (int i=1; i<5; ++i)
+        {
+            TEST_REQUIRE(atlas.FindTexture(*sources[i], false, device, &rect));
+        }
+    }
+
+    // evict the least recently used page when there's no space.
+    {
+        TestDevice device;
+        gfx::TextureAtlas atlas(params);
+
+        gfx::RgbaBitmap bitmap(14, 14);
+        std::vector<std::unique_ptr<gfx::detail::TextureBitmapBufferSource>> sources;
+        for (int i=0; i<5; ++i)
+        {
+            sources.push_back(gfx::CreateTextureFromBitmap(bitmap));
+        }
+        gfx::FRect rect;
+        for (int i=0; i<4; ++i)
+        {
+            const auto& source = *sources[i];
+            TEST_REQUIRE(atlas.AddTexture(source, *source.GetData(), 0, device, &rect));
+        }
+        // page is in use in the current frame.
+        TEST_REQUIRE(atlas.AddTexture(*sources[4], *sources[4]->GetData(), 0, device, &rect) == nullptr);
+
+        atlas.BeginFrame();
+        TEST_REQUIRE(atlas.AddTexture(*sources[4], *sources[4]->GetData(), 0, device, &rect));
+        TEST_REQUIRE(atlas.GetStats().evictions == 1);
+        TEST_REQUIRE(atlas.GetStats().images == 1);
+        TEST_REQUIRE(atlas.FindTexture(*sources[0], false, device, &rect) == nullptr);
+        TEST_REQUIRE(atlas.FindTexture(*sources[4], false, device, &rect));
+
+        // page texture was deleted by the device, should be restored.
+        TestDevice other;
+        TEST_REQUIRE(atlas.FindTexture(*sources[4], false, other, &rect));
+        TEST_REQUIRE(other.GetNumTextures() == 1);
+        TEST_REQUIRE(other.GetTexture(0).GetWidth() == 32);
+    }
+}
+
 int test_main(int argc, char* argv[])
 {
     unit_test_material_uniforms();
@@ -1797,7 +2092,9 @@ int test_main(int argc, char* argv[])
     unit_test_local_particles();
     unit_test_global_particles();
     unit_test_particles();
+    unit_test_curve_lod();
     unit_test_painter_shape_material_pairing();
+    unit_test_texture_atlas();
 
     unit_test_packed_texture_bug();
     return 0;
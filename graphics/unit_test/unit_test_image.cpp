@@ -16,8 +16,26 @@
 
 #include "config.h"
 
+#include <vector>
+
 #include "base/test_minimal.h"
 #include "../image.h"
+#include "../baked_texture.h"
+
+class TestResource : public gfx::Resource
+{
+public:
+    TestResource(std::vector<char>&& data) : mData(std::move(data))
+    {}
+    virtual const void* GetData() const override
+    { return &mData[0]; }
+    virtual std::size_t GetSize() const override
+    { return mData.size(); }
+    virtual std::string GetName() const override
+    { return "test"; }
+private:
+    const std::vector<char> mData;
+};
 
 int test_main(int argc, char* argv[])
 {
@@ -127,7 +145,42 @@ int test_main(int argc, char* argv[])
         TEST_REQUIRE(Compare(bmp, gfx::URect(0, 0, 4, 4), ref, mse));
     }
 
+    // baked texture round trip.
+    {
+        gfx::Image img("../graphics/unit_test/4x4_square_rgba.png");
+        TEST_REQUIRE(img.IsValid());
+        gfx::Bitmap<gfx::RGBA> bmp = img.AsBitmap<gfx::RGBA>();
+
+        std::vector<char> data;
+        TEST_REQUIRE(gfx::BakeTexture(bmp, true, false, &data));
+        TEST_REQUIRE(gfx::BakedTexture::IsBakedTexture(&data[0], data.size()));
+
+        gfx::BakedTexture baked(std::make_shared<TestResource>(std::move(data)));
+        TEST_REQUIRE(baked.IsValid());
+        TEST_REQUIRE(baked.IsPremultiplied() == false);
+        TEST_REQUIRE(baked.GetFormat() == gfx::Texture::Format::sRGBA);
+        TEST_REQUIRE(baked.GetWidth() == 4);
+        TEST_REQUIRE(baked.GetHeight() == 4);
+        TEST_REQUIRE(baked.GetNumLevels() == 3);
+        TEST_REQUIRE(baked.GetLevel(1).width == 2);
+        TEST_REQUIRE(baked.GetLevel(1).height == 2);
+        TEST_REQUIRE(baked.GetLevel(2).width == 1);
+        TEST_REQUIRE(baked.GetLevel(2).height == 1);
+
+        const auto& base = baked.GetLevel(0);
+        TEST_REQUIRE(base.bytes == 4 * 4 * 4);
+        gfx::Bitmap<gfx::RGBA> level0((const gfx::RGBA*)base.data, 4, 4);
+        TEST_REQUIRE(level0 == bmp);
+    }
 
+    // invalid data
+    {
+        std::vector<char> data;
+        data.resize(100);
+        TEST_REQUIRE(gfx::BakedTexture::IsBakedTexture(&data[0], data.size()) == false);
+        gfx::BakedTexture baked(std::make_shared<TestResource>(std::move(data)));
+        TEST_REQUIRE(baked.IsValid() == false);
+    }
 
     return 0;
 }
\ No newline at end of file
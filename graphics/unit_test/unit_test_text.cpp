@@ -0,0 +1,264 @@
+// Copyright (C) 2020-2021 Sami Väisänen
+// Copyright (C) 2020-2021 Ensisoft http://www.ensisoft.com
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+#include "config.h"
+
+#include <cmath>
+#include <string>
+#include <vector>
+
+#include "base/test_minimal.h"
+#include "base/test_help.h"
+#include "base/types.h"
+#include "graphics/text.h"
+
+// the test is run in the graphics test dist folder.
+const std::string Font = "fonts/AtariFontFullVersion.ttf";
+
+using GlyphQuads = std::vector<gfx::GlyphAtlas::GlyphQuad>;
+
+// Map the normalized glyph texture rect back to atlas pixels.
+base::URect GetAtlasRect(const gfx::GlyphAtlas& atlas, const gfx::GlyphAtlas::GlyphQuad& quad)
+{
+    const float size = atlas.GetBitmap().GetWidth();
+    const auto& rect = quad.texture_rect;
+    return base::URect(std::round(rect.GetX() * size),
+                       std::round(rect.GetY() * size),
+                       std::round(rect.GetWidth() * size),
+                       std::round(rect.GetHeight() * size));
+}
+
+bool CheckNoOverlap(const gfx::GlyphAtlas& atlas, const GlyphQuads& quads)
+{
+    for (size_t i=0; i<quads.size(); ++i)
+    {
+        const auto& a = GetAtlasRect(atlas, quads[i]);
+        for (size_t j=i+1; j<quads.size(); ++j)
+        {
+            // same glyph
+            if (quads[i].texture_rect == quads[j].texture_rect)
+                continue;
+            const auto& b = GetAtlasRect(atlas, quads[j]);
+            if (base::DoesIntersect(a, b))
+                return false;
+        }
+    }
+    return true;
+}
+
+void unit_test_glyph_atlas_layout()
+{
+    gfx::GlyphAtlas atlas(Font, 20);
+    TEST_REQUIRE(atlas.IsValid());
+    TEST_REQUIRE(atlas.GetBitmap().GetWidth() == gfx::GlyphAtlas::AtlasSize);
+
+    // size to content.
+    {
+        gfx::TextBuffer text(0, 0);
+        text.AddText("hello world", Font, 20);
+
+        GlyphQuads quads;
+        unsigned width  = 0;
+        unsigned height = 0;
+        TEST_REQUIRE(atlas.Layout(text, &quads, &width, &height));
+        TEST_REQUIRE(width && height);
+        // the space has no pixels and produces no quad.
+        TEST_REQUIRE(quads.size() == 10);
+        // h e l o w r d and the space
+        TEST_REQUIRE(atlas.GetStats().glyphs_rasterized == 8);
+        TEST_REQUIRE(atlas.GetStats().pages_evicted == 0);
+        TEST_REQUIRE(atlas.GetStats().atlas_grown == 0);
+
+        for (const auto& quad : quads)
+        {
+            TEST_REQUIRE(quad.x >= 0.0f);
+            TEST_REQUIRE(quad.x + quad.width <= width);
+            const auto& tex = quad.texture_rect;
+            TEST_REQUIRE(tex.GetX() >= 0.0f && tex.GetX() + tex.GetWidth() <= 1.0f);
+            TEST_REQUIRE(tex.GetY() >= 0.0f && tex.GetY() + tex.GetHeight() <= 1.0f);
+        }
+        // the glyphs are laid out left to right.
+        for (size_t i=1; i<quads.size(); ++i)
+            TEST_REQUIRE(quads[i].x > quads[i-1].x);
+
+        // the same glyph uses the same atlas location.
+        TEST_REQUIRE(quads[2].texture_rect == quads[3].texture_rect);
+        TEST_REQUIRE(quads[2].texture_rect != quads[1].texture_rect);
+        TEST_REQUIRE(CheckNoOverlap(atlas, quads));
+
+        // laying out the same glyphs again doesn't rasterize anything
+        // and doesn't change the atlas.
+        const auto content_version = atlas.GetContentVersion();
+        const auto layout_version  = atlas.GetLayoutVersion();
+        GlyphQuads other;
+        TEST_REQUIRE(atlas.Layout(text, &other, &width, &height));
+        TEST_REQUIRE(other.size() == quads.size());
+        for (size_t i=0; i<quads.size(); ++i)
+        {
+            TEST_REQUIRE(other[i].x == quads[i].x);
+            TEST_REQUIRE(other[i].y == quads[i].y);
+            TEST_REQUIRE(other[i].texture_rect == quads[i].texture_rect);
+        }
+        TEST_REQUIRE(atlas.GetStats().glyphs_rasterized == 8);
+        TEST_REQUIRE(atlas.GetContentVersion() == content_version);
+        TEST_REQUIRE(atlas.GetLayoutVersion() == layout_version);
+
+        // a new glyph changes the content but not the layout.
+        text.AddText("!", Font, 20);
+        TEST_REQUIRE(atlas.Layout(text, &other, &width, &height));
+        TEST_REQUIRE(other.size() == quads.size() + 1);
+        TEST_REQUIRE(atlas.GetStats().glyphs_rasterized == 9);
+        TEST_REQUIRE(atlas.GetContentVersion() != content_version);
+        TEST_REQUIRE(atlas.GetLayoutVersion() == layout_version);
+    }
+
+    // fixed buffer size, the text is aligned inside the buffer.
+    {
+        gfx::TextBuffer text(200, 100);
+        text.SetAlignment(gfx::TextBuffer::HorizontalAlignment::AlignCenter);
+        text.SetAlignment(gfx::TextBuffer::VerticalAlignment::AlignCenter);
+        text.AddText("hello", Font, 20);
+
+        GlyphQuads quads;
+        unsigned width  = 0;
+        unsigned height = 0;
+        TEST_REQUIRE(atlas.Layout(text, &quads, &width, &height));
+        TEST_REQUIRE(width == 200);
+        TEST_REQUIRE(height == 100);
+        TEST_REQUIRE(quads.size() == 5);
+        const float left  = quads.front().x;
+        const float right = 200.0f - (quads.back().x + quads.back().width);
+        TEST_REQUIRE(left > 0.0f);
+        TEST_REQUIRE(right > 0.0f);
+        TEST_REQUIRE(std::abs(left - right) <= 20.0f);
+        for (const auto& quad : quads)
+        {
+            TEST_REQUIRE(quad.y > 0.0f);
+            TEST_REQUIRE(quad.y + quad.height < 100.0f);
+        }
+    }
+
+    // underline adds a quad under the line.
+    {
+        gfx::TextBuffer::Text str;
+        str.text = "hello";
+        str.font = Font;
+        str.fontsize  = 20;
+        str.underline = true;
+        gfx::TextBuffer text(0, 0);
+        text.AddText(str);
+
+        GlyphQuads quads;
+        unsigned width  = 0;
+        unsigned height = 0;
+        TEST_REQUIRE(atlas.Layout(text, &quads, &width, &height));
+        TEST_REQUIRE(quads.size() == 6);
+        TEST_REQUIRE(quads.back().width == quads[4].x + quads[4].width);
+        TEST_REQUIRE(quads.back().y > quads[0].y);
+    }
+
+    // text with another font size isn't laid out.
+    {
+        gfx::TextBuffer text(0, 0);
+        text.AddText("hello", Font, 21);
+
+        GlyphQuads quads;
+        unsigned width  = 0;
+        unsigned height = 0;
+        TEST_REQUIRE(atlas.Layout(text, &quads, &width, &height));
+        TEST_REQUIRE(quads.empty());
+    }
+}
+
+void unit_test_glyph_atlas_packing()
+{
+    // the glyphs at this size are so big that only a few of them
+    // fit in a single atlas page.
+    const unsigned font_size = 200;
+    const std::string glyphs = "ABCDEFGHIJKLMNOPQRSTUVWXYZ0123456789";
+
+    // all the glyphs are needed by a single layout, the atlas must
+    // grow instead of failing the layout.
+    {
+        gfx::GlyphAtlas atlas(Font, font_size);
+        TEST_REQUIRE(atlas.IsValid());
+
+        const auto layout_version = atlas.GetLayoutVersion();
+
+        gfx::TextBuffer text(0, 0);
+        text.AddText(glyphs, Font, font_size);
+
+        GlyphQuads quads;
+        unsigned width  = 0;
+        unsigned height = 0;
+        TEST_REQUIRE(atlas.Layout(text, &quads, &width, &height));
+        TEST_REQUIRE(quads.size() == glyphs.size());
+        TEST_REQUIRE(atlas.GetStats().glyphs_rasterized == glyphs.size());
+        TEST_REQUIRE(atlas.GetStats().atlas_grown >= 1);
+        TEST_REQUIRE(atlas.GetStats().pages_evicted == 0);
+        TEST_REQUIRE(atlas.GetBitmap().GetWidth() > gfx::GlyphAtlas::AtlasSize);
+        TEST_REQUIRE(atlas.GetBitmap().GetWidth() == atlas.GetBitmap().GetHeight());
+        TEST_REQUIRE(atlas.GetLayoutVersion() != layout_version);
+        TEST_REQUIRE(CheckNoOverlap(atlas, quads));
+        for (const auto& quad : quads)
+        {
+            const auto& tex = quad.texture_rect;
+            TEST_REQUIRE(tex.GetX() >= 0.0f && tex.GetX() + tex.GetWidth() <= 1.0f);
+            TEST_REQUIRE(tex.GetY() >= 0.0f && tex.GetY() + tex.GetHeight() <= 1.0f);
+        }
+    }
+
+    // glyphs needed by separate layouts evict the least recently
+    // used pages instead of growing the atlas.
+    {
+        gfx::GlyphAtlas atlas(Font, font_size);
+        TEST_REQUIRE(atlas.IsValid());
+
+        GlyphQuads quads;
+        unsigned width  = 0;
+        unsigned height = 0;
+        for (int round=0; round<2; ++round)
+        {
+            for (auto glyph : glyphs)
+            {
+                gfx::TextBuffer text(0, 0);
+                text.AddText(std::string(1, glyph), Font, font_size);
+                TEST_REQUIRE(atlas.Layout(text, &quads, &width, &height));
+                TEST_REQUIRE(quads.size() == 1);
+            }
+        }
+        TEST_REQUIRE(atlas.GetStats().atlas_grown == 0);
+        TEST_REQUIRE(atlas.GetStats().pages_evicted > 0);
+        TEST_REQUIRE(atlas.GetStats().glyphs_rasterized > glyphs.size());
+        TEST_REQUIRE(atlas.GetBitmap().GetWidth() == gfx::GlyphAtlas::AtlasSize);
+
+        // the glyphs of the latest layout are still valid after eviction.
+        gfx::TextBuffer text(0, 0);
+        text.AddText("789", Font, font_size);
+        const auto rasterized = atlas.GetStats().glyphs_rasterized;
+        TEST_REQUIRE(atlas.Layout(text, &quads, &width, &height));
+        TEST_REQUIRE(quads.size() == 3);
+        TEST_REQUIRE(atlas.GetStats().glyphs_rasterized == rasterized);
+        TEST_REQUIRE(CheckNoOverlap(atlas, quads));
+    }
+}
+
+int test_main(int argc, char* argv[])
+{
+    unit_test_glyph_atlas_layout();
+    unit_test_glyph_atlas_packing();
+    return 0;
+}
@@ -128,6 +128,33 @@ namespace uik
 
         // todo: more sub widget draw ops.
 
+        // Paint caching. A painter implementation can keep the results of painting
+        // a widget and all of its children (i.e. a widget sub-tree) and then
+        // reproduce the same results later without having to repeat all the
+        // individual paint operations. The cached results are identified by the
+        // ID of the sub-tree root widget and a hash value that covers all the
+        // widget state that affects the output. Whenever the hash changes the
+        // cached results are no longer valid. The default implementation does
+        // no caching.
+
+        // Draw the cached paint results for the widget sub-tree in the given
+        // rectangle. The rectangle covers all the visible widgets in the
+        // sub-tree. Returns true if the painter had a valid cached result with
+        // a matching hash value, otherwise false in which case the sub-tree
+        // must be painted normally.
+        virtual bool DrawCachedPaint(const WidgetId& id, const FRect& rect, std::size_t hash)
+        { return false; }
+        // Begin capturing the subsequent paint operations into a cache for the
+        // widget sub-tree in the given rectangle. Returns true if the paint
+        // operations are being captured in which case EndPaintCache must be
+        // called once the sub-tree has been painted.
+        virtual bool BeginPaintCache(const WidgetId& id, const FRect& rect, std::size_t hash)
+        { return false; }
+        // Finish capturing the paint operations for the widget sub-tree and
+        // draw the results.
+        virtual void EndPaintCache(const WidgetId& id)
+        {}
+
         // Parse a style string that can be used to convey painter specific styling
         // data and properties such as colors, font sizes, font names etc. The
         // tag value is used to indicate the source of the styling data and in case
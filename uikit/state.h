@@ -81,22 +81,62 @@ namespace uik
         }
         template<typename T>
         void SetValue(const std::string& key, const T& value)
-        { mState[key] = value; }
+        { StoreValue(key, value); }
         template<typename T>
         void SetValue(const std::string& key, const Widget* widget)
-        { mState[key] = const_cast<Widget*>(widget); }
+        { StoreValue(key, const_cast<Widget*>(widget)); }
         void SetValue(const std::string& key, Widget* widget)
-        { mState[key] = widget; }
+        { StoreValue(key, widget); }
         template<typename T>
         void SetValue(const std::string& key, T* value)
-        { mState[key] = value; }
+        { StoreValue(key, value); }
 
         void Clear()
-        { mState.clear(); }
+        {
+            mState.clear();
+            for (auto& pair : mChangeCounts)
+                ++pair.second;
+        }
+        // Get the number of changes made to the values of the widget
+        // identified by the widget ID, i.e. values whose key begins with
+        // the widget ID followed by '/'. Only setting a value that differs
+        // from the current value counts as a change. This can be used to
+        // detect whether the widget's state has changed since some earlier
+        // point in time.
+        std::size_t GetChangeCount(const std::string& widget) const
+        {
+            auto it = mChangeCounts.find(widget);
+            if (it == mChangeCounts.end())
+                return 0;
+            return it->second;
+        }
     private:
         using Variant = std::variant<int, float, bool, Widget*, base::FPoint>;
 
+        template<typename T>
+        static bool IsSame(const T& lhs, const T& rhs)
+        { return lhs == rhs; }
+        static bool IsSame(const base::FPoint& lhs, const base::FPoint& rhs)
+        { return lhs.GetX() == rhs.GetX() && lhs.GetY() == rhs.GetY(); }
+
+        template<typename T>
+        void StoreValue(const std::string& key, const T& value)
+        {
+            auto it = mState.find(key);
+            if (it != mState.end() && std::holds_alternative<T>(it->second))
+            {
+                if (IsSame(std::get<T>(it->second), value))
+                    return;
+            }
+            mState[key] = value;
+
+            const auto pos = key.find('/');
+            if (pos != std::string::npos)
+                ++mChangeCounts[key.substr(0, pos)];
+        }
+
         std::unordered_map<std::string, Variant> mState;
+        std::unordered_map<std::string, std::size_t> mChangeCounts;
     };
 
 } // namespace
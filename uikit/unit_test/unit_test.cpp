@@ -18,6 +18,7 @@
 
 #include <string>
 #include <iostream>
+#include <unordered_map>
 
 #include "base/test_minimal.h"
 #include "base/test_float.h"
@@ -627,6 +628,168 @@ void unit_test_window_paint()
     }
 }
 
+void unit_test_window_paint_cache()
+{
+    class CachingPainter : public Painter
+    {
+    public:
+        std::unordered_map<std::string, std::size_t> cache;
+        std::vector<std::string> begin;
+        std::vector<std::string> end;
+        std::vector<std::string> drawn;
+        std::unordered_map<std::string, uik::FRect> rects;
+
+        bool DrawCachedPaint(const WidgetId& id, const uik::FRect& rect, std::size_t hash) override
+        {
+            auto it = cache.find(id);
+            if (it == cache.end() || it->second != hash)
+                return false;
+            drawn.push_back(id);
+            return true;
+        }
+        bool BeginPaintCache(const WidgetId& id, const uik::FRect& rect, std::size_t hash) override
+        {
+            cache[id] = hash;
+            rects[id] = rect;
+            begin.push_back(id);
+            return true;
+        }
+        void EndPaintCache(const WidgetId& id) override
+        {
+            end.push_back(id);
+        }
+        void Reset()
+        {
+            begin.clear();
+            end.clear();
+            drawn.clear();
+            cmds.clear();
+        }
+    };
+
+    uik::Window win;
+    {
+        uik::Form form;
+        form.SetSize(500.0f, 500.0f);
+        form.SetName("form");
+        win.AddWidget(form);
+        win.LinkChild(nullptr, win.FindWidgetByName("form"));
+
+        uik::GroupBox group0;
+        group0.SetName("groupbox0");
+        group0.SetSize(100.0f, 150.0f);
+        win.AddWidget(group0);
+        win.LinkChild(win.FindWidgetByName("form"), win.FindWidgetByName("groupbox0"));
+
+        uik::GroupBox group1;
+        group1.SetName("groupbox1");
+        group1.SetSize(100.0f, 150.0f);
+        group1.SetPosition(200.0f, 0.0f);
+        win.AddWidget(group1);
+        win.LinkChild(win.FindWidgetByName("form"), win.FindWidgetByName("groupbox1"));
+
+        uik::Label label0;
+        label0.SetName("label0");
+        label0.SetText("label");
+        label0.SetSize(50.0f, 10.0f);
+        win.AddWidget(label0);
+        win.LinkChild(win.FindWidgetByName("groupbox0"), win.FindWidgetByName("label0"));
+
+        // this label extends outside the group box.
+        uik::Label label1;
+        label1.SetName("label1");
+        label1.SetText("label");
+        label1.SetSize(50.0f, 10.0f);
+        label1.SetPosition(80.0f, 10.0f);
+        win.AddWidget(label1);
+        win.LinkChild(win.FindWidgetByName("groupbox1"), win.FindWidgetByName("label1"));
+    }
+    const auto* group0 = win.FindWidgetByName("groupbox0");
+    const auto* group1 = win.FindWidgetByName("groupbox1");
+    auto* label0 = static_cast<uik::Label*>(win.FindWidgetByName("label0"));
+    auto* label1 = static_cast<uik::Label*>(win.FindWidgetByName("label1"));
+
+    uik::State state;
+    CachingPainter p;
+
+    // first paint goes into the cache, only the leaf containers are cached.
+    win.Paint(state, p);
+    TEST_REQUIRE(p.begin.size() == 2);
+    TEST_REQUIRE(p.begin[0] == group0->GetId());
+    TEST_REQUIRE(p.begin[1] == group1->GetId());
+    TEST_REQUIRE(p.end.size() == 2);
+    TEST_REQUIRE(p.end[0] == group0->GetId());
+    TEST_REQUIRE(p.end[1] == group1->GetId());
+    TEST_REQUIRE(p.drawn.empty());
+    TEST_REQUIRE(!p.cmds.empty());
+
+    // the cached rectangle covers the whole sub-tree and
+    // not just the container.
+    TEST_REQUIRE(p.rects[group0->GetId()] == uik::FRect(0.0f, 0.0f, 100.0f, 150.0f));
+    TEST_REQUIRE(p.rects[group1->GetId()] == uik::FRect(200.0f, 0.0f, 130.0f, 150.0f));
+
+    // nothing has changed, the cached results are used.
+    // the form is still painted normally.
+    p.Reset();
+    win.Paint(state, p);
+    TEST_REQUIRE(p.begin.empty());
+    TEST_REQUIRE(p.drawn.size() == 2);
+    TEST_REQUIRE(!p.cmds.empty());
+    for (const auto& cmd : p.cmds)
+        TEST_REQUIRE(cmd.widget == win.FindWidgetByName("form")->GetId());
+
+    // change in a child widget property invalidates the cache
+    // of the container but not the other containers.
+    p.Reset();
+    label0->SetText("foobar");
+    win.Paint(state, p);
+    TEST_REQUIRE(p.begin.size() == 1);
+    TEST_REQUIRE(p.begin[0] == group0->GetId());
+    TEST_REQUIRE(p.drawn.size() == 1);
+    TEST_REQUIRE(p.drawn[0] == group1->GetId());
+
+    // change in the transient state of a child widget invalidates
+    // the cache of the container but not the other containers.
+    p.Reset();
+    state.SetValue(label1->GetId() + "/foo", true);
+    win.Paint(state, p);
+    TEST_REQUIRE(p.begin.size() == 1);
+    TEST_REQUIRE(p.begin[0] == group1->GetId());
+    TEST_REQUIRE(p.drawn.size() == 1);
+    TEST_REQUIRE(p.drawn[0] == group0->GetId());
+
+    // setting the same value again is not a change.
+    p.Reset();
+    state.SetValue(label1->GetId() + "/foo", true);
+    win.Paint(state, p);
+    TEST_REQUIRE(p.begin.empty());
+    TEST_REQUIRE(p.drawn.size() == 2);
+
+    // transient state that doesn't belong to any widget in the
+    // cached sub-trees doesn't invalidate the cache.
+    p.Reset();
+    state.SetValue(win.GetId() + "/foo", true);
+    win.Paint(state, p);
+    TEST_REQUIRE(p.begin.empty());
+    TEST_REQUIRE(p.drawn.size() == 2);
+
+    // clearing the state invalidates the cache of the widgets
+    // that had state.
+    p.Reset();
+    state.Clear();
+    win.Paint(state, p);
+    TEST_REQUIRE(p.begin.size() == 1);
+    TEST_REQUIRE(p.begin[0] == group1->GetId());
+
+    // paint hook disables caching.
+    p.Reset();
+    uik::PaintHook hook;
+    win.Paint(state, p, 0.0, &hook);
+    TEST_REQUIRE(p.begin.empty());
+    TEST_REQUIRE(p.drawn.empty());
+    TEST_REQUIRE(!p.cmds.empty());
+}
+
 void unit_test_window_mouse()
 {
     uik::Window win;
@@ -801,6 +964,7 @@ int test_main(int argc, char* argv[])
     unit_test_groupbox();
     unit_test_window();
     unit_test_window_paint();
+    unit_test_window_paint_cache();
     unit_test_window_mouse();
     unit_test_window_transforms();
     unit_test_util();
@@ -96,6 +96,89 @@ private:
 };
 
 
+// Visit the widget sub-tree rooted at a container widget in order to
+// find out whether the sub-tree can be painted through the paint cache
+// and to compute the window rectangle and the hash of the paint output.
+// Only leaf containers (containers that don't contain other containers)
+// are cached so that a change in one part of the UI only requires the
+// smallest enclosing container to be painted again.
+class PaintCacheVisitor : public base::RenderTree<Widget>::TVisitor<const Widget> {
+public:
+    PaintCacheVisitor(const Widget* root, const FPoint& origin,
+                      const Widget* focused, const Widget* moused, const State& state)
+      : mRoot(root)
+      , mFocused(focused)
+      , mMoused(moused)
+      , mState(state)
+      , mWidgetOrigin(origin)
+    {
+        mVisible.push(true);
+    }
+    virtual void EnterNode(const Widget* widget) override
+    {
+        if (!widget)
+            return;
+        if (widget != mRoot && widget->IsContainer())
+            mLeafContainer = false;
+
+        const bool visible = mVisible.top() & widget->TestFlag(Widget::Flags::VisibleInGame);
+        if (visible)
+        {
+            FRect rect = widget->GetRect();
+            rect.Translate(widget->GetPosition());
+            rect.Translate(mWidgetOrigin);
+            mRect = base::Union(mRect, rect);
+        }
+        // the transient state of the widget is tracked per widget
+        // so that only changes to the state of the widgets in this
+        // sub-tree invalidate the hash.
+        mHash = base::hash_combine(mHash, widget->GetHash());
+        mHash = base::hash_combine(mHash, widget == mFocused);
+        mHash = base::hash_combine(mHash, widget == mMoused);
+        mHash = base::hash_combine(mHash, mState.GetChangeCount(widget->GetId()));
+
+        mVisible.push(visible);
+        mWidgetOrigin += widget->GetPosition();
+    }
+    virtual void LeaveNode(const Widget* widget) override
+    {
+        if (!widget)
+            return;
+        mWidgetOrigin -= widget->GetPosition();
+        mVisible.pop();
+    }
+    virtual bool IsDone() const override
+    { return !mLeafContainer; }
+
+    bool IsLeafContainer() const
+    { return mLeafContainer; }
+    // Get the window rectangle covered by the visible widgets in the
+    // sub-tree. Child widgets aren't clipped to their container's
+    // rectangle so this can be larger than the container.
+    FRect GetRect() const
+    { return mRect; }
+    std::size_t GetHash(bool enabled) const
+    {
+        std::size_t hash = mHash;
+        hash = base::hash_combine(hash, mRect.GetX());
+        hash = base::hash_combine(hash, mRect.GetY());
+        hash = base::hash_combine(hash, mRect.GetWidth());
+        hash = base::hash_combine(hash, mRect.GetHeight());
+        hash = base::hash_combine(hash, enabled);
+        return hash;
+    }
+private:
+    const Widget* mRoot = nullptr;
+    const Widget* mFocused = nullptr;
+    const Widget* mMoused = nullptr;
+    const State& mState;
+    std::stack<bool> mVisible;
+    std::size_t mHash = 0;
+    bool mLeafContainer = true;
+    FPoint mWidgetOrigin;
+    FRect mRect;
+};
+
 const Widget* hit_test(const RenderTree& tree, const FPoint& point, FPoint* where, FRect* rect, bool flags)
 {
     HitTestVisitor<const Widget>visitor(point, flags);
@@ -222,7 +305,11 @@ void Window::Paint(State& state, Painter& painter, double time, PaintHook* hook)
     // the button can render on top of the container even when not inside
     // the tab widget.
     //
-    //
+    // If the painter supports paint caching the leaf container widgets
+    // (containers without other containers inside them) are painted
+    // through the cache. When nothing in the container's sub-tree has
+    // changed the cached results are drawn and the whole sub-tree is
+    // skipped.
     class PaintVisitor : public ConstVisitor {
     public:
         PaintVisitor(const Window& w, double time, Painter& p, State& s, PaintHook* h)
@@ -247,12 +334,27 @@ void Window::Paint(State& state, Painter& painter, double time, PaintHook* hook)
             const auto state = mState.top();
             const bool visible = state.visible & widget->TestFlag(Widget::Flags::VisibleInGame);
             const bool enabled = state.enabled & widget->TestFlag(Widget::Flags::Enabled);
-            if (visible)
-            {
-                FRect rect = widget->GetRect();
-                rect.Translate(widget->GetPosition());
-                rect.Translate(mWidgetOrigin);
+            FRect rect = widget->GetRect();
+            rect.Translate(widget->GetPosition());
+            rect.Translate(mWidgetOrigin);
 
+            if (visible && !mSkipRoot && !mCacheRoot && !mPaintHook && widget->IsContainer())
+            {
+                PaintCacheVisitor cache(widget, mWidgetOrigin, mFocusedWidget, mWidgetUnderMouse, mWidgetState);
+                mWindow.mRenderTree.PreOrderTraverse(cache, widget);
+                if (cache.IsLeafContainer())
+                {
+                    const auto& id = widget->GetId();
+                    const auto& bounds = cache.GetRect();
+                    const auto hash = cache.GetHash(enabled);
+                    if (mPainter.DrawCachedPaint(id, bounds, hash))
+                        mSkipRoot = widget;
+                    else if (mPainter.BeginPaintCache(id, bounds, hash))
+                        mCacheRoot = widget;
+                }
+            }
+            if (visible && !mSkipRoot)
+            {
                 Widget::PaintEvent paint;
                 paint.clip    = state.clip;
                 paint.rect    = rect;
@@ -290,8 +392,20 @@ void Window::Paint(State& state, Painter& painter, double time, PaintHook* hook)
 
             mWidgetOrigin -= widget->GetPosition();
             mState.pop();
+
+            if (widget == mSkipRoot)
+                mSkipRoot = nullptr;
+            else if (widget == mCacheRoot)
+            {
+                mPainter.EndPaintCache(widget->GetId());
+                mCacheRoot = nullptr;
+            }
         }
     private:
+        // the root of the sub-tree that is being painted into the cache.
+        const Widget* mCacheRoot = nullptr;
+        // the root of the sub-tree that was drawn from the cache.
+        const Widget* mSkipRoot = nullptr;
         const Widget* mFocusedWidget = nullptr;
         const Widget* mWidgetUnderMouse = nullptr;
         const Window& mWindow;